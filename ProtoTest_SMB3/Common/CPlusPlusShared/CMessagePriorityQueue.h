@@ -0,0 +1,569 @@
+#ifndef _MESSAGEPRIORITYQUEUE
+#define _MESSAGEPRIORITYQUEUE
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <utility>
+#include "CMessageQueue.h"
+
+using namespace std;
+
+// how Get picks the next lane
+enum PRIORITY_SCHEDULE
+{
+	// always serve the lowest-numbered non-empty lane first
+	PRIORITY_STRICT,
+
+	// serve lanes round-robin, up to their weight in messages per turn
+	PRIORITY_WEIGHTED
+};
+
+//---------------------------------------------------------------------------------
+// Message Priority Queue Class
+//
+// N lanes, each a bounded CMessageQueue of its own, with lane 0 the most urgent.
+// Control traffic (oplock/lease breaks, cancels, echoes) can go to a high lane
+// and never queue behind bulk READ/WRITE payloads in a low one.
+//
+// Put blocks only when the target lane is full, with that lane's timeout, so a
+// saturated bulk lane never stalls control messages. Get waits until any lane
+// has a message and then picks one by the schedule:
+//	- PRIORITY_STRICT:		lowest lane first; low lanes can starve under load
+//	- PRIORITY_WEIGHTED:	deficit round-robin, a lane may send up to its weight
+//							in messages before the next lane gets its turn
+//
+// GetLaneSize exposes per-lane depths for watching head-of-line blocking.
+//---------------------------------------------------------------------------------
+template <class T, class TQueuePolicy = CLockedQueuePolicy<T> >
+class CMessagePriorityQueue
+{
+private:
+	typedef CMessageQueue<T, TQueuePolicy> CLane;
+
+	// priority lanes, lane 0 first
+	vector<CLane*> m_vLanes;
+
+	// messages a lane may send per turn (weighted schedule)
+	vector<unsigned int> m_vLaneWeights;
+
+	// lane selection schedule
+	PRIORITY_SCHEDULE m_eSchedule;
+
+	// guards m_nCurrentLane and m_nCredit
+	CQueueMutex m_ScheduleMutex;
+
+	// lane whose turn it is (weighted schedule)
+	unsigned int m_nCurrentLane;
+
+	// messages the current lane may still send this turn (weighted schedule)
+	unsigned int m_nCredit;
+
+	// mutex Get waits under
+	CQueueMutex m_QueueMutex;
+
+	// signalled when any lane is no longer empty
+	CQueueCondition m_NotEmptyCondition;
+
+	// time out interval of Get (set without the mutex)
+	atomic<unsigned int> m_nTimeoutMilliseconds;
+
+	// number of threads blocked in Get
+	atomic<unsigned int> m_nGetWaiters;
+
+private:
+	// not copyable
+	CMessagePriorityQueue(const CMessagePriorityQueue&);
+	CMessagePriorityQueue& operator=(const CMessagePriorityQueue&);
+
+	// Create lanes
+	void Initialize(unsigned int nLanes, const unsigned int* pLaneMaxSizes, unsigned int nLaneMaxSize);
+
+	// Dequeue from the lane the schedule picks, without waiting
+	bool TryGet(T& msg);
+
+	// Wake threads blocked in Get after a message was added
+	void NotifyReadable();
+
+public:
+	// Constructor: every lane with the same capacity
+	CMessagePriorityQueue(unsigned int nLanes, unsigned int nLaneMaxSize = DEFAULT_MAX_QUEUE_SIZE, unsigned int nTimeoutMilliseconds = DEFAULT_TIMEOUT_INTERVAL, PRIORITY_SCHEDULE eSchedule = PRIORITY_STRICT);
+
+	// Constructor: per-lane capacities
+	CMessagePriorityQueue(unsigned int nLanes, const unsigned int* pLaneMaxSizes, unsigned int nTimeoutMilliseconds = DEFAULT_TIMEOUT_INTERVAL, PRIORITY_SCHEDULE eSchedule = PRIORITY_STRICT);
+
+	// Destructor
+	virtual ~CMessagePriorityQueue();
+
+public:
+	// Enqueue Message into a lane (copied into queue)
+	bool Put(unsigned int nLane, const T& msg);
+
+	// Enqueue Message into a lane (moved into queue)
+	bool Put(unsigned int nLane, T&& msg);
+
+	// Dequeue Message from the lane the schedule picks
+	bool Get(T& msg);
+
+	// Set the weight of a lane (weighted schedule)
+	void SetLaneWeight(unsigned int nLane, unsigned int nWeight);
+
+	// Get number of lanes
+	unsigned int GetLaneCount();
+
+	// Get depth of one lane
+	unsigned int GetLaneSize(unsigned int nLane);
+
+	// Get total queue size
+	unsigned int GetSize();
+
+	// Set time out interval of Get and of every lane's Put
+	void SetTimeout(unsigned int nTimeoutMilliseconds);
+};
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CMessagePriorityQueue<T, TQueuePolicy>::CMessagePriorityQueue
+//
+// Usage:
+//	- Class Constructor
+//
+// Prameters:
+//	- unsigned int nLanes:					number of priority lanes
+//	- unsigned int nLaneMaxSize:			the maximum allowed size of each lane
+//	- unsigned int nTimeoutMilliseconds:	time out interval of queue transaction
+//	- PRIORITY_SCHEDULE eSchedule:			how Get picks the next lane
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+CMessagePriorityQueue<T, TQueuePolicy>::CMessagePriorityQueue(unsigned int nLanes, unsigned int nLaneMaxSize, unsigned int nTimeoutMilliseconds, PRIORITY_SCHEDULE eSchedule)
+{
+	m_nTimeoutMilliseconds = nTimeoutMilliseconds;
+	m_eSchedule = eSchedule;
+
+	Initialize(nLanes, NULL, nLaneMaxSize);
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CMessagePriorityQueue<T, TQueuePolicy>::CMessagePriorityQueue
+//
+// Usage:
+//	- Class Constructor
+//
+// Prameters:
+//	- unsigned int nLanes:					number of priority lanes
+//	- const unsigned int* pLaneMaxSizes:	the maximum allowed size of each lane
+//	- unsigned int nTimeoutMilliseconds:	time out interval of queue transaction
+//	- PRIORITY_SCHEDULE eSchedule:			how Get picks the next lane
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+CMessagePriorityQueue<T, TQueuePolicy>::CMessagePriorityQueue(unsigned int nLanes, const unsigned int* pLaneMaxSizes, unsigned int nTimeoutMilliseconds, PRIORITY_SCHEDULE eSchedule)
+{
+	m_nTimeoutMilliseconds = nTimeoutMilliseconds;
+	m_eSchedule = eSchedule;
+
+	Initialize(nLanes, pLaneMaxSizes, DEFAULT_MAX_QUEUE_SIZE);
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CMessagePriorityQueue<T, TQueuePolicy>::~CMessagePriorityQueue
+//
+// Usage:
+//	- Class Destructor
+//
+// Prameters:
+//  - N/A
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+CMessagePriorityQueue<T, TQueuePolicy>::~CMessagePriorityQueue()
+{
+	for (unsigned int i = 0; i < m_vLanes.size(); i++)
+	{
+		delete m_vLanes[i];
+	}
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CMessagePriorityQueue<T, TQueuePolicy>::Initialize
+//
+// Usage:
+//	- To create the lanes, each weighted 1
+//
+// Prameters:
+//	- unsigned int nLanes:					number of priority lanes
+//	- const unsigned int* pLaneMaxSizes:	per-lane capacities, NULL for nLaneMaxSize
+//	- unsigned int nLaneMaxSize:			capacity of every lane if pLaneMaxSizes is NULL
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+void CMessagePriorityQueue<T, TQueuePolicy>::Initialize(unsigned int nLanes, const unsigned int* pLaneMaxSizes, unsigned int nLaneMaxSize)
+{
+	// at least one lane, so Put(0, ...) always has somewhere to go
+	if (0 == nLanes)
+	{
+		nLanes = 1;
+		pLaneMaxSizes = NULL;
+	}
+
+	for (unsigned int i = 0; i < nLanes; i++)
+	{
+		unsigned int nMaxSize = (NULL != pLaneMaxSizes) ? pLaneMaxSizes[i] : nLaneMaxSize;
+
+		m_vLanes.push_back(new CLane(nMaxSize, m_nTimeoutMilliseconds));
+		m_vLaneWeights.push_back(1);
+	}
+
+	m_nCurrentLane = 0;
+	m_nCredit = m_vLaneWeights[0];
+
+	// no thread is blocked yet
+	m_nGetWaiters = 0;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CMessagePriorityQueue<T, TQueuePolicy>::Put
+//
+// Usage:
+//	- To put a copy of a message into a lane. Blocks only while that lane is
+//	  full, up to the queue timeout.
+//
+// Prameters:
+//	- unsigned int nLane:	the lane, 0 is the most urgent
+//	- const T& msg:			the message to be put in queue
+//
+// Returns:
+//	- bool: function success/fail status
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+bool CMessagePriorityQueue<T, TQueuePolicy>::Put(unsigned int nLane, const T& msg)
+{
+	if (nLane >= m_vLanes.size() || !m_vLanes[nLane]->Put(msg))
+	{
+		return false;
+	}
+
+	NotifyReadable();
+	return true;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CMessagePriorityQueue<T, TQueuePolicy>::Put
+//
+// Usage:
+//	- To move a message into a lane. msg is left untouched if the put fails.
+//
+// Prameters:
+//	- unsigned int nLane:	the lane, 0 is the most urgent
+//	- T&& msg:				the message to be put in queue
+//
+// Returns:
+//	- bool: function success/fail status
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+bool CMessagePriorityQueue<T, TQueuePolicy>::Put(unsigned int nLane, T&& msg)
+{
+	if (nLane >= m_vLanes.size() || !m_vLanes[nLane]->Put(move(msg)))
+	{
+		return false;
+	}
+
+	NotifyReadable();
+	return true;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CMessagePriorityQueue<T, TQueuePolicy>::Get
+//
+// Usage:
+//	- To get a message from the lane the schedule picks, waiting up to the
+//	  queue timeout for any lane to become non-empty
+//
+// Prameters:
+//	- T& msg:	the message reference to get from queue
+//
+// Returns:
+//	- bool: function success/fail status
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+bool CMessagePriorityQueue<T, TQueuePolicy>::Get(T& msg)
+{
+	if (TryGet(msg))
+	{
+		return true;
+	}
+
+	// hold mutex
+	m_QueueMutex.Lock();
+
+	QUEUE_TICKS nDeadline = QueueDeadline(m_nTimeoutMilliseconds);
+	bool bTimedOut = false;
+	bool bGot = false;
+
+	m_nGetWaiters++;
+	for (;;)
+	{
+		// pairs with the fence in NotifyReadable
+		atomic_thread_fence(memory_order_seq_cst);
+		bGot = TryGet(msg);
+
+		if (bGot || bTimedOut)
+		{
+			break;
+		}
+		bTimedOut = !m_NotEmptyCondition.WaitUntil(m_QueueMutex, nDeadline);
+	}
+	m_nGetWaiters--;
+
+	// release mutex
+	m_QueueMutex.Unlock();
+
+	return bGot;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CMessagePriorityQueue<T, TQueuePolicy>::TryGet
+//
+// Usage:
+//	- To get a message from the lane the schedule picks, without waiting.
+//	  The weighted schedule is deficit round-robin: the current lane is
+//	  served until its credit runs out or it is empty, then the turn moves on
+//	  and the next lane's credit is refilled to its weight.
+//
+// Prameters:
+//	- T& msg:	the message reference to get from queue
+//
+// Returns:
+//	- bool: true if a message was dequeued, false if every lane is empty
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+bool CMessagePriorityQueue<T, TQueuePolicy>::TryGet(T& msg)
+{
+	unsigned int nLanes = (unsigned int)m_vLanes.size();
+
+	if (PRIORITY_STRICT == m_eSchedule)
+	{
+		for (unsigned int i = 0; i < nLanes; i++)
+		{
+			if (m_vLanes[i]->GetBatch(&msg, 1, 0) > 0)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool bGot = false;
+
+	// hold mutex
+	m_ScheduleMutex.Lock();
+
+	unsigned int nStartLane = m_nCurrentLane;
+	unsigned int nStartCredit = m_nCredit;
+
+	// one extra step so the starting lane is retried with fresh credit
+	for (unsigned int i = 0; i <= nLanes; i++)
+	{
+		if (m_nCredit > 0 && m_vLanes[m_nCurrentLane]->GetBatch(&msg, 1, 0) > 0)
+		{
+			m_nCredit--;
+			bGot = true;
+			break;
+		}
+
+		m_nCurrentLane = (m_nCurrentLane + 1) % nLanes;
+		m_nCredit = m_vLaneWeights[m_nCurrentLane];
+	}
+
+	// an empty poll must not move the turn on
+	if (!bGot)
+	{
+		m_nCurrentLane = nStartLane;
+		m_nCredit = nStartCredit;
+	}
+
+	// release mutex
+	m_ScheduleMutex.Unlock();
+
+	return bGot;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CMessagePriorityQueue<T, TQueuePolicy>::NotifyReadable
+//
+// Usage:
+//	- To wake a thread blocked in Get once a message was added to any lane
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+void CMessagePriorityQueue<T, TQueuePolicy>::NotifyReadable()
+{
+	// order the lane update before reading the waiter count
+	atomic_thread_fence(memory_order_seq_cst);
+
+	if (0 == m_nGetWaiters.load(memory_order_relaxed))
+	{
+		return;
+	}
+
+	// make sure a waiter that just missed the message is asleep before notifying
+	m_QueueMutex.Lock();
+	m_QueueMutex.Unlock();
+
+	m_NotEmptyCondition.NotifyOne();
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CMessagePriorityQueue<T, TQueuePolicy>::SetLaneWeight
+//
+// Usage:
+//	- To set how many messages a lane may send per turn under the weighted
+//	  schedule. Has no effect under the strict schedule.
+//
+// Prameters:
+//	- unsigned int nLane:		the lane
+//	- unsigned int nWeight:		messages per turn, 0 is treated as 1
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+void CMessagePriorityQueue<T, TQueuePolicy>::SetLaneWeight(unsigned int nLane, unsigned int nWeight)
+{
+	if (nLane >= m_vLanes.size())
+	{
+		return;
+	}
+
+	// hold mutex
+	m_ScheduleMutex.Lock();
+
+	m_vLaneWeights[nLane] = (nWeight > 0) ? nWeight : 1;
+
+	// a lane that currently has the turn gets the new weight right away
+	if (nLane == m_nCurrentLane)
+	{
+		m_nCredit = m_vLaneWeights[nLane];
+	}
+
+	// release mutex
+	m_ScheduleMutex.Unlock();
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CMessagePriorityQueue<T, TQueuePolicy>::GetLaneCount
+//
+// Usage:
+//	- To get the number of lanes
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- unsigned int: the number of lanes
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+unsigned int CMessagePriorityQueue<T, TQueuePolicy>::GetLaneCount()
+{
+	return (unsigned int)m_vLanes.size();
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CMessagePriorityQueue<T, TQueuePolicy>::GetLaneSize
+//
+// Usage:
+//	- To get the current depth of one lane
+//
+// Prameters:
+//	- unsigned int nLane:	the lane
+//
+// Returns:
+//	- unsigned int: the lane depth, 0 for an invalid lane
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+unsigned int CMessagePriorityQueue<T, TQueuePolicy>::GetLaneSize(unsigned int nLane)
+{
+	if (nLane >= m_vLanes.size())
+	{
+		return 0;
+	}
+
+	return m_vLanes[nLane]->GetSize();
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CMessagePriorityQueue<T, TQueuePolicy>::GetSize
+//
+// Usage:
+//	- To get the total number of queued messages over all lanes
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- unsigned int: the current queue size
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+unsigned int CMessagePriorityQueue<T, TQueuePolicy>::GetSize()
+{
+	unsigned int nSize = 0;
+
+	for (unsigned int i = 0; i < m_vLanes.size(); i++)
+	{
+		nSize += m_vLanes[i]->GetSize();
+	}
+
+	return nSize;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CMessagePriorityQueue<T, TQueuePolicy>::SetTimeout
+//
+// Usage:
+//	- To set the time out interval of Get and of every lane's Put
+//
+// Prameters:
+//	- unsigned int nTimeoutMilliseconds:	time out interval of queue transaction
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+void CMessagePriorityQueue<T, TQueuePolicy>::SetTimeout(unsigned int nTimeoutMilliseconds)
+{
+	m_nTimeoutMilliseconds = nTimeoutMilliseconds;
+
+	for (unsigned int i = 0; i < m_vLanes.size(); i++)
+	{
+		m_vLanes[i]->SetTimeout(nTimeoutMilliseconds);
+	}
+}
+#endif /*_MESSAGEPRIORITYQUEUE*/
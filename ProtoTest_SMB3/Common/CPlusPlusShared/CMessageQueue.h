@@ -3,65 +3,368 @@
 
 #pragma once
 
-#include <windows.h>
-#include <queue>
+#include <atomic>
+#include <vector>
+#include <utility>
+#include "CQueueSync.h"
+#include "CQueueStorage.h"
+#include "CQueueStats.h"
+#include "CQueueAsync.h"
+#include "CQueueSet.h"
+#include "CQueueSpin.h"
+
+#ifdef MESSAGEQUEUE_COROUTINES
+#include <list>
+#include <memory>
+#endif /*MESSAGEQUEUE_COROUTINES*/
 
 using namespace std;
 
 const unsigned int DEFAULT_TIMEOUT_INTERVAL = INFINITE;
 const unsigned int DEFAULT_MAX_QUEUE_SIZE = 1024;
 
-//---------------------
+// deadline meaning "the queue timeout, counted from when the call has to wait"
+const QUEUE_TICKS QUEUE_DEADLINE_DEFAULT = QUEUE_TICKS_INFINITE - 1;
+
+// how often the destructor re-checks for calls still inside the queue
+const unsigned int QUEUE_CLOSE_RECHECK_MS = 10;
+
+// result of a Put/Get with a deadline
+enum QUEUE_STATUS
+{
+	QUEUE_OK,			// message queued/dequeued
+	QUEUE_TIMEOUT,		// deadline passed while the queue was full/empty
+	QUEUE_CLOSED		// queue closed (Get: and no message left)
+};
+
+//---------------------------------------------------------------------------------
 // Message Queue Class
-//---------------------
-template <class T>
+//
+// TQueuePolicy selects the message storage (see CQueueStorage.h):
+//	- CLockedQueuePolicy<T>:	preallocated ring guarded by the queue mutex
+//								(default), optionally with a custom allocator
+//	- CSpscQueuePolicy<T>:		lock-free ring for one producer and one consumer,
+//								Put/Get only enter the kernel when full/empty
+//	- CMpmcQueuePolicy<T>:		lock-free ring for any number of producers and
+//								consumers, same blocking fallback as SPSC
+//
+// Blocking uses separate not-full and not-empty conditions from CQueueSync.h,
+// so a Put wakes one reader and a Get wakes one writer.
+//
+// T only needs to be movable: Put(T&&) and Emplace build the message in queue
+// storage without a copy and Get moves it back out, so ownership types such as
+// unique_ptr<> can be handed between threads.
+//
+// With MESSAGEQUEUE_STATS defined, each queue also keeps the counters from
+// CQueueStats.h; GetStats/GetStatsJson read them. Messages are then stored
+// with an enqueue timestamp to measure how long they waited in queue.
+//
+// With C++20 coroutines (see CQueueAsync.h), co_await GetAsync/PutAsync
+// suspends the calling coroutine instead of its thread while the queue is
+// empty/full; it is resumed on the CQueueExecutor passed to the call.
+//
+// A queue can be added to a CQueueSet (see CQueueSet.h), so one thread can
+// wait for messages on many queues at once.
+//
+// SetWaitStrategy(WAIT_ADAPTIVE) makes Put, Get and GetBatch spin and yield
+// for a while before they block (see CQueueSpin.h), for queues where the next
+// message is usually only a few hundred nanoseconds away.
+//
+// Put(msg, nDeadline) and Get(msg, nDeadline) wait until an absolute
+// QueueGetTicks() deadline instead of the queue timeout, so one deadline
+// (e.g. from QueueDeadline when a request arrives) can cover every stage of a
+// pipeline, and tell a timeout from a closed queue. Close() fails all later
+// Puts and wakes every waiter with QUEUE_CLOSED; Gets keep returning the
+// messages still queued first. The destructor closes the queue and waits for
+// blocked or spinning calls to leave before anything is freed.
+//---------------------------------------------------------------------------------
+template <class T, class TQueuePolicy = CLockedQueuePolicy<T> >
 class CMessageQueue
 {
+	friend class CQueueSet;
+
 private:
+#ifdef MESSAGEQUEUE_STATS
+	// storage keeps each message's enqueue time next to it
+	typedef typename TQueuePolicy::template rebind<CQueueStampedMessage<T> >::other TQueueStorage;
+#else
+	typedef TQueuePolicy TQueueStorage;
+#endif /*MESSAGEQUEUE_STATS*/
+
 	// message queue
-	queue<T> m_qMsgQueue;
+	TQueueStorage m_qMsgQueue;
 	
 	// queue mutex
-	HANDLE m_hQueueMutex; 
+	CQueueMutex m_QueueMutex;
 	
-	// queue writable event
-	HANDLE m_hWritableEvent;
+	// signalled when the queue is no longer full
+	CQueueCondition m_NotFullCondition;
 
-	// queue readable event
-	HANDLE m_hReadableEvent;
+	// signalled when the queue is no longer empty
+	CQueueCondition m_NotEmptyCondition;
 
 	// time out interval (of queue push/pop transaction)
-	unsigned int m_nTimeoutMilliseconds;
+	atomic<unsigned int> m_nTimeoutMilliseconds;
 
 	// maximum allowed queue size
 	unsigned int m_nMaxSize;
 
+	// set by Close, never cleared
+	atomic<bool> m_bClosed;
+
+	// number of calls past their fast path (spinning, taking the mutex or
+	// blocked), the destructor waits for them
+	atomic<unsigned int> m_nWaitingCalls;
+
+	// signalled when the last waiting call leaves a closed queue
+	CQueueCondition m_LeftCondition;
+
+	// number of threads blocked in Put
+	atomic<unsigned int> m_nPutWaiters;
+
+	// number of threads blocked in Get
+	atomic<unsigned int> m_nGetWaiters;
+
+	// entry of the CQueueSet this queue belongs to, NULL if none
+	atomic<CQueueSetEntry*> m_pSetEntry;
+
+	// how Put/Get wait when they cannot complete right away
+	atomic<QUEUE_WAIT_STRATEGY> m_WaitStrategy;
+
+	// spin budgets for WAIT_ADAPTIVE, tuned from recent waits
+	CQueueSpinTuner m_PutSpin;
+	CQueueSpinTuner m_GetSpin;
+
+#ifdef MESSAGEQUEUE_STATS
+	// enqueue/dequeue, blocking and latency counters
+	CQueueStats m_Stats;
+#endif /*MESSAGEQUEUE_STATS*/
+
+#ifdef MESSAGEQUEUE_COROUTINES
+	//---------------------
+	// Parked Coroutines
+	//---------------------
+	struct CAsyncWaitList
+	{
+		// waits in arrival order; timed-out ones linger until discarded
+		list<shared_ptr<CQueueAsyncWait<T> > > m_lstWaits;
+
+		// number of entries in m_lstWaits
+		size_t m_nCount;
+
+		// list length that triggers a sweep for timed-out waits
+		size_t m_nSweepAt;
+
+		CAsyncWaitList() : m_nCount(0), m_nSweepAt(64) { }
+	};
+
+	// coroutines waiting in GetAsync (counted in m_nGetWaiters)
+	CAsyncWaitList m_AsyncGetters;
+
+	// coroutines waiting in PutAsync (counted in m_nPutWaiters)
+	CAsyncWaitList m_AsyncPutters;
+
+	// waits completed under the mutex, resumed once it is released
+	vector<shared_ptr<CQueueAsyncWaitBase> > m_vAsyncReady;
+#endif /*MESSAGEQUEUE_COROUTINES*/
+
+private:
+	// Construct Message in queue, waiting until nDeadline
+	template <class... Args>
+	QUEUE_STATUS EmplaceUntil(QUEUE_TICKS nDeadline, Args&&... args);
+
+	// Take Message from queue, waiting until nDeadline
+	QUEUE_STATUS GetUntil(T& msg, QUEUE_TICKS nDeadline);
+
+	// Turn QUEUE_DEADLINE_DEFAULT into a deadline from now
+	QUEUE_TICKS ResolveDeadline(QUEUE_TICKS nDeadline);
+
+	// Whether a call with this deadline should spin before blocking
+	bool IsAdaptiveWait(QUEUE_TICKS nDeadline);
+
+	// Count a call before it spins or takes the mutex
+	void EnterWait();
+
+	// Uncount a waiting call; last access to the queue unless bMutexHeld
+	void LeaveWait(bool bMutexHeld);
+
+	// Release the mutex, then resume coroutines completed under it
+	void UnlockQueue();
+
+	// Construct Message in storage without waiting
+	template <class... Args>
+	bool StoreEmplace(Args&&... args);
+
+	// Take Message from storage without waiting
+	bool StorePop(T& msg);
+
+	// Put as much of a burst into storage as fits
+	unsigned int StorePushBatch(const T* pMsgs, unsigned int nCount);
+
+	// Take up to nMaxCount messages from storage
+	unsigned int StorePopBatch(T* pMsgs, unsigned int nMaxCount);
+
+	// Construct Message in queue without waiting, notifying readers
+	template <class... Args>
+	bool PollEmplace(Args&&... args);
+
+	// Take up to nMaxCount messages without waiting, notifying writers
+	unsigned int PollGetBatch(T* pMsgs, unsigned int nMaxCount);
+
+	// Wake threads blocked in Put after nCount messages were removed
+	void NotifyWritable(bool bMutexHeld, unsigned int nCount = 1);
+
+	// Wake threads blocked in Get after nCount messages were added
+	void NotifyReadable(bool bMutexHeld, unsigned int nCount = 1);
+
+#ifdef MESSAGEQUEUE_COROUTINES
+	// Hand messages and slots to parked coroutines (mutex held)
+	void ServeAsyncWaiters();
+
+	// Link a wait, dropping timed-out ones first (mutex held)
+	void LinkAsyncWait(CAsyncWaitList& waitList, atomic<unsigned int>& nWaiters, const shared_ptr<CQueueAsyncWait<T> >& pWait, unsigned int nTimeoutMilliseconds);
+
+	// Park a GetAsync coroutine, false if it finished without parking
+	bool SuspendGet(shared_ptr<CQueueAsyncWait<T> > pWait, unsigned int nTimeoutMilliseconds);
+
+	// Park a PutAsync coroutine, false if it finished without parking
+	bool SuspendPut(shared_ptr<CQueueAsyncWait<T> > pWait, unsigned int nTimeoutMilliseconds);
+
+	// Fail every parked coroutine of a list (mutex held)
+	void CloseAsyncWaits(CAsyncWaitList& waitList, atomic<unsigned int>& nWaiters);
+#endif /*MESSAGEQUEUE_COROUTINES*/
+
 public:
 	
 	// Constructor: with parameters
 	CMessageQueue(unsigned int nMaxSize = DEFAULT_MAX_QUEUE_SIZE, unsigned int nTimeoutMilliseconds = DEFAULT_TIMEOUT_INTERVAL);
+
+	// Constructor: with an allocator/arena for the policy's storage
+	template <class TAllocator>
+	CMessageQueue(unsigned int nMaxSize, unsigned int nTimeoutMilliseconds, const TAllocator& alloc);
 	
 	// Destructor
 	virtual ~CMessageQueue();
 
 public:
-	// Enqueue Message
-	bool Put(T msg);
+	// Enqueue Message (copied into queue)
+	bool Put(const T& msg);
+
+	// Enqueue Message (moved into queue)
+	bool Put(T&& msg);
 
-	// Dequeue Message
+	// Enqueue Message constructed in place from args
+	template <class... Args>
+	bool Emplace(Args&&... args);
+
+	// Dequeue Message (moved out of queue)
 	bool Get(T& msg);
 
+	// Enqueue Message (copied into queue), waiting until a deadline
+	QUEUE_STATUS Put(const T& msg, QUEUE_TICKS nDeadline);
+
+	// Enqueue Message (moved into queue), waiting until a deadline
+	QUEUE_STATUS Put(T&& msg, QUEUE_TICKS nDeadline);
+
+	// Dequeue Message (moved out of queue), waiting until a deadline
+	QUEUE_STATUS Get(T& msg, QUEUE_TICKS nDeadline);
+
+	// Enqueue a burst of messages under one critical section
+	unsigned int PutBatch(const T* pMsgs, unsigned int nCount);
+
+	// Dequeue up to nMaxCount messages under one critical section
+	unsigned int GetBatch(T* pMsgs, unsigned int nMaxCount, unsigned int nTimeoutMilliseconds);
+
+	// Dequeue every message currently in queue without waiting
+	unsigned int Drain(vector<T>& vMsgs);
+
+	// Refuse further Puts and wake every waiter
+	void Close();
+
+	// Whether Close was called
+	bool IsClosed();
+
 public:
 	// Get queue size
 	unsigned int GetSize();
 
 	// Set Timeout Interval
 	void SetTimeout(unsigned int nTimeoutMilliseconds);
+
+	// Set how Put/Get wait on a full/empty queue
+	void SetWaitStrategy(QUEUE_WAIT_STRATEGY waitStrategy);
+
+#ifdef MESSAGEQUEUE_STATS
+	// Get a snapshot of the queue counters
+	void GetStats(CQueueStatsSnapshot& snapshot);
+
+	// Get the queue counters as a JSON object
+	string GetStatsJson(const char* pszName = NULL);
+#endif /*MESSAGEQUEUE_STATS*/
+
+#ifdef MESSAGEQUEUE_COROUTINES
+public:
+	//---------------------
+	// GetAsync Awaiter
+	//---------------------
+	class CGetAwaiter
+	{
+	private:
+		CMessageQueue& m_Queue;
+		T& m_Msg;
+		CQueueExecutor& m_Executor;
+		unsigned int m_nTimeoutMilliseconds;
+		shared_ptr<CQueueAsyncWait<T> > m_pWait;
+		bool m_bResult;
+
+	public:
+		CGetAwaiter(CMessageQueue& queue, T& msg, CQueueExecutor& executor, unsigned int nTimeoutMilliseconds)
+			: m_Queue(queue), m_Msg(msg), m_Executor(executor), m_nTimeoutMilliseconds(nTimeoutMilliseconds), m_bResult(false) { }
+
+		bool await_ready();
+		bool await_suspend(coroutine_handle<> hCoroutine);
+		bool await_resume();
+	};
+
+	//---------------------
+	// PutAsync Awaiter
+	//---------------------
+	class CPutAwaiter
+	{
+	private:
+		CMessageQueue& m_Queue;
+		T m_Msg;
+		CQueueExecutor& m_Executor;
+		unsigned int m_nTimeoutMilliseconds;
+		shared_ptr<CQueueAsyncWait<T> > m_pWait;
+		bool m_bResult;
+
+	public:
+		CPutAwaiter(CMessageQueue& queue, T&& msg, CQueueExecutor& executor, unsigned int nTimeoutMilliseconds)
+			: m_Queue(queue), m_Msg(move(msg)), m_Executor(executor), m_nTimeoutMilliseconds(nTimeoutMilliseconds), m_bResult(false) { }
+
+		bool await_ready();
+		bool await_suspend(coroutine_handle<> hCoroutine);
+		bool await_resume();
+	};
+
+	// Dequeue Message, suspending the coroutine (queue timeout)
+	CGetAwaiter GetAsync(T& msg, CQueueExecutor& executor);
+
+	// Dequeue Message, suspending the coroutine (explicit timeout)
+	CGetAwaiter GetAsync(T& msg, CQueueExecutor& executor, unsigned int nTimeoutMilliseconds);
+
+	// Enqueue Message, suspending the coroutine (queue timeout)
+	CPutAwaiter PutAsync(T msg, CQueueExecutor& executor);
+
+	// Enqueue Message, suspending the coroutine (explicit timeout)
+	CPutAwaiter PutAsync(T msg, CQueueExecutor& executor, unsigned int nTimeoutMilliseconds);
+#endif /*MESSAGEQUEUE_COROUTINES*/
 };
 
 //---------------------------------------------------------------------------------
 // Function Name: 
-//	- CMessageQueue<T>::CMessageQueue
+//	- CMessageQueue<T, TQueuePolicy>::CMessageQueue
 //
 // Usage:
 //	- Class Constructor
@@ -73,36 +376,81 @@ public:
 // Returns:
 //	- N/A
 //----------------------------------------------------------------------------------
-template <class T>
-CMessageQueue<T>::CMessageQueue(unsigned int nMaxSize, unsigned int nTimeoutMilliseconds)
+template <class T, class TQueuePolicy>
+CMessageQueue<T, TQueuePolicy>::CMessageQueue(unsigned int nMaxSize, unsigned int nTimeoutMilliseconds)
+	: m_qMsgQueue(nMaxSize)
 {
-    // initialize event handles
-	m_hWritableEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
-	m_hReadableEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	// set timeout interval (by milliseconds)
+	m_nTimeoutMilliseconds = nTimeoutMilliseconds;
+
+	// set maximum allowed queue size
+	m_nMaxSize = nMaxSize;
 
-	// initialize mutex handle
-	m_hQueueMutex = CreateMutex(NULL, FALSE, NULL);
+	// no thread is blocked yet
+	m_nPutWaiters = 0;
+	m_nGetWaiters = 0;
 
+	// open, nobody waiting yet
+	m_bClosed = false;
+	m_nWaitingCalls = 0;
+
+	// not in a queue set yet
+	m_pSetEntry = NULL;
+
+	// block right away unless asked to spin
+	m_WaitStrategy = WAIT_BLOCK;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::CMessageQueue
+//
+// Usage:
+//	- Class Constructor, for policies that take an allocator (CLockedQueuePolicy)
+//
+// Prameters:
+//	- unsigned int nMaxSize:	the maximum allowed queue size
+//	- unsigned int nTimeoutMilliseconds:	time out interval of queue transaction
+//	- const TAllocator& alloc:	allocator the policy gets its slots from
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+template <class TAllocator>
+CMessageQueue<T, TQueuePolicy>::CMessageQueue(unsigned int nMaxSize, unsigned int nTimeoutMilliseconds, const TAllocator& alloc)
+	: m_qMsgQueue(nMaxSize, alloc)
+{
 	// set timeout interval (by milliseconds)
 	m_nTimeoutMilliseconds = nTimeoutMilliseconds;
 
 	// set maximum allowed queue size
 	m_nMaxSize = nMaxSize;
 
-	// enable queue writability according to nMaxSize
-	if (m_nMaxSize > 0)
-	{
-		SetEvent(m_hWritableEvent);
-	}
+	// no thread is blocked yet
+	m_nPutWaiters = 0;
+	m_nGetWaiters = 0;
+
+	// open, nobody waiting yet
+	m_bClosed = false;
+	m_nWaitingCalls = 0;
+
+	// not in a queue set yet
+	m_pSetEntry = NULL;
+
+	// block right away unless asked to spin
+	m_WaitStrategy = WAIT_BLOCK;
 }
 
 
 //---------------------------------------------------------------------------------
 // Function Name: 
-//	- CMessageQueue<T>::~CMessageQueue
+//	- CMessageQueue<T, TQueuePolicy>::~CMessageQueue
 //
 // Usage:
-//	- Class Destructor
+//	- Class Destructor. Threads still blocked, spinning or waiting for the
+//	  mutex in the queue are woken with QUEUE_CLOSED and waited for; new
+//	  calls must not be started.
 //
 // Prameters:
 //  - N/A
@@ -110,184 +458,1933 @@ CMessageQueue<T>::CMessageQueue(unsigned int nMaxSize, unsigned int nTimeoutMill
 // Returns:
 //	- N/A
 //----------------------------------------------------------------------------------
-template <class T>
-CMessageQueue<T>::~CMessageQueue()
+template <class T, class TQueuePolicy>
+CMessageQueue<T, TQueuePolicy>::~CMessageQueue()
 {
+	Close();
+
 	// hold mutex
-	WaitForSingleObject(m_hQueueMutex, INFINITE);
-	
-	// clear queue
-	m_qMsgQueue.empty();	
+	m_QueueMutex.Lock();
+
+	// a call that left without the mutex right as we closed is not signalled,
+	// so look again every now and then
+	while (0 != m_nWaitingCalls.load(memory_order_seq_cst))
+	{
+		m_LeftCondition.WaitUntil(m_QueueMutex, QueueDeadline(QUEUE_CLOSE_RECHECK_MS));
+	}
 
-	// close event handles
-	CloseHandle(m_hWritableEvent);
-	CloseHandle(m_hReadableEvent);
-	
 	// release mutex
-	ReleaseMutex(m_hQueueMutex);
+	m_QueueMutex.Unlock();
+
+	// leave the queue set, so its Wait no longer looks at this queue
+	CQueueSetEntry* pSetEntry = m_pSetEntry.load(memory_order_acquire);
+	if (pSetEntry != NULL)
+	{
+		pSetEntry->m_pSet->Remove(*this);
+	}
+
+	// mutex, conditions and queued messages are released by their destructors
+}
+
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::Put
+//
+// Usage:
+//	- To put a copy of a message into queue
+//
+// Prameters:
+//	- const T& msg:	the message to be put in queue
+//
+// Returns:
+//	- bool: function success/fail status
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+bool CMessageQueue<T, TQueuePolicy>::Put(const T& msg)
+{
+	return Emplace(msg);
+}
 
-	// close mutex handle
-	CloseHandle(m_hQueueMutex);	
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::Put
+//
+// Usage:
+//	- To move a message into queue. msg is left untouched if the put fails.
+//
+// Prameters:
+//	- T&& msg:	the message to be put in queue
+//
+// Returns:
+//	- bool: function success/fail status
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+bool CMessageQueue<T, TQueuePolicy>::Put(T&& msg)
+{
+	return Emplace(move(msg));
 }
 
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::Emplace
+//
+// Usage:
+//	- To construct a message directly in queue storage
+//
+// Prameters:
+//	- Args&&... args:	constructor arguments of the message
+//
+// Returns:
+//	- bool: function success/fail status
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+template <class... Args>
+bool CMessageQueue<T, TQueuePolicy>::Emplace(Args&&... args)
+{
+	return QUEUE_OK == EmplaceUntil(QUEUE_DEADLINE_DEFAULT, forward<Args>(args)...);
+}
 
 //---------------------------------------------------------------------------------
 // Function Name: 
-//	- CMessageQueue<T>::Put
+//	- CMessageQueue<T, TQueuePolicy>::Get
 //
 // Usage:
-//	- To put a message into queue
+//	- To get a message from queue
 //
 // Prameters:
-//	- T msg:	the message to be put in queue
+//  - T& msg:	the message reference to get from queue
 //
 // Returns:
 //	- bool: function success/fail status
 //----------------------------------------------------------------------------------
-template <class T>
-bool CMessageQueue<T>::Put(T msg)
+template <class T, class TQueuePolicy>
+bool CMessageQueue<T, TQueuePolicy>::Get(T& msg)
+{
+	return QUEUE_OK == GetUntil(msg, QUEUE_DEADLINE_DEFAULT);
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::Put
+//
+// Usage:
+//	- To put a copy of a message into queue, waiting for room until an
+//	  absolute deadline rather than for the queue timeout
+//
+// Prameters:
+//	- const T& msg:				the message to be put in queue
+//	- QUEUE_TICKS nDeadline:	QueueGetTicks() value to give up at,
+//								QUEUE_TICKS_INFINITE to wait for ever
+//
+// Returns:
+//	- QUEUE_STATUS: QUEUE_OK, QUEUE_TIMEOUT or QUEUE_CLOSED
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+QUEUE_STATUS CMessageQueue<T, TQueuePolicy>::Put(const T& msg, QUEUE_TICKS nDeadline)
+{
+	return EmplaceUntil(nDeadline, msg);
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::Put
+//
+// Usage:
+//	- To move a message into queue, waiting for room until an absolute
+//	  deadline. msg is left untouched if the put fails.
+//
+// Prameters:
+//	- T&& msg:					the message to be put in queue
+//	- QUEUE_TICKS nDeadline:	QueueGetTicks() value to give up at,
+//								QUEUE_TICKS_INFINITE to wait for ever
+//
+// Returns:
+//	- QUEUE_STATUS: QUEUE_OK, QUEUE_TIMEOUT or QUEUE_CLOSED
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+QUEUE_STATUS CMessageQueue<T, TQueuePolicy>::Put(T&& msg, QUEUE_TICKS nDeadline)
+{
+	return EmplaceUntil(nDeadline, move(msg));
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::Get
+//
+// Usage:
+//	- To get a message from queue, waiting for one until an absolute
+//	  deadline rather than for the queue timeout
+//
+// Prameters:
+//  - T& msg:					the message reference to get from queue
+//	- QUEUE_TICKS nDeadline:	QueueGetTicks() value to give up at,
+//								QUEUE_TICKS_INFINITE to wait for ever
+//
+// Returns:
+//	- QUEUE_STATUS: QUEUE_OK, QUEUE_TIMEOUT or QUEUE_CLOSED
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+QUEUE_STATUS CMessageQueue<T, TQueuePolicy>::Get(T& msg, QUEUE_TICKS nDeadline)
+{
+	return GetUntil(msg, nDeadline);
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::EmplaceUntil
+//
+// Usage:
+//	- To construct a message in queue storage, waiting for room until a
+//	  deadline or until the queue is closed
+//
+// Prameters:
+//	- QUEUE_TICKS nDeadline:	deadline, or QUEUE_DEADLINE_DEFAULT for the
+//								queue timeout
+//	- Args&&... args:			constructor arguments of the message
+//
+// Returns:
+//	- QUEUE_STATUS: QUEUE_OK, QUEUE_TIMEOUT or QUEUE_CLOSED
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+template <class... Args>
+QUEUE_STATUS CMessageQueue<T, TQueuePolicy>::EmplaceUntil(QUEUE_TICKS nDeadline, Args&&... args)
 {
+	// a closed queue takes no more messages
+	if (m_bClosed.load(memory_order_acquire))
+	{
+		return QUEUE_CLOSED;
+	}
+
+	// lock-free fast path: stay in user space unless the queue is full
+	if (TQueuePolicy::LOCK_FREE && StoreEmplace(forward<Args>(args)...))
+	{
+		NotifyReadable(false);
+		return QUEUE_OK;
+	}
+
+	// counted before it can block on the mutex, so the destructor waits for it
+	EnterWait();
+
+	// adaptive wait: spin for a free slot before blocking, stop on Close
+	// (a failed attempt leaves args untouched, so retrying is safe)
+	unsigned long long nWaitStart = 0;
+	bool bAdaptive = IsAdaptiveWait(nDeadline);
+	if (bAdaptive)
+	{
+		bool bPut = false;
+
+		if (m_PutSpin.Spin([&]() { return m_bClosed.load(memory_order_relaxed) || (bPut = PollEmplace(forward<Args>(args)...)); }, nWaitStart) && bPut)
+		{
+			LeaveWait(false);
+			return QUEUE_OK;
+		}
+	}
+
 	// hold mutex
-	WaitForSingleObject(m_hQueueMutex, INFINITE);
+	m_QueueMutex.Lock();
+
+	QUEUE_STATUS status = QUEUE_OK;
 
 	// check writablity
-	while(m_nMaxSize == m_qMsgQueue.size())
+	if (m_bClosed.load(memory_order_relaxed))
 	{
-		if( WAIT_OBJECT_0 != SignalObjectAndWait(m_hQueueMutex, m_hWritableEvent, m_nTimeoutMilliseconds, false))
-		{	
-			return false;
-		}
-		WaitForSingleObject(m_hQueueMutex, INFINITE);
+		status = QUEUE_CLOSED;
 	}
+	else if (!StoreEmplace(forward<Args>(args)...))
+	{
+		nDeadline = ResolveDeadline(nDeadline);
+		bool bTimedOut = false;
+		QUEUE_STATS(unsigned long long nBlockedSince = QueueGetMicroseconds());
 
-	// put message to queue
-	m_qMsgQueue.push(msg);
+		// announce the waiter before re-checking, so a Get that frees a slot
+		// after our check is guaranteed to see us and notify
+		m_nPutWaiters++;
+		for (;;)
+		{
+			atomic_thread_fence(memory_order_seq_cst);
 
-	// disable writable if queue is full
-	if (m_nMaxSize == m_qMsgQueue.size())
+			// closed while we waited: the message stays with the caller
+			if (m_bClosed.load(memory_order_relaxed))
+			{
+				status = QUEUE_CLOSED;
+				break;
+			}
+			if (StoreEmplace(forward<Args>(args)...))
+			{
+				break;
+			}
+
+			// timed out and still full: give up
+			if (bTimedOut)
+			{
+				status = QUEUE_TIMEOUT;
+				break;
+			}
+			bTimedOut = !m_NotFullCondition.WaitUntil(m_QueueMutex, nDeadline);
+		}
+		m_nPutWaiters--;
+		QUEUE_STATS(m_Stats.OnPutBlocked(QueueGetMicroseconds() - nBlockedSince, QUEUE_OK != status));
+	}
+
+	if (QUEUE_OK == status)
 	{
-		ResetEvent(m_hWritableEvent);
+		// wake a blocked reader
+		NotifyReadable(true);
 	}
 
-	// enable readable if queue is no longer empty
-	if(1 == m_qMsgQueue.size())
+	if (bAdaptive)
 	{
-		SetEvent(m_hReadableEvent);
+		m_PutSpin.Record(nWaitStart);
 	}
 
+	LeaveWait(true);
+
 	// release mutex
-	ReleaseMutex(m_hQueueMutex);
+	UnlockQueue();
 
-	// put succeeded
-	return true;
+	return status;
 }
 
 //---------------------------------------------------------------------------------
 // Function Name: 
-//	- CMessageQueue<T>::Get
+//	- CMessageQueue<T, TQueuePolicy>::GetUntil
 //
 // Usage:
-//	- To get a message from queue
+//	- To get a message from queue, waiting for one until a deadline or until
+//	  the queue is closed. Messages queued before Close are still returned.
 //
 // Prameters:
-//  - T& msg:	the message reference to get from queue
+//  - T& msg:					the message reference to get from queue
+//	- QUEUE_TICKS nDeadline:	deadline, or QUEUE_DEADLINE_DEFAULT for the
+//								queue timeout
 //
 // Returns:
-//	- bool: function success/fail status
+//	- QUEUE_STATUS: QUEUE_OK, QUEUE_TIMEOUT or QUEUE_CLOSED
 //----------------------------------------------------------------------------------
-template <class T>
-bool CMessageQueue<T>::Get(T& msg)
+template <class T, class TQueuePolicy>
+QUEUE_STATUS CMessageQueue<T, TQueuePolicy>::GetUntil(T& msg, QUEUE_TICKS nDeadline)
 {
+	// lock-free fast path: stay in user space unless the queue is empty
+	if (TQueuePolicy::LOCK_FREE && StorePop(msg))
+	{
+		NotifyWritable(false);
+		return QUEUE_OK;
+	}
+
+	// counted before it can block on the mutex, so the destructor waits for it
+	EnterWait();
+
+	// adaptive wait: spin for the next message before blocking, stop on Close
+	unsigned long long nWaitStart = 0;
+	bool bAdaptive = IsAdaptiveWait(nDeadline);
+	if (bAdaptive)
+	{
+		bool bGot = false;
+
+		if (m_GetSpin.Spin([&]() { return (bGot = PollGetBatch(&msg, 1) > 0) || m_bClosed.load(memory_order_relaxed); }, nWaitStart) && bGot)
+		{
+			LeaveWait(false);
+			return QUEUE_OK;
+		}
+	}
+
 	// hold mutex
-	WaitForSingleObject(m_hQueueMutex, INFINITE);
+	m_QueueMutex.Lock();
+
+	QUEUE_STATUS status = QUEUE_OK;
 
 	// check readability
-	while (m_qMsgQueue.size() < 1)
+	if (!StorePop(msg))
 	{
-		if( WAIT_OBJECT_0 != SignalObjectAndWait(m_hQueueMutex, m_hReadableEvent, m_nTimeoutMilliseconds, false))
-		{	
-			return false;
+		nDeadline = ResolveDeadline(nDeadline);
+		bool bTimedOut = false;
+		QUEUE_STATS(unsigned long long nBlockedSince = QueueGetMicroseconds());
+
+		// announce the waiter before re-checking, so a Put that adds a message
+		// after our check is guaranteed to see us and notify
+		m_nGetWaiters++;
+		for (;;)
+		{
+			atomic_thread_fence(memory_order_seq_cst);
+			if (StorePop(msg))
+			{
+				break;
+			}
+
+			// closed and drained, or timed out and still empty: give up
+			if (m_bClosed.load(memory_order_relaxed))
+			{
+				status = QUEUE_CLOSED;
+				break;
+			}
+			if (bTimedOut)
+			{
+				status = QUEUE_TIMEOUT;
+				break;
+			}
+			bTimedOut = !m_NotEmptyCondition.WaitUntil(m_QueueMutex, nDeadline);
 		}
-		WaitForSingleObject(m_hQueueMutex, INFINITE);
+		m_nGetWaiters--;
+		QUEUE_STATS(m_Stats.OnGetBlocked(QueueGetMicroseconds() - nBlockedSince, QUEUE_OK != status));
 	}
 
-	// get first item in queue
-	msg = m_qMsgQueue.front();
-	m_qMsgQueue.pop();
-
-	// disable readable if queue is empty
-	if (0 == m_qMsgQueue.size())
+	if (QUEUE_OK == status)
 	{
-		ResetEvent(m_hReadableEvent);
+		// wake a blocked writer
+		NotifyWritable(true);
 	}
 
-	// enable writable if queue is no longer full
-	if (m_nMaxSize - 1 == m_qMsgQueue.size())
+	if (bAdaptive)
 	{
-		SetEvent(m_hWritableEvent);
+		m_GetSpin.Record(nWaitStart);
 	}
 
+	LeaveWait(true);
+
 	// release mutex
-	ReleaseMutex(m_hQueueMutex);
+	UnlockQueue();
 
-	// popped message
-	return true;
+	return status;
 }
 
 //---------------------------------------------------------------------------------
 // Function Name: 
-//	- CMessageQueue<T>::GetSize
+//	- CMessageQueue<T, TQueuePolicy>::PutBatch
 //
 // Usage:
-//	- To get the current queue size
+//	- To put a burst of messages into queue. Messages are queued under one
+//	  critical section and blocked readers are signalled once for the burst.
+//	  If the queue fills up, the part already queued is signalled and the call
+//	  waits for room, up to the queue timeout or until the queue is closed.
 //
 // Prameters:
-//	- N/A
+//	- const T* pMsgs:			the messages to be put in queue
+//	- unsigned int nCount:		number of messages in pMsgs
 //
 // Returns:
-//	- unsigned int: the current queue size
+//	- unsigned int: number of messages queued (less than nCount on timeout
+//	  or Close)
 //----------------------------------------------------------------------------------
-template <class T>
-unsigned int CMessageQueue<T>::GetSize()
+template <class T, class TQueuePolicy>
+unsigned int CMessageQueue<T, TQueuePolicy>::PutBatch(const T* pMsgs, unsigned int nCount)
 {
-	// hold mutex
-	WaitForSingleObject(m_hQueueMutex, INFINITE);
+	unsigned int nPut = 0;
 
-	// get size
-	int nCurrentSize = m_qMsgQueue.size();
-	
-	// release mutex
-	ReleaseMutex(m_hQueueMutex);
+	// a closed queue takes no more messages
+	if (m_bClosed.load(memory_order_acquire))
+	{
+		return 0;
+	}
+
+	// lock-free fast path: stay in user space unless the queue is full
+	if (TQueuePolicy::LOCK_FREE)
+	{
+		nPut = StorePushBatch(pMsgs, nCount);
+		if (nPut == nCount)
+		{
+			NotifyReadable(false, nPut);
+			return nPut;
+		}
+	}
+
+	// counted before it can block on the mutex, so the destructor waits for it
+	EnterWait();
+
+	// hold mutex
+	m_QueueMutex.Lock();
+
+	if (!m_bClosed.load(memory_order_relaxed))
+	{
+		nPut += StorePushBatch(pMsgs + nPut, nCount - nPut);
+	}
+
+	// messages queued but not yet signalled to readers
+	unsigned int nPending = nPut;
+
+	// wait for room for the rest of the burst
+	if (nPut < nCount && !m_bClosed.load(memory_order_relaxed))
+	{
+		QUEUE_TICKS nDeadline = QueueDeadline(m_nTimeoutMilliseconds);
+		bool bTimedOut = false;
+		QUEUE_STATS(unsigned long long nBlockedSince = QueueGetMicroseconds());
+
+		m_nPutWaiters++;
+		for (;;)
+		{
+			atomic_thread_fence(memory_order_seq_cst);
+			if (m_bClosed.load(memory_order_relaxed))
+			{
+				break;
+			}
+
+			unsigned int nPushed = StorePushBatch(pMsgs + nPut, nCount - nPut);
+			nPut += nPushed;
+			nPending += nPushed;
+
+			if (nPut == nCount || bTimedOut)
+			{
+				break;
+			}
+
+			// let readers drain what is already queued before we block
+			NotifyReadable(true, nPending);
+			nPending = 0;
+
+#ifdef MESSAGEQUEUE_COROUTINES
+			// coroutines served above may be the readers we wait for:
+			// resume them and re-check instead of blocking
+			if (!m_vAsyncReady.empty())
+			{
+				UnlockQueue();
+				m_QueueMutex.Lock();
+				continue;
+			}
+#endif /*MESSAGEQUEUE_COROUTINES*/
+
+			bTimedOut = !m_NotFullCondition.WaitUntil(m_QueueMutex, nDeadline);
+		}
+		m_nPutWaiters--;
+		QUEUE_STATS(m_Stats.OnPutBlocked(QueueGetMicroseconds() - nBlockedSince, nPut < nCount));
+	}
+
+	// wake blocked readers once for the burst
+	NotifyReadable(true, nPending);
+
+	LeaveWait(true);
+
+	// release mutex
+	UnlockQueue();
+
+	return nPut;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::GetBatch
+//
+// Usage:
+//	- To get up to nMaxCount messages from queue under one critical section.
+//	  Waits for the first message only; whatever else is queued at that point
+//	  is returned with it. Blocked writers are signalled once for the batch.
+//
+// Prameters:
+//	- T* pMsgs:							buffer receiving the messages, in queue order
+//	- unsigned int nMaxCount:			capacity of pMsgs
+//	- unsigned int nTimeoutMilliseconds:	how long to wait for the first message
+//
+// Returns:
+//	- unsigned int: number of messages dequeued (0 on timeout, or once the
+//	  queue is closed and empty)
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+unsigned int CMessageQueue<T, TQueuePolicy>::GetBatch(T* pMsgs, unsigned int nMaxCount, unsigned int nTimeoutMilliseconds)
+{
+	if (0 == nMaxCount)
+	{
+		return 0;
+	}
+
+	// lock-free fast path: stay in user space unless the queue is empty
+	if (TQueuePolicy::LOCK_FREE)
+	{
+		unsigned int nGot = StorePopBatch(pMsgs, nMaxCount);
+		if (nGot > 0)
+		{
+			NotifyWritable(false, nGot);
+			return nGot;
+		}
+	}
+
+	// counted before it can block on the mutex, so the destructor waits for it
+	EnterWait();
+
+	// adaptive wait: spin for the next message before blocking, stop on Close
+	unsigned int nGot = 0;
+	unsigned long long nWaitStart = 0;
+	bool bAdaptive = (WAIT_ADAPTIVE == m_WaitStrategy.load(memory_order_relaxed) && 0 != nTimeoutMilliseconds);
+	if (bAdaptive)
+	{
+		if (m_GetSpin.Spin([&]() { return (nGot = PollGetBatch(pMsgs, nMaxCount)) > 0 || m_bClosed.load(memory_order_relaxed); }, nWaitStart) && nGot > 0)
+		{
+			LeaveWait(false);
+			return nGot;
+		}
+	}
+
+	// hold mutex
+	m_QueueMutex.Lock();
+
+	// check readability
+	nGot = StorePopBatch(pMsgs, nMaxCount);
+	if (0 == nGot)
+	{
+		QUEUE_TICKS nDeadline = QueueDeadline(nTimeoutMilliseconds);
+		bool bTimedOut = false;
+		QUEUE_STATS(unsigned long long nBlockedSince = QueueGetMicroseconds());
+
+		m_nGetWaiters++;
+		for (;;)
+		{
+			atomic_thread_fence(memory_order_seq_cst);
+			nGot = StorePopBatch(pMsgs, nMaxCount);
+
+			if (nGot > 0 || bTimedOut || m_bClosed.load(memory_order_relaxed))
+			{
+				break;
+			}
+			bTimedOut = !m_NotEmptyCondition.WaitUntil(m_QueueMutex, nDeadline);
+		}
+		m_nGetWaiters--;
+		QUEUE_STATS(m_Stats.OnGetBlocked(QueueGetMicroseconds() - nBlockedSince, 0 == nGot));
+	}
+
+	// wake blocked writers once for the batch
+	NotifyWritable(true, nGot);
+
+	if (bAdaptive)
+	{
+		m_GetSpin.Record(nWaitStart);
+	}
+
+	LeaveWait(true);
+
+	// release mutex
+	UnlockQueue();
+
+	return nGot;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::Drain
+//
+// Usage:
+//	- To move every message currently in queue to the end of a vector,
+//	  without waiting. Messages put while draining may be left for later.
+//	  With CSpscQueuePolicy it must be called from the consumer thread.
+//
+// Prameters:
+//	- vector<T>& vMsgs:	vector receiving the messages, in queue order
+//
+// Returns:
+//	- unsigned int: number of messages dequeued
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+unsigned int CMessageQueue<T, TQueuePolicy>::Drain(vector<T>& vMsgs)
+{
+	// counted before it can block on the mutex, so the destructor waits for it
+	EnterWait();
+
+	// hold mutex
+	m_QueueMutex.Lock();
+
+	// take a snapshot of the size, so busy producers cannot keep us here
+	unsigned int nAvailable = m_qMsgQueue.GetSize();
+	unsigned int nGot = 0;
+	T msg;
+
+	// reserve rather than resize, so no placeholder messages are built in
+	// the vector; each message is moved into it as it is popped
+	vMsgs.reserve(vMsgs.size() + nAvailable);
+	while (nGot < nAvailable && StorePop(msg))
+	{
+		vMsgs.emplace_back(move(msg));
+		nGot++;
+	}
+
+	// wake blocked writers once for the whole drain
+	NotifyWritable(true, nGot);
+
+	LeaveWait(true);
+
+	// release mutex
+	UnlockQueue();
+
+	return nGot;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::Close
+//
+// Usage:
+//	- To shut the queue down, e.g. when its connection is torn down. Later
+//	  Puts fail with QUEUE_CLOSED; blocked Puts and Gets, parked coroutines
+//	  and threads spinning in the queue are woken. Gets still return the
+//	  messages left in queue, then QUEUE_CLOSED. A Put racing with Close on
+//	  a lock-free policy may still land, and is returned by a later Get.
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+void CMessageQueue<T, TQueuePolicy>::Close()
+{
+	// hold mutex
+	m_QueueMutex.Lock();
+
+	if (m_bClosed.load(memory_order_relaxed))
+	{
+		// release mutex
+		UnlockQueue();
+		return;
+	}
+
+	// waiters test the flag under the mutex before they sleep, so none of
+	// them can miss the wakeup below
+	m_bClosed.store(true, memory_order_seq_cst);
+
+#ifdef MESSAGEQUEUE_COROUTINES
+	CloseAsyncWaits(m_AsyncGetters, m_nGetWaiters);
+	CloseAsyncWaits(m_AsyncPutters, m_nPutWaiters);
+#endif /*MESSAGEQUEUE_COROUTINES*/
+
+	m_NotFullCondition.NotifyAll();
+	m_NotEmptyCondition.NotifyAll();
+
+	// a closed queue is readable, so a thread waiting on its set notices
+	CQueueSetEntry* pSetEntry = m_pSetEntry.load(memory_order_acquire);
+	if (pSetEntry != NULL)
+	{
+		pSetEntry->m_pSet->SignalReady(pSetEntry);
+	}
+
+	// release mutex
+	UnlockQueue();
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::IsClosed
+//
+// Usage:
+//	- To test whether Close was called
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- bool: true once the queue is closed
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+bool CMessageQueue<T, TQueuePolicy>::IsClosed()
+{
+	return m_bClosed.load(memory_order_acquire);
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::StoreEmplace
+//
+// Usage:
+//	- To construct a message in storage without waiting. Stamps and counts
+//	  it when MESSAGEQUEUE_STATS is defined.
+//
+// Prameters:
+//	- Args&&... args:	constructor arguments of the message
+//
+// Returns:
+//	- bool: true if the message was queued, false if queue is full
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+template <class... Args>
+bool CMessageQueue<T, TQueuePolicy>::StoreEmplace(Args&&... args)
+{
+#ifdef MESSAGEQUEUE_STATS
+	if (!m_qMsgQueue.TryEmplace(CQueueStampTag(), forward<Args>(args)...))
+	{
+		return false;
+	}
+
+	m_Stats.OnEnqueue(m_qMsgQueue.GetSize());
+	return true;
+#else
+	return m_qMsgQueue.TryEmplace(forward<Args>(args)...);
+#endif /*MESSAGEQUEUE_STATS*/
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::StorePop
+//
+// Usage:
+//	- To take a message from storage without waiting. Records how long it
+//	  was queued when MESSAGEQUEUE_STATS is defined.
+//
+// Prameters:
+//	- T& msg:	the message reference to get from queue
+//
+// Returns:
+//	- bool: true if a message was popped, false if queue is empty
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+bool CMessageQueue<T, TQueuePolicy>::StorePop(T& msg)
+{
+#ifdef MESSAGEQUEUE_STATS
+	CQueueStampedMessage<T> stamped;
+
+	if (!m_qMsgQueue.TryPop(stamped))
+	{
+		return false;
+	}
+
+	msg = move(stamped.m_Msg);
+	m_Stats.OnDequeue(QueueGetMicroseconds() - stamped.m_nStampMicros);
+	return true;
+#else
+	return m_qMsgQueue.TryPop(msg);
+#endif /*MESSAGEQUEUE_STATS*/
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::StorePushBatch
+//
+// Usage:
+//	- To put as much of a burst into storage as fits. With MESSAGEQUEUE_STATS
+//	  messages are stamped one by one instead of using the policy's batch push.
+//
+// Prameters:
+//	- const T* pMsgs:			the messages to be put in queue
+//	- unsigned int nCount:		number of messages in pMsgs
+//
+// Returns:
+//	- unsigned int: number of messages queued, from the front of pMsgs
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+unsigned int CMessageQueue<T, TQueuePolicy>::StorePushBatch(const T* pMsgs, unsigned int nCount)
+{
+#ifdef MESSAGEQUEUE_STATS
+	unsigned int nPushed = 0;
+
+	while (nPushed < nCount && StoreEmplace(pMsgs[nPushed]))
+	{
+		nPushed++;
+	}
+
+	return nPushed;
+#else
+	return m_qMsgQueue.TryPushBatch(pMsgs, nCount);
+#endif /*MESSAGEQUEUE_STATS*/
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::StorePopBatch
+//
+// Usage:
+//	- To take up to nMaxCount messages from storage. With MESSAGEQUEUE_STATS
+//	  messages are taken one by one so each latency is recorded.
+//
+// Prameters:
+//	- T* pMsgs:					buffer receiving the messages, in queue order
+//	- unsigned int nMaxCount:	capacity of pMsgs
+//
+// Returns:
+//	- unsigned int: number of messages popped
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+unsigned int CMessageQueue<T, TQueuePolicy>::StorePopBatch(T* pMsgs, unsigned int nMaxCount)
+{
+#ifdef MESSAGEQUEUE_STATS
+	unsigned int nPopped = 0;
+
+	while (nPopped < nMaxCount && StorePop(pMsgs[nPopped]))
+	{
+		nPopped++;
+	}
+
+	return nPopped;
+#else
+	return m_qMsgQueue.TryPopBatch(pMsgs, nMaxCount);
+#endif /*MESSAGEQUEUE_STATS*/
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::PollEmplace
+//
+// Usage:
+//	- To construct a message in queue without waiting and wake a reader, as
+//	  one step of an adaptive spin. Unless storage is lock-free, the mutex is
+//	  only taken once the storage size shows a free slot, so the spinner does
+//	  not compete with the other side for the mutex while the queue is full.
+//
+// Prameters:
+//	- Args&&... args:	constructor arguments of the message
+//
+// Returns:
+//	- bool: true if the message was queued, false if queue is full
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+template <class... Args>
+bool CMessageQueue<T, TQueuePolicy>::PollEmplace(Args&&... args)
+{
+	if (TQueuePolicy::LOCK_FREE)
+	{
+		if (!StoreEmplace(forward<Args>(args)...))
+		{
+			return false;
+		}
+
+		NotifyReadable(false);
+		return true;
+	}
+
+	if (m_qMsgQueue.GetSize() >= m_nMaxSize)
+	{
+		return false;
+	}
+
+	// hold mutex
+	m_QueueMutex.Lock();
+
+	bool bPut = StoreEmplace(forward<Args>(args)...);
+	if (bPut)
+	{
+		NotifyReadable(true);
+	}
+
+	// release mutex
+	UnlockQueue();
+
+	return bPut;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::PollGetBatch
+//
+// Usage:
+//	- To take up to nMaxCount messages without waiting and wake writers, as
+//	  one step of an adaptive spin. Unless storage is lock-free, the mutex is
+//	  only taken once the storage size shows a message.
+//
+// Prameters:
+//	- T* pMsgs:					buffer receiving the messages, in queue order
+//	- unsigned int nMaxCount:	capacity of pMsgs
+//
+// Returns:
+//	- unsigned int: number of messages dequeued
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+unsigned int CMessageQueue<T, TQueuePolicy>::PollGetBatch(T* pMsgs, unsigned int nMaxCount)
+{
+	if (TQueuePolicy::LOCK_FREE)
+	{
+		unsigned int nGot = StorePopBatch(pMsgs, nMaxCount);
+
+		NotifyWritable(false, nGot);
+		return nGot;
+	}
+
+	if (0 == m_qMsgQueue.GetSize())
+	{
+		return 0;
+	}
+
+	// hold mutex
+	m_QueueMutex.Lock();
+
+	unsigned int nGot = StorePopBatch(pMsgs, nMaxCount);
+	NotifyWritable(true, nGot);
+
+	// release mutex
+	UnlockQueue();
+
+	return nGot;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::ResolveDeadline
+//
+// Usage:
+//	- To start the queue timeout for calls made without a deadline. Done
+//	  only once a call has to wait, so the fast path reads no clock.
+//
+// Prameters:
+//	- QUEUE_TICKS nDeadline:	deadline of the call, or QUEUE_DEADLINE_DEFAULT
+//
+// Returns:
+//	- QUEUE_TICKS: absolute deadline, QUEUE_TICKS_INFINITE for none
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+QUEUE_TICKS CMessageQueue<T, TQueuePolicy>::ResolveDeadline(QUEUE_TICKS nDeadline)
+{
+	if (QUEUE_DEADLINE_DEFAULT == nDeadline)
+	{
+		return QueueDeadline(m_nTimeoutMilliseconds.load(memory_order_relaxed));
+	}
+
+	return nDeadline;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::IsAdaptiveWait
+//
+// Usage:
+//	- To decide whether a call spins before it blocks: only with
+//	  WAIT_ADAPTIVE, and not when it may not wait at all
+//
+// Prameters:
+//	- QUEUE_TICKS nDeadline:	deadline of the call, or QUEUE_DEADLINE_DEFAULT
+//
+// Returns:
+//	- bool: true to spin first
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+bool CMessageQueue<T, TQueuePolicy>::IsAdaptiveWait(QUEUE_TICKS nDeadline)
+{
+	if (WAIT_ADAPTIVE != m_WaitStrategy.load(memory_order_relaxed))
+	{
+		return false;
+	}
+
+	if (QUEUE_DEADLINE_DEFAULT == nDeadline)
+	{
+		return 0 != m_nTimeoutMilliseconds.load(memory_order_relaxed);
+	}
+
+	return QUEUE_TICKS_INFINITE == nDeadline || QueueGetTicks() < nDeadline;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::EnterWait
+//
+// Usage:
+//	- To count a call before it spins or takes the mutex, so the destructor
+//	  does not free the queue under it. A thread still waiting to take the
+//	  mutex is counted as well.
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+void CMessageQueue<T, TQueuePolicy>::EnterWait()
+{
+	m_nWaitingCalls.fetch_add(1, memory_order_seq_cst);
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::LeaveWait
+//
+// Usage:
+//	- To uncount a waiting call, waking the destructor if it was the last
+//	  one. With the mutex held the destructor cannot go on before the caller
+//	  unlocks. Without it, the count is the last thing the call touches, so
+//	  the closed flag is read first; a Close slipping in between goes
+//	  unsignalled and is caught by the destructor's periodic re-check.
+//
+// Prameters:
+//	- bool bMutexHeld:	whether the caller holds the queue mutex
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+void CMessageQueue<T, TQueuePolicy>::LeaveWait(bool bMutexHeld)
+{
+	if (bMutexHeld)
+	{
+		if (1 == m_nWaitingCalls.fetch_sub(1, memory_order_acq_rel) && m_bClosed.load(memory_order_relaxed))
+		{
+			m_LeftCondition.NotifyAll();
+		}
+		return;
+	}
+
+	if (!m_bClosed.load(memory_order_acquire))
+	{
+		m_nWaitingCalls.fetch_sub(1, memory_order_release);
+		return;
+	}
+
+	// hold mutex
+	m_QueueMutex.Lock();
+
+	LeaveWait(true);
+
+	// release mutex
+	m_QueueMutex.Unlock();
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::UnlockQueue
+//
+// Usage:
+//	- To release the queue mutex and then hand the coroutines whose waits
+//	  were completed under it to their executors, after taking timed waits
+//	  out of the async timer. Resuming after the unlock keeps the mutex free
+//	  for the coroutine's next GetAsync/PutAsync, which may run before the
+//	  executor returns. Only locals are touched once the mutex is released.
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+void CMessageQueue<T, TQueuePolicy>::UnlockQueue()
+{
+#ifdef MESSAGEQUEUE_COROUTINES
+	if (!m_vAsyncReady.empty())
+	{
+		vector<shared_ptr<CQueueAsyncWaitBase> > vReady;
+		vReady.swap(m_vAsyncReady);
+
+		m_QueueMutex.Unlock();
+
+		for (size_t i = 0; i < vReady.size(); i++)
+		{
+			if (vReady[i]->m_bTimed)
+			{
+				CQueueAsyncTimer::GetInstance().Remove(vReady[i]);
+			}
+			vReady[i]->Resume();
+		}
+		return;
+	}
+#endif /*MESSAGEQUEUE_COROUTINES*/
+
+	m_QueueMutex.Unlock();
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::NotifyWritable
+//
+// Usage:
+//	- To wake threads blocked in Put once slots were freed. Only touches the
+//	  mutex and condition when a thread is actually waiting. A batch of
+//	  more than one message wakes every waiter with a single call.
+//
+// Prameters:
+//	- bool bMutexHeld:		whether the caller already holds the queue mutex
+//	- unsigned int nCount:	number of messages moved by the caller
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+void CMessageQueue<T, TQueuePolicy>::NotifyWritable(bool bMutexHeld, unsigned int nCount)
+{
+	if (0 == nCount)
+	{
+		return;
+	}
+
+	// order the queue update before reading the waiter count (pairs with the
+	// fence in the waiter's re-check loop)
+	if (TQueuePolicy::LOCK_FREE)
+	{
+		atomic_thread_fence(memory_order_seq_cst);
+	}
+
+	if (0 == m_nPutWaiters.load(memory_order_relaxed))
+	{
+		return;
+	}
+
+	// a waiter between its re-check and its wait holds the mutex, so
+	// passing through the mutex guarantees it is asleep before we notify;
+	// a lock-free fast path is counted until it is done with the queue
+	if (!bMutexHeld)
+	{
+		EnterWait();
+		m_QueueMutex.Lock();
+	}
+
+#ifdef MESSAGEQUEUE_COROUTINES
+	ServeAsyncWaiters();
+#endif /*MESSAGEQUEUE_COROUTINES*/
+
+	if (!bMutexHeld)
+	{
+		UnlockQueue();
+	}
+
+	if (1 == nCount)
+	{
+		m_NotFullCondition.NotifyOne();
+	}
+	else
+	{
+		m_NotFullCondition.NotifyAll();
+	}
+
+	if (!bMutexHeld)
+	{
+		LeaveWait(false);
+	}
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::NotifyReadable
+//
+// Usage:
+//	- To wake threads blocked in Get once messages were added. Only touches the
+//	  mutex and condition when a thread is actually waiting. A batch of
+//	  more than one message wakes every waiter with a single call. Also
+//	  reports the queue to its CQueueSet, if any.
+//
+// Prameters:
+//	- bool bMutexHeld:		whether the caller already holds the queue mutex
+//	- unsigned int nCount:	number of messages moved by the caller
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+void CMessageQueue<T, TQueuePolicy>::NotifyReadable(bool bMutexHeld, unsigned int nCount)
+{
+	if (0 == nCount)
+	{
+		return;
+	}
+
+	// a no-op unless the queue just became ready for its set
+	CQueueSetEntry* pSetEntry = m_pSetEntry.load(memory_order_acquire);
+	if (pSetEntry != NULL)
+	{
+		pSetEntry->m_pSet->SignalReady(pSetEntry);
+	}
+
+	// order the queue update before reading the waiter count (pairs with the
+	// fence in the waiter's re-check loop)
+	if (TQueuePolicy::LOCK_FREE)
+	{
+		atomic_thread_fence(memory_order_seq_cst);
+	}
+
+	if (0 == m_nGetWaiters.load(memory_order_relaxed))
+	{
+		return;
+	}
+
+	// a waiter between its re-check and its wait holds the mutex, so
+	// passing through the mutex guarantees it is asleep before we notify;
+	// a lock-free fast path is counted until it is done with the queue
+	if (!bMutexHeld)
+	{
+		EnterWait();
+		m_QueueMutex.Lock();
+	}
+
+#ifdef MESSAGEQUEUE_COROUTINES
+	ServeAsyncWaiters();
+#endif /*MESSAGEQUEUE_COROUTINES*/
+
+	if (!bMutexHeld)
+	{
+		UnlockQueue();
+	}
+
+	if (1 == nCount)
+	{
+		m_NotEmptyCondition.NotifyOne();
+	}
+	else
+	{
+		m_NotEmptyCondition.NotifyAll();
+	}
+
+	if (!bMutexHeld)
+	{
+		LeaveWait(false);
+	}
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::GetSize
+//
+// Usage:
+//	- To get the current queue size
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- unsigned int: the current queue size
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+unsigned int CMessageQueue<T, TQueuePolicy>::GetSize()
+{
+	// lock-free storage can report its size without the mutex
+	if (TQueuePolicy::LOCK_FREE)
+	{
+		return m_qMsgQueue.GetSize();
+	}
+
+	// counted before it can block on the mutex, so the destructor waits for it
+	EnterWait();
+
+	// hold mutex
+	m_QueueMutex.Lock();
+
+	// get size
+	unsigned int nCurrentSize = m_qMsgQueue.GetSize();
+
+	LeaveWait(true);
+	
+	// release mutex
+	UnlockQueue();
+
+	// return size
+	return nCurrentSize;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::SetTimeout
+//
+// Usage:
+//	- To set time out interval
+//
+// Prameters:
+//	- unsigned int nTimeoutMilliseconds:	time out interval in milliseconds
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+void CMessageQueue<T, TQueuePolicy>::SetTimeout(unsigned int nTimeoutMilliseconds)
+{
+	// counted before it can block on the mutex, so the destructor waits for it
+	EnterWait();
+
+	// hold mutex
+	m_QueueMutex.Lock();
+
+	// set timeout interval (by milliseconds)
+	m_nTimeoutMilliseconds = nTimeoutMilliseconds;
+
+	LeaveWait(true);
+	
+	// release mutex
+	UnlockQueue();
+
+	return;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::SetWaitStrategy
+//
+// Usage:
+//	- To choose how Put, Get and GetBatch wait on a full/empty queue:
+//	  WAIT_BLOCK blocks right away, WAIT_ADAPTIVE spins and yields first.
+//	  Calls already waiting keep the strategy they started with.
+//
+// Prameters:
+//	- QUEUE_WAIT_STRATEGY waitStrategy:	the strategy
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+void CMessageQueue<T, TQueuePolicy>::SetWaitStrategy(QUEUE_WAIT_STRATEGY waitStrategy)
+{
+	m_WaitStrategy.store(waitStrategy, memory_order_relaxed);
+}
+
+#ifdef MESSAGEQUEUE_STATS
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::GetStats
+//
+// Usage:
+//	- To read the queue counters without stopping producers or consumers
+//
+// Prameters:
+//	- CQueueStatsSnapshot& snapshot:	receives the counters
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+void CMessageQueue<T, TQueuePolicy>::GetStats(CQueueStatsSnapshot& snapshot)
+{
+	m_Stats.GetSnapshot(snapshot);
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::GetStatsJson
+//
+// Usage:
+//	- To dump the queue counters as one JSON object, e.g. to compare the
+//	  queues of a pipeline and find the bottleneck
+//
+// Prameters:
+//	- const char* pszName:	name to tag the object with, NULL for none
+//
+// Returns:
+//	- string: the JSON text
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+string CMessageQueue<T, TQueuePolicy>::GetStatsJson(const char* pszName)
+{
+	CQueueStatsSnapshot snapshot;
+
+	m_Stats.GetSnapshot(snapshot);
+	return CQueueStats::ToJson(snapshot, pszName, GetSize(), m_nMaxSize);
+}
+#endif /*MESSAGEQUEUE_STATS*/
+
+#ifdef MESSAGEQUEUE_COROUTINES
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::ServeAsyncWaiters
+//
+// Usage:
+//	- To move queued messages to parked GetAsync coroutines and messages of
+//	  parked PutAsync coroutines into free slots, oldest wait first, until
+//	  neither side can make progress. Timed-out waits met on the way are
+//	  dropped. The queue mutex must be held; the served coroutines are
+//	  resumed by UnlockQueue, so an executor never runs under the mutex.
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+void CMessageQueue<T, TQueuePolicy>::ServeAsyncWaiters()
+{
+	unsigned int nGot = 0;
+	unsigned int nPut = 0;
+	bool bProgress = true;
 
-	// return size
-	return nCurrentSize;
+	// a get frees a slot for a parked put and vice versa, so alternate
+	while (bProgress)
+	{
+		bProgress = false;
+
+		while (!m_AsyncGetters.m_lstWaits.empty())
+		{
+			shared_ptr<CQueueAsyncWait<T> > pWait = m_AsyncGetters.m_lstWaits.front();
+
+			pWait->m_Mutex.Lock();
+			if (!pWait->m_bCompleted.load(memory_order_relaxed))
+			{
+				if (!StorePop(pWait->m_Msg))
+				{
+					pWait->m_Mutex.Unlock();
+					break;
+				}
+
+				pWait->Complete(true);
+				m_vAsyncReady.push_back(pWait);
+				nGot++;
+				bProgress = true;
+			}
+			pWait->m_Mutex.Unlock();
+
+			m_AsyncGetters.m_lstWaits.pop_front();
+			m_AsyncGetters.m_nCount--;
+			m_nGetWaiters--;
+		}
+
+		while (!m_AsyncPutters.m_lstWaits.empty())
+		{
+			shared_ptr<CQueueAsyncWait<T> > pWait = m_AsyncPutters.m_lstWaits.front();
+
+			pWait->m_Mutex.Lock();
+			if (!pWait->m_bCompleted.load(memory_order_relaxed))
+			{
+				if (!StoreEmplace(move(pWait->m_Msg)))
+				{
+					pWait->m_Mutex.Unlock();
+					break;
+				}
+
+				pWait->Complete(true);
+				m_vAsyncReady.push_back(pWait);
+				nPut++;
+				bProgress = true;
+			}
+			pWait->m_Mutex.Unlock();
+
+			m_AsyncPutters.m_lstWaits.pop_front();
+			m_AsyncPutters.m_nCount--;
+			m_nPutWaiters--;
+		}
+	}
+
+	// blocked threads on the other side may be able to proceed now
+	if (nGot > 0 && 0 != m_nPutWaiters.load(memory_order_relaxed))
+	{
+		m_NotFullCondition.NotifyAll();
+	}
+	if (nPut > 0 && 0 != m_nGetWaiters.load(memory_order_relaxed))
+	{
+		m_NotEmptyCondition.NotifyAll();
+	}
 }
 
 //---------------------------------------------------------------------------------
 // Function Name: 
-//	- CMessageQueue<T>::SetTimeout
+//	- CMessageQueue<T, TQueuePolicy>::LinkAsyncWait
 //
 // Usage:
-//	- To set time out interval
+//	- To append a wait to a list and arm its timeout. Timed-out waits at the
+//	  front are dropped first, and the whole list is swept whenever it has
+//	  doubled since the last sweep, so abandoned waits cannot pile up. The
+//	  queue mutex must be held and nWaiters must already count pWait.
 //
 // Prameters:
-//	- unsigned int nTimeoutMilliseconds:	time out interval in milliseconds
+//	- CAsyncWaitList& waitList:					the list to link into
+//	- atomic<unsigned int>& nWaiters:			the waiter count covering the list
+//	- const shared_ptr<CQueueAsyncWait<T> >& pWait:	the wait
+//	- unsigned int nTimeoutMilliseconds:		timeout of the wait, INFINITE for none
 //
 // Returns:
 //	- N/A
 //----------------------------------------------------------------------------------
-template <class T>
-void CMessageQueue<T>::SetTimeout(unsigned int nTimeoutMilliseconds)
+template <class T, class TQueuePolicy>
+void CMessageQueue<T, TQueuePolicy>::LinkAsyncWait(CAsyncWaitList& waitList, atomic<unsigned int>& nWaiters, const shared_ptr<CQueueAsyncWait<T> >& pWait, unsigned int nTimeoutMilliseconds)
+{
+	list<shared_ptr<CQueueAsyncWait<T> > >& lstWaits = waitList.m_lstWaits;
+
+	while (!lstWaits.empty() && lstWaits.front()->m_bCompleted.load(memory_order_acquire))
+	{
+		lstWaits.pop_front();
+		waitList.m_nCount--;
+		nWaiters--;
+	}
+
+	if (waitList.m_nCount >= waitList.m_nSweepAt)
+	{
+		typename list<shared_ptr<CQueueAsyncWait<T> > >::iterator it = lstWaits.begin();
+
+		while (it != lstWaits.end())
+		{
+			if ((*it)->m_bCompleted.load(memory_order_acquire))
+			{
+				it = lstWaits.erase(it);
+				waitList.m_nCount--;
+				nWaiters--;
+			}
+			else
+			{
+				++it;
+			}
+		}
+
+		waitList.m_nSweepAt = (waitList.m_nCount * 2 > 64) ? waitList.m_nCount * 2 : 64;
+	}
+
+	lstWaits.push_back(pWait);
+	waitList.m_nCount++;
+
+	if (INFINITE != nTimeoutMilliseconds)
+	{
+		CQueueAsyncTimer::GetInstance().Add(QueueDeadline(nTimeoutMilliseconds), pWait);
+	}
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::SuspendGet
+//
+// Usage:
+//	- To park a GetAsync coroutine until a message is handed to it. Re-checks
+//	  the queue after announcing the waiter, like Get, so a concurrent Put
+//	  either is seen here or sees the parked wait.
+//
+// Prameters:
+//	- shared_ptr<CQueueAsyncWait<T> > pWait:	the wait, receives the message
+//	- unsigned int nTimeoutMilliseconds:		how long to wait
+//
+// Returns:
+//	- bool: true if parked, false if done already (pWait->m_bResult tells how)
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+bool CMessageQueue<T, TQueuePolicy>::SuspendGet(shared_ptr<CQueueAsyncWait<T> > pWait, unsigned int nTimeoutMilliseconds)
 {
 	// hold mutex
-	WaitForSingleObject(m_hQueueMutex, INFINITE);
+	m_QueueMutex.Lock();
+
+	m_nGetWaiters++;
+	atomic_thread_fence(memory_order_seq_cst);
+
+	if (StorePop(pWait->m_Msg))
+	{
+		m_nGetWaiters--;
+		pWait->m_bResult = true;
+		NotifyWritable(true);
+
+		// release mutex
+		UnlockQueue();
+		return false;
+	}
+
+	// nothing more will come once closed and drained
+	if (0 == nTimeoutMilliseconds || m_bClosed.load(memory_order_relaxed))
+	{
+		m_nGetWaiters--;
+		pWait->m_bResult = false;
+
+		// release mutex
+		UnlockQueue();
+		return false;
+	}
+
+	LinkAsyncWait(m_AsyncGetters, m_nGetWaiters, pWait, nTimeoutMilliseconds);
 
-	// set timeout interval (by milliseconds)
-	m_nTimeoutMilliseconds = nTimeoutMilliseconds;
-	
 	// release mutex
-	ReleaseMutex(m_hQueueMutex);
+	UnlockQueue();
 
-	return;
+	return true;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::SuspendPut
+//
+// Usage:
+//	- To park a PutAsync coroutine until its message fits in queue
+//
+// Prameters:
+//	- shared_ptr<CQueueAsyncWait<T> > pWait:	the wait, holds the message
+//	- unsigned int nTimeoutMilliseconds:		how long to wait
+//
+// Returns:
+//	- bool: true if parked, false if done already (pWait->m_bResult tells how)
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+bool CMessageQueue<T, TQueuePolicy>::SuspendPut(shared_ptr<CQueueAsyncWait<T> > pWait, unsigned int nTimeoutMilliseconds)
+{
+	// hold mutex
+	m_QueueMutex.Lock();
+
+	m_nPutWaiters++;
+	atomic_thread_fence(memory_order_seq_cst);
+
+	if (m_bClosed.load(memory_order_relaxed))
+	{
+		m_nPutWaiters--;
+		pWait->m_bResult = false;
+
+		// release mutex
+		UnlockQueue();
+		return false;
+	}
+
+	if (StoreEmplace(move(pWait->m_Msg)))
+	{
+		m_nPutWaiters--;
+		pWait->m_bResult = true;
+		NotifyReadable(true);
+
+		// release mutex
+		UnlockQueue();
+		return false;
+	}
+
+	if (0 == nTimeoutMilliseconds)
+	{
+		m_nPutWaiters--;
+		pWait->m_bResult = false;
+
+		// release mutex
+		UnlockQueue();
+		return false;
+	}
+
+	LinkAsyncWait(m_AsyncPutters, m_nPutWaiters, pWait, nTimeoutMilliseconds);
+
+	// release mutex
+	UnlockQueue();
+
+	return true;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::CloseAsyncWaits
+//
+// Usage:
+//	- To complete every parked coroutine of a list with false and empty the
+//	  list. Called by Close with the queue mutex held.
+//
+// Prameters:
+//	- CAsyncWaitList& waitList:					the list to empty
+//	- atomic<unsigned int>& nWaiters:			the waiter count covering the list
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+void CMessageQueue<T, TQueuePolicy>::CloseAsyncWaits(CAsyncWaitList& waitList, atomic<unsigned int>& nWaiters)
+{
+	while (!waitList.m_lstWaits.empty())
+	{
+		shared_ptr<CQueueAsyncWait<T> > pWait = waitList.m_lstWaits.front();
+
+		pWait->m_Mutex.Lock();
+		if (!pWait->m_bCompleted.load(memory_order_relaxed))
+		{
+			pWait->Complete(false);
+			m_vAsyncReady.push_back(pWait);
+		}
+		pWait->m_Mutex.Unlock();
+
+		waitList.m_lstWaits.pop_front();
+		waitList.m_nCount--;
+		nWaiters--;
+	}
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::GetAsync
+//
+// Usage:
+//	- To get a message from queue in a coroutine: co_await suspends the
+//	  coroutine while the queue is empty, up to the queue timeout
+//
+// Prameters:
+//	- T& msg:					the message reference to get from queue
+//	- CQueueExecutor& executor:	where the coroutine is resumed
+//
+// Returns:
+//	- CGetAwaiter: awaiter, co_await yields the success/fail status
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+typename CMessageQueue<T, TQueuePolicy>::CGetAwaiter CMessageQueue<T, TQueuePolicy>::GetAsync(T& msg, CQueueExecutor& executor)
+{
+	return CGetAwaiter(*this, msg, executor, m_nTimeoutMilliseconds);
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::GetAsync
+//
+// Usage:
+//	- To get a message from queue in a coroutine, with a per-call timeout
+//
+// Prameters:
+//	- T& msg:								the message reference to get from queue
+//	- CQueueExecutor& executor:				where the coroutine is resumed
+//	- unsigned int nTimeoutMilliseconds:	how long to wait, INFINITE for ever
+//
+// Returns:
+//	- CGetAwaiter: awaiter, co_await yields the success/fail status
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+typename CMessageQueue<T, TQueuePolicy>::CGetAwaiter CMessageQueue<T, TQueuePolicy>::GetAsync(T& msg, CQueueExecutor& executor, unsigned int nTimeoutMilliseconds)
+{
+	return CGetAwaiter(*this, msg, executor, nTimeoutMilliseconds);
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::PutAsync
+//
+// Usage:
+//	- To put a message into queue in a coroutine: co_await suspends the
+//	  coroutine while the queue is full, up to the queue timeout
+//
+// Prameters:
+//	- T msg:					the message to be put in queue
+//	- CQueueExecutor& executor:	where the coroutine is resumed
+//
+// Returns:
+//	- CPutAwaiter: awaiter, co_await yields the success/fail status
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+typename CMessageQueue<T, TQueuePolicy>::CPutAwaiter CMessageQueue<T, TQueuePolicy>::PutAsync(T msg, CQueueExecutor& executor)
+{
+	return CPutAwaiter(*this, move(msg), executor, m_nTimeoutMilliseconds);
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::PutAsync
+//
+// Usage:
+//	- To put a message into queue in a coroutine, with a per-call timeout
+//
+// Prameters:
+//	- T msg:								the message to be put in queue
+//	- CQueueExecutor& executor:				where the coroutine is resumed
+//	- unsigned int nTimeoutMilliseconds:	how long to wait, INFINITE for ever
+//
+// Returns:
+//	- CPutAwaiter: awaiter, co_await yields the success/fail status
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+typename CMessageQueue<T, TQueuePolicy>::CPutAwaiter CMessageQueue<T, TQueuePolicy>::PutAsync(T msg, CQueueExecutor& executor, unsigned int nTimeoutMilliseconds)
+{
+	return CPutAwaiter(*this, move(msg), executor, nTimeoutMilliseconds);
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::CGetAwaiter::await_ready
+//
+// Usage:
+//	- Lock-free policies try to take a message without any locking first
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- bool: true if a message was taken and the coroutine need not suspend
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+bool CMessageQueue<T, TQueuePolicy>::CGetAwaiter::await_ready()
+{
+	if (TQueuePolicy::LOCK_FREE && m_Queue.StorePop(m_Msg))
+	{
+		m_Queue.NotifyWritable(false);
+		m_bResult = true;
+		return true;
+	}
+
+	return false;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::CGetAwaiter::await_suspend
+//
+// Usage:
+//	- To park the coroutine. Once parked it may be resumed on another thread
+//	  before this returns, so the awaiter is not touched after that.
+//
+// Prameters:
+//	- coroutine_handle<> hCoroutine:	the awaiting coroutine
+//
+// Returns:
+//	- bool: true to stay suspended, false to continue right away
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+bool CMessageQueue<T, TQueuePolicy>::CGetAwaiter::await_suspend(coroutine_handle<> hCoroutine)
+{
+	m_pWait = make_shared<CQueueAsyncWait<T> >(hCoroutine, &m_Executor);
+
+	return m_Queue.SuspendGet(m_pWait, m_nTimeoutMilliseconds);
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::CGetAwaiter::await_resume
+//
+// Usage:
+//	- To deliver the result of the co_await
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- bool: true if a message was stored in msg, false on timeout or Close
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+bool CMessageQueue<T, TQueuePolicy>::CGetAwaiter::await_resume()
+{
+	if (m_pWait)
+	{
+		m_bResult = m_pWait->m_bResult;
+		if (m_bResult)
+		{
+			m_Msg = move(m_pWait->m_Msg);
+		}
+		m_pWait.reset();
+	}
+
+	return m_bResult;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::CPutAwaiter::await_ready
+//
+// Usage:
+//	- Lock-free policies try to queue the message without any locking first
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- bool: true if the message was queued and the coroutine need not suspend
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+bool CMessageQueue<T, TQueuePolicy>::CPutAwaiter::await_ready()
+{
+	if (TQueuePolicy::LOCK_FREE && !m_Queue.m_bClosed.load(memory_order_acquire) && m_Queue.StoreEmplace(move(m_Msg)))
+	{
+		m_Queue.NotifyReadable(false);
+		m_bResult = true;
+		return true;
+	}
+
+	return false;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::CPutAwaiter::await_suspend
+//
+// Usage:
+//	- To park the coroutine with its message. Once parked it may be resumed
+//	  on another thread before this returns, so the awaiter is not touched
+//	  after that.
+//
+// Prameters:
+//	- coroutine_handle<> hCoroutine:	the awaiting coroutine
+//
+// Returns:
+//	- bool: true to stay suspended, false to continue right away
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+bool CMessageQueue<T, TQueuePolicy>::CPutAwaiter::await_suspend(coroutine_handle<> hCoroutine)
+{
+	m_pWait = make_shared<CQueueAsyncWait<T> >(hCoroutine, &m_Executor, move(m_Msg));
+
+	return m_Queue.SuspendPut(m_pWait, m_nTimeoutMilliseconds);
+}
+
+//---------------------------------------------------------------------------------
+// Function Name: 
+//	- CMessageQueue<T, TQueuePolicy>::CPutAwaiter::await_resume
+//
+// Usage:
+//	- To deliver the result of the co_await
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- bool: true if the message was queued, false on timeout or Close
+//----------------------------------------------------------------------------------
+template <class T, class TQueuePolicy>
+bool CMessageQueue<T, TQueuePolicy>::CPutAwaiter::await_resume()
+{
+	if (m_pWait)
+	{
+		m_bResult = m_pWait->m_bResult;
+		m_pWait.reset();
+	}
+
+	return m_bResult;
 }
+#endif /*MESSAGEQUEUE_COROUTINES*/
 #endif /*_MESSAGEQUEUE*/
\ No newline at end of file
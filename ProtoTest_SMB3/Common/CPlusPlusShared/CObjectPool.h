@@ -0,0 +1,809 @@
+#ifndef _OBJECTPOOL
+#define _OBJECTPOOL
+
+#pragma once
+
+#include <atomic>
+#include <utility>
+#include <new>
+#include "CQueueSync.h"
+#include "CQueueStorage.h"
+
+using namespace std;
+
+//---------------------------------------------------------------------------------
+// Object Pool Class
+//
+// Recycles message payloads so producers and consumers on different threads
+// stop going through the global allocator for every packet. Make() returns a
+// CPooledPtr<T>, a move-only handle that CMessageQueue carries like any other
+// message; dropping the handle on the consumer destroys the object and gives
+// its memory back to the pool.
+//
+// Free objects are kept in batches of POOL_BATCH_SIZE:
+//	- each thread works on a cache of two batches inside the pool (the
+//	  "current" one it takes from/returns to, and one spare full batch)
+//	- a thread whose cache holds two full batches hands one to the shared
+//	  depot, a lock-free stack of batches; a thread with an empty cache takes
+//	  a whole batch from there. Objects freed by a consumer thus reach the
+//	  producer POOL_BATCH_SIZE at a time, for one CAS per batch.
+//	- only when the depot is empty does the pool allocate another chunk of
+//	  POOL_CHUNK_SIZE objects (under a mutex). Once the pool has grown to the
+//	  working set, the message path never calls malloc/free.
+//
+// Caches belong to the pool, not to threads: threads map onto them by
+// QueueThreadIndex, so nothing needs cleaning up when a thread exits; a
+// later thread with the same mapping picks up what it left behind. A pool
+// that cannot grow any more moves the free objects of every idle cache to
+// the depot before Make gives up, so none stay stranded in the cache of a
+// thread that exited or stopped freeing.
+//
+// Objects never leave the pool before it is destroyed, so a stale read of a
+// batch link is always of pool memory; an ABA tag on the depot top makes such
+// reads harmless. The pool must outlive every CPooledPtr it handed out.
+//---------------------------------------------------------------------------------
+
+// objects per batch moved between a thread cache and the depot
+const unsigned int POOL_BATCH_SIZE = 32;
+
+// objects allocated at a time when the pool grows
+const unsigned int POOL_CHUNK_SIZE = 256;
+
+// most chunks a pool can grow to (bounds the pool at 1M objects)
+const unsigned int POOL_MAX_CHUNKS = 4096;
+
+// thread caches per pool, a power of two; threads beyond that share caches
+const unsigned int POOL_CACHE_COUNT = 64;
+
+template <class T> class CObjectPool;
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- QueueThreadIndex
+//
+// Usage:
+//	- To get a small number identifying the calling thread, handed out in the
+//	  order threads first ask for one
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- unsigned int: the thread's index
+//----------------------------------------------------------------------------------
+inline unsigned int QueueThreadIndex()
+{
+	static atomic<unsigned int> s_nNextIndex(0);
+	static thread_local unsigned int t_nIndex = s_nNextIndex.fetch_add(1, memory_order_relaxed);
+
+	return t_nIndex;
+}
+
+//---------------------
+// Pool Node
+//---------------------
+template <class T>
+struct CPoolNode
+{
+	// own index + 1 (0 means "no node" in links)
+	unsigned int m_nIndex;
+
+	// next free node of the same batch
+	unsigned int m_nNext;
+
+	// number of nodes in the batch, valid on the batch's first node
+	unsigned int m_nBatchCount;
+
+	// next batch in the depot, read by racing pops
+	atomic<unsigned int> m_nNextBatch;
+
+	// the object, constructed while handed out
+	alignas(T) unsigned char m_Storage[sizeof(T)];
+
+	T* GetPayload() { return reinterpret_cast<T*>(m_Storage); }
+};
+
+//---------------------------------------------------------------------------------
+// Pooled Pointer Class
+//
+// Owns one object from a CObjectPool. Move-only; the object is destroyed and
+// its memory returned to the pool when the handle is reset or destroyed.
+//---------------------------------------------------------------------------------
+template <class T>
+class CPooledPtr
+{
+	friend class CObjectPool<T>;
+
+private:
+	// pool the object came from
+	CObjectPool<T>* m_pPool;
+
+	// node holding the object, NULL if empty
+	CPoolNode<T>* m_pNode;
+
+private:
+	// not copyable
+	CPooledPtr(const CPooledPtr&);
+	CPooledPtr& operator=(const CPooledPtr&);
+
+	// Constructor: used by CObjectPool::Make
+	CPooledPtr(CObjectPool<T>* pPool, CPoolNode<T>* pNode) : m_pPool(pPool), m_pNode(pNode) { }
+
+public:
+	// Constructor: empty handle
+	CPooledPtr() : m_pPool(NULL), m_pNode(NULL) { }
+
+	// Constructor: take over another handle's object
+	CPooledPtr(CPooledPtr&& other) : m_pPool(other.m_pPool), m_pNode(other.m_pNode)
+	{
+		other.m_pPool = NULL;
+		other.m_pNode = NULL;
+	}
+
+	// Destructor
+	~CPooledPtr() { Reset(); }
+
+	// Take over another handle's object, releasing ours
+	CPooledPtr& operator=(CPooledPtr&& other);
+
+	// Destroy the object and return it to the pool
+	void Reset();
+
+public:
+	T* Get() const			{ return (m_pNode != NULL) ? m_pNode->GetPayload() : NULL; }
+	T* operator->() const	{ return m_pNode->GetPayload(); }
+	T& operator*() const	{ return *m_pNode->GetPayload(); }
+
+	// Whether the handle owns an object
+	bool IsNull() const				{ return NULL == m_pNode; }
+	explicit operator bool() const	{ return m_pNode != NULL; }
+};
+
+template <class T>
+class CObjectPool
+{
+	friend class CPooledPtr<T>;
+
+private:
+	//---------------------
+	// Thread Cache
+	//---------------------
+	struct CPoolCache
+	{
+		// taken by the thread working on the cache; a thread finding it
+		// taken goes to the depot instead of waiting
+		atomic<bool> m_bBusy;
+
+		// batch objects are taken from and returned to
+		unsigned int m_nCurrent;
+		unsigned int m_nCurrentCount;
+
+		// spare full batch (count 0 or POOL_BATCH_SIZE)
+		unsigned int m_nFull;
+		unsigned int m_nFullCount;
+
+		char m_Pad[QUEUE_CACHE_LINE_SIZE];
+
+		CPoolCache() : m_bBusy(false), m_nCurrent(0), m_nCurrentCount(0), m_nFull(0), m_nFullCount(0) { }
+	};
+
+	// thread caches
+	CPoolCache m_Caches[POOL_CACHE_COUNT];
+
+	// depot of free batches: ABA tag in the high half, node index + 1 in the low half
+	atomic<unsigned long long> m_nDepotTop;
+
+	char m_Pad0[QUEUE_CACHE_LINE_SIZE];
+
+	// chunks of nodes, published once allocated
+	atomic<CPoolNode<T>*> m_pChunks[POOL_MAX_CHUNKS];
+
+	// guards growing
+	CQueueMutex m_GrowMutex;
+
+	// number of chunks allocated (grow mutex)
+	unsigned int m_nChunkCount;
+
+	// most chunks this pool may allocate
+	unsigned int m_nMaxChunks;
+
+private:
+	// not copyable
+	CObjectPool(const CObjectPool&);
+	CObjectPool& operator=(const CObjectPool&);
+
+	// Find a node by index + 1
+	CPoolNode<T>* GetNode(unsigned int nIndex);
+
+	// Push a batch onto the depot
+	void PushBatch(unsigned int nBatch, unsigned int nCount);
+
+	// Pop a batch from the depot, 0 if it is empty
+	unsigned int PopBatch();
+
+	// Take a free node, 0 if the pool is exhausted
+	unsigned int AllocateNode();
+
+	// Give a node back
+	void FreeNode(unsigned int nIndex);
+
+	// Allocate one more chunk and put it in the depot
+	bool Grow();
+
+	// Move the free nodes of every idle thread cache to the depot
+	bool ReclaimCaches();
+
+	// Allocate a chunk and push its nodes to the depot (grow mutex held)
+	void AddChunk();
+
+public:
+	// Constructor
+	CObjectPool(unsigned int nMaxObjects = POOL_CHUNK_SIZE * POOL_MAX_CHUNKS);
+
+	// Destructor
+	~CObjectPool();
+
+public:
+	// Construct an object from the pool
+	template <class... Args>
+	CPooledPtr<T> Make(Args&&... args);
+
+	// Allocate up front so the first nObjects never need to grow the pool
+	bool Reserve(unsigned int nObjects);
+
+	// Get number of objects the pool has allocated, in use or free
+	unsigned int GetCapacity();
+};
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CPooledPtr<T>::operator=
+//
+// Usage:
+//	- To move an object into this handle, releasing the one it held
+//
+// Prameters:
+//	- CPooledPtr&& other:	the handle to take the object from
+//
+// Returns:
+//	- CPooledPtr&: this handle
+//----------------------------------------------------------------------------------
+template <class T>
+CPooledPtr<T>& CPooledPtr<T>::operator=(CPooledPtr&& other)
+{
+	if (this != &other)
+	{
+		Reset();
+
+		m_pPool = other.m_pPool;
+		m_pNode = other.m_pNode;
+		other.m_pPool = NULL;
+		other.m_pNode = NULL;
+	}
+
+	return *this;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CPooledPtr<T>::Reset
+//
+// Usage:
+//	- To destroy the object and return its memory to the pool
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T>
+void CPooledPtr<T>::Reset()
+{
+	if (NULL == m_pNode)
+	{
+		return;
+	}
+
+	m_pNode->GetPayload()->~T();
+	m_pPool->FreeNode(m_pNode->m_nIndex);
+
+	m_pPool = NULL;
+	m_pNode = NULL;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CObjectPool<T>::CObjectPool
+//
+// Usage:
+//	- Class Constructor. Nothing is allocated until the first Make/Reserve.
+//
+// Prameters:
+//	- unsigned int nMaxObjects:	most objects the pool may allocate, rounded
+//								up to whole chunks (Make fails beyond that)
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T>
+CObjectPool<T>::CObjectPool(unsigned int nMaxObjects)
+{
+	m_nDepotTop.store(0, memory_order_relaxed);
+	m_nChunkCount = 0;
+
+	m_nMaxChunks = (nMaxObjects + POOL_CHUNK_SIZE - 1) / POOL_CHUNK_SIZE;
+	if (m_nMaxChunks > POOL_MAX_CHUNKS)
+	{
+		m_nMaxChunks = POOL_MAX_CHUNKS;
+	}
+
+	for (unsigned int i = 0; i < POOL_MAX_CHUNKS; i++)
+	{
+		m_pChunks[i].store(NULL, memory_order_relaxed);
+	}
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CObjectPool<T>::~CObjectPool
+//
+// Usage:
+//	- Class Destructor, frees every chunk. All CPooledPtr handles must have
+//	  been released.
+//
+// Prameters:
+//  - N/A
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T>
+CObjectPool<T>::~CObjectPool()
+{
+	for (unsigned int i = 0; i < m_nChunkCount; i++)
+	{
+		delete [] m_pChunks[i].load(memory_order_relaxed);
+	}
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CObjectPool<T>::GetNode
+//
+// Usage:
+//	- To find a node by its index + 1
+//
+// Prameters:
+//	- unsigned int nIndex:	node index + 1, not 0
+//
+// Returns:
+//	- CPoolNode<T>*: the node
+//----------------------------------------------------------------------------------
+template <class T>
+CPoolNode<T>* CObjectPool<T>::GetNode(unsigned int nIndex)
+{
+	nIndex--;
+
+	return m_pChunks[nIndex / POOL_CHUNK_SIZE].load(memory_order_acquire) + nIndex % POOL_CHUNK_SIZE;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CObjectPool<T>::PushBatch
+//
+// Usage:
+//	- To put a batch of free nodes on the depot
+//
+// Prameters:
+//	- unsigned int nBatch:	first node of the batch (index + 1)
+//	- unsigned int nCount:	number of nodes in the batch
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T>
+void CObjectPool<T>::PushBatch(unsigned int nBatch, unsigned int nCount)
+{
+	CPoolNode<T>* pNode = GetNode(nBatch);
+	pNode->m_nBatchCount = nCount;
+
+	unsigned long long nTop = m_nDepotTop.load(memory_order_relaxed);
+	unsigned long long nNewTop;
+
+	do
+	{
+		pNode->m_nNextBatch.store((unsigned int)nTop, memory_order_relaxed);
+		nNewTop = (((nTop >> 32) + 1) << 32) | nBatch;
+	}
+	while (!m_nDepotTop.compare_exchange_weak(nTop, nNewTop, memory_order_release, memory_order_relaxed));
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CObjectPool<T>::PopBatch
+//
+// Usage:
+//	- To take a batch of free nodes from the depot. The tag bump on every
+//	  change keeps a pop that read a stale next link from succeeding.
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- unsigned int: first node of the batch (index + 1), 0 if the depot is empty
+//----------------------------------------------------------------------------------
+template <class T>
+unsigned int CObjectPool<T>::PopBatch()
+{
+	unsigned long long nTop = m_nDepotTop.load(memory_order_acquire);
+	unsigned long long nNewTop;
+	unsigned int nBatch;
+
+	do
+	{
+		nBatch = (unsigned int)nTop;
+		if (0 == nBatch)
+		{
+			return 0;
+		}
+
+		unsigned int nNextBatch = GetNode(nBatch)->m_nNextBatch.load(memory_order_relaxed);
+		nNewTop = (((nTop >> 32) + 1) << 32) | nNextBatch;
+	}
+	while (!m_nDepotTop.compare_exchange_weak(nTop, nNewTop, memory_order_acquire, memory_order_acquire));
+
+	return nBatch;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CObjectPool<T>::AllocateNode
+//
+// Usage:
+//	- To take a free node: from the thread's cache, else a batch from the
+//	  depot, else a freshly grown chunk, else what other caches hold
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- unsigned int: node index + 1, 0 if the pool reached its maximum size
+//----------------------------------------------------------------------------------
+template <class T>
+unsigned int CObjectPool<T>::AllocateNode()
+{
+	CPoolCache& cache = m_Caches[QueueThreadIndex() & (POOL_CACHE_COUNT - 1)];
+
+	for (;;)
+	{
+		if (!cache.m_bBusy.exchange(true, memory_order_acquire))
+		{
+			// refill from the spare batch, then from the depot
+			if (0 == cache.m_nCurrentCount)
+			{
+				if (cache.m_nFullCount > 0)
+				{
+					cache.m_nCurrent = cache.m_nFull;
+					cache.m_nCurrentCount = cache.m_nFullCount;
+					cache.m_nFullCount = 0;
+				}
+				else
+				{
+					cache.m_nCurrent = PopBatch();
+					cache.m_nCurrentCount = (cache.m_nCurrent != 0) ? GetNode(cache.m_nCurrent)->m_nBatchCount : 0;
+				}
+			}
+
+			unsigned int nIndex = cache.m_nCurrent;
+			if (nIndex != 0)
+			{
+				cache.m_nCurrent = GetNode(nIndex)->m_nNext;
+				cache.m_nCurrentCount--;
+			}
+
+			cache.m_bBusy.store(false, memory_order_release);
+
+			if (nIndex != 0)
+			{
+				return nIndex;
+			}
+		}
+		else
+		{
+			// cache shared with a busy thread: take a batch from the depot
+			// and return all but one node to it
+			unsigned int nIndex = PopBatch();
+			if (nIndex != 0)
+			{
+				CPoolNode<T>* pNode = GetNode(nIndex);
+				if (pNode->m_nBatchCount > 1)
+				{
+					PushBatch(pNode->m_nNext, pNode->m_nBatchCount - 1);
+				}
+
+				return nIndex;
+			}
+		}
+
+		if (!Grow() && !ReclaimCaches())
+		{
+			return 0;
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CObjectPool<T>::FreeNode
+//
+// Usage:
+//	- To give a node back to the thread's cache. When the cache already
+//	  holds two full batches, the spare one goes to the depot.
+//
+// Prameters:
+//	- unsigned int nIndex:	node index + 1
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T>
+void CObjectPool<T>::FreeNode(unsigned int nIndex)
+{
+	CPoolCache& cache = m_Caches[QueueThreadIndex() & (POOL_CACHE_COUNT - 1)];
+
+	if (cache.m_bBusy.exchange(true, memory_order_acquire))
+	{
+		// cache shared with a busy thread: a batch of one
+		GetNode(nIndex)->m_nNext = 0;
+		PushBatch(nIndex, 1);
+		return;
+	}
+
+	if (POOL_BATCH_SIZE == cache.m_nCurrentCount)
+	{
+		if (cache.m_nFullCount > 0)
+		{
+			PushBatch(cache.m_nFull, cache.m_nFullCount);
+		}
+
+		cache.m_nFull = cache.m_nCurrent;
+		cache.m_nFullCount = cache.m_nCurrentCount;
+		cache.m_nCurrent = 0;
+		cache.m_nCurrentCount = 0;
+	}
+
+	GetNode(nIndex)->m_nNext = cache.m_nCurrent;
+	cache.m_nCurrent = nIndex;
+	cache.m_nCurrentCount++;
+
+	cache.m_bBusy.store(false, memory_order_release);
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CObjectPool<T>::Grow
+//
+// Usage:
+//	- To allocate another chunk and put its nodes on the depot in batches.
+//	  A thread that finds the depot refilled while it waited for the mutex
+//	  does not grow again.
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- bool: false if the pool reached its maximum size and the depot is empty
+//----------------------------------------------------------------------------------
+template <class T>
+bool CObjectPool<T>::Grow()
+{
+	// hold mutex
+	m_GrowMutex.Lock();
+
+	if ((unsigned int)m_nDepotTop.load(memory_order_acquire) != 0)
+	{
+		// release mutex
+		m_GrowMutex.Unlock();
+		return true;
+	}
+
+	bool bGrown = (m_nChunkCount < m_nMaxChunks);
+	if (bGrown)
+	{
+		AddChunk();
+	}
+
+	// release mutex
+	m_GrowMutex.Unlock();
+
+	return bGrown;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CObjectPool<T>::ReclaimCaches
+//
+// Usage:
+//	- To push the batches of every thread cache not in use right now to the
+//	  depot, once the pool reached its maximum size. A cache that is busy is
+//	  skipped; its thread is working on it and will spill or use it.
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- bool: true if any node was moved to the depot
+//----------------------------------------------------------------------------------
+template <class T>
+bool CObjectPool<T>::ReclaimCaches()
+{
+	bool bReclaimed = false;
+
+	for (unsigned int i = 0; i < POOL_CACHE_COUNT; i++)
+	{
+		CPoolCache& cache = m_Caches[i];
+
+		if (cache.m_bBusy.exchange(true, memory_order_acquire))
+		{
+			continue;
+		}
+
+		if (cache.m_nCurrentCount > 0)
+		{
+			PushBatch(cache.m_nCurrent, cache.m_nCurrentCount);
+			cache.m_nCurrent = 0;
+			cache.m_nCurrentCount = 0;
+			bReclaimed = true;
+		}
+
+		if (cache.m_nFullCount > 0)
+		{
+			PushBatch(cache.m_nFull, cache.m_nFullCount);
+			cache.m_nFull = 0;
+			cache.m_nFullCount = 0;
+			bReclaimed = true;
+		}
+
+		cache.m_bBusy.store(false, memory_order_release);
+	}
+
+	return bReclaimed;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CObjectPool<T>::AddChunk
+//
+// Usage:
+//	- To allocate the next chunk, publish it and push its nodes to the depot
+//	  in batches. The caller holds m_GrowMutex and checked m_nMaxChunks.
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T>
+void CObjectPool<T>::AddChunk()
+{
+	CPoolNode<T>* pChunk = new CPoolNode<T>[POOL_CHUNK_SIZE];
+	unsigned int nFirst = m_nChunkCount * POOL_CHUNK_SIZE + 1;
+
+	for (unsigned int i = 0; i < POOL_CHUNK_SIZE; i++)
+	{
+		pChunk[i].m_nIndex = nFirst + i;
+		pChunk[i].m_nNext = ((i + 1) % POOL_BATCH_SIZE != 0) ? nFirst + i + 1 : 0;
+		pChunk[i].m_nBatchCount = 0;
+		pChunk[i].m_nNextBatch.store(0, memory_order_relaxed);
+	}
+
+	// publish before any node index of the chunk can be seen
+	m_pChunks[m_nChunkCount].store(pChunk, memory_order_release);
+	m_nChunkCount++;
+
+	for (unsigned int i = 0; i < POOL_CHUNK_SIZE; i += POOL_BATCH_SIZE)
+	{
+		PushBatch(nFirst + i, POOL_BATCH_SIZE);
+	}
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CObjectPool<T>::Make
+//
+// Usage:
+//	- To construct an object in pooled memory
+//
+// Prameters:
+//	- Args&&... args:	constructor arguments of the object
+//
+// Returns:
+//	- CPooledPtr<T>: handle owning the object, empty if the pool is exhausted
+//----------------------------------------------------------------------------------
+template <class T>
+template <class... Args>
+CPooledPtr<T> CObjectPool<T>::Make(Args&&... args)
+{
+	unsigned int nIndex = AllocateNode();
+	if (0 == nIndex)
+	{
+		return CPooledPtr<T>();
+	}
+
+	CPoolNode<T>* pNode = GetNode(nIndex);
+
+	try
+	{
+		new (pNode->m_Storage) T(forward<Args>(args)...);
+	}
+	catch (...)
+	{
+		FreeNode(nIndex);
+		throw;
+	}
+
+	return CPooledPtr<T>(this, pNode);
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CObjectPool<T>::Reserve
+//
+// Usage:
+//	- To grow the pool to at least nObjects up front, e.g. before a run, so
+//	  warming up does not allocate on the message path
+//
+// Prameters:
+//	- unsigned int nObjects:	number of objects to have allocated
+//
+// Returns:
+//	- bool: false if that exceeds the pool's maximum size
+//----------------------------------------------------------------------------------
+template <class T>
+bool CObjectPool<T>::Reserve(unsigned int nObjects)
+{
+	// hold mutex
+	m_GrowMutex.Lock();
+
+	while (m_nChunkCount * POOL_CHUNK_SIZE < nObjects && m_nChunkCount < m_nMaxChunks)
+	{
+		AddChunk();
+	}
+
+	bool bReserved = (m_nChunkCount * POOL_CHUNK_SIZE >= nObjects);
+
+	// release mutex
+	m_GrowMutex.Unlock();
+
+	return bReserved;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CObjectPool<T>::GetCapacity
+//
+// Usage:
+//	- To get how many objects the pool has allocated so far
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- unsigned int: allocated objects, in use or free
+//----------------------------------------------------------------------------------
+template <class T>
+unsigned int CObjectPool<T>::GetCapacity()
+{
+	// hold mutex
+	m_GrowMutex.Lock();
+
+	unsigned int nCapacity = m_nChunkCount * POOL_CHUNK_SIZE;
+
+	// release mutex
+	m_GrowMutex.Unlock();
+
+	return nCapacity;
+}
+#endif /*_OBJECTPOOL*/
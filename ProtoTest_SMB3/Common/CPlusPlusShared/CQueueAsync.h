@@ -0,0 +1,418 @@
+#ifndef _QUEUEASYNC
+#define _QUEUEASYNC
+
+#pragma once
+
+//---------------------------------------------------------------------------------
+// Coroutine support for CMessageQueue
+//
+// Enabled automatically when the compiler implements C++20 coroutines
+// (MESSAGEQUEUE_COROUTINES is then defined). A coroutine that co_awaits
+// GetAsync/PutAsync on a full/empty queue is parked as a CQueueAsyncWait node
+// instead of blocking its thread. The thread that later frees a slot or adds a
+// message hands it over under the queue mutex, and once it has released the
+// mutex asks the waiter's CQueueExecutor to resume the coroutine.
+//
+// Timed waits are expired by one process-wide CQueueAsyncTimer thread. The
+// timer only touches the wait node, never the queue; a timed-out node stays
+// linked in the queue until the next waker or link operation discards it.
+// A wait that completes before its deadline is taken out of the timer right
+// away, so the timer only holds waits that are still pending.
+//---------------------------------------------------------------------------------
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#define MESSAGEQUEUE_COROUTINES
+#endif
+#endif
+
+#ifdef MESSAGEQUEUE_COROUTINES
+
+#include <coroutine>
+#include <memory>
+#include <map>
+#include <thread>
+#include <atomic>
+#include "CQueueSync.h"
+
+using namespace std;
+
+class CQueueAsyncWaitBase;
+
+// pending timeouts by deadline
+typedef multimap<QUEUE_TICKS, shared_ptr<CQueueAsyncWaitBase> > CQueueTimeoutMap;
+
+//------------------------------------------------------------
+// Queue Executor Interface
+//
+// Resumes coroutines woken by a queue. Resume is called after
+// the queue mutex is released, but still from inside the call
+// that woke the coroutine (possibly the timer thread), so it
+// should hand the coroutine to another thread or a run loop,
+// and must neither block nor drop it.
+//------------------------------------------------------------
+class CQueueExecutor
+{
+public:
+	virtual ~CQueueExecutor() { }
+
+	// Schedule a suspended coroutine to continue
+	virtual void Resume(coroutine_handle<> hCoroutine) = 0;
+};
+
+//------------------------------------------------------------
+// Async Wait Node Base
+//
+// Completion is decided exactly once under m_Mutex, either by
+// a queue operation (result true) or by the timer (false).
+//------------------------------------------------------------
+class CQueueAsyncWaitBase
+{
+private:
+	// not copyable
+	CQueueAsyncWaitBase(const CQueueAsyncWaitBase&);
+	CQueueAsyncWaitBase& operator=(const CQueueAsyncWaitBase&);
+
+public:
+	// guards completion
+	CQueueMutex m_Mutex;
+
+	// set once the wait is over, readable without the mutex
+	atomic<bool> m_bCompleted;
+
+	// outcome of the wait, valid once completed
+	bool m_bResult;
+
+	// the suspended coroutine
+	coroutine_handle<> m_hCoroutine;
+
+	// where the coroutine is resumed
+	CQueueExecutor* m_pExecutor;
+
+	// set when the wait is given a deadline, before it can complete
+	bool m_bTimed;
+
+	// whether m_itTimeout is in the timer's map (timer mutex)
+	bool m_bTimerLinked;
+
+	// entry of the wait in the timer's map
+	CQueueTimeoutMap::iterator m_itTimeout;
+
+public:
+	CQueueAsyncWaitBase(coroutine_handle<> hCoroutine, CQueueExecutor* pExecutor)
+		: m_bCompleted(false), m_bResult(false), m_hCoroutine(hCoroutine), m_pExecutor(pExecutor), m_bTimed(false), m_bTimerLinked(false) { }
+
+	virtual ~CQueueAsyncWaitBase() { }
+
+	// Complete the wait with a result; the caller holds m_Mutex
+	void Complete(bool bResult);
+
+	// Schedule the coroutine of a completed wait; no lock held
+	void Resume();
+};
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CQueueAsyncWaitBase::Complete
+//
+// Usage:
+//	- To finish the wait. m_Mutex must be held and the wait must not be
+//	  completed yet. Whoever completes the wait calls Resume once it has
+//	  released its locks.
+//
+// Prameters:
+//	- bool bResult:	what the co_await returns
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+inline void CQueueAsyncWaitBase::Complete(bool bResult)
+{
+	m_bResult = bResult;
+	m_bCompleted.store(true, memory_order_release);
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CQueueAsyncWaitBase::Resume
+//
+// Usage:
+//	- To hand the coroutine of a completed wait to its executor. Called
+//	  without any queue or timer lock held: the executor may need to take
+//	  them again, e.g. to run the coroutine on the calling thread.
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+inline void CQueueAsyncWaitBase::Resume()
+{
+	m_pExecutor->Resume(m_hCoroutine);
+}
+
+//------------------------------------------------------------
+// Async Wait Node
+//
+// Get: the waker moves the message into m_Msg.
+// Put: m_Msg holds the message until a slot frees up.
+//------------------------------------------------------------
+template <class T>
+class CQueueAsyncWait : public CQueueAsyncWaitBase
+{
+public:
+	// message being handed over
+	T m_Msg;
+
+public:
+	CQueueAsyncWait(coroutine_handle<> hCoroutine, CQueueExecutor* pExecutor)
+		: CQueueAsyncWaitBase(hCoroutine, pExecutor), m_Msg() { }
+
+	template <class U>
+	CQueueAsyncWait(coroutine_handle<> hCoroutine, CQueueExecutor* pExecutor, U&& msg)
+		: CQueueAsyncWaitBase(hCoroutine, pExecutor), m_Msg(forward<U>(msg)) { }
+};
+
+//------------------------------------------------------------
+// Async Timer Class
+//
+// One thread for the whole process expiring timed waits.
+//------------------------------------------------------------
+class CQueueAsyncTimer
+{
+private:
+	// pending timeouts by deadline
+	CQueueTimeoutMap m_mapTimeouts;
+
+	// guards m_mapTimeouts and m_bStopping
+	CQueueMutex m_TimerMutex;
+
+	// signalled when an earlier deadline is added or the timer stops
+	CQueueCondition m_TimerCondition;
+
+	// set when the process is shutting down
+	bool m_bStopping;
+
+	// timer thread
+	thread m_Thread;
+
+private:
+	// not copyable
+	CQueueAsyncTimer(const CQueueAsyncTimer&);
+	CQueueAsyncTimer& operator=(const CQueueAsyncTimer&);
+
+	// Constructor (use GetInstance)
+	CQueueAsyncTimer();
+
+	// Timer thread body
+	void TimerLoop();
+
+public:
+	// Destructor
+	~CQueueAsyncTimer();
+
+	// Get the process-wide timer
+	static CQueueAsyncTimer& GetInstance();
+
+	// Expire a wait at a deadline unless it completes first
+	void Add(QUEUE_TICKS nDeadline, const shared_ptr<CQueueAsyncWaitBase>& pWait);
+
+	// Forget the deadline of a wait that completed before it
+	void Remove(const shared_ptr<CQueueAsyncWaitBase>& pWait);
+};
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CQueueAsyncTimer::CQueueAsyncTimer
+//
+// Usage:
+//	- Class Constructor, starts the timer thread
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+inline CQueueAsyncTimer::CQueueAsyncTimer()
+{
+	m_bStopping = false;
+	m_Thread = thread(&CQueueAsyncTimer::TimerLoop, this);
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CQueueAsyncTimer::~CQueueAsyncTimer
+//
+// Usage:
+//	- Class Destructor, stops the timer thread. Pending waits are dropped.
+//
+// Prameters:
+//  - N/A
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+inline CQueueAsyncTimer::~CQueueAsyncTimer()
+{
+	// hold mutex
+	m_TimerMutex.Lock();
+
+	m_bStopping = true;
+	m_TimerCondition.NotifyOne();
+
+	// release mutex
+	m_TimerMutex.Unlock();
+
+	m_Thread.join();
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CQueueAsyncTimer::GetInstance
+//
+// Usage:
+//	- To get the process-wide timer, created on first use
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- CQueueAsyncTimer&: the timer
+//----------------------------------------------------------------------------------
+inline CQueueAsyncTimer& CQueueAsyncTimer::GetInstance()
+{
+	static CQueueAsyncTimer s_Timer;
+
+	return s_Timer;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CQueueAsyncTimer::Add
+//
+// Usage:
+//	- To complete a wait with false at a deadline, if nothing completes it first
+//
+// Prameters:
+//	- QUEUE_TICKS nDeadline:						absolute deadline
+//	- const shared_ptr<CQueueAsyncWaitBase>& pWait:	the wait
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+inline void CQueueAsyncTimer::Add(QUEUE_TICKS nDeadline, const shared_ptr<CQueueAsyncWaitBase>& pWait)
+{
+	// hold mutex
+	m_TimerMutex.Lock();
+
+	// only an earlier deadline changes how long the timer thread sleeps
+	bool bEarliest = m_mapTimeouts.empty() || nDeadline < m_mapTimeouts.begin()->first;
+	pWait->m_itTimeout = m_mapTimeouts.insert(make_pair(nDeadline, pWait));
+	pWait->m_bTimerLinked = true;
+	pWait->m_bTimed = true;
+
+	if (bEarliest)
+	{
+		m_TimerCondition.NotifyOne();
+	}
+
+	// release mutex
+	m_TimerMutex.Unlock();
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CQueueAsyncTimer::Remove
+//
+// Usage:
+//	- To drop the entry of a wait that a queue operation completed, so busy
+//	  queues with long timeouts do not keep every finished wait alive until
+//	  its deadline. Must not be called with the wait's m_Mutex held, the
+//	  timer thread takes that mutex under the timer mutex.
+//
+// Prameters:
+//	- const shared_ptr<CQueueAsyncWaitBase>& pWait:	the completed wait
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+inline void CQueueAsyncTimer::Remove(const shared_ptr<CQueueAsyncWaitBase>& pWait)
+{
+	// hold mutex
+	m_TimerMutex.Lock();
+
+	// the timer thread may have taken it out already
+	if (pWait->m_bTimerLinked)
+	{
+		m_mapTimeouts.erase(pWait->m_itTimeout);
+		pWait->m_bTimerLinked = false;
+	}
+
+	// release mutex
+	m_TimerMutex.Unlock();
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CQueueAsyncTimer::TimerLoop
+//
+// Usage:
+//	- Timer thread body: sleep until the earliest deadline and expire every
+//	  wait that is due and still pending
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+inline void CQueueAsyncTimer::TimerLoop()
+{
+	// hold mutex
+	m_TimerMutex.Lock();
+
+	while (!m_bStopping)
+	{
+		if (m_mapTimeouts.empty())
+		{
+			m_TimerCondition.WaitUntil(m_TimerMutex, QUEUE_TICKS_INFINITE);
+			continue;
+		}
+
+		QUEUE_TICKS nDeadline = m_mapTimeouts.begin()->first;
+		if (QueueGetTicks() < nDeadline)
+		{
+			m_TimerCondition.WaitUntil(m_TimerMutex, nDeadline);
+			continue;
+		}
+
+		shared_ptr<CQueueAsyncWaitBase> pWait = m_mapTimeouts.begin()->second;
+		m_mapTimeouts.erase(m_mapTimeouts.begin());
+		pWait->m_bTimerLinked = false;
+
+		bool bExpired = false;
+		pWait->m_Mutex.Lock();
+		if (!pWait->m_bCompleted.load(memory_order_relaxed))
+		{
+			pWait->Complete(false);
+			bExpired = true;
+		}
+		pWait->m_Mutex.Unlock();
+
+		// the coroutine may add a timed wait right away
+		if (bExpired)
+		{
+			m_TimerMutex.Unlock();
+			pWait->Resume();
+			m_TimerMutex.Lock();
+		}
+	}
+
+	// release mutex
+	m_TimerMutex.Unlock();
+}
+
+#endif /*MESSAGEQUEUE_COROUTINES*/
+#endif /*_QUEUEASYNC*/
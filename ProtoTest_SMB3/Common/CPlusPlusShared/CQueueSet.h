@@ -0,0 +1,583 @@
+#ifndef _QUEUESET
+#define _QUEUESET
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include "CQueueSync.h"
+
+using namespace std;
+
+//---------------------------------------------------------------------------------
+// Queue Set Class
+//
+// Lets one thread block until any of many CMessageQueue instances has messages,
+// instead of polling each queue with a short timeout (compare epoll).
+//
+// A member queue reports itself to the set when a put makes it readable while
+// it is not already on the set's ready list, so a busy queue costs one atomic
+// load per put and no lock. Wait hands back the context of every ready queue,
+// up to a limit, in one call. Readiness is level-triggered: a queue that still
+// has messages after Wait is moved to the back of the ready list and reported
+// again by the next Wait, so one busy connection cannot starve the others.
+// Queues that were drained in the meantime are dropped silently. A closed
+// queue stays ready until it is removed, so its Get can report QUEUE_CLOSED.
+//
+// Locks are always taken in the order set wait mutex, queue mutex, set ready
+// mutex, so a queue can report itself while holding its own mutex.
+//
+// A queue leaves its set when it is destroyed. The set must not be destroyed
+// while its member queues are still being used.
+//---------------------------------------------------------------------------------
+class CQueueSet;
+
+//---------------------
+// Queue Set Member
+//---------------------
+struct CQueueSetEntry
+{
+	// owning set, never changes
+	CQueueSet* m_pSet;
+
+	// member queue and its readiness test (set wait mutex)
+	void* m_pQueue;
+	bool (*m_pfnIsReadable)(void* pQueue);
+
+	// what Wait returns for this queue (set wait mutex)
+	void* m_pContext;
+
+	// link from the queue back to this entry, cleared on removal (set wait mutex)
+	atomic<CQueueSetEntry*>* m_ppQueueLink;
+
+	// whether the entry belongs to a queue (set wait mutex)
+	bool m_bActive;
+
+	// whether the entry is on the ready list, set by whoever links it
+	atomic<bool> m_bListed;
+
+	// next entry on the ready list (set ready mutex)
+	CQueueSetEntry* m_pNextReady;
+
+	// next unused entry (set wait mutex)
+	CQueueSetEntry* m_pNextFree;
+
+	CQueueSetEntry(CQueueSet* pSet)
+		: m_pSet(pSet), m_pQueue(NULL), m_pfnIsReadable(NULL), m_pContext(NULL), m_ppQueueLink(NULL),
+		  m_bActive(false), m_bListed(false), m_pNextReady(NULL), m_pNextFree(NULL) { }
+};
+
+class CQueueSet
+{
+	template <class T, class TQueuePolicy> friend class CMessageQueue;
+
+private:
+	// serializes Wait scans against Add/Remove
+	CQueueMutex m_WaitMutex;
+
+	// guards the ready list and m_nWaiters
+	CQueueMutex m_ReadyMutex;
+
+	// signalled when the ready list becomes non-empty
+	CQueueCondition m_ReadyCondition;
+
+	// ready list, in the order queues became ready
+	CQueueSetEntry* m_pReadyHead;
+	CQueueSetEntry* m_pReadyTail;
+
+	// number of threads blocked in Wait
+	unsigned int m_nWaiters;
+
+	// every entry ever allocated, freed with the set (set wait mutex)
+	vector<CQueueSetEntry*> m_vEntries;
+
+	// entries of removed queues, reused by Add (set wait mutex)
+	CQueueSetEntry* m_pFreeEntries;
+
+	// number of member queues (set wait mutex)
+	unsigned int m_nCount;
+
+private:
+	// not copyable
+	CQueueSet(const CQueueSet&);
+	CQueueSet& operator=(const CQueueSet&);
+
+	// Readiness test for one queue type
+	template <class TQueue>
+	static bool IsQueueReadable(void* pQueue);
+
+	// Put an entry on the ready list unless it is already there
+	void SignalReady(CQueueSetEntry* pEntry);
+
+	// Detach an entry from its queue (wait mutex held)
+	void RemoveEntry(CQueueSetEntry* pEntry);
+
+	// Report ready queues from the ready list without blocking
+	unsigned int Scan(vector<void*>& vReady, unsigned int nMaxReady);
+
+public:
+	// Constructor
+	CQueueSet();
+
+	// Destructor
+	~CQueueSet();
+
+public:
+	// Add a queue; Wait reports pContext (the queue itself if NULL)
+	template <class TQueue>
+	bool Add(TQueue& queue, void* pContext = NULL);
+
+	// Remove a queue
+	template <class TQueue>
+	bool Remove(TQueue& queue);
+
+	// Wait until at least one queue is ready and append up to nMaxReady contexts
+	unsigned int Wait(vector<void*>& vReady, unsigned int nMaxReady, unsigned int nTimeoutMilliseconds);
+
+	// Get number of member queues
+	unsigned int GetCount();
+};
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CQueueSet::CQueueSet
+//
+// Usage:
+//	- Class Constructor
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+inline CQueueSet::CQueueSet()
+{
+	m_pReadyHead = NULL;
+	m_pReadyTail = NULL;
+	m_nWaiters = 0;
+	m_pFreeEntries = NULL;
+	m_nCount = 0;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CQueueSet::~CQueueSet
+//
+// Usage:
+//	- Class Destructor, detaches the remaining queues. No thread may be putting
+//	  into a member queue or waiting on the set any more.
+//
+// Prameters:
+//  - N/A
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+inline CQueueSet::~CQueueSet()
+{
+	for (size_t i = 0; i < m_vEntries.size(); i++)
+	{
+		if (m_vEntries[i]->m_bActive)
+		{
+			RemoveEntry(m_vEntries[i]);
+		}
+
+		delete m_vEntries[i];
+	}
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CQueueSet::IsQueueReadable
+//
+// Usage:
+//	- To test whether a Get on a member queue would return right away
+//
+// Prameters:
+//	- void* pQueue:	the queue, a TQueue
+//
+// Returns:
+//	- bool: true if the queue is not empty or is closed
+//----------------------------------------------------------------------------------
+template <class TQueue>
+bool CQueueSet::IsQueueReadable(void* pQueue)
+{
+	TQueue* pTypedQueue = static_cast<TQueue*>(pQueue);
+
+	return pTypedQueue->GetSize() > 0 || pTypedQueue->IsClosed();
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CQueueSet::Add
+//
+// Usage:
+//	- To add a queue to the set. A queue that already has messages is ready
+//	  right away. A queue can belong to one set at a time.
+//
+// Prameters:
+//	- TQueue& queue:	the queue (a CMessageQueue)
+//	- void* pContext:	what Wait reports for the queue, NULL for &queue
+//
+// Returns:
+//	- bool: false if the queue already belongs to a set
+//----------------------------------------------------------------------------------
+template <class TQueue>
+bool CQueueSet::Add(TQueue& queue, void* pContext)
+{
+	// hold mutex
+	m_WaitMutex.Lock();
+
+	if (queue.m_pSetEntry.load(memory_order_acquire) != NULL)
+	{
+		// release mutex
+		m_WaitMutex.Unlock();
+		return false;
+	}
+
+	CQueueSetEntry* pEntry = m_pFreeEntries;
+	if (pEntry != NULL)
+	{
+		m_pFreeEntries = pEntry->m_pNextFree;
+	}
+	else
+	{
+		pEntry = new CQueueSetEntry(this);
+		m_vEntries.push_back(pEntry);
+	}
+
+	// a reused entry may still sit on the ready list; the next Scan tests
+	// it against the new queue, which at worst is a spurious report
+	pEntry->m_pQueue = &queue;
+	pEntry->m_pfnIsReadable = &CQueueSet::IsQueueReadable<TQueue>;
+	pEntry->m_pContext = (pContext != NULL) ? pContext : &queue;
+	pEntry->m_ppQueueLink = &queue.m_pSetEntry;
+	pEntry->m_bActive = true;
+	m_nCount++;
+
+	// publish the entry before testing, so a put racing with us is reported
+	// either by itself or by the test below
+	queue.m_pSetEntry.store(pEntry, memory_order_seq_cst);
+	if (pEntry->m_pfnIsReadable(pEntry->m_pQueue))
+	{
+		SignalReady(pEntry);
+	}
+
+	// release mutex
+	m_WaitMutex.Unlock();
+
+	return true;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CQueueSet::Remove
+//
+// Usage:
+//	- To take a queue out of the set. Once this returns, Wait no longer
+//	  touches the queue and it may be destroyed.
+//
+// Prameters:
+//	- TQueue& queue:	the queue (a CMessageQueue)
+//
+// Returns:
+//	- bool: false if the queue does not belong to this set
+//----------------------------------------------------------------------------------
+template <class TQueue>
+bool CQueueSet::Remove(TQueue& queue)
+{
+	// hold mutex
+	m_WaitMutex.Lock();
+
+	CQueueSetEntry* pEntry = queue.m_pSetEntry.load(memory_order_acquire);
+	bool bMember = (pEntry != NULL && pEntry->m_pSet == this);
+
+	if (bMember)
+	{
+		RemoveEntry(pEntry);
+	}
+
+	// release mutex
+	m_WaitMutex.Unlock();
+
+	return bMember;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CQueueSet::RemoveEntry
+//
+// Usage:
+//	- To detach an entry from its queue and make it reusable. The entry may
+//	  stay on the ready list; Scan drops it once it sees it inactive. A put
+//	  that loaded the entry just before the detach can still link it, which
+//	  is equally harmless. Caller holds m_WaitMutex.
+//
+// Prameters:
+//	- CQueueSetEntry* pEntry:	the entry
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+inline void CQueueSet::RemoveEntry(CQueueSetEntry* pEntry)
+{
+	pEntry->m_ppQueueLink->store(NULL, memory_order_release);
+
+	pEntry->m_pQueue = NULL;
+	pEntry->m_pfnIsReadable = NULL;
+	pEntry->m_pContext = NULL;
+	pEntry->m_ppQueueLink = NULL;
+	pEntry->m_bActive = false;
+	m_nCount--;
+
+	pEntry->m_pNextFree = m_pFreeEntries;
+	m_pFreeEntries = pEntry;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CQueueSet::SignalReady
+//
+// Usage:
+//	- Called by a member queue after a put. Links the queue's entry to the
+//	  ready list and wakes a waiter, unless the entry is already listed.
+//
+// Prameters:
+//	- CQueueSetEntry* pEntry:	the queue's entry
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+inline void CQueueSet::SignalReady(CQueueSetEntry* pEntry)
+{
+	// order the put before reading the flag (pairs with the fence in Scan
+	// between clearing the flag and testing the queue again)
+	atomic_thread_fence(memory_order_seq_cst);
+
+	if (pEntry->m_bListed.load(memory_order_relaxed) || pEntry->m_bListed.exchange(true, memory_order_acq_rel))
+	{
+		return;
+	}
+
+	// hold mutex
+	m_ReadyMutex.Lock();
+
+	pEntry->m_pNextReady = NULL;
+	if (NULL == m_pReadyTail)
+	{
+		m_pReadyHead = pEntry;
+	}
+	else
+	{
+		m_pReadyTail->m_pNextReady = pEntry;
+	}
+	m_pReadyTail = pEntry;
+
+	if (m_nWaiters > 0)
+	{
+		m_ReadyCondition.NotifyOne();
+	}
+
+	// release mutex
+	m_ReadyMutex.Unlock();
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CQueueSet::Scan
+//
+// Usage:
+//	- To walk the ready list from the front and report queues that still have
+//	  messages, up to nMaxReady of them. Reported queues move to the back of
+//	  the list, empty ones leave it, entries not reached keep their place.
+//
+// Prameters:
+//	- vector<void*>& vReady:	receives the contexts of ready queues
+//	- unsigned int nMaxReady:	most queues to report
+//
+// Returns:
+//	- unsigned int: number of queues reported
+//----------------------------------------------------------------------------------
+inline unsigned int CQueueSet::Scan(vector<void*>& vReady, unsigned int nMaxReady)
+{
+	// hold mutex
+	m_WaitMutex.Lock();
+
+	// take the whole ready list, so puts are not held up while we test queues
+	m_ReadyMutex.Lock();
+	CQueueSetEntry* pPending = m_pReadyHead;
+	CQueueSetEntry* pPendingTail = m_pReadyTail;
+	m_pReadyHead = NULL;
+	m_pReadyTail = NULL;
+	m_ReadyMutex.Unlock();
+
+	// reported entries, to go back on the list behind everything else
+	CQueueSetEntry* pReportedHead = NULL;
+	CQueueSetEntry* pReportedTail = NULL;
+	unsigned int nFound = 0;
+
+	while (pPending != NULL && nFound < nMaxReady)
+	{
+		CQueueSetEntry* pEntry = pPending;
+		pPending = pEntry->m_pNextReady;
+		pEntry->m_pNextReady = NULL;
+
+		if (!pEntry->m_bActive || !pEntry->m_pfnIsReadable(pEntry->m_pQueue))
+		{
+			// unlist, then test again: a put that saw the entry listed
+			// before we cleared the flag did not link it
+			pEntry->m_bListed.store(false, memory_order_release);
+			atomic_thread_fence(memory_order_seq_cst);
+
+			if (!pEntry->m_bActive || !pEntry->m_pfnIsReadable(pEntry->m_pQueue))
+			{
+				continue;
+			}
+
+			// a put linked the entry again after all
+			if (pEntry->m_bListed.exchange(true, memory_order_acq_rel))
+			{
+				continue;
+			}
+		}
+
+		vReady.push_back(pEntry->m_pContext);
+		nFound++;
+
+		if (NULL == pReportedTail)
+		{
+			pReportedHead = pEntry;
+		}
+		else
+		{
+			pReportedTail->m_pNextReady = pEntry;
+		}
+		pReportedTail = pEntry;
+	}
+
+	if (NULL == pPending)
+	{
+		pPendingTail = NULL;
+	}
+
+	// entries not reached, then entries linked meanwhile, then reported ones
+	m_ReadyMutex.Lock();
+
+	if (pPending != NULL)
+	{
+		pPendingTail->m_pNextReady = m_pReadyHead;
+		if (NULL == m_pReadyHead)
+		{
+			m_pReadyTail = pPendingTail;
+		}
+		m_pReadyHead = pPending;
+	}
+
+	if (pReportedHead != NULL)
+	{
+		if (NULL == m_pReadyTail)
+		{
+			m_pReadyHead = pReportedHead;
+		}
+		else
+		{
+			m_pReadyTail->m_pNextReady = pReportedHead;
+		}
+		m_pReadyTail = pReportedTail;
+	}
+
+	m_ReadyMutex.Unlock();
+
+	// release mutex
+	m_WaitMutex.Unlock();
+
+	return nFound;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CQueueSet::Wait
+//
+// Usage:
+//	- To block until at least one member queue has messages and append the
+//	  contexts of the ready queues, up to nMaxReady, to vReady. Queues are
+//	  reported in the order they became ready. Getting from a reported queue
+//	  may still find it empty when several threads consume the same queue.
+//
+// Prameters:
+//	- vector<void*>& vReady:				receives the contexts of ready queues
+//	- unsigned int nMaxReady:				most queues to report
+//	- unsigned int nTimeoutMilliseconds:	how long to wait, 0 to poll, INFINITE for ever
+//
+// Returns:
+//	- unsigned int: number of queues reported (0 on timeout)
+//----------------------------------------------------------------------------------
+inline unsigned int CQueueSet::Wait(vector<void*>& vReady, unsigned int nMaxReady, unsigned int nTimeoutMilliseconds)
+{
+	if (0 == nMaxReady)
+	{
+		return 0;
+	}
+
+	QUEUE_TICKS nDeadline = QueueDeadline(nTimeoutMilliseconds);
+
+	for (;;)
+	{
+		bool bTimedOut = false;
+
+		// hold mutex
+		m_ReadyMutex.Lock();
+
+		m_nWaiters++;
+		while (NULL == m_pReadyHead && !bTimedOut)
+		{
+			bTimedOut = !m_ReadyCondition.WaitUntil(m_ReadyMutex, nDeadline);
+		}
+		m_nWaiters--;
+
+		bool bAnyListed = (m_pReadyHead != NULL);
+
+		// release mutex
+		m_ReadyMutex.Unlock();
+
+		if (!bAnyListed)
+		{
+			return 0;
+		}
+
+		// listed queues may have been drained since; keep waiting if so
+		unsigned int nFound = Scan(vReady, nMaxReady);
+		if (nFound > 0 || QueueGetTicks() >= nDeadline)
+		{
+			return nFound;
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CQueueSet::GetCount
+//
+// Usage:
+//	- To get the number of member queues
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- unsigned int: the number of queues in the set
+//----------------------------------------------------------------------------------
+inline unsigned int CQueueSet::GetCount()
+{
+	// hold mutex
+	m_WaitMutex.Lock();
+
+	unsigned int nCount = m_nCount;
+
+	// release mutex
+	m_WaitMutex.Unlock();
+
+	return nCount;
+}
+#endif /*_QUEUESET*/
@@ -0,0 +1,221 @@
+#ifndef _QUEUESPIN
+#define _QUEUESPIN
+
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include "CQueueSync.h"
+
+using namespace std;
+
+//---------------------------------------------------------------------------------
+// Adaptive waiting for CMessageQueue
+//
+// Blocking on an empty or full queue costs a kernel round trip on each side,
+// which is far longer than the gap between messages on a busy queue. With
+// WAIT_ADAPTIVE a waiter first spins with a pause instruction, then yields,
+// and only then blocks. How long it spins follows a moving average of how
+// long recent waits on the same queue lasted, i.e. the observed inter-arrival
+// gap: about twice the average gap, and no spinning beyond a short probe once
+// gaps are longer than spinning could cover. On a single CPU the other side
+// cannot make progress while we spin, and a yielding waiter misses the wakeup
+// boost a blocked one gets, so WAIT_ADAPTIVE behaves like WAIT_BLOCK there.
+// Tests/QueueSpinLatency.cpp compares the p50/p99 handoff latency of the two.
+//---------------------------------------------------------------------------------
+
+// how a queue waits when it cannot complete a Get/Put right away
+enum QUEUE_WAIT_STRATEGY
+{
+	WAIT_BLOCK,			// block in the kernel right away (default)
+	WAIT_ADAPTIVE		// spin, then yield, then block, tuned from recent waits
+};
+
+// longest part of a wait spent spinning, in nanoseconds
+const unsigned long long QUEUE_SPIN_MAX_NS = 20000;
+
+// longest spin plus yield before blocking, in nanoseconds
+const unsigned long long QUEUE_YIELD_MAX_NS = 100000;
+
+// spin kept up on queues with long gaps, to notice when they speed up again
+const unsigned long long QUEUE_SPIN_PROBE_NS = 1000;
+
+// most pause instructions between two looks at the queue
+const unsigned int QUEUE_SPIN_MAX_PAUSES = 64;
+
+// a new gap weighs 1/8 in the moving average
+const unsigned int QUEUE_SPIN_AVERAGE_SHIFT = 3;
+
+//------------------------------------------------------------
+// Spin Tuner Class
+//
+// One per queue and direction. Waiters update the average
+// without synchronizing with each other; a lost update only
+// makes the estimate a little less smooth.
+//------------------------------------------------------------
+class CQueueSpinTuner
+{
+private:
+	// moving average of wait durations, in nanoseconds
+	atomic<unsigned long long> m_nAverageGapNs;
+
+private:
+	// not copyable
+	CQueueSpinTuner(const CQueueSpinTuner&);
+	CQueueSpinTuner& operator=(const CQueueSpinTuner&);
+
+public:
+	// Constructor
+	CQueueSpinTuner();
+
+public:
+	// Spin and yield while tryFunc fails, up to the current budget
+	template <class TTryFunc>
+	bool Spin(TTryFunc tryFunc, unsigned long long& nStartNs);
+
+	// Record a wait that started at nStartNs and ends now
+	void Record(unsigned long long nStartNs);
+
+	// Get the current average gap, in nanoseconds
+	unsigned long long GetAverageGap();
+};
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CQueueSpinTuner::CQueueSpinTuner
+//
+// Usage:
+//	- Class Constructor. Starts from a gap that allows a moderate spin, the
+//	  first few waits then pull the average to what the queue really sees.
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+inline CQueueSpinTuner::CQueueSpinTuner()
+{
+	m_nAverageGapNs.store(QUEUE_SPIN_MAX_NS / 2, memory_order_relaxed);
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CQueueSpinTuner::Spin
+//
+// Usage:
+//	- To retry an operation without blocking: pausing for the first part of
+//	  the budget, with the pause count doubling between attempts so the
+//	  queue's cache lines are not hammered, then yielding for the rest.
+//	  A successful spin records its own duration; after a failed one the
+//	  caller blocks and calls Record once the wait is over.
+//
+// Prameters:
+//	- TTryFunc tryFunc:				returns true once the operation succeeded
+//	- unsigned long long& nStartNs:	receives the start time of the wait
+//
+// Returns:
+//	- bool: true if tryFunc succeeded, false if the budget ran out
+//----------------------------------------------------------------------------------
+template <class TTryFunc>
+bool CQueueSpinTuner::Spin(TTryFunc tryFunc, unsigned long long& nStartNs)
+{
+	nStartNs = QueueGetNanoseconds();
+
+	// cover about twice the usual gap, or just probe if that is too long
+	unsigned long long nBudget = 2 * m_nAverageGapNs.load(memory_order_relaxed);
+	if (nBudget > QUEUE_YIELD_MAX_NS || nBudget < QUEUE_SPIN_PROBE_NS)
+	{
+		nBudget = QUEUE_SPIN_PROBE_NS;
+	}
+	unsigned long long nSpinBudget = (nBudget < QUEUE_SPIN_MAX_NS) ? nBudget : QUEUE_SPIN_MAX_NS;
+
+	// nobody else can run while we wait on a uniprocessor: block right away
+	static const bool s_bUniprocessor = (thread::hardware_concurrency() == 1);
+	if (s_bUniprocessor)
+	{
+		return false;
+	}
+
+	unsigned int nPauses = 1;
+	for (;;)
+	{
+		if (tryFunc())
+		{
+			Record(nStartNs);
+			return true;
+		}
+
+		unsigned long long nElapsed = QueueGetNanoseconds() - nStartNs;
+		if (nElapsed >= nBudget)
+		{
+			return false;
+		}
+
+		if (nElapsed < nSpinBudget)
+		{
+			for (unsigned int i = 0; i < nPauses; i++)
+			{
+				QueuePause();
+			}
+
+			if (nPauses < QUEUE_SPIN_MAX_PAUSES)
+			{
+				nPauses <<= 1;
+			}
+		}
+		else
+		{
+			QueueYield();
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CQueueSpinTuner::Record
+//
+// Usage:
+//	- To fold the duration of a finished wait into the average. Long waits
+//	  are clipped, so one timeout cannot keep a queue from spinning for long
+//	  once messages flow fast again.
+//
+// Prameters:
+//	- unsigned long long nStartNs:	start time of the wait (from Spin)
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+inline void CQueueSpinTuner::Record(unsigned long long nStartNs)
+{
+	long long nGap = (long long)(QueueGetNanoseconds() - nStartNs);
+
+	if (nGap > (long long)(2 * QUEUE_YIELD_MAX_NS))
+	{
+		nGap = (long long)(2 * QUEUE_YIELD_MAX_NS);
+	}
+
+	long long nAverage = (long long)m_nAverageGapNs.load(memory_order_relaxed);
+	nAverage += (nGap - nAverage) / (1 << QUEUE_SPIN_AVERAGE_SHIFT);
+
+	m_nAverageGapNs.store((unsigned long long)nAverage, memory_order_relaxed);
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CQueueSpinTuner::GetAverageGap
+//
+// Usage:
+//	- To read the moving average that sizes the spin budget
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- unsigned long long: average wait duration in nanoseconds
+//----------------------------------------------------------------------------------
+inline unsigned long long CQueueSpinTuner::GetAverageGap()
+{
+	return m_nAverageGapNs.load(memory_order_relaxed);
+}
+#endif /*_QUEUESPIN*/
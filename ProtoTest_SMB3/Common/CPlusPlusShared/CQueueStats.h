@@ -0,0 +1,454 @@
+#ifndef _QUEUESTATS
+#define _QUEUESTATS
+
+#pragma once
+
+//---------------------------------------------------------------------------------
+// Queue instrumentation
+//
+// Compiled in only when MESSAGEQUEUE_STATS is defined; otherwise QUEUE_STATS()
+// expands to nothing and CMessageQueue carries no counters at all.
+//
+// Counters are spread over QUEUE_STATS_SHARDS cache-line padded shards and each
+// thread always updates the same shard with relaxed atomics, so instrumented
+// threads do not contend with each other. A snapshot sums the shards; it is
+// not atomic across counters, but every counter in it is exact.
+//
+// Enqueue-to-dequeue latency is kept as a log2 histogram in microseconds:
+// bucket 0 counts latencies under 1us, bucket i counts [2^(i-1), 2^i) us and
+// the last bucket also takes everything longer.
+//---------------------------------------------------------------------------------
+
+#include <atomic>
+#include <string>
+#include <cstdio>
+#include <utility>
+#include "CQueueSync.h"
+#include "CQueueStorage.h"
+
+using namespace std;
+
+#ifdef MESSAGEQUEUE_STATS
+#define QUEUE_STATS(...) __VA_ARGS__
+#else
+#define QUEUE_STATS(...)
+#endif /*MESSAGEQUEUE_STATS*/
+
+// number of counter shards per queue
+const unsigned int QUEUE_STATS_SHARDS = 16;
+
+// number of latency histogram buckets
+const unsigned int QUEUE_LATENCY_BUCKETS = 32;
+
+//---------------------------
+// Queue Statistics Snapshot
+//---------------------------
+struct CQueueStatsSnapshot
+{
+	// messages put into queue
+	unsigned long long m_nEnqueued;
+
+	// messages taken from queue
+	unsigned long long m_nDequeued;
+
+	// time spent blocked in Put/PutBatch, in microseconds
+	unsigned long long m_nPutBlockedMicros;
+
+	// time spent blocked in Get/GetBatch, in microseconds
+	unsigned long long m_nGetBlockedMicros;
+
+	// Put/PutBatch calls that gave up on a full queue
+	unsigned long long m_nPutTimeouts;
+
+	// Get/GetBatch calls that gave up on an empty queue
+	unsigned long long m_nGetTimeouts;
+
+	// deepest the queue has been
+	unsigned int m_nHighWater;
+
+	// log2 histogram of enqueue-to-dequeue latency
+	unsigned long long m_nLatency[QUEUE_LATENCY_BUCKETS];
+};
+
+//---------------------------
+// Queue Statistics Shard
+//---------------------------
+struct CQueueStatsShard
+{
+	atomic<unsigned long long> m_nEnqueued;
+	atomic<unsigned long long> m_nDequeued;
+	atomic<unsigned long long> m_nPutBlockedMicros;
+	atomic<unsigned long long> m_nGetBlockedMicros;
+	atomic<unsigned long long> m_nPutTimeouts;
+	atomic<unsigned long long> m_nGetTimeouts;
+	atomic<unsigned long long> m_nLatency[QUEUE_LATENCY_BUCKETS];
+
+	// keep the next shard off this shard's last cache line
+	char m_Pad[QUEUE_CACHE_LINE_SIZE];
+};
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- QueueStatsShardIndex
+//
+// Usage:
+//	- To get the shard the calling thread updates. Threads are assigned
+//	  shards round-robin on first use, so up to QUEUE_STATS_SHARDS threads
+//	  never share one.
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- unsigned int: shard index of the calling thread
+//----------------------------------------------------------------------------------
+inline unsigned int QueueStatsShardIndex()
+{
+	static atomic<unsigned int> s_nNextShard(0);
+	static thread_local unsigned int s_nShard = s_nNextShard.fetch_add(1, memory_order_relaxed) % QUEUE_STATS_SHARDS;
+
+	return s_nShard;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- QueueLatencyBucket
+//
+// Usage:
+//	- To map a latency to its histogram bucket
+//
+// Prameters:
+//	- unsigned long long nMicros:	latency in microseconds
+//
+// Returns:
+//	- unsigned int: bucket index, the bit length of nMicros capped to the last bucket
+//----------------------------------------------------------------------------------
+inline unsigned int QueueLatencyBucket(unsigned long long nMicros)
+{
+	unsigned int nBucket = 0;
+
+	while (0 != nMicros && nBucket < QUEUE_LATENCY_BUCKETS - 1)
+	{
+		nMicros >>= 1;
+		nBucket++;
+	}
+
+	return nBucket;
+}
+
+//------------------------------------------------------------
+// Stamped Message
+//
+// What the storage policy holds when latency is measured: the
+// message plus the time it was put. The tag keeps the stamping
+// constructor from competing with copy/move construction.
+//------------------------------------------------------------
+struct CQueueStampTag
+{
+};
+
+template <class T>
+struct CQueueStampedMessage
+{
+	// the message
+	T m_Msg;
+
+	// QueueGetMicroseconds() when the message was put
+	unsigned long long m_nStampMicros;
+
+	CQueueStampedMessage() : m_Msg(), m_nStampMicros(0) { }
+
+	template <class... Args>
+	CQueueStampedMessage(CQueueStampTag, Args&&... args)
+		: m_Msg(forward<Args>(args)...), m_nStampMicros(QueueGetMicroseconds()) { }
+};
+
+//---------------------------
+// Queue Statistics Class
+//---------------------------
+class CQueueStats
+{
+private:
+	// per-thread counter shards
+	CQueueStatsShard m_Shards[QUEUE_STATS_SHARDS];
+
+	// deepest the queue has been (written only when it grows)
+	atomic<unsigned int> m_nHighWater;
+
+private:
+	// not copyable
+	CQueueStats(const CQueueStats&);
+	CQueueStats& operator=(const CQueueStats&);
+
+	// Get the calling thread's shard
+	CQueueStatsShard& GetShard() { return m_Shards[QueueStatsShardIndex()]; }
+
+public:
+	// Constructor
+	CQueueStats();
+
+public:
+	// Record a message put, and the queue depth after it
+	void OnEnqueue(unsigned int nSize);
+
+	// Record a message taken and how long it was queued
+	void OnDequeue(unsigned long long nLatencyMicros);
+
+	// Record a blocked Put
+	void OnPutBlocked(unsigned long long nBlockedMicros, bool bTimedOut);
+
+	// Record a blocked Get
+	void OnGetBlocked(unsigned long long nBlockedMicros, bool bTimedOut);
+
+	// Sum the shards
+	void GetSnapshot(CQueueStatsSnapshot& snapshot);
+
+	// Format a snapshot as a JSON object
+	static string ToJson(const CQueueStatsSnapshot& snapshot, const char* pszName, unsigned int nSize, unsigned int nMaxSize);
+};
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CQueueStats::CQueueStats
+//
+// Usage:
+//	- Class Constructor, zeroes every counter
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+inline CQueueStats::CQueueStats()
+{
+	for (unsigned int i = 0; i < QUEUE_STATS_SHARDS; i++)
+	{
+		CQueueStatsShard& shard = m_Shards[i];
+
+		shard.m_nEnqueued.store(0, memory_order_relaxed);
+		shard.m_nDequeued.store(0, memory_order_relaxed);
+		shard.m_nPutBlockedMicros.store(0, memory_order_relaxed);
+		shard.m_nGetBlockedMicros.store(0, memory_order_relaxed);
+		shard.m_nPutTimeouts.store(0, memory_order_relaxed);
+		shard.m_nGetTimeouts.store(0, memory_order_relaxed);
+
+		for (unsigned int j = 0; j < QUEUE_LATENCY_BUCKETS; j++)
+		{
+			shard.m_nLatency[j].store(0, memory_order_relaxed);
+		}
+	}
+
+	m_nHighWater.store(0, memory_order_relaxed);
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CQueueStats::OnEnqueue
+//
+// Usage:
+//	- To count a message put and raise the high-water mark if needed
+//
+// Prameters:
+//	- unsigned int nSize:	queue depth right after the put
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+inline void CQueueStats::OnEnqueue(unsigned int nSize)
+{
+	GetShard().m_nEnqueued.fetch_add(1, memory_order_relaxed);
+
+	// the shared mark is only written when it actually grows
+	unsigned int nHighWater = m_nHighWater.load(memory_order_relaxed);
+	while (nSize > nHighWater && !m_nHighWater.compare_exchange_weak(nHighWater, nSize, memory_order_relaxed))
+	{
+	}
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CQueueStats::OnDequeue
+//
+// Usage:
+//	- To count a message taken and add its latency to the histogram
+//
+// Prameters:
+//	- unsigned long long nLatencyMicros:	time between its put and this get
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+inline void CQueueStats::OnDequeue(unsigned long long nLatencyMicros)
+{
+	CQueueStatsShard& shard = GetShard();
+
+	shard.m_nDequeued.fetch_add(1, memory_order_relaxed);
+	shard.m_nLatency[QueueLatencyBucket(nLatencyMicros)].fetch_add(1, memory_order_relaxed);
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CQueueStats::OnPutBlocked
+//
+// Usage:
+//	- To add the time a Put spent waiting for room
+//
+// Prameters:
+//	- unsigned long long nBlockedMicros:	time spent waiting
+//	- bool bTimedOut:						whether the Put gave up
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+inline void CQueueStats::OnPutBlocked(unsigned long long nBlockedMicros, bool bTimedOut)
+{
+	CQueueStatsShard& shard = GetShard();
+
+	shard.m_nPutBlockedMicros.fetch_add(nBlockedMicros, memory_order_relaxed);
+	if (bTimedOut)
+	{
+		shard.m_nPutTimeouts.fetch_add(1, memory_order_relaxed);
+	}
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CQueueStats::OnGetBlocked
+//
+// Usage:
+//	- To add the time a Get spent waiting for a message
+//
+// Prameters:
+//	- unsigned long long nBlockedMicros:	time spent waiting
+//	- bool bTimedOut:						whether the Get gave up
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+inline void CQueueStats::OnGetBlocked(unsigned long long nBlockedMicros, bool bTimedOut)
+{
+	CQueueStatsShard& shard = GetShard();
+
+	shard.m_nGetBlockedMicros.fetch_add(nBlockedMicros, memory_order_relaxed);
+	if (bTimedOut)
+	{
+		shard.m_nGetTimeouts.fetch_add(1, memory_order_relaxed);
+	}
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CQueueStats::GetSnapshot
+//
+// Usage:
+//	- To sum every shard into a snapshot, without stopping the queue
+//
+// Prameters:
+//	- CQueueStatsSnapshot& snapshot:	receives the totals
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+inline void CQueueStats::GetSnapshot(CQueueStatsSnapshot& snapshot)
+{
+	snapshot.m_nEnqueued = 0;
+	snapshot.m_nDequeued = 0;
+	snapshot.m_nPutBlockedMicros = 0;
+	snapshot.m_nGetBlockedMicros = 0;
+	snapshot.m_nPutTimeouts = 0;
+	snapshot.m_nGetTimeouts = 0;
+	snapshot.m_nHighWater = m_nHighWater.load(memory_order_relaxed);
+
+	for (unsigned int j = 0; j < QUEUE_LATENCY_BUCKETS; j++)
+	{
+		snapshot.m_nLatency[j] = 0;
+	}
+
+	for (unsigned int i = 0; i < QUEUE_STATS_SHARDS; i++)
+	{
+		CQueueStatsShard& shard = m_Shards[i];
+
+		snapshot.m_nEnqueued += shard.m_nEnqueued.load(memory_order_relaxed);
+		snapshot.m_nDequeued += shard.m_nDequeued.load(memory_order_relaxed);
+		snapshot.m_nPutBlockedMicros += shard.m_nPutBlockedMicros.load(memory_order_relaxed);
+		snapshot.m_nGetBlockedMicros += shard.m_nGetBlockedMicros.load(memory_order_relaxed);
+		snapshot.m_nPutTimeouts += shard.m_nPutTimeouts.load(memory_order_relaxed);
+		snapshot.m_nGetTimeouts += shard.m_nGetTimeouts.load(memory_order_relaxed);
+
+		for (unsigned int j = 0; j < QUEUE_LATENCY_BUCKETS; j++)
+		{
+			snapshot.m_nLatency[j] += shard.m_nLatency[j].load(memory_order_relaxed);
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CQueueStats::ToJson
+//
+// Usage:
+//	- To format a snapshot as one JSON object. The histogram is an array of
+//	  QUEUE_LATENCY_BUCKETS counts, see the bucket layout at the top of file.
+//
+// Prameters:
+//	- const CQueueStatsSnapshot& snapshot:	the counters to format
+//	- const char* pszName:					queue name, NULL to leave it out
+//	- unsigned int nSize:					current queue depth
+//	- unsigned int nMaxSize:				queue capacity
+//
+// Returns:
+//	- string: the JSON text
+//----------------------------------------------------------------------------------
+inline string CQueueStats::ToJson(const CQueueStatsSnapshot& snapshot, const char* pszName, unsigned int nSize, unsigned int nMaxSize)
+{
+	char szBuffer[64];
+	string strJson = "{";
+
+	if (NULL != pszName)
+	{
+		strJson += "\"name\":\"";
+		for (const char* p = pszName; '\0' != *p; p++)
+		{
+			if ('"' == *p || '\\' == *p)
+			{
+				strJson += '\\';
+			}
+			if ((unsigned char)*p >= 0x20)
+			{
+				strJson += *p;
+			}
+		}
+		strJson += "\",";
+	}
+
+	snprintf(szBuffer, sizeof(szBuffer), "\"size\":%u,", nSize);
+	strJson += szBuffer;
+	snprintf(szBuffer, sizeof(szBuffer), "\"max_size\":%u,", nMaxSize);
+	strJson += szBuffer;
+	snprintf(szBuffer, sizeof(szBuffer), "\"high_water\":%u,", snapshot.m_nHighWater);
+	strJson += szBuffer;
+	snprintf(szBuffer, sizeof(szBuffer), "\"enqueued\":%llu,", snapshot.m_nEnqueued);
+	strJson += szBuffer;
+	snprintf(szBuffer, sizeof(szBuffer), "\"dequeued\":%llu,", snapshot.m_nDequeued);
+	strJson += szBuffer;
+	snprintf(szBuffer, sizeof(szBuffer), "\"put_blocked_us\":%llu,", snapshot.m_nPutBlockedMicros);
+	strJson += szBuffer;
+	snprintf(szBuffer, sizeof(szBuffer), "\"get_blocked_us\":%llu,", snapshot.m_nGetBlockedMicros);
+	strJson += szBuffer;
+	snprintf(szBuffer, sizeof(szBuffer), "\"put_timeouts\":%llu,", snapshot.m_nPutTimeouts);
+	strJson += szBuffer;
+	snprintf(szBuffer, sizeof(szBuffer), "\"get_timeouts\":%llu,", snapshot.m_nGetTimeouts);
+	strJson += szBuffer;
+
+	strJson += "\"latency_us_log2\":[";
+	for (unsigned int j = 0; j < QUEUE_LATENCY_BUCKETS; j++)
+	{
+		snprintf(szBuffer, sizeof(szBuffer), (j > 0) ? ",%llu" : "%llu", snapshot.m_nLatency[j]);
+		strJson += szBuffer;
+	}
+	strJson += "]}";
+
+	return strJson;
+}
+#endif /*_QUEUESTATS*/
@@ -0,0 +1,975 @@
+#ifndef _QUEUESTORAGE
+#define _QUEUESTORAGE
+
+#pragma once
+
+#include <memory>
+#include <atomic>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+using namespace std;
+
+// assumed cache line size, used to keep producer and consumer indices apart
+const unsigned int QUEUE_CACHE_LINE_SIZE = 64;
+
+//---------------------------------------------------------------------------------
+// Storage policies for CMessageQueue<T, TQueuePolicy>
+//
+// A policy owns the queued messages and offers non-blocking TryEmplace/TryPop
+// (and their batch forms) bounded by nMaxSize. CMessageQueue adds the blocking
+// and timeout behaviour on top. Policies with LOCK_FREE set are called without
+// the queue mutex held.
+//
+// Messages are moved in and out, so move-only payloads are supported.
+// TryEmplace only touches its arguments when it succeeds, which lets callers
+// retry with the same rvalue after a failed attempt. rebind<U>::other names the
+// same policy for another message type (CMessageQueue uses it to store
+// timestamped messages when MESSAGEQUEUE_STATS is defined).
+//
+// Every policy allocates its slots once in the constructor; Put/Get never touch
+// the heap afterwards (beyond whatever T itself allocates).
+//
+// GetSize of every policy may be called without the queue mutex and then
+// returns a snapshot; adaptive waits spin on it so that they only take the
+// mutex once the queue can serve them.
+//---------------------------------------------------------------------------------
+
+//---------------------------------------------------------
+// Locked FIFO Policy
+//
+// Contiguous circular buffer of exactly nMaxSize slots.
+// TAllocator supplies the slot array, so a pool or arena
+// allocator can be plugged in; it is called only from the
+// constructor and destructor.
+//---------------------------------------------------------
+template <class T, class TAllocator = allocator<T> >
+class CLockedQueuePolicy
+{
+public:
+	typedef TAllocator allocator_type;
+
+private:
+	typedef allocator_traits<TAllocator> CAllocTraits;
+
+	// slot allocator
+	TAllocator m_Allocator;
+
+	// ring slots (raw storage, constructed on push and destroyed on pop)
+	T* m_pSlots;
+
+	// index of the oldest message
+	unsigned int m_nHead;
+
+	// number of queued messages (changed with the queue mutex held, read
+	// without it by GetSize)
+	atomic<unsigned int> m_nCount;
+
+	// maximum allowed queue size (also the ring capacity)
+	unsigned int m_nMaxSize;
+
+private:
+	// not copyable
+	CLockedQueuePolicy(const CLockedQueuePolicy&);
+	CLockedQueuePolicy& operator=(const CLockedQueuePolicy&);
+
+public:
+	// same policy for another message type
+	template <class U>
+	struct rebind
+	{
+		typedef CLockedQueuePolicy<U, typename allocator_traits<TAllocator>::template rebind_alloc<U> > other;
+	};
+
+	// every call must be made with the queue mutex held
+	enum { LOCK_FREE = false };
+
+	// Constructor
+	CLockedQueuePolicy(unsigned int nMaxSize, const TAllocator& alloc = TAllocator());
+
+	// Destructor
+	~CLockedQueuePolicy();
+
+public:
+	// Construct Message in queue, fails if queue is full
+	template <class... Args>
+	bool TryEmplace(Args&&... args);
+
+	// Dequeue Message, fails if queue is empty
+	bool TryPop(T& msg);
+
+	// Enqueue as much of a burst as fits
+	unsigned int TryPushBatch(const T* pMsgs, unsigned int nCount);
+
+	// Dequeue up to nMaxCount messages
+	unsigned int TryPopBatch(T* pMsgs, unsigned int nMaxCount);
+
+	// Get queue size (a snapshot when called without the queue mutex)
+	unsigned int GetSize();
+};
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CLockedQueuePolicy<T, TAllocator>::CLockedQueuePolicy
+//
+// Usage:
+//	- Class Constructor, allocates all nMaxSize slots up front
+//
+// Prameters:
+//	- unsigned int nMaxSize:		the maximum allowed queue size
+//	- const TAllocator& alloc:		allocator for the slot array
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T, class TAllocator>
+CLockedQueuePolicy<T, TAllocator>::CLockedQueuePolicy(unsigned int nMaxSize, const TAllocator& alloc)
+	: m_Allocator(alloc)
+{
+	m_pSlots = (nMaxSize > 0) ? CAllocTraits::allocate(m_Allocator, nMaxSize) : NULL;
+	m_nHead = 0;
+	m_nCount = 0;
+
+	// set maximum allowed queue size
+	m_nMaxSize = nMaxSize;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CLockedQueuePolicy<T, TAllocator>::~CLockedQueuePolicy
+//
+// Usage:
+//	- Class Destructor
+//
+// Prameters:
+//  - N/A
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T, class TAllocator>
+CLockedQueuePolicy<T, TAllocator>::~CLockedQueuePolicy()
+{
+	// destroy messages still in the ring
+	for (unsigned int nCount = m_nCount.load(memory_order_relaxed); nCount > 0; nCount--)
+	{
+		CAllocTraits::destroy(m_Allocator, &m_pSlots[m_nHead]);
+		m_nHead = (m_nHead + 1 == m_nMaxSize) ? 0 : m_nHead + 1;
+	}
+
+	if (NULL != m_pSlots)
+	{
+		CAllocTraits::deallocate(m_Allocator, m_pSlots, m_nMaxSize);
+	}
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CLockedQueuePolicy<T, TAllocator>::TryEmplace
+//
+// Usage:
+//	- To construct a message in queue if it is not full
+//
+// Prameters:
+//	- Args&&... args:	constructor arguments of the message
+//
+// Returns:
+//	- bool: true if the message was queued, false if queue is full
+//----------------------------------------------------------------------------------
+template <class T, class TAllocator>
+template <class... Args>
+bool CLockedQueuePolicy<T, TAllocator>::TryEmplace(Args&&... args)
+{
+	// only ever changed under the mutex, so a plain load and store suffice
+	unsigned int nCount = m_nCount.load(memory_order_relaxed);
+	if (m_nMaxSize <= nCount)
+	{
+		return false;
+	}
+
+	// the ring is exactly nMaxSize long, so wrap with a compare instead of a modulo
+	unsigned int nTail = m_nHead + nCount;
+	if (nTail >= m_nMaxSize)
+	{
+		nTail -= m_nMaxSize;
+	}
+
+	CAllocTraits::construct(m_Allocator, &m_pSlots[nTail], forward<Args>(args)...);
+	m_nCount.store(nCount + 1, memory_order_relaxed);
+	return true;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CLockedQueuePolicy<T, TAllocator>::TryPop
+//
+// Usage:
+//	- To get a message from queue if it is not empty
+//
+// Prameters:
+//	- T& msg:	the message reference to get from queue
+//
+// Returns:
+//	- bool: true if a message was popped, false if queue is empty
+//----------------------------------------------------------------------------------
+template <class T, class TAllocator>
+bool CLockedQueuePolicy<T, TAllocator>::TryPop(T& msg)
+{
+	unsigned int nCount = m_nCount.load(memory_order_relaxed);
+	if (0 == nCount)
+	{
+		return false;
+	}
+
+	T* pSlot = &m_pSlots[m_nHead];
+	msg = move(*pSlot);
+	CAllocTraits::destroy(m_Allocator, pSlot);
+
+	m_nHead = (m_nHead + 1 == m_nMaxSize) ? 0 : m_nHead + 1;
+	m_nCount.store(nCount - 1, memory_order_relaxed);
+	return true;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CLockedQueuePolicy<T, TAllocator>::TryPushBatch
+//
+// Usage:
+//	- To put as many messages of a burst into queue as currently fit
+//
+// Prameters:
+//	- const T* pMsgs:			the messages to be put in queue
+//	- unsigned int nCount:		number of messages in pMsgs
+//
+// Returns:
+//	- unsigned int: number of messages queued, from the front of pMsgs
+//----------------------------------------------------------------------------------
+template <class T, class TAllocator>
+unsigned int CLockedQueuePolicy<T, TAllocator>::TryPushBatch(const T* pMsgs, unsigned int nCount)
+{
+	unsigned int nPushed = 0;
+
+	while (nPushed < nCount && TryEmplace(pMsgs[nPushed]))
+	{
+		nPushed++;
+	}
+
+	return nPushed;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CLockedQueuePolicy<T, TAllocator>::TryPopBatch
+//
+// Usage:
+//	- To get up to nMaxCount messages from queue without waiting
+//
+// Prameters:
+//	- T* pMsgs:					buffer receiving the messages, in queue order
+//	- unsigned int nMaxCount:	capacity of pMsgs
+//
+// Returns:
+//	- unsigned int: number of messages popped
+//----------------------------------------------------------------------------------
+template <class T, class TAllocator>
+unsigned int CLockedQueuePolicy<T, TAllocator>::TryPopBatch(T* pMsgs, unsigned int nMaxCount)
+{
+	unsigned int nPopped = 0;
+
+	while (nPopped < nMaxCount && TryPop(pMsgs[nPopped]))
+	{
+		nPopped++;
+	}
+
+	return nPopped;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CLockedQueuePolicy<T, TAllocator>::GetSize
+//
+// Usage:
+//	- To get the current queue size. Without the queue mutex this is only a
+//	  hint, e.g. for a spinning waiter deciding whether to take the mutex.
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- unsigned int: the current queue size
+//----------------------------------------------------------------------------------
+template <class T, class TAllocator>
+unsigned int CLockedQueuePolicy<T, TAllocator>::GetSize()
+{
+	return m_nCount.load(memory_order_relaxed);
+}
+
+
+//---------------------------------------------------------
+// Single-Producer/Single-Consumer Lock-Free Ring Policy
+//
+// Exactly one thread may push and exactly one thread may
+// pop. The ring is rounded up to a power of two, but the
+// queue still holds at most nMaxSize messages.
+//---------------------------------------------------------
+template <class T>
+class CSpscQueuePolicy
+{
+private:
+	// ring slots (raw storage, constructed on push and destroyed on pop)
+	T* m_pSlots;
+
+	// ring capacity - 1
+	size_t m_nMask;
+
+	// maximum allowed queue size
+	size_t m_nMaxSize;
+
+	char m_Pad0[QUEUE_CACHE_LINE_SIZE];
+
+	// consumer index, written by the consumer only
+	atomic<size_t> m_nHead;
+
+	// consumer's last observed producer index
+	size_t m_nTailCache;
+
+	char m_Pad1[QUEUE_CACHE_LINE_SIZE];
+
+	// producer index, written by the producer only
+	atomic<size_t> m_nTail;
+
+	// producer's last observed consumer index
+	size_t m_nHeadCache;
+
+	char m_Pad2[QUEUE_CACHE_LINE_SIZE];
+
+private:
+	// not copyable
+	CSpscQueuePolicy(const CSpscQueuePolicy&);
+	CSpscQueuePolicy& operator=(const CSpscQueuePolicy&);
+
+public:
+	// same policy for another message type
+	template <class U>
+	struct rebind
+	{
+		typedef CSpscQueuePolicy<U> other;
+	};
+
+	// safe to call without the queue mutex
+	enum { LOCK_FREE = true };
+
+	// Constructor
+	CSpscQueuePolicy(unsigned int nMaxSize);
+
+	// Destructor
+	~CSpscQueuePolicy();
+
+public:
+	// Construct Message in queue, fails if queue is full (producer thread only)
+	template <class... Args>
+	bool TryEmplace(Args&&... args);
+
+	// Dequeue Message, fails if queue is empty (consumer thread only)
+	bool TryPop(T& msg);
+
+	// Enqueue as much of a burst as fits (producer thread only)
+	unsigned int TryPushBatch(const T* pMsgs, unsigned int nCount);
+
+	// Dequeue up to nMaxCount messages (consumer thread only)
+	unsigned int TryPopBatch(T* pMsgs, unsigned int nMaxCount);
+
+	// Get queue size (a snapshot, may be stale by the time it returns)
+	unsigned int GetSize();
+};
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CSpscQueuePolicy<T>::CSpscQueuePolicy
+//
+// Usage:
+//	- Class Constructor
+//
+// Prameters:
+//	- unsigned int nMaxSize:	the maximum allowed queue size
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T>
+CSpscQueuePolicy<T>::CSpscQueuePolicy(unsigned int nMaxSize)
+{
+	size_t nCapacity = 1;
+
+	// round the ring up to a power of two so slot lookup is a mask
+	while (nCapacity < nMaxSize)
+	{
+		nCapacity <<= 1;
+	}
+
+	m_pSlots = static_cast<T*>(::operator new(nCapacity * sizeof(T)));
+	m_nMask = nCapacity - 1;
+	m_nMaxSize = nMaxSize;
+
+	m_nHead.store(0, memory_order_relaxed);
+	m_nTail.store(0, memory_order_relaxed);
+	m_nTailCache = 0;
+	m_nHeadCache = 0;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CSpscQueuePolicy<T>::~CSpscQueuePolicy
+//
+// Usage:
+//	- Class Destructor
+//
+// Prameters:
+//  - N/A
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T>
+CSpscQueuePolicy<T>::~CSpscQueuePolicy()
+{
+	size_t nTail = m_nTail.load(memory_order_acquire);
+
+	// destroy messages still in the ring
+	for (size_t i = m_nHead.load(memory_order_relaxed); i != nTail; i++)
+	{
+		m_pSlots[i & m_nMask].~T();
+	}
+
+	::operator delete(m_pSlots);
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CSpscQueuePolicy<T>::TryEmplace
+//
+// Usage:
+//	- To construct a message in queue if it is not full
+//
+// Prameters:
+//	- Args&&... args:	constructor arguments of the message
+//
+// Returns:
+//	- bool: true if the message was queued, false if queue is full
+//----------------------------------------------------------------------------------
+template <class T>
+template <class... Args>
+bool CSpscQueuePolicy<T>::TryEmplace(Args&&... args)
+{
+	size_t nTail = m_nTail.load(memory_order_relaxed);
+
+	// only touch the consumer's cache line when the cached index says full
+	if (nTail - m_nHeadCache >= m_nMaxSize)
+	{
+		m_nHeadCache = m_nHead.load(memory_order_acquire);
+		if (nTail - m_nHeadCache >= m_nMaxSize)
+		{
+			return false;
+		}
+	}
+
+	new (&m_pSlots[nTail & m_nMask]) T(forward<Args>(args)...);
+
+	// publish the slot to the consumer
+	m_nTail.store(nTail + 1, memory_order_release);
+	return true;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CSpscQueuePolicy<T>::TryPop
+//
+// Usage:
+//	- To get a message from queue if it is not empty
+//
+// Prameters:
+//	- T& msg:	the message reference to get from queue
+//
+// Returns:
+//	- bool: true if a message was popped, false if queue is empty
+//----------------------------------------------------------------------------------
+template <class T>
+bool CSpscQueuePolicy<T>::TryPop(T& msg)
+{
+	size_t nHead = m_nHead.load(memory_order_relaxed);
+
+	// only touch the producer's cache line when the cached index says empty
+	if (nHead == m_nTailCache)
+	{
+		m_nTailCache = m_nTail.load(memory_order_acquire);
+		if (nHead == m_nTailCache)
+		{
+			return false;
+		}
+	}
+
+	T* pSlot = &m_pSlots[nHead & m_nMask];
+	msg = move(*pSlot);
+	pSlot->~T();
+
+	// hand the slot back to the producer
+	m_nHead.store(nHead + 1, memory_order_release);
+	return true;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CSpscQueuePolicy<T>::TryPushBatch
+//
+// Usage:
+//	- To put as many messages of a burst into queue as currently fit. The
+//	  whole burst is published to the consumer with a single index store.
+//
+// Prameters:
+//	- const T* pMsgs:			the messages to be put in queue
+//	- unsigned int nCount:		number of messages in pMsgs
+//
+// Returns:
+//	- unsigned int: number of messages queued, from the front of pMsgs
+//----------------------------------------------------------------------------------
+template <class T>
+unsigned int CSpscQueuePolicy<T>::TryPushBatch(const T* pMsgs, unsigned int nCount)
+{
+	size_t nTail = m_nTail.load(memory_order_relaxed);
+
+	// refresh the consumer index only if the cached one cannot fit the burst
+	if (m_nMaxSize - (nTail - m_nHeadCache) < nCount)
+	{
+		m_nHeadCache = m_nHead.load(memory_order_acquire);
+	}
+
+	size_t nFree = m_nMaxSize - (nTail - m_nHeadCache);
+	unsigned int nPushed = (unsigned int)(nFree < nCount ? nFree : nCount);
+
+	for (unsigned int i = 0; i < nPushed; i++)
+	{
+		new (&m_pSlots[(nTail + i) & m_nMask]) T(pMsgs[i]);
+	}
+
+	// publish the burst to the consumer
+	if (nPushed > 0)
+	{
+		m_nTail.store(nTail + nPushed, memory_order_release);
+	}
+	return nPushed;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CSpscQueuePolicy<T>::TryPopBatch
+//
+// Usage:
+//	- To get up to nMaxCount messages from queue without waiting. The slots
+//	  are handed back to the producer with a single index store.
+//
+// Prameters:
+//	- T* pMsgs:					buffer receiving the messages, in queue order
+//	- unsigned int nMaxCount:	capacity of pMsgs
+//
+// Returns:
+//	- unsigned int: number of messages popped
+//----------------------------------------------------------------------------------
+template <class T>
+unsigned int CSpscQueuePolicy<T>::TryPopBatch(T* pMsgs, unsigned int nMaxCount)
+{
+	size_t nHead = m_nHead.load(memory_order_relaxed);
+
+	// refresh the producer index only if the cached one cannot fill the buffer
+	if (m_nTailCache - nHead < nMaxCount)
+	{
+		m_nTailCache = m_nTail.load(memory_order_acquire);
+	}
+
+	size_t nAvailable = m_nTailCache - nHead;
+	unsigned int nPopped = (unsigned int)(nAvailable < nMaxCount ? nAvailable : nMaxCount);
+
+	for (unsigned int i = 0; i < nPopped; i++)
+	{
+		T* pSlot = &m_pSlots[(nHead + i) & m_nMask];
+		pMsgs[i] = move(*pSlot);
+		pSlot->~T();
+	}
+
+	// hand the slots back to the producer
+	if (nPopped > 0)
+	{
+		m_nHead.store(nHead + nPopped, memory_order_release);
+	}
+	return nPopped;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CSpscQueuePolicy<T>::GetSize
+//
+// Usage:
+//	- To get the current queue size
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- unsigned int: the current queue size
+//----------------------------------------------------------------------------------
+template <class T>
+unsigned int CSpscQueuePolicy<T>::GetSize()
+{
+	// read head first so the difference can never go negative
+	size_t nHead = m_nHead.load(memory_order_acquire);
+	size_t nSize = m_nTail.load(memory_order_acquire) - nHead;
+
+	return (unsigned int)(nSize < m_nMaxSize ? nSize : m_nMaxSize);
+}
+
+//---------------------------------------------------------
+// Multi-Producer/Multi-Consumer Lock-Free Ring Policy
+//
+// Bounded array of slots, each carrying a sequence number
+// that tells producers and consumers whose turn the slot is
+// (D. Vyukov's bounded MPMC queue). Any number of threads
+// may push and pop concurrently; a thread only retries when
+// another thread claimed the same position first.
+//---------------------------------------------------------
+template <class T>
+class CMpmcQueuePolicy
+{
+private:
+	struct CSlot
+	{
+		// position this slot is ready for: pos (free) or pos + 1 (filled)
+		atomic<size_t> nSequence;
+
+		// message storage, constructed on push and destroyed on pop
+		typename aligned_storage<sizeof(T), alignment_of<T>::value>::type data;
+	};
+
+	// ring slots
+	CSlot* m_pSlots;
+
+	// ring capacity - 1
+	size_t m_nMask;
+
+	// maximum allowed queue size
+	size_t m_nMaxSize;
+
+	char m_Pad0[QUEUE_CACHE_LINE_SIZE];
+
+	// next position to be claimed by a producer
+	atomic<size_t> m_nEnqueuePos;
+
+	char m_Pad1[QUEUE_CACHE_LINE_SIZE];
+
+	// next position to be claimed by a consumer
+	atomic<size_t> m_nDequeuePos;
+
+	char m_Pad2[QUEUE_CACHE_LINE_SIZE];
+
+private:
+	// not copyable
+	CMpmcQueuePolicy(const CMpmcQueuePolicy&);
+	CMpmcQueuePolicy& operator=(const CMpmcQueuePolicy&);
+
+public:
+	// same policy for another message type
+	template <class U>
+	struct rebind
+	{
+		typedef CMpmcQueuePolicy<U> other;
+	};
+
+	// safe to call without the queue mutex
+	enum { LOCK_FREE = true };
+
+	// Constructor
+	CMpmcQueuePolicy(unsigned int nMaxSize);
+
+	// Destructor
+	~CMpmcQueuePolicy();
+
+public:
+	// Construct Message in queue, fails if queue is full
+	template <class... Args>
+	bool TryEmplace(Args&&... args);
+
+	// Dequeue Message, fails if queue is empty
+	bool TryPop(T& msg);
+
+	// Enqueue as much of a burst as fits
+	unsigned int TryPushBatch(const T* pMsgs, unsigned int nCount);
+
+	// Dequeue up to nMaxCount messages
+	unsigned int TryPopBatch(T* pMsgs, unsigned int nMaxCount);
+
+	// Get queue size (a snapshot, may be stale by the time it returns)
+	unsigned int GetSize();
+};
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CMpmcQueuePolicy<T>::CMpmcQueuePolicy
+//
+// Usage:
+//	- Class Constructor
+//
+// Prameters:
+//	- unsigned int nMaxSize:	the maximum allowed queue size
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T>
+CMpmcQueuePolicy<T>::CMpmcQueuePolicy(unsigned int nMaxSize)
+{
+	// at least two slots: with one, a filled slot (pos + 1) would look free
+	// for the next lap (also pos + 1) and the ring would never be full
+	size_t nCapacity = 2;
+
+	// round the ring up to a power of two so slot lookup is a mask
+	while (nCapacity < nMaxSize)
+	{
+		nCapacity <<= 1;
+	}
+
+	m_pSlots = new CSlot[nCapacity];
+	m_nMask = nCapacity - 1;
+	m_nMaxSize = nMaxSize;
+
+	// every slot starts out free for the first lap
+	for (size_t i = 0; i < nCapacity; i++)
+	{
+		m_pSlots[i].nSequence.store(i, memory_order_relaxed);
+	}
+
+	m_nEnqueuePos.store(0, memory_order_relaxed);
+	m_nDequeuePos.store(0, memory_order_relaxed);
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CMpmcQueuePolicy<T>::~CMpmcQueuePolicy
+//
+// Usage:
+//	- Class Destructor
+//
+// Prameters:
+//  - N/A
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T>
+CMpmcQueuePolicy<T>::~CMpmcQueuePolicy()
+{
+	size_t nEnqueuePos = m_nEnqueuePos.load(memory_order_acquire);
+
+	// destroy messages still in the ring
+	for (size_t i = m_nDequeuePos.load(memory_order_relaxed); i != nEnqueuePos; i++)
+	{
+		reinterpret_cast<T*>(&m_pSlots[i & m_nMask].data)->~T();
+	}
+
+	delete[] m_pSlots;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CMpmcQueuePolicy<T>::TryEmplace
+//
+// Usage:
+//	- To construct a message in queue if it is not full
+//
+// Prameters:
+//	- Args&&... args:	constructor arguments of the message
+//
+// Returns:
+//	- bool: true if the message was queued, false if queue is full
+//----------------------------------------------------------------------------------
+template <class T>
+template <class... Args>
+bool CMpmcQueuePolicy<T>::TryEmplace(Args&&... args)
+{
+	size_t nPos = m_nEnqueuePos.load(memory_order_relaxed);
+	CSlot* pSlot;
+
+	for (;;)
+	{
+		pSlot = &m_pSlots[nPos & m_nMask];
+
+		size_t nSequence = pSlot->nSequence.load(memory_order_acquire);
+		ptrdiff_t nDiff = (ptrdiff_t)nSequence - (ptrdiff_t)nPos;
+
+		if (nDiff == 0)
+		{
+			// the ring may be larger than nMaxSize, keep the queue bound. Other
+			// threads may have pushed and popped past a stale nPos, so the
+			// difference can be negative: compare it signed, the claim below
+			// then fails and reloads nPos
+			if (m_nMaxSize != m_nMask + 1 &&
+				(ptrdiff_t)(nPos - m_nDequeuePos.load(memory_order_relaxed)) >= (ptrdiff_t)m_nMaxSize)
+			{
+				return false;
+			}
+
+			// slot is free for this lap, try to claim the position
+			if (m_nEnqueuePos.compare_exchange_weak(nPos, nPos + 1, memory_order_relaxed))
+			{
+				break;
+			}
+		}
+		else if (nDiff < 0)
+		{
+			// slot still holds last lap's message: queue is full
+			return false;
+		}
+		else
+		{
+			// another producer claimed this position, catch up
+			nPos = m_nEnqueuePos.load(memory_order_relaxed);
+		}
+	}
+
+	new (&pSlot->data) T(forward<Args>(args)...);
+
+	// publish the slot to consumers
+	pSlot->nSequence.store(nPos + 1, memory_order_release);
+	return true;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CMpmcQueuePolicy<T>::TryPop
+//
+// Usage:
+//	- To get a message from queue if it is not empty
+//
+// Prameters:
+//	- T& msg:	the message reference to get from queue
+//
+// Returns:
+//	- bool: true if a message was popped, false if queue is empty
+//----------------------------------------------------------------------------------
+template <class T>
+bool CMpmcQueuePolicy<T>::TryPop(T& msg)
+{
+	size_t nPos = m_nDequeuePos.load(memory_order_relaxed);
+	CSlot* pSlot;
+
+	for (;;)
+	{
+		pSlot = &m_pSlots[nPos & m_nMask];
+
+		size_t nSequence = pSlot->nSequence.load(memory_order_acquire);
+		ptrdiff_t nDiff = (ptrdiff_t)nSequence - (ptrdiff_t)(nPos + 1);
+
+		if (nDiff == 0)
+		{
+			// slot is filled for this lap, try to claim the position
+			if (m_nDequeuePos.compare_exchange_weak(nPos, nPos + 1, memory_order_relaxed))
+			{
+				break;
+			}
+		}
+		else if (nDiff < 0)
+		{
+			// slot not filled yet: queue is empty
+			return false;
+		}
+		else
+		{
+			// another consumer claimed this position, catch up
+			nPos = m_nDequeuePos.load(memory_order_relaxed);
+		}
+	}
+
+	T* pValue = reinterpret_cast<T*>(&pSlot->data);
+	msg = move(*pValue);
+	pValue->~T();
+
+	// free the slot for the producers' next lap
+	pSlot->nSequence.store(nPos + m_nMask + 1, memory_order_release);
+	return true;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CMpmcQueuePolicy<T>::TryPushBatch
+//
+// Usage:
+//	- To put as many messages of a burst into queue as currently fit
+//
+// Prameters:
+//	- const T* pMsgs:			the messages to be put in queue
+//	- unsigned int nCount:		number of messages in pMsgs
+//
+// Returns:
+//	- unsigned int: number of messages queued, from the front of pMsgs
+//----------------------------------------------------------------------------------
+template <class T>
+unsigned int CMpmcQueuePolicy<T>::TryPushBatch(const T* pMsgs, unsigned int nCount)
+{
+	unsigned int nPushed = 0;
+
+	while (nPushed < nCount && TryEmplace(pMsgs[nPushed]))
+	{
+		nPushed++;
+	}
+
+	return nPushed;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CMpmcQueuePolicy<T>::TryPopBatch
+//
+// Usage:
+//	- To get up to nMaxCount messages from queue without waiting
+//
+// Prameters:
+//	- T* pMsgs:					buffer receiving the messages, in queue order
+//	- unsigned int nMaxCount:	capacity of pMsgs
+//
+// Returns:
+//	- unsigned int: number of messages popped
+//----------------------------------------------------------------------------------
+template <class T>
+unsigned int CMpmcQueuePolicy<T>::TryPopBatch(T* pMsgs, unsigned int nMaxCount)
+{
+	unsigned int nPopped = 0;
+
+	while (nPopped < nMaxCount && TryPop(pMsgs[nPopped]))
+	{
+		nPopped++;
+	}
+
+	return nPopped;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CMpmcQueuePolicy<T>::GetSize
+//
+// Usage:
+//	- To get the current queue size
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- unsigned int: the current queue size
+//----------------------------------------------------------------------------------
+template <class T>
+unsigned int CMpmcQueuePolicy<T>::GetSize()
+{
+	// read the dequeue position first so the difference can never go negative
+	size_t nDequeuePos = m_nDequeuePos.load(memory_order_acquire);
+	size_t nSize = m_nEnqueuePos.load(memory_order_acquire) - nDequeuePos;
+
+	return (unsigned int)(nSize < m_nMaxSize ? nSize : m_nMaxSize);
+}
+#endif /*_QUEUESTORAGE*/
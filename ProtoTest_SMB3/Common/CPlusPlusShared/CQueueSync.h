@@ -0,0 +1,350 @@
+#ifndef _QUEUESYNC
+#define _QUEUESYNC
+
+#pragma once
+
+//---------------------------------------------------------------------------------
+// Synchronization backend for CMessageQueue
+//
+// The backend is chosen at compile time:
+//	- Win32 (default on Windows):	CRITICAL_SECTION + CONDITION_VARIABLE
+//	- Portable (everywhere else, or when MESSAGEQUEUE_PORTABLE is defined):
+//									std::mutex + std::condition_variable
+//
+// Both expose the same CQueueMutex/CQueueCondition interface, and waits take an
+// absolute deadline on a monotonic millisecond clock (QueueGetTicks).
+//---------------------------------------------------------------------------------
+
+#if defined(_WIN32) && !defined(MESSAGEQUEUE_PORTABLE)
+#define MESSAGEQUEUE_WIN32
+#endif
+
+#ifdef MESSAGEQUEUE_WIN32
+#include <windows.h>
+#else
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <thread>
+
+// keep INFINITE timeouts spelled the same way on every platform
+#ifndef INFINITE
+#define INFINITE 0xFFFFFFFF
+#endif
+#endif /*MESSAGEQUEUE_WIN32*/
+
+using namespace std;
+
+// monotonic time in milliseconds
+typedef unsigned long long QUEUE_TICKS;
+
+// deadline that never expires
+const QUEUE_TICKS QUEUE_TICKS_INFINITE = ~0ULL;
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- QueueGetTicks
+//
+// Usage:
+//	- To read the monotonic millisecond clock used for queue deadlines
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- QUEUE_TICKS: milliseconds since an unspecified epoch
+//----------------------------------------------------------------------------------
+inline QUEUE_TICKS QueueGetTicks()
+{
+#ifdef MESSAGEQUEUE_WIN32
+	return GetTickCount64();
+#else
+	return chrono::duration_cast<chrono::milliseconds>(
+		chrono::steady_clock::now().time_since_epoch()).count();
+#endif /*MESSAGEQUEUE_WIN32*/
+}
+
+#ifdef MESSAGEQUEUE_WIN32
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- QueuePerformanceFrequency
+//
+// Usage:
+//	- To get the performance counter frequency, queried once per process
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- unsigned long long: performance counter ticks per second
+//----------------------------------------------------------------------------------
+inline unsigned long long QueuePerformanceFrequency()
+{
+	struct CFrequency
+	{
+		unsigned long long m_nFrequency;
+
+		CFrequency()
+		{
+			LARGE_INTEGER liFrequency;
+
+			QueryPerformanceFrequency(&liFrequency);
+			m_nFrequency = liFrequency.QuadPart;
+		}
+	};
+
+	// initialized once, even if several threads get here first
+	static const CFrequency s_Frequency;
+
+	return s_Frequency.m_nFrequency;
+}
+#endif /*MESSAGEQUEUE_WIN32*/
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- QueueGetMicroseconds
+//
+// Usage:
+//	- To read a monotonic microsecond clock, for measuring short intervals
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- unsigned long long: microseconds since an unspecified epoch
+//----------------------------------------------------------------------------------
+inline unsigned long long QueueGetMicroseconds()
+{
+#ifdef MESSAGEQUEUE_WIN32
+	unsigned long long nFrequency = QueuePerformanceFrequency();
+	LARGE_INTEGER liCounter;
+
+	QueryPerformanceCounter(&liCounter);
+
+	// split the conversion so the multiply cannot overflow on long uptimes
+	unsigned long long nSeconds = liCounter.QuadPart / nFrequency;
+	unsigned long long nRemainder = liCounter.QuadPart % nFrequency;
+	return nSeconds * 1000000ULL + nRemainder * 1000000ULL / nFrequency;
+#else
+	return chrono::duration_cast<chrono::microseconds>(
+		chrono::steady_clock::now().time_since_epoch()).count();
+#endif /*MESSAGEQUEUE_WIN32*/
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- QueueGetNanoseconds
+//
+// Usage:
+//	- To read a monotonic nanosecond clock, for timing spin waits
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- unsigned long long: nanoseconds since an unspecified epoch
+//----------------------------------------------------------------------------------
+inline unsigned long long QueueGetNanoseconds()
+{
+#ifdef MESSAGEQUEUE_WIN32
+	unsigned long long nFrequency = QueuePerformanceFrequency();
+	LARGE_INTEGER liCounter;
+
+	QueryPerformanceCounter(&liCounter);
+
+	// split the conversion so the multiply cannot overflow on long uptimes
+	unsigned long long nSeconds = liCounter.QuadPart / nFrequency;
+	unsigned long long nRemainder = liCounter.QuadPart % nFrequency;
+	return nSeconds * 1000000000ULL + nRemainder * 1000000000ULL / nFrequency;
+#else
+	return chrono::duration_cast<chrono::nanoseconds>(
+		chrono::steady_clock::now().time_since_epoch()).count();
+#endif /*MESSAGEQUEUE_WIN32*/
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- QueuePause
+//
+// Usage:
+//	- To tell the CPU we are in a spin loop (PAUSE on x86, YIELD on ARM), which
+//	  saves power and frees the core for its hyper-threaded sibling
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+inline void QueuePause()
+{
+#ifdef MESSAGEQUEUE_WIN32
+	YieldProcessor();
+#elif defined(__i386__) || defined(__x86_64__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+	__asm__ __volatile__("yield");
+#endif /*MESSAGEQUEUE_WIN32*/
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- QueueYield
+//
+// Usage:
+//	- To give the rest of the time slice to another ready thread
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+inline void QueueYield()
+{
+#ifdef MESSAGEQUEUE_WIN32
+	SwitchToThread();
+#else
+	this_thread::yield();
+#endif /*MESSAGEQUEUE_WIN32*/
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- QueueDeadline
+//
+// Usage:
+//	- To turn a relative timeout into an absolute deadline
+//
+// Prameters:
+//	- unsigned int nTimeoutMilliseconds:	relative timeout, INFINITE for none
+//
+// Returns:
+//	- QUEUE_TICKS: the deadline, QUEUE_TICKS_INFINITE if the timeout is INFINITE
+//----------------------------------------------------------------------------------
+inline QUEUE_TICKS QueueDeadline(unsigned int nTimeoutMilliseconds)
+{
+	if (INFINITE == nTimeoutMilliseconds)
+	{
+		return QUEUE_TICKS_INFINITE;
+	}
+
+	return QueueGetTicks() + nTimeoutMilliseconds;
+}
+
+//---------------------
+// Queue Mutex Class
+//---------------------
+class CQueueMutex
+{
+	friend class CQueueCondition;
+
+private:
+#ifdef MESSAGEQUEUE_WIN32
+	CRITICAL_SECTION m_csLock;
+#else
+	mutex m_mtxLock;
+#endif /*MESSAGEQUEUE_WIN32*/
+
+	// not copyable
+	CQueueMutex(const CQueueMutex&);
+	CQueueMutex& operator=(const CQueueMutex&);
+
+public:
+#ifdef MESSAGEQUEUE_WIN32
+	CQueueMutex()	{ InitializeCriticalSection(&m_csLock); }
+	~CQueueMutex()	{ DeleteCriticalSection(&m_csLock); }
+
+	void Lock()		{ EnterCriticalSection(&m_csLock); }
+	void Unlock()	{ LeaveCriticalSection(&m_csLock); }
+#else
+	CQueueMutex()	{ }
+
+	void Lock()		{ m_mtxLock.lock(); }
+	void Unlock()	{ m_mtxLock.unlock(); }
+#endif /*MESSAGEQUEUE_WIN32*/
+};
+
+//-------------------------
+// Queue Condition Class
+//-------------------------
+class CQueueCondition
+{
+private:
+#ifdef MESSAGEQUEUE_WIN32
+	CONDITION_VARIABLE m_cvCondition;
+#else
+	condition_variable m_cvCondition;
+#endif /*MESSAGEQUEUE_WIN32*/
+
+	// not copyable
+	CQueueCondition(const CQueueCondition&);
+	CQueueCondition& operator=(const CQueueCondition&);
+
+public:
+#ifdef MESSAGEQUEUE_WIN32
+	CQueueCondition()	{ InitializeConditionVariable(&m_cvCondition); }
+
+	void NotifyOne()	{ WakeConditionVariable(&m_cvCondition); }
+	void NotifyAll()	{ WakeAllConditionVariable(&m_cvCondition); }
+#else
+	CQueueCondition()	{ }
+
+	void NotifyOne()	{ m_cvCondition.notify_one(); }
+	void NotifyAll()	{ m_cvCondition.notify_all(); }
+#endif /*MESSAGEQUEUE_WIN32*/
+
+	// Wait for a notification; the mutex must be held and is held again on return
+	bool WaitUntil(CQueueMutex& queueMutex, QUEUE_TICKS nDeadline);
+};
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CQueueCondition::WaitUntil
+//
+// Usage:
+//	- To release the mutex and sleep until notified or the deadline passes.
+//	  Wakeups may be spurious, callers re-check their predicate in a loop.
+//
+// Prameters:
+//	- CQueueMutex& queueMutex:	the mutex held by the caller
+//	- QUEUE_TICKS nDeadline:	absolute deadline, QUEUE_TICKS_INFINITE for none
+//
+// Returns:
+//	- bool: false if the deadline passed, true otherwise
+//----------------------------------------------------------------------------------
+inline bool CQueueCondition::WaitUntil(CQueueMutex& queueMutex, QUEUE_TICKS nDeadline)
+{
+	if (QUEUE_TICKS_INFINITE == nDeadline)
+	{
+#ifdef MESSAGEQUEUE_WIN32
+		SleepConditionVariableCS(&m_cvCondition, &queueMutex.m_csLock, INFINITE);
+#else
+		unique_lock<mutex> lock(queueMutex.m_mtxLock, adopt_lock);
+		m_cvCondition.wait(lock);
+		lock.release();
+#endif /*MESSAGEQUEUE_WIN32*/
+		return true;
+	}
+
+	QUEUE_TICKS nNow = QueueGetTicks();
+	if (nNow >= nDeadline)
+	{
+		return false;
+	}
+
+#ifdef MESSAGEQUEUE_WIN32
+	// stay below INFINITE so a long finite wait never turns into an endless one
+	QUEUE_TICKS nRemaining = nDeadline - nNow;
+	DWORD dwMilliseconds = (nRemaining < INFINITE) ? (DWORD)nRemaining : INFINITE - 1;
+
+	return FALSE != SleepConditionVariableCS(&m_cvCondition, &queueMutex.m_csLock, dwMilliseconds);
+#else
+	unique_lock<mutex> lock(queueMutex.m_mtxLock, adopt_lock);
+	cv_status status = m_cvCondition.wait_for(lock, chrono::milliseconds(nDeadline - nNow));
+	lock.release();
+
+	return cv_status::no_timeout == status;
+#endif /*MESSAGEQUEUE_WIN32*/
+}
+#endif /*_QUEUESYNC*/
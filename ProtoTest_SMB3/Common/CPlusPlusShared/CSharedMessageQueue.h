@@ -0,0 +1,868 @@
+#ifndef _SHAREDMESSAGEQUEUE
+#define _SHAREDMESSAGEQUEUE
+
+#pragma once
+
+//---------------------------------------------------------------------------------
+// Shared Memory Message Queue Class
+//
+// Bounded queue of trivially copyable messages shared between processes
+// through a named POSIX shared memory segment. The segment holds a header and
+// the ring of message slots; every process maps it and copies messages in and
+// out directly, so nothing passes through a socket.
+//
+// The ring is guarded by a robust, process-shared mutex. Blocked callers sleep
+// on futex words in the segment (not FUTEX_PRIVATE, so wakeups cross process
+// boundaries). Put/Get keep the CMessageQueue semantics: the queue holds at
+// most nMaxSize messages and a full/empty queue waits up to the timeout.
+//
+// Recovery from dead peers:
+//	- a peer that dies holding the mutex leaves it EOWNERDEAD; the next locker
+//	  marks it consistent. The ring is always consistent: its state is a put
+//	  and a get position that only ever grow, and Put/Get each publish a
+//	  completely copied message or freed slot with one store to one of them.
+//	- a peer that dies between updating the ring and waking a waiter cannot
+//	  strand it: sleepers re-check the ring at least every
+//	  SHARED_QUEUE_RECHECK_INTERVAL milliseconds.
+//	- a creator that dies while initializing leaves a segment Open rejects;
+//	  Unlink it and open again.
+//
+// Linux only (futex). The segment outlives the processes until Unlink.
+//---------------------------------------------------------------------------------
+
+#if defined(__linux__)
+
+#include <atomic>
+#include <type_traits>
+#include <new>
+#include <climits>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "CQueueSync.h"
+#include "CQueueStorage.h"
+#include "CMessageQueue.h"
+
+using namespace std;
+
+// identifies an initialized segment and its layout ("SMQ2")
+const unsigned int SHARED_QUEUE_MAGIC = 0x32514D53;
+
+// longest a blocked caller sleeps before looking at the ring again
+const unsigned int SHARED_QUEUE_RECHECK_INTERVAL = 100;
+
+// how long Open waits for another process to finish creating the segment
+const unsigned int SHARED_QUEUE_OPEN_TIMEOUT = 1000;
+
+//---------------------
+// Segment Header
+//---------------------
+struct CSharedQueueHeader
+{
+	// SHARED_QUEUE_MAGIC once the creator finished initializing
+	atomic<unsigned int> m_nMagic;
+
+	// layout checks for processes attaching
+	unsigned int m_nMsgSize;
+	unsigned int m_nMaxSize;
+
+	// guards the ring (robust, process-shared)
+	pthread_mutex_t m_Mutex;
+
+	// messages ever put and taken (mutex); slot = position % m_nMaxSize,
+	// queue size = put - get. Each is advanced with a single store, so a
+	// peer dying at any point leaves a consistent ring.
+	atomic<unsigned long long> m_nPutPosition;
+	atomic<unsigned long long> m_nGetPosition;
+
+	char m_Pad0[QUEUE_CACHE_LINE_SIZE];
+
+	// futex words, bumped on every put/get
+	atomic<unsigned int> m_nPutSequence;
+	atomic<unsigned int> m_nGetSequence;
+
+	// number of callers sleeping on each word (a dead sleeper only costs wakeups)
+	atomic<unsigned int> m_nGetWaiters;
+	atomic<unsigned int> m_nPutWaiters;
+
+	// number of times a dead lock owner was recovered from
+	atomic<unsigned int> m_nRecoveries;
+
+	char m_Pad1[QUEUE_CACHE_LINE_SIZE];
+};
+
+template <class T>
+class CSharedMessageQueue
+{
+	static_assert(is_trivially_copyable<T>::value, "CSharedMessageQueue holds trivially copyable messages only");
+	static_assert(sizeof(atomic<unsigned int>) == sizeof(int), "futex words must be plain 32-bit integers");
+	static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "ring positions must be lock-free to live in shared memory");
+
+private:
+	// mapped segment
+	void* m_pSegment;
+	size_t m_nSegmentSize;
+
+	// header at the start of the segment
+	CSharedQueueHeader* m_pHeader;
+
+	// ring slots after the header
+	T* m_pSlots;
+
+	// time out interval (of queue push/pop transaction)
+	atomic<unsigned int> m_nTimeoutMilliseconds;
+
+private:
+	// not copyable
+	CSharedMessageQueue(const CSharedMessageQueue&);
+	CSharedMessageQueue& operator=(const CSharedMessageQueue&);
+
+	// Segment size for a ring of nMaxSize messages
+	static size_t GetSegmentSize(unsigned int nMaxSize);
+
+	// Offset of the ring in the segment
+	static size_t GetSlotsOffset();
+
+	// Initialize a freshly created segment
+	void InitializeSegment(unsigned int nMaxSize);
+
+	// Map an existing segment and check it matches T
+	bool AttachSegment(int nFile);
+
+	// Lock the ring, recovering from a dead owner
+	bool Lock();
+
+	// Unlock the ring
+	void Unlock();
+
+	// Sleep on a futex word while it still holds nValue
+	static void FutexWait(atomic<unsigned int>* pWord, unsigned int nValue, QUEUE_TICKS nDeadline);
+
+	// Wake sleepers on a futex word
+	static void FutexWake(atomic<unsigned int>* pWord, int nCount);
+
+public:
+	// Constructor
+	CSharedMessageQueue();
+
+	// Destructor
+	~CSharedMessageQueue();
+
+public:
+	// Create the named segment, or attach to it if it exists
+	bool Open(const char* pszName, unsigned int nMaxSize = DEFAULT_MAX_QUEUE_SIZE, unsigned int nTimeoutMilliseconds = DEFAULT_TIMEOUT_INTERVAL);
+
+	// Unmap the segment (it stays until Unlink)
+	void Close();
+
+	// Remove the named segment; processes that mapped it keep their mapping
+	static bool Unlink(const char* pszName);
+
+public:
+	// Enqueue Message (copied into the segment)
+	bool Put(const T& msg);
+
+	// Dequeue Message (copied out of the segment)
+	bool Get(T& msg);
+
+public:
+	// Get queue size
+	unsigned int GetSize();
+
+	// Get maximum queue size
+	unsigned int GetMaxSize();
+
+	// Get number of times a dead peer's lock was recovered
+	unsigned int GetRecoveryCount();
+
+	// Set Timeout Interval
+	void SetTimeout(unsigned int nTimeoutMilliseconds);
+};
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CSharedMessageQueue<T>::CSharedMessageQueue
+//
+// Usage:
+//	- Class Constructor, the queue is usable after Open
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T>
+CSharedMessageQueue<T>::CSharedMessageQueue()
+{
+	m_pSegment = NULL;
+	m_nSegmentSize = 0;
+	m_pHeader = NULL;
+	m_pSlots = NULL;
+	m_nTimeoutMilliseconds = DEFAULT_TIMEOUT_INTERVAL;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CSharedMessageQueue<T>::~CSharedMessageQueue
+//
+// Usage:
+//	- Class Destructor, unmaps the segment
+//
+// Prameters:
+//  - N/A
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T>
+CSharedMessageQueue<T>::~CSharedMessageQueue()
+{
+	Close();
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CSharedMessageQueue<T>::GetSlotsOffset
+//
+// Usage:
+//	- To get where the ring starts, aligned for T and to a cache line
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- size_t: offset of the first slot
+//----------------------------------------------------------------------------------
+template <class T>
+size_t CSharedMessageQueue<T>::GetSlotsOffset()
+{
+	size_t nAlign = (alignof(T) > QUEUE_CACHE_LINE_SIZE) ? alignof(T) : QUEUE_CACHE_LINE_SIZE;
+
+	return (sizeof(CSharedQueueHeader) + nAlign - 1) / nAlign * nAlign;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CSharedMessageQueue<T>::GetSegmentSize
+//
+// Usage:
+//	- To get the size of a segment holding nMaxSize messages
+//
+// Prameters:
+//	- unsigned int nMaxSize:	the maximum allowed queue size
+//
+// Returns:
+//	- size_t: segment size in bytes
+//----------------------------------------------------------------------------------
+template <class T>
+size_t CSharedMessageQueue<T>::GetSegmentSize(unsigned int nMaxSize)
+{
+	return GetSlotsOffset() + (size_t)nMaxSize * sizeof(T);
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CSharedMessageQueue<T>::Open
+//
+// Usage:
+//	- To create the named segment with room for nMaxSize messages, or to
+//	  attach to it if another process created it already. nMaxSize is only
+//	  used when creating; attaching uses the size the creator chose.
+//
+// Prameters:
+//	- const char* pszName:					segment name, "/name" as for shm_open
+//	- unsigned int nMaxSize:				the maximum allowed queue size
+//	- unsigned int nTimeoutMilliseconds:	time out interval of queue transaction
+//
+// Returns:
+//	- bool: false if the segment cannot be created/mapped, was created for
+//	  another message size, or its creator never finished initializing it
+//----------------------------------------------------------------------------------
+template <class T>
+bool CSharedMessageQueue<T>::Open(const char* pszName, unsigned int nMaxSize, unsigned int nTimeoutMilliseconds)
+{
+	Close();
+
+	if (0 == nMaxSize)
+	{
+		return false;
+	}
+
+	m_nTimeoutMilliseconds = nTimeoutMilliseconds;
+
+	// exactly one process wins the exclusive create and initializes the segment
+	int nFile = shm_open(pszName, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (nFile >= 0)
+	{
+		size_t nSegmentSize = GetSegmentSize(nMaxSize);
+
+		if (0 != ftruncate(nFile, (off_t)nSegmentSize))
+		{
+			close(nFile);
+			shm_unlink(pszName);
+			return false;
+		}
+
+		m_pSegment = mmap(NULL, nSegmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, nFile, 0);
+		close(nFile);
+
+		if (MAP_FAILED == m_pSegment)
+		{
+			m_pSegment = NULL;
+			shm_unlink(pszName);
+			return false;
+		}
+
+		m_nSegmentSize = nSegmentSize;
+		InitializeSegment(nMaxSize);
+		return true;
+	}
+
+	if (EEXIST != errno)
+	{
+		return false;
+	}
+
+	nFile = shm_open(pszName, O_RDWR, 0600);
+	if (nFile < 0)
+	{
+		return false;
+	}
+
+	bool bAttached = AttachSegment(nFile);
+	close(nFile);
+
+	return bAttached;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CSharedMessageQueue<T>::InitializeSegment
+//
+// Usage:
+//	- To set up the header of a segment this process created. The magic is
+//	  written last, which is what attaching processes wait for.
+//
+// Prameters:
+//	- unsigned int nMaxSize:	the maximum allowed queue size
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T>
+void CSharedMessageQueue<T>::InitializeSegment(unsigned int nMaxSize)
+{
+	m_pHeader = new (m_pSegment) CSharedQueueHeader();
+	m_pSlots = reinterpret_cast<T*>(static_cast<char*>(m_pSegment) + GetSlotsOffset());
+
+	m_pHeader->m_nMsgSize = sizeof(T);
+	m_pHeader->m_nMaxSize = nMaxSize;
+	m_pHeader->m_nPutPosition = 0;
+	m_pHeader->m_nGetPosition = 0;
+	m_pHeader->m_nPutSequence = 0;
+	m_pHeader->m_nGetSequence = 0;
+	m_pHeader->m_nGetWaiters = 0;
+	m_pHeader->m_nPutWaiters = 0;
+	m_pHeader->m_nRecoveries = 0;
+
+	pthread_mutexattr_t mutexAttr;
+	pthread_mutexattr_init(&mutexAttr);
+	pthread_mutexattr_setpshared(&mutexAttr, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&mutexAttr, PTHREAD_MUTEX_ROBUST);
+	pthread_mutex_init(&m_pHeader->m_Mutex, &mutexAttr);
+	pthread_mutexattr_destroy(&mutexAttr);
+
+	m_pHeader->m_nMagic.store(SHARED_QUEUE_MAGIC, memory_order_release);
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CSharedMessageQueue<T>::AttachSegment
+//
+// Usage:
+//	- To map a segment another process created, waiting briefly for it to
+//	  be sized and initialized
+//
+// Prameters:
+//	- int nFile:	descriptor of the open segment
+//
+// Returns:
+//	- bool: true if the segment is mapped and matches T
+//----------------------------------------------------------------------------------
+template <class T>
+bool CSharedMessageQueue<T>::AttachSegment(int nFile)
+{
+	QUEUE_TICKS nDeadline = QueueDeadline(SHARED_QUEUE_OPEN_TIMEOUT);
+	struct stat fileStat;
+
+	// the creator may not have sized the segment yet
+	for (;;)
+	{
+		if (0 != fstat(nFile, &fileStat))
+		{
+			return false;
+		}
+
+		if ((size_t)fileStat.st_size >= sizeof(CSharedQueueHeader))
+		{
+			break;
+		}
+
+		if (QueueGetTicks() >= nDeadline)
+		{
+			return false;
+		}
+		usleep(1000);
+	}
+
+	size_t nSegmentSize = (size_t)fileStat.st_size;
+	void* pSegment = mmap(NULL, nSegmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, nFile, 0);
+	if (MAP_FAILED == pSegment)
+	{
+		return false;
+	}
+
+	CSharedQueueHeader* pHeader = static_cast<CSharedQueueHeader*>(pSegment);
+
+	// nor finished initializing it
+	while (SHARED_QUEUE_MAGIC != pHeader->m_nMagic.load(memory_order_acquire))
+	{
+		if (QueueGetTicks() >= nDeadline)
+		{
+			munmap(pSegment, nSegmentSize);
+			return false;
+		}
+		usleep(1000);
+	}
+
+	if (sizeof(T) != pHeader->m_nMsgSize || nSegmentSize < GetSegmentSize(pHeader->m_nMaxSize))
+	{
+		munmap(pSegment, nSegmentSize);
+		return false;
+	}
+
+	m_pSegment = pSegment;
+	m_nSegmentSize = nSegmentSize;
+	m_pHeader = pHeader;
+	m_pSlots = reinterpret_cast<T*>(static_cast<char*>(m_pSegment) + GetSlotsOffset());
+
+	return true;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CSharedMessageQueue<T>::Close
+//
+// Usage:
+//	- To unmap the segment. No thread of this process may be using the queue.
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T>
+void CSharedMessageQueue<T>::Close()
+{
+	if (m_pSegment != NULL)
+	{
+		munmap(m_pSegment, m_nSegmentSize);
+	}
+
+	m_pSegment = NULL;
+	m_nSegmentSize = 0;
+	m_pHeader = NULL;
+	m_pSlots = NULL;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CSharedMessageQueue<T>::Unlink
+//
+// Usage:
+//	- To remove the named segment, e.g. at the end of a run or after a
+//	  creator died before initializing it
+//
+// Prameters:
+//	- const char* pszName:	segment name
+//
+// Returns:
+//	- bool: function success/fail status
+//----------------------------------------------------------------------------------
+template <class T>
+bool CSharedMessageQueue<T>::Unlink(const char* pszName)
+{
+	return 0 == shm_unlink(pszName);
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CSharedMessageQueue<T>::Lock
+//
+// Usage:
+//	- To lock the ring. If the previous owner died holding the lock, the
+//	  ring is still consistent (see Put/Get), so the lock is simply marked
+//	  consistent; sleepers are woken in case the dead owner had not woken
+//	  them yet.
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- bool: false if the lock cannot be taken (e.g. ENOTRECOVERABLE); the
+//	  caller then fails without touching the ring
+//----------------------------------------------------------------------------------
+template <class T>
+bool CSharedMessageQueue<T>::Lock()
+{
+	int nResult = pthread_mutex_lock(&m_pHeader->m_Mutex);
+
+	if (EOWNERDEAD == nResult)
+	{
+		if (0 != pthread_mutex_consistent(&m_pHeader->m_Mutex))
+		{
+			pthread_mutex_unlock(&m_pHeader->m_Mutex);
+			return false;
+		}
+		m_pHeader->m_nRecoveries++;
+
+		m_pHeader->m_nPutSequence++;
+		m_pHeader->m_nGetSequence++;
+		FutexWake(&m_pHeader->m_nPutSequence, INT_MAX);
+		FutexWake(&m_pHeader->m_nGetSequence, INT_MAX);
+		return true;
+	}
+
+	return 0 == nResult;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CSharedMessageQueue<T>::Unlock
+//
+// Usage:
+//	- To unlock the ring
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T>
+void CSharedMessageQueue<T>::Unlock()
+{
+	pthread_mutex_unlock(&m_pHeader->m_Mutex);
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CSharedMessageQueue<T>::FutexWait
+//
+// Usage:
+//	- To sleep while a futex word still holds nValue, until woken, the
+//	  deadline passes, or SHARED_QUEUE_RECHECK_INTERVAL elapses
+//
+// Prameters:
+//	- atomic<unsigned int>* pWord:	the futex word in the segment
+//	- unsigned int nValue:			value read under the mutex
+//	- QUEUE_TICKS nDeadline:		absolute deadline, QUEUE_TICKS_INFINITE for none
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T>
+void CSharedMessageQueue<T>::FutexWait(atomic<unsigned int>* pWord, unsigned int nValue, QUEUE_TICKS nDeadline)
+{
+	QUEUE_TICKS nNow = QueueGetTicks();
+	if (nNow >= nDeadline)
+	{
+		return;
+	}
+
+	QUEUE_TICKS nSleep = nDeadline - nNow;
+	if (nSleep > SHARED_QUEUE_RECHECK_INTERVAL)
+	{
+		nSleep = SHARED_QUEUE_RECHECK_INTERVAL;
+	}
+
+	struct timespec timeout;
+	timeout.tv_sec = (time_t)(nSleep / 1000);
+	timeout.tv_nsec = (long)(nSleep % 1000) * 1000000L;
+
+	// returns at once if a put/get changed the word after we read it
+	syscall(SYS_futex, reinterpret_cast<int*>(pWord), FUTEX_WAIT, (int)nValue, &timeout, NULL, 0);
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CSharedMessageQueue<T>::FutexWake
+//
+// Usage:
+//	- To wake sleepers on a futex word, in any process
+//
+// Prameters:
+//	- atomic<unsigned int>* pWord:	the futex word in the segment
+//	- int nCount:					most sleepers to wake
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T>
+void CSharedMessageQueue<T>::FutexWake(atomic<unsigned int>* pWord, int nCount)
+{
+	syscall(SYS_futex, reinterpret_cast<int*>(pWord), FUTEX_WAKE, nCount, NULL, NULL, 0);
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CSharedMessageQueue<T>::Put
+//
+// Usage:
+//	- To copy a message into the segment, waiting up to the timeout while
+//	  the queue is full
+//
+// Prameters:
+//	- const T& msg:	the message to be put in queue
+//
+// Returns:
+//	- bool: function success/fail status (false if not open, timed out or
+//	  the lock is unusable)
+//----------------------------------------------------------------------------------
+template <class T>
+bool CSharedMessageQueue<T>::Put(const T& msg)
+{
+	if (NULL == m_pHeader)
+	{
+		return false;
+	}
+
+	QUEUE_TICKS nDeadline = QueueDeadline(m_nTimeoutMilliseconds);
+
+	// hold mutex
+	if (!Lock())
+	{
+		return false;
+	}
+
+	while (m_pHeader->m_nPutPosition.load(memory_order_relaxed) - m_pHeader->m_nGetPosition.load(memory_order_relaxed) >= m_pHeader->m_nMaxSize)
+	{
+		if (QueueGetTicks() >= nDeadline)
+		{
+			// release mutex
+			Unlock();
+			return false;
+		}
+
+		// read the word under the mutex, so a get after we unlock changes it
+		unsigned int nSequence = m_pHeader->m_nGetSequence.load(memory_order_relaxed);
+		m_pHeader->m_nPutWaiters++;
+
+		// release mutex
+		Unlock();
+
+		FutexWait(&m_pHeader->m_nGetSequence, nSequence, nDeadline);
+		m_pHeader->m_nPutWaiters--;
+
+		// hold mutex
+		if (!Lock())
+		{
+			return false;
+		}
+	}
+
+	// copy first, publish after with one store: a death mid-copy leaves
+	// the ring unchanged
+	unsigned long long nPut = m_pHeader->m_nPutPosition.load(memory_order_relaxed);
+	memcpy(static_cast<void*>(&m_pSlots[nPut % m_pHeader->m_nMaxSize]), &msg, sizeof(T));
+	m_pHeader->m_nPutPosition.store(nPut + 1, memory_order_release);
+	m_pHeader->m_nPutSequence++;
+
+	bool bWake = m_pHeader->m_nGetWaiters.load(memory_order_relaxed) > 0;
+
+	// release mutex
+	Unlock();
+
+	// wake a blocked reader
+	if (bWake)
+	{
+		FutexWake(&m_pHeader->m_nPutSequence, 1);
+	}
+
+	return true;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CSharedMessageQueue<T>::Get
+//
+// Usage:
+//	- To copy the oldest message out of the segment, waiting up to the
+//	  timeout while the queue is empty
+//
+// Prameters:
+//  - T& msg:	the message reference to get from queue
+//
+// Returns:
+//	- bool: function success/fail status (false if not open, timed out or
+//	  the lock is unusable)
+//----------------------------------------------------------------------------------
+template <class T>
+bool CSharedMessageQueue<T>::Get(T& msg)
+{
+	if (NULL == m_pHeader)
+	{
+		return false;
+	}
+
+	QUEUE_TICKS nDeadline = QueueDeadline(m_nTimeoutMilliseconds);
+
+	// hold mutex
+	if (!Lock())
+	{
+		return false;
+	}
+
+	while (m_pHeader->m_nPutPosition.load(memory_order_relaxed) == m_pHeader->m_nGetPosition.load(memory_order_relaxed))
+	{
+		if (QueueGetTicks() >= nDeadline)
+		{
+			// release mutex
+			Unlock();
+			return false;
+		}
+
+		// read the word under the mutex, so a put after we unlock changes it
+		unsigned int nSequence = m_pHeader->m_nPutSequence.load(memory_order_relaxed);
+		m_pHeader->m_nGetWaiters++;
+
+		// release mutex
+		Unlock();
+
+		FutexWait(&m_pHeader->m_nPutSequence, nSequence, nDeadline);
+		m_pHeader->m_nGetWaiters--;
+
+		// hold mutex
+		if (!Lock())
+		{
+			return false;
+		}
+	}
+
+	// copy first, release the slot after with one store
+	unsigned long long nGet = m_pHeader->m_nGetPosition.load(memory_order_relaxed);
+	memcpy(static_cast<void*>(&msg), &m_pSlots[nGet % m_pHeader->m_nMaxSize], sizeof(T));
+	m_pHeader->m_nGetPosition.store(nGet + 1, memory_order_release);
+	m_pHeader->m_nGetSequence++;
+
+	bool bWake = m_pHeader->m_nPutWaiters.load(memory_order_relaxed) > 0;
+
+	// release mutex
+	Unlock();
+
+	// wake a blocked writer
+	if (bWake)
+	{
+		FutexWake(&m_pHeader->m_nGetSequence, 1);
+	}
+
+	return true;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CSharedMessageQueue<T>::GetSize
+//
+// Usage:
+//	- To get the current queue size
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- unsigned int: the current queue size, 0 if not open or the lock is
+//	  unusable
+//----------------------------------------------------------------------------------
+template <class T>
+unsigned int CSharedMessageQueue<T>::GetSize()
+{
+	if (NULL == m_pHeader || !Lock())
+	{
+		return 0;
+	}
+
+	unsigned int nCurrentSize = (unsigned int)(m_pHeader->m_nPutPosition.load(memory_order_relaxed) - m_pHeader->m_nGetPosition.load(memory_order_relaxed));
+
+	// release mutex
+	Unlock();
+
+	return nCurrentSize;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CSharedMessageQueue<T>::GetMaxSize
+//
+// Usage:
+//	- To get the capacity chosen by the segment's creator
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- unsigned int: the maximum allowed queue size, 0 if not open
+//----------------------------------------------------------------------------------
+template <class T>
+unsigned int CSharedMessageQueue<T>::GetMaxSize()
+{
+	return (NULL == m_pHeader) ? 0 : m_pHeader->m_nMaxSize;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CSharedMessageQueue<T>::GetRecoveryCount
+//
+// Usage:
+//	- To find out how often a process died holding the queue lock
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- unsigned int: number of recoveries since the segment was created
+//----------------------------------------------------------------------------------
+template <class T>
+unsigned int CSharedMessageQueue<T>::GetRecoveryCount()
+{
+	return (NULL == m_pHeader) ? 0 : m_pHeader->m_nRecoveries.load(memory_order_relaxed);
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CSharedMessageQueue<T>::SetTimeout
+//
+// Usage:
+//	- To set time out interval for this process's Put/Get calls
+//
+// Prameters:
+//	- unsigned int nTimeoutMilliseconds:	time out interval in milliseconds
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T>
+void CSharedMessageQueue<T>::SetTimeout(unsigned int nTimeoutMilliseconds)
+{
+	m_nTimeoutMilliseconds = nTimeoutMilliseconds;
+}
+
+#endif /*__linux__*/
+#endif /*_SHAREDMESSAGEQUEUE*/
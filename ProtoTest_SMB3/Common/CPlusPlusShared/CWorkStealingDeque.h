@@ -0,0 +1,309 @@
+#ifndef _WORKSTEALINGDEQUE
+#define _WORKSTEALINGDEQUE
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <type_traits>
+#include "CQueueStorage.h"
+
+using namespace std;
+
+// initial deque capacity, must be a power of two
+const unsigned int DEFAULT_DEQUE_CAPACITY = 256;
+
+//---------------------------------------------------------------------------------
+// Work-Stealing Deque Class (Chase-Lev)
+//
+// One owner thread pushes and pops at the bottom (LIFO, cache-warm); any other
+// thread may steal from the top (FIFO, oldest work first). Only a pop racing a
+// steal for the very last element needs a CAS.
+//
+// The ring grows by doubling when the owner pushes into a full one. Thieves
+// may still be reading the old ring, so retired rings are kept until the deque
+// is destroyed. T must be trivially copyable (in practice a pointer).
+//---------------------------------------------------------------------------------
+template <class T>
+class CWorkStealingDeque
+{
+	static_assert(is_trivially_copyable<T>::value, "CWorkStealingDeque holds trivially copyable elements only");
+
+private:
+	//---------------------
+	// Ring Array
+	//---------------------
+	struct CRing
+	{
+		// capacity - 1
+		long long m_nMask;
+
+		// slots, read by thieves concurrently with the owner's writes
+		atomic<T>* m_pSlots;
+
+		CRing(long long nCapacity) : m_nMask(nCapacity - 1), m_pSlots(new atomic<T>[(size_t)nCapacity]) { }
+		~CRing() { delete [] m_pSlots; }
+
+		T Get(long long i) { return m_pSlots[i & m_nMask].load(memory_order_relaxed); }
+		void Put(long long i, T x) { m_pSlots[i & m_nMask].store(x, memory_order_relaxed); }
+	};
+
+	// steal end, advanced by thieves (and the owner taking the last element)
+	atomic<long long> m_nTop;
+
+	char m_Pad0[QUEUE_CACHE_LINE_SIZE];
+
+	// owner end
+	atomic<long long> m_nBottom;
+
+	// current ring
+	atomic<CRing*> m_pRing;
+
+	char m_Pad1[QUEUE_CACHE_LINE_SIZE];
+
+	// rings replaced by a grow, freed with the deque (owner only)
+	vector<CRing*> m_vRetired;
+
+private:
+	// not copyable
+	CWorkStealingDeque(const CWorkStealingDeque&);
+	CWorkStealingDeque& operator=(const CWorkStealingDeque&);
+
+	// Double the ring (owner only)
+	CRing* Grow(CRing* pRing, long long nBottom, long long nTop);
+
+public:
+	// Constructor
+	CWorkStealingDeque(unsigned int nCapacity = DEFAULT_DEQUE_CAPACITY);
+
+	// Destructor
+	~CWorkStealingDeque();
+
+public:
+	// Push at the bottom (owner thread only)
+	void Push(T x);
+
+	// Pop from the bottom (owner thread only)
+	bool Pop(T& x);
+
+	// Steal from the top (any thread)
+	bool Steal(T& x);
+
+	// Get number of elements (a snapshot)
+	unsigned int GetSize();
+};
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CWorkStealingDeque<T>::CWorkStealingDeque
+//
+// Usage:
+//	- Class Constructor
+//
+// Prameters:
+//	- unsigned int nCapacity:	initial capacity, rounded up to a power of two
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T>
+CWorkStealingDeque<T>::CWorkStealingDeque(unsigned int nCapacity)
+{
+	long long nRingCapacity = 1;
+
+	while (nRingCapacity < nCapacity)
+	{
+		nRingCapacity <<= 1;
+	}
+
+	m_nTop.store(0, memory_order_relaxed);
+	m_nBottom.store(0, memory_order_relaxed);
+	m_pRing.store(new CRing(nRingCapacity), memory_order_relaxed);
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CWorkStealingDeque<T>::~CWorkStealingDeque
+//
+// Usage:
+//	- Class Destructor. No thread may be using the deque any more.
+//
+// Prameters:
+//  - N/A
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T>
+CWorkStealingDeque<T>::~CWorkStealingDeque()
+{
+	delete m_pRing.load(memory_order_relaxed);
+
+	for (size_t i = 0; i < m_vRetired.size(); i++)
+	{
+		delete m_vRetired[i];
+	}
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CWorkStealingDeque<T>::Grow
+//
+// Usage:
+//	- To move the live elements into a ring twice as large
+//
+// Prameters:
+//	- CRing* pRing:				the current (full) ring
+//	- long long nBottom:		owner end
+//	- long long nTop:			steal end
+//
+// Returns:
+//	- CRing*: the new ring, already published
+//----------------------------------------------------------------------------------
+template <class T>
+typename CWorkStealingDeque<T>::CRing* CWorkStealingDeque<T>::Grow(CRing* pRing, long long nBottom, long long nTop)
+{
+	CRing* pNewRing = new CRing((pRing->m_nMask + 1) * 2);
+
+	for (long long i = nTop; i < nBottom; i++)
+	{
+		pNewRing->Put(i, pRing->Get(i));
+	}
+
+	// thieves that loaded the old ring may still read from it
+	m_vRetired.push_back(pRing);
+	m_pRing.store(pNewRing, memory_order_release);
+
+	return pNewRing;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CWorkStealingDeque<T>::Push
+//
+// Usage:
+//	- To push an element at the owner end, growing the ring if it is full
+//
+// Prameters:
+//	- T x:	the element
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+template <class T>
+void CWorkStealingDeque<T>::Push(T x)
+{
+	long long nBottom = m_nBottom.load(memory_order_relaxed);
+	long long nTop = m_nTop.load(memory_order_acquire);
+	CRing* pRing = m_pRing.load(memory_order_relaxed);
+
+	if (nBottom - nTop > pRing->m_nMask)
+	{
+		pRing = Grow(pRing, nBottom, nTop);
+	}
+
+	pRing->Put(nBottom, x);
+
+	// publish the element with the new bottom (pairs with the acquire in Steal)
+	m_nBottom.store(nBottom + 1, memory_order_release);
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CWorkStealingDeque<T>::Pop
+//
+// Usage:
+//	- To pop the most recently pushed element at the owner end
+//
+// Prameters:
+//	- T& x:	receives the element
+//
+// Returns:
+//	- bool: true if an element was popped, false if empty or lost to a thief
+//----------------------------------------------------------------------------------
+template <class T>
+bool CWorkStealingDeque<T>::Pop(T& x)
+{
+	long long nBottom = m_nBottom.load(memory_order_relaxed) - 1;
+	CRing* pRing = m_pRing.load(memory_order_relaxed);
+
+	// claim the bottom slot before looking at top (pairs with the fence in Steal)
+	m_nBottom.store(nBottom, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	long long nTop = m_nTop.load(memory_order_relaxed);
+
+	if (nTop > nBottom)
+	{
+		// empty: undo the claim
+		m_nBottom.store(nBottom + 1, memory_order_release);
+		return false;
+	}
+
+	x = pRing->Get(nBottom);
+	if (nTop < nBottom)
+	{
+		// more than one element left, no thief can reach this one
+		return true;
+	}
+
+	// last element: race the thieves for it
+	bool bWon = m_nTop.compare_exchange_strong(nTop, nTop + 1, memory_order_seq_cst, memory_order_relaxed);
+	m_nBottom.store(nBottom + 1, memory_order_release);
+
+	return bWon;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CWorkStealingDeque<T>::Steal
+//
+// Usage:
+//	- To take the oldest element from the steal end
+//
+// Prameters:
+//	- T& x:	receives the element
+//
+// Returns:
+//	- bool: true if an element was stolen, false if empty or lost a race
+//----------------------------------------------------------------------------------
+template <class T>
+bool CWorkStealingDeque<T>::Steal(T& x)
+{
+	long long nTop = m_nTop.load(memory_order_acquire);
+	atomic_thread_fence(memory_order_seq_cst);
+	long long nBottom = m_nBottom.load(memory_order_acquire);
+
+	if (nTop >= nBottom)
+	{
+		return false;
+	}
+
+	CRing* pRing = m_pRing.load(memory_order_acquire);
+	x = pRing->Get(nTop);
+
+	// another thief or the owner's last-element pop may have beaten us
+	return m_nTop.compare_exchange_strong(nTop, nTop + 1, memory_order_seq_cst, memory_order_relaxed);
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CWorkStealingDeque<T>::GetSize
+//
+// Usage:
+//	- To get the number of elements
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- unsigned int: the number of elements, may be stale by the time it returns
+//----------------------------------------------------------------------------------
+template <class T>
+unsigned int CWorkStealingDeque<T>::GetSize()
+{
+	long long nBottom = m_nBottom.load(memory_order_relaxed);
+	long long nTop = m_nTop.load(memory_order_relaxed);
+
+	return (nBottom > nTop) ? (unsigned int)(nBottom - nTop) : 0;
+}
+#endif /*_WORKSTEALINGDEQUE*/
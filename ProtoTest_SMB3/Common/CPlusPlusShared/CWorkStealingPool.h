@@ -0,0 +1,701 @@
+#ifndef _WORKSTEALINGPOOL
+#define _WORKSTEALINGPOOL
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <list>
+#include <thread>
+#include <functional>
+#include "CMessageQueue.h"
+#include "CWorkStealingDeque.h"
+
+using namespace std;
+
+// a unit of work run by the pool
+typedef function<void()> CPoolTask;
+
+//---------------------------------------------------------------------------------
+// Work-Stealing Pool Class
+//
+// A fixed set of worker threads, each owning a CWorkStealingDeque of tasks.
+//	- Submit from a worker pushes to that worker's own deque, so follow-up
+//	  work (e.g. encrypt after decode on the same connection) stays on the
+//	  core that has its data cached.
+//	- Submit from any other thread goes through the injection queue, a
+//	  bounded CMessageQueue on CMpmcQueuePolicy; it blocks while that is full,
+//	  up to the pool timeout. Post never blocks: what does not fit goes to an
+//	  unbounded overflow list instead.
+//	- An idle worker looks at its own deque, then the injection queue, then
+//	  steals from the other workers, and finally parks. A parked worker is
+//	  woken by new work, and otherwise rescans every pool timeout interval.
+//
+// Tasks must not throw. WaitIdle waits until every submitted task has run;
+// the destructor does the same and then stops the workers.
+//---------------------------------------------------------------------------------
+class CWorkStealingPool
+{
+private:
+	//---------------------
+	// Worker
+	//---------------------
+	struct CWorker
+	{
+		// pool owning this worker
+		CWorkStealingPool* m_pPool;
+
+		// index in m_vWorkers
+		unsigned int m_nIndex;
+
+		// tasks submitted from this worker
+		CWorkStealingDeque<CPoolTask*> m_Deque;
+
+		// victim selection state (xorshift)
+		unsigned int m_nRandom;
+
+		// worker thread
+		thread m_Thread;
+	};
+
+	// worker threads
+	vector<CWorker*> m_vWorkers;
+
+	// tasks submitted from outside the pool
+	CMessageQueue<CPoolTask*, CMpmcQueuePolicy<CPoolTask*> > m_qInjection;
+
+	// tasks posted while the injection queue was full
+	list<CPoolTask*> m_lstOverflow;
+
+	// number of tasks in m_lstOverflow, readable without the mutex
+	atomic<unsigned int> m_nOverflow;
+
+	// guards m_lstOverflow
+	CQueueMutex m_OverflowMutex;
+
+	// guards parking and WaitIdle
+	CQueueMutex m_ParkMutex;
+
+	// signalled when work arrives or the pool stops
+	CQueueCondition m_WorkCondition;
+
+	// signalled when the last pending task finishes
+	CQueueCondition m_IdleCondition;
+
+	// number of parked workers
+	atomic<unsigned int> m_nParked;
+
+	// tasks submitted but not finished
+	atomic<unsigned int> m_nPending;
+
+	// set once the workers should exit
+	atomic<bool> m_bStopping;
+
+	// park interval of idle workers and Submit timeout, in milliseconds
+	atomic<unsigned int> m_nTimeoutMilliseconds;
+
+private:
+	// not copyable
+	CWorkStealingPool(const CWorkStealingPool&);
+	CWorkStealingPool& operator=(const CWorkStealingPool&);
+
+	// Get the worker running on the calling thread, NULL if none of ours
+	static CWorker*& CurrentWorker();
+
+	// Worker thread body
+	void WorkerLoop(CWorker* pWorker);
+
+	// Find a task for a worker: own deque, injection queue, overflow, then steal
+	bool FindTask(CWorker* pWorker, CPoolTask*& pTask);
+
+	// Take the oldest task of the overflow list
+	bool PopOverflow(CPoolTask*& pTask);
+
+	// Whether any task is waiting anywhere
+	bool HasWork();
+
+	// Park an idle worker until work arrives or the timeout passes
+	void Park();
+
+	// Wake one parked worker after work was added
+	void NotifyWork();
+
+	// Run a task and account for it
+	void RunTask(CPoolTask* pTask);
+
+public:
+	// Constructor
+	CWorkStealingPool(unsigned int nWorkers = 0, unsigned int nInjectionSize = DEFAULT_MAX_QUEUE_SIZE, unsigned int nTimeoutMilliseconds = DEFAULT_TIMEOUT_INTERVAL);
+
+	// Destructor
+	virtual ~CWorkStealingPool();
+
+public:
+	// Queue a task
+	bool Submit(const CPoolTask& task);
+
+	// Queue a task without blocking or failing
+	void Post(const CPoolTask& task);
+
+	// Wait until every submitted task has finished
+	void WaitIdle();
+
+	// Get number of worker threads
+	unsigned int GetWorkerCount();
+
+	// Get number of tasks submitted but not finished
+	unsigned int GetPendingCount();
+
+	// Set park interval and Submit timeout
+	void SetTimeout(unsigned int nTimeoutMilliseconds);
+};
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CWorkStealingPool::CWorkStealingPool
+//
+// Usage:
+//	- Class Constructor, starts the workers
+//
+// Prameters:
+//	- unsigned int nWorkers:				number of workers, 0 for one per core
+//	- unsigned int nInjectionSize:			capacity of the injection queue
+//	- unsigned int nTimeoutMilliseconds:	park interval and Submit timeout
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+inline CWorkStealingPool::CWorkStealingPool(unsigned int nWorkers, unsigned int nInjectionSize, unsigned int nTimeoutMilliseconds)
+	: m_qInjection(nInjectionSize, nTimeoutMilliseconds)
+{
+	m_nParked = 0;
+	m_nPending = 0;
+	m_nOverflow = 0;
+	m_bStopping = false;
+	m_nTimeoutMilliseconds = nTimeoutMilliseconds;
+
+	if (0 == nWorkers)
+	{
+		nWorkers = thread::hardware_concurrency();
+	}
+	if (0 == nWorkers)
+	{
+		nWorkers = 1;
+	}
+
+	// create every worker before starting any, thieves index m_vWorkers
+	for (unsigned int i = 0; i < nWorkers; i++)
+	{
+		CWorker* pWorker = new CWorker;
+
+		pWorker->m_pPool = this;
+		pWorker->m_nIndex = i;
+		pWorker->m_nRandom = 2463534242u + i * 2654435761u;
+		m_vWorkers.push_back(pWorker);
+	}
+
+	for (unsigned int i = 0; i < nWorkers; i++)
+	{
+		m_vWorkers[i]->m_Thread = thread(&CWorkStealingPool::WorkerLoop, this, m_vWorkers[i]);
+	}
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CWorkStealingPool::~CWorkStealingPool
+//
+// Usage:
+//	- Class Destructor, runs the remaining tasks and joins the workers
+//
+// Prameters:
+//  - N/A
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+inline CWorkStealingPool::~CWorkStealingPool()
+{
+	WaitIdle();
+
+	// hold mutex
+	m_ParkMutex.Lock();
+
+	m_bStopping = true;
+	m_WorkCondition.NotifyAll();
+
+	// release mutex
+	m_ParkMutex.Unlock();
+
+	for (unsigned int i = 0; i < m_vWorkers.size(); i++)
+	{
+		m_vWorkers[i]->m_Thread.join();
+		delete m_vWorkers[i];
+	}
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CWorkStealingPool::CurrentWorker
+//
+// Usage:
+//	- To reach the calling thread's worker slot
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- CWorker*&: the worker running on this thread, NULL outside any pool
+//----------------------------------------------------------------------------------
+inline CWorkStealingPool::CWorker*& CWorkStealingPool::CurrentWorker()
+{
+	static thread_local CWorker* s_pWorker = NULL;
+
+	return s_pWorker;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CWorkStealingPool::Submit
+//
+// Usage:
+//	- To queue a task. From one of this pool's workers it goes to that
+//	  worker's deque and never blocks; from any other thread it goes to the
+//	  injection queue and may block while that is full.
+//
+// Prameters:
+//	- const CPoolTask& task:	the task
+//
+// Returns:
+//	- bool: false if the injection queue stayed full until the timeout
+//----------------------------------------------------------------------------------
+inline bool CWorkStealingPool::Submit(const CPoolTask& task)
+{
+	CPoolTask* pTask = new CPoolTask(task);
+	CWorker* pWorker = CurrentWorker();
+
+	m_nPending++;
+
+	if (NULL != pWorker && this == pWorker->m_pPool)
+	{
+		pWorker->m_Deque.Push(pTask);
+	}
+	else if (!m_qInjection.Put(pTask))
+	{
+		delete pTask;
+
+		// may have been the last thing WaitIdle was waiting on
+		if (1 == m_nPending.fetch_sub(1))
+		{
+			m_ParkMutex.Lock();
+			m_IdleCondition.NotifyAll();
+			m_ParkMutex.Unlock();
+		}
+		return false;
+	}
+
+	NotifyWork();
+	return true;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CWorkStealingPool::Post
+//
+// Usage:
+//	- To queue a task from a thread that must not block, e.g. one resuming
+//	  a coroutine on behalf of a queue. Like Submit, but a task that does not
+//	  fit in the injection queue right away goes to the overflow list, so it
+//	  is never dropped.
+//
+// Prameters:
+//	- const CPoolTask& task:	the task
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+inline void CWorkStealingPool::Post(const CPoolTask& task)
+{
+	CPoolTask* pTask = new CPoolTask(task);
+	CWorker* pWorker = CurrentWorker();
+
+	m_nPending++;
+
+	if (NULL != pWorker && this == pWorker->m_pPool)
+	{
+		pWorker->m_Deque.Push(pTask);
+	}
+	else if (QUEUE_OK != m_qInjection.Put(pTask, (QUEUE_TICKS)0))
+	{
+		// hold mutex
+		m_OverflowMutex.Lock();
+
+		m_lstOverflow.push_back(pTask);
+		m_nOverflow++;
+
+		// release mutex
+		m_OverflowMutex.Unlock();
+	}
+
+	NotifyWork();
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CWorkStealingPool::WaitIdle
+//
+// Usage:
+//	- To wait until every submitted task has finished. Must not be called
+//	  from a task, which would wait for itself.
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+inline void CWorkStealingPool::WaitIdle()
+{
+	// hold mutex
+	m_ParkMutex.Lock();
+
+	while (0 != m_nPending.load())
+	{
+		m_IdleCondition.WaitUntil(m_ParkMutex, QUEUE_TICKS_INFINITE);
+	}
+
+	// release mutex
+	m_ParkMutex.Unlock();
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CWorkStealingPool::WorkerLoop
+//
+// Usage:
+//	- Worker thread body: run tasks until the pool stops
+//
+// Prameters:
+//	- CWorker* pWorker:	the worker this thread runs
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+inline void CWorkStealingPool::WorkerLoop(CWorker* pWorker)
+{
+	CurrentWorker() = pWorker;
+
+	while (!m_bStopping.load())
+	{
+		CPoolTask* pTask = NULL;
+
+		if (FindTask(pWorker, pTask))
+		{
+			RunTask(pTask);
+		}
+		else
+		{
+			Park();
+		}
+	}
+
+	CurrentWorker() = NULL;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CWorkStealingPool::FindTask
+//
+// Usage:
+//	- To find a task for a worker: newest task of its own deque first, then
+//	  the injection queue and its overflow list, then the oldest task of
+//	  another worker starting at a random victim
+//
+// Prameters:
+//	- CWorker* pWorker:		the worker looking for work
+//	- CPoolTask*& pTask:	receives the task
+//
+// Returns:
+//	- bool: true if a task was found
+//----------------------------------------------------------------------------------
+inline bool CWorkStealingPool::FindTask(CWorker* pWorker, CPoolTask*& pTask)
+{
+	if (pWorker->m_Deque.Pop(pTask))
+	{
+		return true;
+	}
+
+	if (m_qInjection.GetBatch(&pTask, 1, 0) > 0)
+	{
+		return true;
+	}
+
+	if (0 != m_nOverflow.load() && PopOverflow(pTask))
+	{
+		return true;
+	}
+
+	unsigned int nWorkers = (unsigned int)m_vWorkers.size();
+
+	// xorshift32 so thieves spread over victims instead of all hitting worker 0
+	pWorker->m_nRandom ^= pWorker->m_nRandom << 13;
+	pWorker->m_nRandom ^= pWorker->m_nRandom >> 17;
+	pWorker->m_nRandom ^= pWorker->m_nRandom << 5;
+
+	unsigned int nStart = pWorker->m_nRandom % nWorkers;
+	for (unsigned int i = 0; i < nWorkers; i++)
+	{
+		CWorker* pVictim = m_vWorkers[(nStart + i) % nWorkers];
+
+		if (pVictim != pWorker && pVictim->m_Deque.Steal(pTask))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CWorkStealingPool::PopOverflow
+//
+// Usage:
+//	- To take the oldest task posted while the injection queue was full
+//
+// Prameters:
+//	- CPoolTask*& pTask:	receives the task
+//
+// Returns:
+//	- bool: true if a task was taken
+//----------------------------------------------------------------------------------
+inline bool CWorkStealingPool::PopOverflow(CPoolTask*& pTask)
+{
+	bool bFound = false;
+
+	// hold mutex
+	m_OverflowMutex.Lock();
+
+	if (!m_lstOverflow.empty())
+	{
+		pTask = m_lstOverflow.front();
+		m_lstOverflow.pop_front();
+		m_nOverflow--;
+		bFound = true;
+	}
+
+	// release mutex
+	m_OverflowMutex.Unlock();
+
+	return bFound;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CWorkStealingPool::HasWork
+//
+// Usage:
+//	- To check whether any task is waiting in the injection queue, the
+//	  overflow list or a deque
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- bool: true if some task is waiting
+//----------------------------------------------------------------------------------
+inline bool CWorkStealingPool::HasWork()
+{
+	if (m_qInjection.GetSize() > 0 || 0 != m_nOverflow.load())
+	{
+		return true;
+	}
+
+	for (unsigned int i = 0; i < m_vWorkers.size(); i++)
+	{
+		if (m_vWorkers[i]->m_Deque.GetSize() > 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CWorkStealingPool::Park
+//
+// Usage:
+//	- To put an idle worker to sleep until work arrives, the pool stops or
+//	  the pool timeout passes
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+inline void CWorkStealingPool::Park()
+{
+	// hold mutex
+	m_ParkMutex.Lock();
+
+	// announce before re-checking, so a Submit after the check sees us
+	m_nParked++;
+	atomic_thread_fence(memory_order_seq_cst);
+
+	if (!m_bStopping.load() && !HasWork())
+	{
+		m_WorkCondition.WaitUntil(m_ParkMutex, QueueDeadline(m_nTimeoutMilliseconds.load()));
+	}
+	m_nParked--;
+
+	// release mutex
+	m_ParkMutex.Unlock();
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CWorkStealingPool::NotifyWork
+//
+// Usage:
+//	- To wake one parked worker after a task was queued. Costs only a fence
+//	  and a load while every worker is busy.
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+inline void CWorkStealingPool::NotifyWork()
+{
+	// pairs with the fence in Park
+	atomic_thread_fence(memory_order_seq_cst);
+
+	if (0 == m_nParked.load(memory_order_relaxed))
+	{
+		return;
+	}
+
+	// hold mutex
+	m_ParkMutex.Lock();
+
+	m_WorkCondition.NotifyOne();
+
+	// release mutex
+	m_ParkMutex.Unlock();
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CWorkStealingPool::RunTask
+//
+// Usage:
+//	- To run a task, free it and wake WaitIdle if it was the last one
+//
+// Prameters:
+//	- CPoolTask* pTask:	the task
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+inline void CWorkStealingPool::RunTask(CPoolTask* pTask)
+{
+	(*pTask)();
+	delete pTask;
+
+	if (1 == m_nPending.fetch_sub(1))
+	{
+		// hold mutex
+		m_ParkMutex.Lock();
+
+		m_IdleCondition.NotifyAll();
+
+		// release mutex
+		m_ParkMutex.Unlock();
+	}
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CWorkStealingPool::GetWorkerCount
+//
+// Usage:
+//	- To get the number of worker threads
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- unsigned int: the number of workers
+//----------------------------------------------------------------------------------
+inline unsigned int CWorkStealingPool::GetWorkerCount()
+{
+	return (unsigned int)m_vWorkers.size();
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CWorkStealingPool::GetPendingCount
+//
+// Usage:
+//	- To get the number of tasks submitted but not finished
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- unsigned int: the number of pending tasks
+//----------------------------------------------------------------------------------
+inline unsigned int CWorkStealingPool::GetPendingCount()
+{
+	return m_nPending.load();
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CWorkStealingPool::SetTimeout
+//
+// Usage:
+//	- To set how long idle workers park before rescanning, and how long
+//	  Submit waits on a full injection queue
+//
+// Prameters:
+//	- unsigned int nTimeoutMilliseconds:	time out interval in milliseconds
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+inline void CWorkStealingPool::SetTimeout(unsigned int nTimeoutMilliseconds)
+{
+	m_nTimeoutMilliseconds = nTimeoutMilliseconds;
+	m_qInjection.SetTimeout(nTimeoutMilliseconds);
+}
+
+#ifdef MESSAGEQUEUE_COROUTINES
+//------------------------------------------------------------
+// Pool Executor Class
+//
+// Resumes coroutines woken by a CMessageQueue on the workers
+// of a CWorkStealingPool. Uses Post, so a full injection queue
+// neither blocks the waking thread nor loses the coroutine.
+//------------------------------------------------------------
+class CPoolExecutor : public CQueueExecutor
+{
+private:
+	// pool running the coroutines
+	CWorkStealingPool& m_Pool;
+
+public:
+	// Constructor
+	CPoolExecutor(CWorkStealingPool& pool) : m_Pool(pool) { }
+
+	// Schedule a suspended coroutine as a pool task
+	virtual void Resume(coroutine_handle<> hCoroutine)
+	{
+		m_Pool.Post([hCoroutine]() { hCoroutine.resume(); });
+	}
+};
+#endif /*MESSAGEQUEUE_COROUTINES*/
+#endif /*_WORKSTEALINGPOOL*/
@@ -0,0 +1,235 @@
+//---------------------------------------------------------------------------------
+// Locked Queue Allocation Test
+//
+// Checks that a CMessageQueue on CLockedQueuePolicy allocates nothing once it
+// is constructed: every operator new is counted, and the policy gets its
+// slots from a counting allocator. After warming up, Put/Get, PutBatch/
+// GetBatch and a producer/consumer pair that keeps blocking on a small queue
+// must not allocate at all. The slot allocator must be used exactly once.
+//
+// Build and run from this directory:
+//	g++ -std=c++17 -O2 -I.. LockedQueueAllocations.cpp -o LockedQueueAllocations -lpthread
+//	./LockedQueueAllocations
+//---------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <thread>
+#include "CMessageQueue.h"
+
+using namespace std;
+
+const unsigned int ALLOC_TEST_QUEUE_SIZE = 64;
+const unsigned int ALLOC_TEST_MESSAGES = 1000000;
+
+// operator new calls anywhere in the process
+static atomic<unsigned long long> g_nNewCalls(0);
+
+// allocate calls on any CCountingAllocator
+static atomic<unsigned long long> g_nSlotAllocations(0);
+
+void* operator new(size_t nSize)
+{
+	g_nNewCalls++;
+
+	void* p = malloc((nSize > 0) ? nSize : 1);
+	if (NULL == p)
+	{
+		throw bad_alloc();
+	}
+	return p;
+}
+
+void* operator new[](size_t nSize)
+{
+	return operator new(nSize);
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+	free(p);
+}
+
+// allocator that counts the slot allocations of the policy
+template <class T>
+class CCountingAllocator
+{
+public:
+	typedef T value_type;
+
+	CCountingAllocator() { }
+
+	template <class U>
+	CCountingAllocator(const CCountingAllocator<U>&) { }
+
+	T* allocate(size_t nCount)
+	{
+		g_nSlotAllocations++;
+		return allocator<T>().allocate(nCount);
+	}
+
+	void deallocate(T* p, size_t nCount)
+	{
+		allocator<T>().deallocate(p, nCount);
+	}
+
+	template <class U>
+	bool operator==(const CCountingAllocator<U>&) const { return true; }
+
+	template <class U>
+	bool operator!=(const CCountingAllocator<U>&) const { return false; }
+};
+
+typedef CMessageQueue<unsigned int, CLockedQueuePolicy<unsigned int, CCountingAllocator<unsigned int> > > CCountedQueue;
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CheckNoAllocations
+//
+// Usage:
+//	- To report whether a phase allocated since nNewCalls was sampled
+//
+// Prameters:
+//	- const char* pszPhase:				phase name to print
+//	- unsigned long long nNewCalls:		operator new count at the start
+//
+// Returns:
+//	- bool: true if nothing was allocated
+//----------------------------------------------------------------------------------
+bool CheckNoAllocations(const char* pszPhase, unsigned long long nNewCalls)
+{
+	unsigned long long nAllocated = g_nNewCalls - nNewCalls;
+
+	printf("%-28s %llu allocations\n", pszPhase, nAllocated);
+	return 0 == nAllocated;
+}
+
+int main()
+{
+	bool bOk = true;
+	CCountedQueue queue(ALLOC_TEST_QUEUE_SIZE, INFINITE, CCountingAllocator<unsigned int>());
+	unsigned int vBatch[ALLOC_TEST_QUEUE_SIZE];
+	unsigned int nMsg = 0;
+
+	// warm up: fill and drain once
+	for (unsigned int i = 0; i < ALLOC_TEST_QUEUE_SIZE; i++)
+	{
+		queue.Put(i);
+	}
+	while (queue.GetSize() > 0)
+	{
+		queue.Get(nMsg);
+	}
+
+	// Put/Get on one thread, at every depth up to full
+	unsigned long long nNewCalls = g_nNewCalls;
+	for (unsigned int i = 0; i < ALLOC_TEST_MESSAGES; i++)
+	{
+		queue.Put(i);
+		if (queue.GetSize() == ALLOC_TEST_QUEUE_SIZE)
+		{
+			while (queue.GetSize() > 0)
+			{
+				queue.Get(nMsg);
+			}
+		}
+	}
+	while (queue.GetSize() > 0)
+	{
+		queue.Get(nMsg);
+	}
+	bOk = CheckNoAllocations("Put/Get", nNewCalls) && bOk;
+
+	// PutBatch/GetBatch
+	for (unsigned int i = 0; i < ALLOC_TEST_QUEUE_SIZE; i++)
+	{
+		vBatch[i] = i;
+	}
+	nNewCalls = g_nNewCalls;
+	for (unsigned int i = 0; i < ALLOC_TEST_MESSAGES / ALLOC_TEST_QUEUE_SIZE; i++)
+	{
+		queue.PutBatch(vBatch, ALLOC_TEST_QUEUE_SIZE);
+		queue.GetBatch(vBatch, ALLOC_TEST_QUEUE_SIZE, 0);
+	}
+	bOk = CheckNoAllocations("PutBatch/GetBatch", nNewCalls) && bOk;
+
+	// a producer and a consumer that keep blocking on a small queue; the
+	// threads are created before sampling and wait for the start flag
+	CCountedQueue smallQueue(2, INFINITE, CCountingAllocator<unsigned int>());
+	atomic<unsigned int> nReady(0);
+	atomic<bool> bStart(false);
+	unsigned long long nSum = 0;
+
+	thread producer([&]()
+	{
+		nReady++;
+		while (!bStart)
+		{
+			this_thread::yield();
+		}
+		for (unsigned int i = 1; i <= ALLOC_TEST_MESSAGES; i++)
+		{
+			smallQueue.Put(i);
+		}
+	});
+
+	thread consumer([&]()
+	{
+		nReady++;
+		while (!bStart)
+		{
+			this_thread::yield();
+		}
+		for (unsigned int i = 0; i < ALLOC_TEST_MESSAGES; i++)
+		{
+			unsigned int nValue = 0;
+			smallQueue.Get(nValue);
+			nSum += nValue;
+		}
+	});
+
+	while (nReady < 2)
+	{
+		this_thread::yield();
+	}
+	nNewCalls = g_nNewCalls;
+	bStart = true;
+	producer.join();
+	consumer.join();
+	bOk = CheckNoAllocations("blocking producer/consumer", nNewCalls) && bOk;
+
+	if (nSum != (unsigned long long)ALLOC_TEST_MESSAGES * (ALLOC_TEST_MESSAGES + 1) / 2)
+	{
+		printf("FAILED: messages lost or duplicated\n");
+		bOk = false;
+	}
+
+	// one slot array per queue, nothing else
+	printf("%-28s %llu\n", "slot allocations", g_nSlotAllocations.load());
+	bOk = (2 == g_nSlotAllocations) && bOk;
+
+	if (!bOk)
+	{
+		printf("FAILED: steady-state queue operations allocated\n");
+		return 1;
+	}
+
+	return 0;
+}
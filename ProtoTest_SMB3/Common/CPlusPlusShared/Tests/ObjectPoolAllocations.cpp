@@ -0,0 +1,271 @@
+//---------------------------------------------------------------------------------
+// Object Pool Allocation Test
+//
+// Checks that pooled messages stop allocating once the pool has grown: every
+// operator new is counted while a producer thread makes packets from a
+// CObjectPool and puts them on a CMessageQueue<CPooledPtr<T>>, and a consumer
+// thread gets them and drops them, which returns them to the pool through the
+// consumer's cache and the depot. After a warm-up run the counted run must
+// not allocate at all and the pool must not grow.
+//
+// Then exhausts a one-chunk pool, frees half of the packets on another thread
+// so they sit in that thread's cache, and exhausts the pool again: every
+// node must come back, none may be left stranded in a cache.
+//
+// Build and run from this directory:
+//	g++ -std=c++17 -O2 -I.. ObjectPoolAllocations.cpp -o ObjectPoolAllocations -lpthread
+//	./ObjectPoolAllocations
+//---------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+#include <thread>
+#include <vector>
+#include "CMessageQueue.h"
+#include "CObjectPool.h"
+
+using namespace std;
+
+const unsigned int POOL_TEST_QUEUE_SIZE = 64;
+const unsigned int POOL_TEST_MESSAGES = 1000000;
+
+// objects reserved for the producer/consumer run
+const unsigned int POOL_TEST_RESERVE = 4 * POOL_CHUNK_SIZE;
+
+// operator new calls anywhere in the process
+static atomic<unsigned long long> g_nNewCalls(0);
+
+void* operator new(size_t nSize)
+{
+	g_nNewCalls++;
+
+	void* p = malloc((nSize > 0) ? nSize : 1);
+	if (NULL == p)
+	{
+		throw bad_alloc();
+	}
+	return p;
+}
+
+void* operator new[](size_t nSize)
+{
+	return operator new(nSize);
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+	free(p);
+}
+
+// payload of a pooled message
+struct CPacket
+{
+	unsigned int m_nSeq;
+	unsigned char m_Data[60];
+
+	CPacket(unsigned int nSeq) : m_nSeq(nSeq) { m_Data[0] = (unsigned char)nSeq; }
+};
+
+typedef CMessageQueue<CPooledPtr<CPacket> > CPacketQueue;
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- CheckNoAllocations
+//
+// Usage:
+//	- To report whether a phase allocated since nNewCalls was sampled
+//
+// Prameters:
+//	- const char* pszPhase:				phase name to print
+//	- unsigned long long nNewCalls:		operator new count at the start
+//
+// Returns:
+//	- bool: true if nothing was allocated
+//----------------------------------------------------------------------------------
+bool CheckNoAllocations(const char* pszPhase, unsigned long long nNewCalls)
+{
+	unsigned long long nAllocated = g_nNewCalls - nNewCalls;
+
+	printf("%-28s %llu allocations\n", pszPhase, nAllocated);
+	return 0 == nAllocated;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- RunProducerConsumer
+//
+// Usage:
+//	- To pass POOL_TEST_MESSAGES pooled packets from a producer thread to a
+//	  consumer thread. The threads are created before sampling the operator
+//	  new count and wait for the start flag.
+//
+// Prameters:
+//	- CObjectPool<CPacket>& pool:		pool the producer makes packets from
+//	- CPacketQueue& queue:				queue between the threads
+//	- const char* pszPhase:				phase name to print
+//
+// Returns:
+//	- bool: true if nothing was allocated and every packet arrived once
+//----------------------------------------------------------------------------------
+bool RunProducerConsumer(CObjectPool<CPacket>& pool, CPacketQueue& queue, const char* pszPhase)
+{
+	atomic<unsigned int> nReady(0);
+	atomic<bool> bStart(false);
+	atomic<unsigned int> nMakeFailed(0);
+	unsigned long long nSum = 0;
+
+	thread producer([&]()
+	{
+		nReady++;
+		while (!bStart)
+		{
+			this_thread::yield();
+		}
+		for (unsigned int i = 1; i <= POOL_TEST_MESSAGES; i++)
+		{
+			CPooledPtr<CPacket> pPacket = pool.Make(i);
+			if (pPacket.IsNull())
+			{
+				nMakeFailed++;
+				pPacket = pool.Make(0u);
+			}
+			queue.Put(move(pPacket));
+		}
+	});
+
+	thread consumer([&]()
+	{
+		nReady++;
+		while (!bStart)
+		{
+			this_thread::yield();
+		}
+		for (unsigned int i = 0; i < POOL_TEST_MESSAGES; i++)
+		{
+			CPooledPtr<CPacket> pPacket;
+			if (queue.Get(pPacket) && !pPacket.IsNull())
+			{
+				nSum += pPacket->m_nSeq;
+			}
+		}
+	});
+
+	while (nReady < 2)
+	{
+		this_thread::yield();
+	}
+	unsigned long long nNewCalls = g_nNewCalls;
+	bStart = true;
+	producer.join();
+	consumer.join();
+	bool bOk = CheckNoAllocations(pszPhase, nNewCalls);
+
+	if (nMakeFailed != 0 || nSum != (unsigned long long)POOL_TEST_MESSAGES * (POOL_TEST_MESSAGES + 1) / 2)
+	{
+		printf("FAILED: %u packets could not be made, or packets lost or duplicated\n", nMakeFailed.load());
+		bOk = false;
+	}
+
+	return bOk;
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- MakeUntilExhausted
+//
+// Usage:
+//	- To take packets from the pool until Make fails
+//
+// Prameters:
+//	- CObjectPool<CPacket>& pool:				the pool
+//	- vector<CPooledPtr<CPacket> >& vPackets:	receives the packets
+//
+// Returns:
+//	- unsigned int: number of packets made
+//----------------------------------------------------------------------------------
+unsigned int MakeUntilExhausted(CObjectPool<CPacket>& pool, vector<CPooledPtr<CPacket> >& vPackets)
+{
+	unsigned int nMade = 0;
+
+	for (;;)
+	{
+		CPooledPtr<CPacket> pPacket = pool.Make(nMade);
+		if (pPacket.IsNull())
+		{
+			return nMade;
+		}
+		vPackets.push_back(move(pPacket));
+		nMade++;
+	}
+}
+
+int main()
+{
+	bool bOk = true;
+
+	// producer and consumer on a pool reserved up front
+	CObjectPool<CPacket> pool(POOL_TEST_RESERVE);
+	CPacketQueue queue(POOL_TEST_QUEUE_SIZE, INFINITE);
+
+	pool.Reserve(POOL_TEST_RESERVE);
+	bOk = RunProducerConsumer(pool, queue, "warm-up producer/consumer") && bOk;
+	bOk = RunProducerConsumer(pool, queue, "producer/consumer") && bOk;
+
+	printf("%-28s %u objects\n", "pool capacity", pool.GetCapacity());
+	bOk = (POOL_TEST_RESERVE == pool.GetCapacity()) && bOk;
+
+	// exhaust a one-chunk pool, free half on another thread, exhaust again
+	CObjectPool<CPacket> smallPool(POOL_CHUNK_SIZE);
+	vector<CPooledPtr<CPacket> > vPackets;
+	vector<CPooledPtr<CPacket> > vOtherPackets;
+	unsigned int nFirst = MakeUntilExhausted(smallPool, vPackets);
+
+	for (unsigned int i = 0; i < nFirst / 2; i++)
+	{
+		vOtherPackets.push_back(move(vPackets.back()));
+		vPackets.pop_back();
+	}
+
+	thread releaser([&]()
+	{
+		vOtherPackets.clear();
+	});
+	releaser.join();
+	vPackets.clear();
+
+	unsigned int nSecond = MakeUntilExhausted(smallPool, vPackets);
+	vPackets.clear();
+	unsigned int nThird = MakeUntilExhausted(smallPool, vPackets);
+	vPackets.clear();
+
+	printf("%-28s %u, %u, %u objects\n", "exhaust/reuse", nFirst, nSecond, nThird);
+	if (nFirst != POOL_CHUNK_SIZE || nSecond != POOL_CHUNK_SIZE || nThird != POOL_CHUNK_SIZE)
+	{
+		printf("FAILED: pool nodes lost\n");
+		bOk = false;
+	}
+
+	if (!bOk)
+	{
+		printf("FAILED: pooled messages allocated or lost\n");
+		return 1;
+	}
+
+	return 0;
+}
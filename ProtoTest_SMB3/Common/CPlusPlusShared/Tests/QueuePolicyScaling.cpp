@@ -0,0 +1,133 @@
+//---------------------------------------------------------------------------------
+// Queue Policy Scaling Benchmark
+//
+// Compares CMpmcQueuePolicy with the default CLockedQueuePolicy for 1 to 32
+// threads. With one thread it alternates Put and Get; otherwise half of the
+// threads put and half get, on a queue of DEFAULT_MAX_QUEUE_SIZE messages.
+// Prints the throughput of each run in million messages per second and
+// fails if a message is lost.
+//
+// Build and run from this directory:
+//	g++ -std=c++17 -O2 -I.. QueuePolicyScaling.cpp -o QueuePolicyScaling -lpthread
+//	./QueuePolicyScaling [messages per run]
+//---------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "CMessageQueue.h"
+
+using namespace std;
+
+const unsigned int SCALING_DEFAULT_MESSAGES = 2000000;
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- RunScaling
+//
+// Usage:
+//	- To move nMessages through a fresh queue with nThreads threads
+//
+// Prameters:
+//	- unsigned int nThreads:			threads taking part
+//	- unsigned int nMessages:			messages to move
+//	- double& dMillionPerSecond:		receives the throughput
+//
+// Returns:
+//	- bool: true if every message arrived exactly once
+//----------------------------------------------------------------------------------
+template <class TQueuePolicy>
+bool RunScaling(unsigned int nThreads, unsigned int nMessages, double& dMillionPerSecond)
+{
+	CMessageQueue<unsigned int, TQueuePolicy> queue;
+	vector<thread> threads;
+	atomic<unsigned long long> nSum(0);
+	unsigned int nProducers = (nThreads < 2) ? 1 : nThreads / 2;
+	unsigned int nConsumers = (nThreads < 2) ? 1 : nThreads - nProducers;
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	if (nThreads < 2)
+	{
+		unsigned long long nLocal = 0;
+		for (unsigned int i = 1; i <= nMessages; i++)
+		{
+			unsigned int nMsg = 0;
+			queue.Put(i);
+			queue.Get(nMsg);
+			nLocal += nMsg;
+		}
+		nSum += nLocal;
+	}
+	else
+	{
+		for (unsigned int p = 0; p < nProducers; p++)
+		{
+			threads.push_back(thread([&queue, p, nProducers, nMessages]()
+			{
+				for (unsigned int i = p + 1; i <= nMessages; i += nProducers)
+				{
+					queue.Put(i);
+				}
+			}));
+		}
+
+		for (unsigned int c = 0; c < nConsumers; c++)
+		{
+			unsigned int nShare = nMessages / nConsumers + ((c < nMessages % nConsumers) ? 1 : 0);
+			threads.push_back(thread([&queue, &nSum, nShare]()
+			{
+				unsigned long long nLocal = 0;
+				for (unsigned int i = 0; i < nShare; i++)
+				{
+					unsigned int nMsg = 0;
+					if (queue.Get(nMsg))
+					{
+						nLocal += nMsg;
+					}
+				}
+				nSum += nLocal;
+			}));
+		}
+
+		for (size_t i = 0; i < threads.size(); i++)
+		{
+			threads[i].join();
+		}
+	}
+
+	double dSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	dMillionPerSecond = nMessages / dSeconds / 1e6;
+
+	return nSum == (unsigned long long)nMessages * (nMessages + 1) / 2;
+}
+
+int main(int argc, char* argv[])
+{
+	unsigned int nMessages = (argc > 1) ? (unsigned int)atoi(argv[1]) : SCALING_DEFAULT_MESSAGES;
+	static const unsigned int s_Threads[] = { 1, 2, 4, 8, 16, 32 };
+	bool bOk = true;
+
+	printf("%u CPUs, %u messages per run\n", thread::hardware_concurrency(), nMessages);
+	printf("threads   locked Mmsg/s   mpmc Mmsg/s\n");
+
+	for (size_t i = 0; i < sizeof(s_Threads) / sizeof(s_Threads[0]); i++)
+	{
+		double dLocked = 0;
+		double dMpmc = 0;
+
+		bOk = RunScaling<CLockedQueuePolicy<unsigned int> >(s_Threads[i], nMessages, dLocked) && bOk;
+		bOk = RunScaling<CMpmcQueuePolicy<unsigned int> >(s_Threads[i], nMessages, dMpmc) && bOk;
+
+		printf("%7u   %13.2f   %11.2f\n", s_Threads[i], dLocked, dMpmc);
+	}
+
+	if (!bOk)
+	{
+		printf("FAILED: messages lost or duplicated\n");
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,139 @@
+//---------------------------------------------------------------------------------
+// Queue Spin Latency Benchmark
+//
+// Measures the handoff latency of CMessageQueue with WAIT_BLOCK and with
+// WAIT_ADAPTIVE: one thread puts a timestamp, waits for a fixed gap and puts
+// the next one, and another thread gets them and records how long each took
+// to arrive. With a gap the consumer finds the queue empty and has to wait
+// every time, which is what the spin tuner is for. Prints the p50 and p99
+// latency of each run in microseconds.
+//
+// The producer waits out the gap by spinning, so on a single CPU it competes
+// with the consumer and the numbers show the scheduler rather than the
+// queue; WAIT_ADAPTIVE then behaves like WAIT_BLOCK anyway.
+//
+// Build and run from this directory:
+//	g++ -std=c++17 -O2 -I.. QueueSpinLatency.cpp -o QueueSpinLatency -lpthread
+//	./QueueSpinLatency [handoffs per run]
+//---------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "CMessageQueue.h"
+
+using namespace std;
+
+const unsigned int SPIN_LATENCY_DEFAULT_HANDOFFS = 20000;
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- NowNs
+//
+// Usage:
+//	- To get a monotonic timestamp
+//
+// Prameters:
+//	- N/A
+//
+// Returns:
+//	- unsigned long long: nanoseconds since an arbitrary start
+//----------------------------------------------------------------------------------
+unsigned long long NowNs()
+{
+	return (unsigned long long)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- RunLatency
+//
+// Usage:
+//	- To hand nHandoffs timestamps nGapNs apart through a fresh queue and
+//	  measure how long each took to arrive
+//
+// Prameters:
+//	- QUEUE_WAIT_STRATEGY waitStrategy:		strategy of the queue
+//	- unsigned long long nGapNs:			time between two puts
+//	- unsigned int nHandoffs:				timestamps to hand over
+//	- double& dP50Us:						receives the median latency
+//	- double& dP99Us:						receives the 99th percentile latency
+//
+// Returns:
+//	- bool: true if every timestamp arrived
+//----------------------------------------------------------------------------------
+bool RunLatency(QUEUE_WAIT_STRATEGY waitStrategy, unsigned long long nGapNs, unsigned int nHandoffs, double& dP50Us, double& dP99Us)
+{
+	CMessageQueue<unsigned long long> queue(DEFAULT_MAX_QUEUE_SIZE, INFINITE);
+	vector<unsigned long long> vLatencies(nHandoffs);
+	unsigned int nReceived = 0;
+
+	queue.SetWaitStrategy(waitStrategy);
+
+	thread consumer([&]()
+	{
+		for (unsigned int i = 0; i < nHandoffs; i++)
+		{
+			unsigned long long nStamp = 0;
+			if (queue.Get(nStamp))
+			{
+				vLatencies[nReceived++] = NowNs() - nStamp;
+			}
+		}
+	});
+
+	for (unsigned int i = 0; i < nHandoffs; i++)
+	{
+		unsigned long long nNext = NowNs() + nGapNs;
+		while (NowNs() < nNext)
+		{
+		}
+		queue.Put(NowNs());
+	}
+
+	consumer.join();
+
+	if (0 == nReceived)
+	{
+		return false;
+	}
+
+	sort(vLatencies.begin(), vLatencies.begin() + nReceived);
+	dP50Us = vLatencies[nReceived / 2] / 1000.0;
+	dP99Us = vLatencies[(nReceived - 1) * 99 / 100] / 1000.0;
+
+	return nReceived == nHandoffs;
+}
+
+int main(int argc, char* argv[])
+{
+	unsigned int nHandoffs = (argc > 1) ? (unsigned int)atoi(argv[1]) : SPIN_LATENCY_DEFAULT_HANDOFFS;
+	static const unsigned long long s_GapsNs[] = { 0, 2000, 10000, 50000 };
+	bool bOk = true;
+
+	printf("%u CPUs, %u handoffs per run\n", thread::hardware_concurrency(), nHandoffs);
+	printf("gap us   block p50 us   block p99 us   adaptive p50 us   adaptive p99 us\n");
+
+	for (size_t i = 0; i < sizeof(s_GapsNs) / sizeof(s_GapsNs[0]); i++)
+	{
+		double dBlockP50 = 0;
+		double dBlockP99 = 0;
+		double dAdaptiveP50 = 0;
+		double dAdaptiveP99 = 0;
+
+		bOk = RunLatency(WAIT_BLOCK, s_GapsNs[i], nHandoffs, dBlockP50, dBlockP99) && bOk;
+		bOk = RunLatency(WAIT_ADAPTIVE, s_GapsNs[i], nHandoffs, dAdaptiveP50, dAdaptiveP99) && bOk;
+
+		printf("%6llu   %12.2f   %12.2f   %15.2f   %15.2f\n", s_GapsNs[i] / 1000, dBlockP50, dBlockP99, dAdaptiveP50, dAdaptiveP99);
+	}
+
+	if (!bOk)
+	{
+		printf("FAILED: timestamps lost\n");
+		return 1;
+	}
+
+	return 0;
+}
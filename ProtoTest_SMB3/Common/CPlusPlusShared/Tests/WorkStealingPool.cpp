@@ -0,0 +1,268 @@
+//---------------------------------------------------------------------------------
+// Work-Stealing Pool Test
+//
+// Stresses CWorkStealingDeque with one owner and 1 to 8 thieves: the owner
+// pushes bursts into a deque that starts at 2 slots, so it keeps growing, and
+// pops part of each burst back while the thieves steal. Every element must be
+// taken exactly once, by the owner or by one thief.
+//
+// Then runs CWorkStealingPool with nested Submit: tasks submitted from outside
+// submit children from inside the pool, down a binary tree, and WaitIdle
+// must return only once every task in the tree has run, exactly once. A small
+// injection queue makes outside Posts spill into the overflow list as well.
+//
+// Build and run from this directory:
+//	g++ -std=c++17 -O2 -I.. WorkStealingPool.cpp -o WorkStealingPool -lpthread
+//	./WorkStealingPool [elements per deque run]
+//---------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "CWorkStealingPool.h"
+
+using namespace std;
+
+const unsigned int STEAL_DEFAULT_ELEMENTS = 1000000;
+
+// tree depth and roots of the nested Submit run
+const unsigned int POOL_TREE_DEPTH = 12;
+const unsigned int POOL_TREE_ROOTS = 16;
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- RunDequeStress
+//
+// Usage:
+//	- To push nElements through a deque with one owner and nThieves thieves
+//	  and check that every element was taken exactly once
+//
+// Prameters:
+//	- unsigned int nThieves:		stealing threads
+//	- unsigned int nElements:		elements to push
+//	- unsigned int& nStolen:		receives how many elements the thieves took
+//
+// Returns:
+//	- bool: true if every element was taken exactly once
+//----------------------------------------------------------------------------------
+bool RunDequeStress(unsigned int nThieves, unsigned int nElements, unsigned int& nStolen)
+{
+	CWorkStealingDeque<unsigned int> deque(2);
+	unique_ptr<atomic<unsigned char>[]> pTaken(new atomic<unsigned char>[nElements]);
+	atomic<bool> bOwnerDone(false);
+	atomic<unsigned int> nThiefCount(0);
+	vector<thread> thieves;
+
+	for (unsigned int i = 0; i < nElements; i++)
+	{
+		pTaken[i].store(0, memory_order_relaxed);
+	}
+
+	for (unsigned int t = 0; t < nThieves; t++)
+	{
+		thieves.push_back(thread([&]()
+		{
+			unsigned int nLocal = 0;
+			unsigned int nElement = 0;
+
+			// keep stealing until the owner is done and the deque is empty
+			for (;;)
+			{
+				if (deque.Steal(nElement))
+				{
+					pTaken[nElement]++;
+					nLocal++;
+				}
+				else if (bOwnerDone.load(memory_order_acquire) && 0 == deque.GetSize())
+				{
+					break;
+				}
+			}
+			nThiefCount += nLocal;
+		}));
+	}
+
+	// owner: bursts of 1 to 64 pushes, then pop back about half of each burst
+	unsigned int nRandom = 2463534242u;
+	unsigned int nNext = 0;
+	while (nNext < nElements)
+	{
+		nRandom ^= nRandom << 13;
+		nRandom ^= nRandom >> 17;
+		nRandom ^= nRandom << 5;
+
+		unsigned int nBurst = 1 + nRandom % 64;
+		for (unsigned int i = 0; i < nBurst && nNext < nElements; i++)
+		{
+			deque.Push(nNext++);
+		}
+
+		unsigned int nElement = 0;
+		for (unsigned int i = 0; i < nBurst / 2 && deque.Pop(nElement); i++)
+		{
+			pTaken[nElement]++;
+		}
+	}
+
+	// take back what the thieves left; the thieves stop once it is empty
+	unsigned int nElement = 0;
+	while (deque.Pop(nElement))
+	{
+		pTaken[nElement]++;
+	}
+	bOwnerDone.store(true, memory_order_release);
+
+	for (size_t i = 0; i < thieves.size(); i++)
+	{
+		thieves[i].join();
+	}
+
+	nStolen = nThiefCount;
+
+	for (unsigned int i = 0; i < nElements; i++)
+	{
+		if (1 != pTaken[i].load(memory_order_relaxed))
+		{
+			printf("element %u taken %u times\n", i, (unsigned int)pTaken[i].load());
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// state shared by the tasks of one nested Submit run
+struct CTreeRun
+{
+	CWorkStealingPool* m_pPool;
+	atomic<unsigned int> m_nRan;
+	atomic<unsigned int> m_nSubmitFailed;
+};
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- RunTreeNode
+//
+// Usage:
+//	- To run one task of the tree: count it and submit its two children from
+//	  inside the pool
+//
+// Prameters:
+//	- CTreeRun* pRun:			the run
+//	- unsigned int nDepth:		levels still below this task
+//
+// Returns:
+//	- N/A
+//----------------------------------------------------------------------------------
+void RunTreeNode(CTreeRun* pRun, unsigned int nDepth)
+{
+	pRun->m_nRan++;
+
+	if (0 == nDepth)
+	{
+		return;
+	}
+
+	for (unsigned int i = 0; i < 2; i++)
+	{
+		if (!pRun->m_pPool->Submit([pRun, nDepth]() { RunTreeNode(pRun, nDepth - 1); }))
+		{
+			pRun->m_nSubmitFailed++;
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------
+// Function Name:
+//	- RunPoolTree
+//
+// Usage:
+//	- To run POOL_TREE_ROOTS trees of nested Submits on a fresh pool, half of
+//	  the roots submitted and half posted, and check the count after WaitIdle
+//
+// Prameters:
+//	- unsigned int nWorkers:		pool workers
+//
+// Returns:
+//	- bool: true if every task ran exactly once before WaitIdle returned
+//----------------------------------------------------------------------------------
+bool RunPoolTree(unsigned int nWorkers)
+{
+	// a 4-slot injection queue, so the posted roots overflow
+	CWorkStealingPool pool(nWorkers, 4, INFINITE);
+	CTreeRun run;
+	unsigned int nExpected = POOL_TREE_ROOTS * ((1u << (POOL_TREE_DEPTH + 1)) - 1);
+
+	run.m_pPool = &pool;
+	run.m_nRan = 0;
+	run.m_nSubmitFailed = 0;
+
+	for (unsigned int nRound = 0; nRound < 3; nRound++)
+	{
+		run.m_nRan = 0;
+
+		for (unsigned int i = 0; i < POOL_TREE_ROOTS; i++)
+		{
+			CTreeRun* pRun = &run;
+
+			if (0 == i % 2)
+			{
+				pool.Submit([pRun]() { RunTreeNode(pRun, POOL_TREE_DEPTH); });
+			}
+			else
+			{
+				pool.Post([pRun]() { RunTreeNode(pRun, POOL_TREE_DEPTH); });
+			}
+		}
+
+		pool.WaitIdle();
+
+		if (run.m_nRan != nExpected || 0 != run.m_nSubmitFailed || 0 != pool.GetPendingCount())
+		{
+			printf("%u workers, round %u: %u of %u tasks ran, %u submits failed, %u pending\n",
+				nWorkers, nRound, run.m_nRan.load(), nExpected, run.m_nSubmitFailed.load(), pool.GetPendingCount());
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	unsigned int nElements = (argc > 1) ? (unsigned int)atoi(argv[1]) : STEAL_DEFAULT_ELEMENTS;
+	static const unsigned int s_Threads[] = { 1, 2, 4, 8 };
+	bool bOk = true;
+
+	printf("%u CPUs, %u elements per deque run\n", thread::hardware_concurrency(), nElements);
+	printf("thieves   stolen   exactly once\n");
+
+	for (size_t i = 0; i < sizeof(s_Threads) / sizeof(s_Threads[0]); i++)
+	{
+		unsigned int nStolen = 0;
+		bool bRun = RunDequeStress(s_Threads[i], nElements, nStolen);
+
+		printf("%7u   %6u   %s\n", s_Threads[i], nStolen, bRun ? "yes" : "NO");
+		bOk = bRun && bOk;
+	}
+
+	printf("workers   nested submit + WaitIdle\n");
+
+	for (size_t i = 0; i < sizeof(s_Threads) / sizeof(s_Threads[0]); i++)
+	{
+		bool bRun = RunPoolTree(s_Threads[i]);
+
+		printf("%7u   %s\n", s_Threads[i], bRun ? "ok" : "FAILED");
+		bOk = bRun && bOk;
+	}
+
+	if (!bOk)
+	{
+		printf("FAILED\n");
+		return 1;
+	}
+
+	return 0;
+}
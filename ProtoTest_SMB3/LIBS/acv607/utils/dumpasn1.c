@@ -40,12 +40,16 @@
    Communications of the ACM, Vol.26, No.11 (November 1983), p.861) */
 
 #include <ctype.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
+#include <sys/stat.h>
 #ifdef OS390
   #include <unistd.h>
 #endif /* OS390 */
+#include "dumpasn1.h"
 
 /* The update string, printed as part of the help screen */
 
@@ -99,6 +103,11 @@
 	  defined( __WIN32__ ) )
   #define __WIN32__
 #endif /* Win32 */
+#ifdef __WIN32__
+  #define WIN32_LEAN_AND_MEAN
+  #include <windows.h>
+  #include <io.h>
+#endif /* Win32 */
 
 /* Under Unix we can do special-case handling for paths and Unicode strings.
    Detecting Unix systems is a bit tricky but the following should find most
@@ -137,6 +146,91 @@
   #endif /* _GUARDIAN_TARGET */
 #endif /* __TANDEM */
 
+/* Most Unix systems can memory-map the input file */
+
+#if defined( __UNIX__ ) && !defined( __TANDEM )
+  #include <sys/types.h>
+  #include <sys/mman.h>
+  #define USE_MMAP
+#endif /* Unix systems with mmap() */
+
+/* Systems with threads can decode multiple files, or the elements of large
+   objects, in parallel, and we need to be able to read directories to find
+   the files */
+
+#if defined( __WIN32__ )
+  #define USE_THREADS
+#elif defined( __UNIX__ ) && !defined( __TANDEM )
+  #include <pthread.h>
+  #include <unistd.h>
+  #define USE_THREADS
+#endif /* Systems with threads */
+#if defined( __UNIX__ )
+  #include <dirent.h>
+#endif /* Unix systems with readdir() */
+
+/* Threading primitives */
+
+#if defined( __WIN32__ )
+  #define THREAD_HANDLE					HANDLE
+  #define THREAD_FUNCTION( name, arg )	DWORD WINAPI name( LPVOID arg )
+  #define THREAD_RETURN					return( 0 )
+  #define threadCreate( handle, function, arg ) \
+		  ( ( *( handle ) = CreateThread( NULL, 0, function, arg, 0, \
+										  NULL ) ) != NULL )
+  #define threadJoin( handle ) \
+		  { WaitForSingleObject( handle, INFINITE ); CloseHandle( handle ); }
+  #define MUTEX_TYPE					CRITICAL_SECTION
+  #define mutexInit( mutex )			InitializeCriticalSection( mutex )
+  #define mutexDestroy( mutex )			DeleteCriticalSection( mutex )
+  #define mutexLock( mutex )			EnterCriticalSection( mutex )
+  #define mutexUnlock( mutex )			LeaveCriticalSection( mutex )
+  #define COND_TYPE						CONDITION_VARIABLE
+  #define condInit( cond )				InitializeConditionVariable( cond )
+  #define condDestroy( cond )
+  #define condWait( cond, mutex ) \
+		  SleepConditionVariableCS( cond, mutex, INFINITE )
+  #define condBroadcast( cond )			WakeAllConditionVariable( cond )
+#elif defined( USE_THREADS )
+  #define THREAD_HANDLE					pthread_t
+  #define THREAD_FUNCTION( name, arg )	void *name( void *arg )
+  #define THREAD_RETURN					return( NULL )
+  #define threadCreate( handle, function, arg ) \
+		  ( !pthread_create( handle, NULL, function, arg ) )
+  #define threadJoin( handle )			pthread_join( handle, NULL )
+  #define MUTEX_TYPE					pthread_mutex_t
+  #define mutexInit( mutex )			pthread_mutex_init( mutex, NULL )
+  #define mutexDestroy( mutex )			pthread_mutex_destroy( mutex )
+  #define mutexLock( mutex )			pthread_mutex_lock( mutex )
+  #define mutexUnlock( mutex )			pthread_mutex_unlock( mutex )
+  #define COND_TYPE						pthread_cond_t
+  #define condInit( cond )				pthread_cond_init( cond, NULL )
+  #define condDestroy( cond )			pthread_cond_destroy( cond )
+  #define condWait( cond, mutex )		pthread_cond_wait( cond, mutex )
+  #define condBroadcast( cond )			pthread_cond_broadcast( cond )
+#else
+  /* Without threads everything is done by the main thread, so there's
+	 never anything to wait for */
+  #define MUTEX_TYPE					int
+  #define mutexInit( mutex )
+  #define mutexDestroy( mutex )
+  #define mutexLock( mutex )
+  #define mutexUnlock( mutex )
+  #define COND_TYPE						int
+  #define condInit( cond )
+  #define condDestroy( cond )
+  #define condWait( cond, mutex )
+  #define condBroadcast( cond )
+#endif /* Threading primitives */
+
+/* On x86 systems with SSE2 we can convert data to hex 16 bytes at a time */
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || \
+	( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+  #include <emmintrin.h>
+  #define USE_SSE2
+#endif /* x86 systems with SSE2 */
+
 /* Some OS's don't define the min() macro */
 
 #ifndef min
@@ -230,26 +324,14 @@ typedef struct {
 	unsigned char header[ 8 ];	/* Tag+length data */
 	} ASN1_ITEM;
 
-/* Config options */
-
-static int printDots = FALSE;		/* Whether to print dots to align columns */
-static int doPure = FALSE;			/* Print data without LHS info column */
-static int doDumpHeader = FALSE;	/* Dump tag+len in hex (level = 0, 1, 2) */
-static int extraOIDinfo = FALSE;	/* Print extra information about OIDs */
-static int doHexValues = FALSE;		/* Display size, offset in hex not dec.*/
-static int useStdin = FALSE;		/* Take input from stdin */
-static int zeroLengthAllowed = FALSE;/* Zero-length items allowed */
-static int dumpText = FALSE;		/* Dump text alongside hex data */
-static int printAllData = FALSE;	/* Whether to print all data in long blocks */
-static int checkEncaps = TRUE;		/* Print encaps.data in BIT/OCTET STRINGs */
-static int checkCharset = TRUE;		/* Check val.of char strs.hidden in OCTET STRs */
-#ifndef __OS390__
-static int reverseBitString = TRUE;	/* Print BIT STRINGs in natural order */
-#else
-static int reverseBitString = FALSE;/* Natural order on OS390 is the same as ASN.1 */
-#endif /* __OS390__ */
-static int rawTimeString = FALSE;	/* Print raw time strings */
-static int shallowIndent = FALSE;	/* Perform shallow indenting */
+/* The buffer size for non-seekable input, and the amount of data before
+   the current position that's kept when the buffer is refilled.  The
+   lookback has to be at least as large as the most data that we ever read
+   ahead and then seek back over, which is the 24 bytes displayed by
+   dumpHeader() */
+
+#define INPUT_BUFSIZE	65536
+#define INPUT_LOOKBACK	64
 
 /* The indent size and fixed indent string to the left of the data */
 
@@ -267,32 +349,6 @@ static int shallowIndent = FALSE;	/* Perform shallow indenting */
 
 #define OUTPUT_WIDTH		80
 
-/* Error and warning information */
-
-static int noErrors = 0;			/* Number of errors found */
-static int noWarnings = 0;			/* Number of warnings */
-
-/* Position in the input stream */
-
-static int fPos = 0;				/* Absolute position in data */
-
-/* The output stream */
-
-static FILE *output;				/* Output stream */
-
-/* Information on an ASN.1 Object Identifier */
-
-#define MAX_OID_SIZE	32
-
-typedef struct tagOIDINFO {
-	struct tagOIDINFO *next;		/* Next item in list */
-	char oid[ MAX_OID_SIZE ], *comment, *description;
-	int oidLength;					/* Name, rank, serial number */
-	int warn;						/* Whether to warn if OID encountered */
-	} OIDINFO;
-
-static OIDINFO *oidList = NULL;
-
 /* If the config file isn't present in the current directory, we search the
    following paths (this is needed for Unix with dumpasn1 somewhere in the
    path, since this doesn't set up argv[0] to the full path).  Anything
@@ -380,7 +436,7 @@ static const char *configPaths[] = {
 
 /* Return descriptive strings for universal tags */
 
-char *idstr( const int tagID )
+static char *idstr( const int tagID )
 	{
 	switch( tagID )
 		{
@@ -443,28 +499,193 @@ char *idstr( const int tagID )
 		}
 	}
 
-/* Return information on an object identifier */
+/* Hash the encoded form of an OID (FNV-1a) */
+
+static unsigned int hashOID( const char *oid, const int oidLength )
+	{
+	unsigned int hashValue = 2166136261U;
+	int i;
+
+	for( i = 0; i < oidLength; i++ )
+		hashValue = ( hashValue ^ ( unsigned char ) oid[ i ] ) * 16777619U;
+
+	return( hashValue );
+	}
+
+/* The size and modification time of a file, recorded in a saved index so
+   that we can tell when the file has changed.  The time is kept at the full
+   resolution that the system provides, since with one-second times a file
+   that's rewritten in the same second as its index was saved, with the same
+   size, would look unchanged.  Under Win32 it's the FILETIME in 100ns units,
+   elsewhere it's the seconds and nanoseconds parts of the stat() time */
+
+typedef struct {
+	unsigned int sizeLow, sizeHigh;	/* File size */
+	unsigned int timeLow, timeHigh;	/* Modification time */
+	unsigned int timeNsec;			/* Nanoseconds part of time */
+	} FILE_STAMP;
+
+static int getFileStamp( const char *path, FILE_STAMP *stamp )
+	{
+#ifdef __WIN32__
+	WIN32_FILE_ATTRIBUTE_DATA fileInfo;
+#else
+	struct stat fileInfo;
+#endif /* __WIN32__ */
+
+	memset( stamp, 0, sizeof( FILE_STAMP ) );
+#ifdef __WIN32__
+	if( !GetFileAttributesExA( path, GetFileExInfoStandard, &fileInfo ) )
+		return( FALSE );
+	stamp->sizeLow = fileInfo.nFileSizeLow;
+	stamp->sizeHigh = fileInfo.nFileSizeHigh;
+	stamp->timeLow = fileInfo.ftLastWriteTime.dwLowDateTime;
+	stamp->timeHigh = fileInfo.ftLastWriteTime.dwHighDateTime;
+#else
+	if( stat( path, &fileInfo ) )
+		return( FALSE );
+
+	/* off_t and time_t may be 32 or 64 bits, so the high halves are shifted
+	   down in two steps */
+	stamp->sizeLow = ( unsigned int ) fileInfo.st_size;
+	stamp->sizeHigh = ( unsigned int ) ( ( fileInfo.st_size >> 16 ) >> 16 );
+	stamp->timeLow = ( unsigned int ) fileInfo.st_mtime;
+	stamp->timeHigh = ( unsigned int ) ( ( fileInfo.st_mtime >> 16 ) >> 16 );
+  #if defined( __MACH__ )
+	stamp->timeNsec = ( unsigned int ) fileInfo.st_mtimespec.tv_nsec;
+  #elif defined( __linux__ ) || defined( __FreeBSD__ ) || \
+		defined( __OpenBSD__ ) || defined( sun )
+	stamp->timeNsec = ( unsigned int ) fileInfo.st_mtim.tv_nsec;
+  #endif /* Systems with nanosecond file times */
+#endif /* __WIN32__ */
+
+	return( TRUE );
+	}
+
+/* The compiled OID index consists of a header, a table of OIDs sorted by
+   OID value, and a pool of null-terminated description and comment strings
+   which the table entries refer to by offset.  The pool starts with a null
+   byte so that an offset of zero means "not present".  The index is stored
+   in the native byte order, if it's moved to a system with a different byte
+   order then the magic value won't match and it'll be ignored */
+
+#define INDEX_MAGIC		0x44413149L	/* 'DA1I' */
+#define INDEX_VERSION	2
+
+typedef struct {
+	unsigned int magic, version;	/* Magic value and format version */
+	FILE_STAMP configStamp;			/* Size and time of text config file */
+	unsigned int noEntries;			/* Number of OIDs in table */
+	unsigned int poolSize;			/* Size of string pool */
+	} INDEX_HEADER;
+
+typedef struct {
+	unsigned char oid[ MAX_OID_SIZE ];	/* Encoded OID */
+	unsigned int description, comment;	/* Offsets of strings in pool */
+	unsigned char oidLength, warn;	/* Length of OID, whether to warn */
+	} INDEX_ENTRY;
+
+#define indexEntries( index ) \
+		( ( const INDEX_ENTRY * ) ( ( index )->data + sizeof( INDEX_HEADER ) ) )
+#define indexPool( index ) \
+		( ( const char * ) ( indexEntries( index ) + \
+			( ( const INDEX_HEADER * ) ( index )->data )->noEntries ) )
+
+/* Compare two OID values.  This only needs to give a consistent ordering
+   for the binary search, not a meaningful one */
+
+static int compareOIDs( const void *oid1, const int oid1Length,
+						const void *oid2, const int oid2Length )
+	{
+	if( oid1Length != oid2Length )
+		return( oid1Length - oid2Length );
+	return( memcmp( oid1, oid2, oid1Length ) );
+	}
+
+/* Find an OID in the compiled index */
+
+static const INDEX_ENTRY *findIndexEntry( const DUMPASN1_CONFIG *config,
+										  const char *oid,
+										  const int oidLength )
+	{
+	const INDEX_ENTRY *entries = indexEntries( &config->index );
+	int low = 0, high;
+
+	if( config->index.data == NULL )
+		return( NULL );
+	high = ( int ) ( ( const INDEX_HEADER * ) config->index.data )->noEntries;
+	while( low < high )
+		{
+		const int mid = low + ( high - low ) / 2;
+		const int result = compareOIDs( entries[ mid ].oid + 2,
+										entries[ mid ].oidLength - 2,
+										oid, oidLength );
+
+		if( result == 0 )
+			return( &entries[ mid ] );
+		if( result < 0 )
+			low = mid + 1;
+		else
+			high = mid;
+		}
+
+	return( NULL );
+	}
+
+/* Return information on an object identifier.  The OIDs from text config
+   files are stored in an open-addressing hash table keyed on the OID value
+   (without the tag and length), any that aren't there may be in the
+   compiled index, in which case the details are returned in oidInfoBuffer */
 
-static OIDINFO *getOIDinfo( char *oid, const int oidLength )
+static const OIDINFO *getOIDinfo( const DUMPASN1_CONFIG *config, char *oid,
+								  const int oidLength,
+								  OIDINFO *oidInfoBuffer )
 	{
+	const INDEX_ENTRY *entryPtr;
 	OIDINFO *oidPtr;
+	const int mask = config->oidTableSize - 1;
+	int index;
 
 	memset( oid + oidLength, 0, 2 );
-	for( oidPtr = oidList; oidPtr != NULL; oidPtr = oidPtr->next )
-		if( oidLength == oidPtr->oidLength - 2 && \
-			!memcmp( oidPtr->oid + 2, oid, oidLength ) )
-			return( oidPtr );
+	if( config->oidTable != NULL )
+		{
+		for( index = hashOID( oid, oidLength ) & mask;
+			 ( oidPtr = config->oidTable[ index ] ) != NULL;
+			 index = ( index + 1 ) & mask )
+			if( oidLength == oidPtr->oidLength - 2 && \
+				!memcmp( oidPtr->oid + 2, oid, oidLength ) )
+				return( oidPtr );
+		}
+	if( ( entryPtr = findIndexEntry( config, oid, oidLength ) ) != NULL )
+		{
+		const INDEX_HEADER *header = ( const INDEX_HEADER * ) config->index.data;
+		const char *pool = indexPool( &config->index );
+
+		/* Make sure that the strings are within the pool, which was checked
+		   when the index was loaded to end with a null */
+		if( entryPtr->description >= header->poolSize || \
+			entryPtr->comment >= header->poolSize )
+			return( NULL );
+		memset( oidInfoBuffer, 0, sizeof( OIDINFO ) );
+		oidInfoBuffer->description = ( entryPtr->description ) ? \
+			( char * ) pool + entryPtr->description : NULL;
+		oidInfoBuffer->comment = ( entryPtr->comment ) ? \
+			( char * ) pool + entryPtr->comment : NULL;
+		oidInfoBuffer->warn = entryPtr->warn;
+		return( oidInfoBuffer );
+		}
 
 	return( NULL );
 	}
 
 /* Add an OID attribute */
 
-static int addAttribute( char **buffer, char *attribute )
+static int addAttribute( char **buffer, char *attribute,
+						 char *errorString )
 	{
 	if( ( *buffer = ( char * ) malloc( strlen( attribute ) + 1 ) ) == NULL )
 		{
-		puts( "Out of memory." );
+		strcpy( errorString, "Out of memory" );
 		return( FALSE );
 		}
 	strcpy( *buffer, attribute );
@@ -525,11 +746,12 @@ static int isIA5( int ch )
 
 #define MAX_LINESIZE	512
 
-/* Read a line of text from the config file */
-
-static int lineNo;
+/* Read a line of text from the config file.  Problems with the config file
+   are reported in errorString rather than being printed, since the library
+   may be used in a process where stdout isn't ours to write to */
 
-static int readLine( FILE *file, char *buffer )
+static int readLine( FILE *file, char *buffer, const int lineNo,
+					 char *errorString )
 	{
 	int bufCount = 0, ch;
 
@@ -544,8 +766,8 @@ static int readLine( FILE *file, char *buffer )
 		   non-ASCII strings */
 		if( !isprint( ch ) )
 			{
-			printf( "Bad character '%c' in config file line %d.\n",
-					ch, lineNo );
+			sprintf( errorString, "Bad character '%c' in config file line %d",
+					 ch, lineNo );
 			return( FALSE );
 			}
 
@@ -561,7 +783,7 @@ static int readLine( FILE *file, char *buffer )
 		/* Make sure the line is of the correct length */
 		if( bufCount > MAX_LINESIZE )
 			{
-			printf( "Config file line %d too long.\n", lineNo );
+			sprintf( errorString, "Config file line %d too long", lineNo );
 			return( FALSE );
 			}
 		else
@@ -589,12 +811,18 @@ static int readLine( FILE *file, char *buffer )
 			/* Keep going until we hit the true EOF (or some sort of error) */
 			ch = getc( file );
 
-	return( ferror( file ) ? FALSE : TRUE );
+	if( ferror( file ) )
+		{
+		sprintf( errorString, "Cannot read config file line %d", lineNo );
+		return( FALSE );
+		}
+	return( TRUE );
 	}
 
 /* Process an OID specified as space-separated hex digits */
 
-static int processHexOID( OIDINFO *oidInfo, char *string )
+static int processHexOID( OIDINFO *oidInfo, char *string, const int lineNo,
+						  char *errorString )
 	{
 	int value, index = 0;
 
@@ -602,14 +830,16 @@ static int processHexOID( OIDINFO *oidInfo, char *string )
 		{
 		if( sscanf( string, "%x", &value ) != 1 || value > 255 )
 			{
-			printf( "Invalid hex value in config file line %d.\n", lineNo );
+			sprintf( errorString, "Invalid hex value in config file line %d",
+					 lineNo );
 			return( FALSE );
 			}
 		oidInfo->oid[ index++ ] = value;
 		string += 2;
 		if( *string && *string++ != ' ' )
 			{
-			printf( "Invalid hex string in config file line %d.\n", lineNo );
+			sprintf( errorString, "Invalid hex string in config file line %d",
+					 lineNo );
 			return( FALSE );
 			}
 		}
@@ -617,52 +847,120 @@ static int processHexOID( OIDINFO *oidInfo, char *string )
 	oidInfo->oidLength = index;
 	if( index >= MAX_OID_SIZE - 1 )
 		{
-		printf( "OID value in config file line %d too long.\n", lineNo );
+		sprintf( errorString, "OID value in config file line %d too long",
+				 lineNo );
 		return( FALSE );
 		}
 	return( TRUE );
 	}
 
-/* Read a config file */
+/* Add an OID to the hash table, which is expanded as required to keep it
+   no more than half full.  If the OID is already present we leave the
+   existing entry in place, since the first one read takes precedence (this
+   is what allows a user config file to override the global one) */
+
+static int addOID( DUMPASN1_CONFIG *config, OIDINFO *oidInfo )
+	{
+	const int oidLength = oidInfo->oidLength - 2;
+	int mask, index;
+
+	if( oidLength < 0 )
+		return( TRUE );		/* Can never match, don't bother adding it */
+
+	/* If there's a compiled index loaded then it was read before this OID
+	   and takes precedence */
+	if( findIndexEntry( config, oidInfo->oid + 2, oidLength ) != NULL )
+		return( TRUE );
+
+	/* If the table is getting full, move everything to a larger one */
+	if( ( config->noOIDs + 1 ) * 2 > config->oidTableSize )
+		{
+		OIDINFO **oldTable = config->oidTable;
+		const int oldSize = config->oidTableSize;
+		int i;
+
+		config->oidTableSize = ( oldSize > 0 ) ? oldSize * 2 : 256;
+		if( ( config->oidTable = ( OIDINFO ** ) \
+					calloc( config->oidTableSize, sizeof( OIDINFO * ) ) ) == NULL )
+			{
+			config->oidTable = oldTable;
+			config->oidTableSize = oldSize;
+			strcpy( config->errorString, "Out of memory" );
+			return( FALSE );
+			}
+		mask = config->oidTableSize - 1;
+		for( i = 0; i < oldSize; i++ )
+			{
+			OIDINFO *oidPtr = oldTable[ i ];
+
+			if( oidPtr == NULL )
+				continue;
+			for( index = hashOID( oidPtr->oid + 2, oidPtr->oidLength - 2 ) & mask;
+				 config->oidTable[ index ] != NULL;
+				 index = ( index + 1 ) & mask );
+			config->oidTable[ index ] = oidPtr;
+			}
+		if( oldTable != NULL )
+			free( oldTable );
+		}
+
+	/* Find the OID's slot, skipping it if it's a duplicate */
+	mask = config->oidTableSize - 1;
+	for( index = hashOID( oidInfo->oid + 2, oidLength ) & mask;
+		 config->oidTable[ index ] != NULL;
+		 index = ( index + 1 ) & mask )
+		{
+		const OIDINFO *oidPtr = config->oidTable[ index ];
+
+		if( oidPtr->oidLength == oidInfo->oidLength && \
+			!memcmp( oidPtr->oid + 2, oidInfo->oid + 2, oidLength ) )
+			return( TRUE );
+		}
+	config->oidTable[ index ] = oidInfo;
+	config->noOIDs++;
+
+	return( TRUE );
+	}
+
+/* Read a text config file.  If there's a problem with it we return FALSE
+   with config->errorString saying what it is */
 
-static int readConfig( const char *path, const int isDefaultConfig )
+static int readTextConfig( DUMPASN1_CONFIG *config, const char *path,
+						   const int isDefaultConfig )
 	{
 	OIDINFO dummyOID = { NULL, "Dummy", "Dummy", "Dummy", 1 }, *oidPtr;
 	FILE *file;
 	char buffer[ MAX_LINESIZE ];
-	int status;
+	int lineNo, status;
 
 	/* Try and open the config file */
 	if( ( file = fopen( path, "rb" ) ) == NULL )
 		{
-		/* If we can't open the default config file, issue a warning but
-		   continue anyway */
+		/* If we can't open the default config file, note it so that the
+		   caller can warn about it, but continue anyway */
 		if( isDefaultConfig )
 			{
-			puts( "Cannot open config file 'dumpasn1.cfg', which should be in the same" );
-			puts( "directory as the dumpasn1 program, a standard system directory, or" );
-			puts( "in a location pointed to by the DUMPASN1_PATH environment variable." );
-			puts( "Operation will continue without the ability to display Object " );
-			puts( "Identifier information." );
-			puts( "" );
-			puts( "If the config file is located elsewhere, you can set the environment" );
-			puts( "variable DUMPASN1_PATH to the path to the file." );
+			config->noGlobalConfig = TRUE;
 			return( TRUE );
 			}
 
-		printf( "Cannot open config file '%s'.\n", path );
+		sprintf( config->errorString, "Cannot open config file '%.80s'",
+				 path );
 		return( FALSE );
 		}
 
 	/* Add the new config entries at the appropriate point in the OID list */
-	if( oidList == NULL )
+	if( config->oidList == NULL )
 		oidPtr = &dummyOID;
 	else
-		for( oidPtr = oidList; oidPtr->next != NULL; oidPtr = oidPtr->next );
+		for( oidPtr = config->oidList; oidPtr->next != NULL; \
+			 oidPtr = oidPtr->next );
 
 	/* Read each line in the config file */
 	lineNo = 1;
-	while( ( status = readLine( file, buffer ) ) == TRUE && !feof( file ) )
+	while( ( status = readLine( file, buffer, lineNo,
+								config->errorString ) ) == TRUE && \
+		   !feof( file ) )
 		{
 		/* If it's a comment line, skip it */
 		if( !*buffer )
@@ -678,64 +976,83 @@ static int readConfig( const char *path, const int isDefaultConfig )
 			   present */
 			if( oidPtr->description == NULL )
 				{
-				printf( "OID ending on config file line %d has no "
-						"description attribute.\n", lineNo - 1 );
-				return( FALSE );
+				sprintf( config->errorString, "OID ending on config file "
+						 "line %d has no description attribute", lineNo - 1 );
+				status = FALSE;
+				break;
 				}
 
 			/* Allocate storage for the new OID */
 			if( ( oidPtr->next = ( struct tagOIDINFO * ) \
 								 malloc( sizeof( OIDINFO ) ) ) == NULL )
 				{
-				puts( "Out of memory." );
-				return( FALSE );
+				strcpy( config->errorString, "Out of memory" );
+				status = FALSE;
+				break;
 				}
 			oidPtr = oidPtr->next;
-			if( oidList == NULL )
-				oidList = oidPtr;
+			if( config->oidList == NULL )
+				config->oidList = oidPtr;
 			memset( oidPtr, 0, sizeof( OIDINFO ) );
 
 			/* Add the new OID */
-			if( !processHexOID( oidPtr, buffer + 6 ) )
-				return( FALSE );
+			if( !processHexOID( oidPtr, buffer + 6, lineNo,
+								config->errorString ) || \
+				!addOID( config, oidPtr ) )
+				{
+				status = FALSE;
+				break;
+				}
 			}
 		else if( !strncmp( buffer, "Description = ", 14 ) )
 			{
 			if( oidPtr->description != NULL )
 				{
-				printf( "Duplicate OID description in config file line %d.\n",
-						lineNo );
-				return( FALSE );
+				sprintf( config->errorString, "Duplicate OID description in "
+						 "config file line %d", lineNo );
+				status = FALSE;
+				break;
+				}
+			if( !addAttribute( &oidPtr->description, buffer + 14,
+							   config->errorString ) )
+				{
+				status = FALSE;
+				break;
 				}
-			if( !addAttribute( &oidPtr->description, buffer + 14 ) )
-				return( FALSE );
 			}
 		else if( !strncmp( buffer, "Comment = ", 10 ) )
 			{
 			if( oidPtr->comment != NULL )
 				{
-				printf( "Duplicate OID comment in config file line %d.\n",
-						lineNo );
-				return( FALSE );
+				sprintf( config->errorString, "Duplicate OID comment in "
+						 "config file line %d", lineNo );
+				status = FALSE;
+				break;
+				}
+			if( !addAttribute( &oidPtr->comment, buffer + 10,
+							   config->errorString ) )
+				{
+				status = FALSE;
+				break;
 				}
-			if( !addAttribute( &oidPtr->comment, buffer + 10 ) )
-				return( FALSE );
 			}
 		else if( !strncmp( buffer, "Warning", 7 ) )
 			{
 			if( oidPtr->warn )
 				{
-				printf( "Duplicate OID warning in config file line %d.\n",
-						lineNo );
-				return( FALSE );
+				sprintf( config->errorString, "Duplicate OID warning in "
+						 "config file line %d", lineNo );
+				status = FALSE;
+				break;
 				}
 			oidPtr->warn = TRUE;
 			}
 		else
 			{
-			printf( "Unrecognised attribute '%s', line %d.\n", buffer,
-					lineNo );
-			return( FALSE );
+			sprintf( config->errorString, "Unrecognised attribute '%.64s', "
+					 "line %d", buffer, lineNo );
+			status = FALSE;
+			break;
 			}
 
 		lineNo++;
@@ -745,6 +1062,258 @@ static int readConfig( const char *path, const int isDefaultConfig )
 	return( status );
 	}
 
+/* The compiled index is mapped into memory in the same way as the input
+   data */
+
+static int inOpen( ASN1_INPUT *input, FILE *inFile );
+static void inClose( ASN1_INPUT *input );
+
+/* Get the path for the compiled index corresponding to a config file, by
+   replacing the .cfg extension with .idx or appending .idx if there isn't
+   one */
+
+static int buildIndexPath( char *indexPath, const char *path )
+	{
+	int pathLen = strlen( path );
+
+	if( pathLen > FILENAME_MAX - 5 )
+		return( FALSE );
+	strcpy( indexPath, path );
+	if( pathLen > 4 && !strcmp( indexPath + pathLen - 4, ".cfg" ) )
+		pathLen -= 4;
+	strcpy( indexPath + pathLen, ".idx" );
+
+	return( TRUE );
+	}
+
+/* Try and use the compiled index for a config file.  If there's no index,
+   or it's been corrupted, or the config file has changed since it was
+   compiled, we return FALSE and the caller falls back to the text config
+   file */
+
+static int loadIndex( DUMPASN1_CONFIG *config, const char *path )
+	{
+	const INDEX_HEADER *header;
+	FILE_STAMP configStamp;
+	FILE *file;
+	char indexPath[ FILENAME_MAX ];
+	long entriesSize;
+	int status;
+
+	/* Only one index can be in use at a time, any further config files are
+	   read as text */
+	if( config->index.data != NULL )
+		return( FALSE );
+
+	if( !getFileStamp( path, &configStamp ) || \
+		!buildIndexPath( indexPath, path ) || \
+		( file = fopen( indexPath, "rb" ) ) == NULL )
+		return( FALSE );
+	status = inOpen( &config->index, file );
+	fclose( file );
+	if( !status )
+		{
+		memset( &config->index, 0, sizeof( ASN1_INPUT ) );
+		return( FALSE );
+		}
+
+	/* Make sure that the index is in memory and is what it claims to be */
+	header = ( const INDEX_HEADER * ) config->index.data;
+	if( config->index.stream != NULL || \
+		config->index.dataLen < ( long ) sizeof( INDEX_HEADER ) || \
+		header->magic != INDEX_MAGIC || header->version != INDEX_VERSION || \
+		memcmp( &header->configStamp, &configStamp, sizeof( FILE_STAMP ) ) || \
+		header->noEntries > ( unsigned int ) config->index.dataLen / \
+							sizeof( INDEX_ENTRY ) )
+		{
+		inClose( &config->index );
+		memset( &config->index, 0, sizeof( ASN1_INPUT ) );
+		return( FALSE );
+		}
+	entriesSize = ( long ) ( header->noEntries * sizeof( INDEX_ENTRY ) );
+	if( header->poolSize < 1 || config->index.dataLen != \
+			( long ) sizeof( INDEX_HEADER ) + entriesSize + \
+			( long ) header->poolSize || \
+		indexPool( &config->index )[ header->poolSize - 1 ] != '\0' )
+		{
+		inClose( &config->index );
+		memset( &config->index, 0, sizeof( ASN1_INPUT ) );
+		return( FALSE );
+		}
+
+	return( TRUE );
+	}
+
+/* Read a config file, using the compiled index if there's an up-to-date
+   one present */
+
+static int readConfig( DUMPASN1_CONFIG *config, const char *path,
+					   const int isDefaultConfig )
+	{
+	if( loadIndex( config, path ) )
+		return( TRUE );
+
+	return( readTextConfig( config, path, isDefaultConfig ) );
+	}
+
+/* Compile a config file into an index */
+
+static int compareOIDinfo( const void *oidInfo1, const void *oidInfo2 )
+	{
+	const OIDINFO *oidPtr1 = *( ( const OIDINFO ** ) oidInfo1 );
+	const OIDINFO *oidPtr2 = *( ( const OIDINFO ** ) oidInfo2 );
+
+	return( compareOIDs( oidPtr1->oid + 2, oidPtr1->oidLength - 2,
+						 oidPtr2->oid + 2, oidPtr2->oidLength - 2 ) );
+	}
+
+static unsigned int addPoolString( char *pool, unsigned int *poolPos,
+								   const char *string )
+	{
+	const unsigned int stringPos = *poolPos;
+
+	if( string == NULL )
+		return( 0 );
+	strcpy( pool + stringPos, string );
+	*poolPos += strlen( string ) + 1;
+
+	return( stringPos );
+	}
+
+/* Write an index, consisting of a header, a table of entries, and optional
+   extra data, to a temporary file and then move it into place, so that
+   anything currently using the old index doesn't see a partially-written
+   one */
+
+static int writeIndex( const char *indexPath, const void *header,
+					   const int headerSize, const void *entries,
+					   const long entriesSize, const void *extraData,
+					   const long extraDataSize, char *errorString )
+	{
+	FILE *file;
+	char tempPath[ FILENAME_MAX ];
+	int status;
+
+	sprintf( tempPath, "%.*s.tmp", FILENAME_MAX - 5, indexPath );
+	if( ( file = fopen( tempPath, "wb" ) ) == NULL )
+		{
+		sprintf( errorString, "Cannot create index file '%.80s'",
+				 tempPath );
+		return( FALSE );
+		}
+	status = fwrite( header, 1, headerSize, file ) == ( size_t ) headerSize && \
+			 fwrite( entries, 1, entriesSize, file ) == ( size_t ) entriesSize && \
+			 ( extraDataSize <= 0 || \
+			   fwrite( extraData, 1, extraDataSize,
+					   file ) == ( size_t ) extraDataSize );
+	if( fclose( file ) || !status )
+		{
+		remove( tempPath );
+		sprintf( errorString, "Cannot write index file '%.80s'",
+				 tempPath );
+		return( FALSE );
+		}
+#ifdef __WIN32__
+	remove( indexPath );	/* Win32 rename() won't replace existing files */
+#endif /* __WIN32__ */
+	if( rename( tempPath, indexPath ) )
+		{
+		remove( tempPath );
+		sprintf( errorString, "Cannot create index file '%.80s'",
+				 indexPath );
+		return( FALSE );
+		}
+
+	return( TRUE );
+	}
+
+static int compileConfig( DUMPASN1_CONFIG *config, const char *path )
+	{
+	INDEX_HEADER header;
+	INDEX_ENTRY *entries;
+	OIDINFO **oidList;
+	FILE_STAMP configStamp;
+	char indexPath[ FILENAME_MAX ], *pool;
+	unsigned int poolPos = 1;
+	long poolSize = 1;
+	int noEntries = 0, status = FALSE, i;
+
+	if( !buildIndexPath( indexPath, path ) )
+		{
+		sprintf( config->errorString, "Config file path '%.80s' is too long",
+				 path );
+		return( FALSE );
+		}
+
+	/* Read the text config file.  Since the hash table has already weeded
+	   out any duplicates, the index only needs to contain what's in the
+	   table */
+	if( !readTextConfig( config, path, FALSE ) )
+		return( FALSE );
+	if( !getFileStamp( path, &configStamp ) )
+		{
+		sprintf( config->errorString, "Cannot open config file '%.80s'",
+				 path );
+		return( FALSE );
+		}
+	for( i = 0; i < config->oidTableSize; i++ )
+		{
+		const OIDINFO *oidPtr = config->oidTable[ i ];
+
+		if( oidPtr == NULL )
+			continue;
+		if( oidPtr->description != NULL )
+			poolSize += strlen( oidPtr->description ) + 1;
+		if( oidPtr->comment != NULL )
+			poolSize += strlen( oidPtr->comment ) + 1;
+		}
+	oidList = malloc( ( config->noOIDs + 1 ) * sizeof( OIDINFO * ) );
+	entries = calloc( config->noOIDs + 1, sizeof( INDEX_ENTRY ) );
+	pool = malloc( poolSize );
+	if( oidList != NULL && entries != NULL && pool != NULL )
+		{
+		/* Sort the OIDs so that they can be binary-searched */
+		for( i = 0; i < config->oidTableSize; i++ )
+			if( config->oidTable[ i ] != NULL )
+				oidList[ noEntries++ ] = config->oidTable[ i ];
+		qsort( oidList, noEntries, sizeof( OIDINFO * ), compareOIDinfo );
+
+		/* Build the table of OIDs and the string pool */
+		*pool = '\0';
+		for( i = 0; i < noEntries; i++ )
+			{
+			const OIDINFO *oidPtr = oidList[ i ];
+
+			memcpy( entries[ i ].oid, oidPtr->oid, MAX_OID_SIZE );
+			entries[ i ].oidLength = ( unsigned char ) oidPtr->oidLength;
+			entries[ i ].warn = ( unsigned char ) oidPtr->warn;
+			entries[ i ].description = addPoolString( pool, &poolPos,
+													  oidPtr->description );
+			entries[ i ].comment = addPoolString( pool, &poolPos,
+												  oidPtr->comment );
+			}
+		memset( &header, 0, sizeof( INDEX_HEADER ) );
+		header.magic = INDEX_MAGIC;
+		header.version = INDEX_VERSION;
+		header.configStamp = configStamp;
+		header.noEntries = noEntries;
+		header.poolSize = poolPos;
+		status = writeIndex( indexPath, &header, sizeof( INDEX_HEADER ),
+							 entries, noEntries * sizeof( INDEX_ENTRY ),
+							 pool, poolPos, config->errorString );
+		}
+	else
+		strcpy( config->errorString, "Out of memory" );
+	if( pool != NULL )
+		free( pool );
+	if( entries != NULL )
+		free( entries );
+	if( oidList != NULL )
+		free( oidList );
+
+	return( status );
+	}
+
 /* Check for the existence of a config file path (access() isn't available
    on all systems) */
 
@@ -821,14 +1390,13 @@ static void buildConfigPath( char *path, const char *pathTemplate )
 	strcpy( path, newPath );
 	}
 
-/* Read the global config file */
+/* Find the global config file */
 
-static int readGlobalConfig( const char *path )
+static void findGlobalConfig( char *buffer, const char *path )
 	{
-	char buffer[ FILENAME_MAX ];
 	char *searchPos = ( char * ) path, *namePos, *lastPos = NULL;
 #ifdef __UNIX__
-	char *envPath;
+	const char *envPath;
 #endif /* __UNIX__ */
 	int i;
 
@@ -861,7 +1429,7 @@ static int readGlobalConfig( const char *path )
 			memcpy( buffer, path, endPos );
 			strcpy( buffer + endPos, CONFIG_NAME );
 			if( testConfigPath( buffer ) )
-				return( readConfig( buffer, TRUE ) );
+				return;
 			}
 
 		/* That didn't work, try the absolute locations and $PATH */
@@ -873,7 +1441,7 @@ static int readGlobalConfig( const char *path )
 		strcpy( buffer, path );
 		strcpy( buffer + ( int ) ( namePos - ( char * ) path ), CONFIG_NAME );
 		if( testConfigPath( buffer ) )
-			return( readConfig( buffer, TRUE ) );
+			return;
 		}
 
 	/* Now try each of the possible absolute locations for the config file */
@@ -881,205 +1449,688 @@ static int readGlobalConfig( const char *path )
 		{
 		buildConfigPath( buffer, configPaths[ i ] );
 		if( testConfigPath( buffer ) )
-			return( readConfig( buffer, TRUE ) );
+			return;
 		}
 
 #ifdef __UNIX__
-	/* On Unix systems we can also search for the config file on $PATH */
+	/* On Unix systems we can also search for the config file on $PATH.  We
+	   can't use strtok() for this since it's not thread-safe and would
+	   modify the environment */
 	if( ( envPath = getenv( "PATH" ) ) != NULL )
 		{
-		char *pathPtr = strtok( envPath, ":" );
-
 		do
 			{
-			sprintf( buffer, "%s/%s", pathPtr, CONFIG_NAME );
-			if( testConfigPath( buffer ) )
-				return( readConfig( buffer, TRUE ) );
-			pathPtr = strtok( NULL, ":" );
+			const char *endPtr = strchr( envPath, ':' );
+			const int pathLen = ( endPtr != NULL ) ? \
+								( int ) ( endPtr - envPath ) : \
+								( int ) strlen( envPath );
+
+			if( pathLen > 0 && pathLen < FILENAME_MAX - 14 )
+				{
+				sprintf( buffer, "%.*s/%s", pathLen, envPath, CONFIG_NAME );
+				if( testConfigPath( buffer ) )
+					return;
+				}
+			envPath = ( endPtr != NULL ) ? endPtr + 1 : NULL;
 			}
-		while( pathPtr != NULL );
+		while( envPath != NULL );
 		}
 #endif /* __UNIX__ */
 
 	/* Default to just the config name (which should fail as it was the
-	   first entry in configPaths[]).  readConfig() will display the
-	   appropriate warning */
-	return( readConfig( CONFIG_NAME, TRUE ) );
+	   first entry in configPaths[]).  readConfig() will flag the
+	   missing config file */
+	strcpy( buffer, CONFIG_NAME );
+	}
+
+/* Read the global config file */
+
+static int readGlobalConfig( DUMPASN1_CONFIG *config, const char *path )
+	{
+	char buffer[ FILENAME_MAX ];
+
+	findGlobalConfig( buffer, path );
+	return( readConfig( config, buffer, TRUE ) );
 	}
 
 /****************************************************************************
 *																			*
-*							Output/Formatting Routines						*
+*								Input Routines								*
 *																			*
 ****************************************************************************/
 
-#ifdef __OS390__
+/* Refill the input buffer once we've used up the data in it.  For in-memory
+   data there's nothing more to read, so we're at EOF.  For buffered input
+   we move the last INPUT_LOOKBACK bytes to the start of the buffer before
+   reading more data after them, so that the code that looks ahead in the
+   data can always seek back to where it started */
 
-static int asciiToEbcdic( const int ch )
+static int inFill( ASN1_INPUT *input )
 	{
-	char convBuffer[ 2 ];
+	long keep;
+	size_t count;
 
-	convBuffer[ 0 ] = ch;
-	convBuffer[ 1 ] = '\0';
-	__atoe( convBuffer ); /* Convert ASCII to EBCDIC for 390 */
-	return( convBuffer[ 0 ] );
-	}
-#endif /* __OS390__ */
+	/* If a character was pushed back after we hit EOF, return that */
+	if( input->pushback != EOF )
+		{
+		const int ch = input->pushback;
 
-/* Indent a string by the appropriate amount */
+		input->pushback = EOF;
+		return( ch );
+		}
 
-static void doIndent( const int level )
-	{
-	int i;
+	if( input->stream == NULL )
+		{
+		input->eof = TRUE;
+		return( EOF );
+		}
+	keep = min( input->dataLen, INPUT_LOOKBACK );
+	memmove( input->buffer, input->buffer + input->dataLen - keep, keep );
+	input->dataStart += input->dataLen - keep;
+	input->dataLen = keep;
+	input->pos = keep;
+	if( ( count = fread( input->buffer + keep, 1, INPUT_BUFSIZE,
+						 input->stream ) ) == 0 )
+		{
+		input->eof = TRUE;
+		return( EOF );
+		}
+	input->dataLen += ( long ) count;
 
-	for( i = 0; i < level; i++ )
-		fprintf( output, printDots ? ". " : \
-						 shallowIndent ? " " : "  " );
+	return( input->data[ input->pos++ ] );
 	}
 
-/* Complain about an error in the ASN.1 object */
-
-static void complain( const char *message, const int level )
-	{
-	if( !doPure )
-		fprintf( output, INDENT_STRING );
-	doIndent( level + 1 );
-	fprintf( output, "Error: %s.\n", message );
-	noErrors++;
-	}
+/* The stdio-style functions used to read the input.  inGetc() is called
+   for almost every byte of data so it's a macro that only drops into
+   inFill() when the buffer is empty */
 
-/* Dump data as a string of hex digits up to a maximum of 128 bytes */
+#define inGetc( input ) \
+	( ( ( input )->pos < ( input )->dataLen ) ? \
+	  ( int ) ( input )->data[ ( input )->pos++ ] : inFill( input ) )
+#define inEof( input )	( ( input )->eof )
+#define inTell( input )	( ( input )->dataStart + ( input )->pos )
 
-static void dumpHex( FILE *inFile, long length, int level, int isInteger )
+static void inUngetc( const int ch, ASN1_INPUT *input )
 	{
-	const int lineLength = ( dumpText ) ? 8 : 16;
-	char printable[ 9 ];
-	long noBytes = length;
+	if( ch == EOF )
+		return;
+
+	/* We only ever push back the last character read, which is still in
+	   the buffer.  The exception is if the read hit EOF, in which case we
+	   have to remember the character as stdio does */
+	if( input->eof )
+		input->pushback = ch;
+	else
+		if( input->pos > 0 )
+			input->pos--;
+	input->eof = FALSE;
+	}
+
+static long inRead( void *buffer, const long length, ASN1_INPUT *input )
+	{
+	unsigned char *bufPtr = buffer;
+	long count = 0;
+
+	while( count < length )
+		{
+		long bytesLeft = input->dataLen - input->pos;
+		int ch;
+
+		if( bytesLeft <= 0 )
+			{
+			if( ( ch = inFill( input ) ) == EOF )
+				break;
+			bufPtr[ count++ ] = ch;
+			continue;
+			}
+		if( bytesLeft > length - count )
+			bytesLeft = length - count;
+		memcpy( bufPtr + count, input->data + input->pos, bytesLeft );
+		input->pos += bytesLeft;
+		count += bytesLeft;
+		}
+
+	return( count );
+	}
+
+static int inSeek( ASN1_INPUT *input, const long offset, const int whence )
+	{
+	const long newPos = ( whence == SEEK_SET ) ? offset : \
+						inTell( input ) + offset;
+
+	if( newPos < 0 )
+		return( -1 );
+
+	/* If the data is in memory, seeking is just a matter of moving the
+	   position.  As with fseek() it's OK to move past the end of the data,
+	   we'll get an EOF on the next read */
+	input->pushback = EOF;
+	if( input->stream == NULL )
+		{
+		input->pos = newPos;
+		input->eof = FALSE;
+		return( 0 );
+		}
+
+	/* Buffered input can only go back as far as the start of the buffer,
+	   and going forwards means reading and discarding the data in
+	   between */
+	if( newPos < inTell( input ) )
+		{
+		if( newPos < input->dataStart )
+			return( -1 );
+		input->pos = newPos - input->dataStart;
+		input->eof = FALSE;
+		return( 0 );
+		}
+	while( inTell( input ) < newPos )
+		{
+		long bytesLeft = input->dataLen - input->pos;
+
+		if( bytesLeft <= 0 )
+			{
+			if( inFill( input ) == EOF )
+				break;
+			continue;
+			}
+		if( bytesLeft > newPos - inTell( input ) )
+			bytesLeft = newPos - inTell( input );
+		input->pos += bytesLeft;
+		}
+	input->eof = FALSE;
+
+	return( 0 );
+	}
+
+/* Check whether there's any more data present */
+
+static int inMoreData( ASN1_INPUT *input )
+	{
+	const int ch = inGetc( input );
+
+	if( ch == EOF )
+		return( FALSE );
+	inUngetc( ch, input );
+	return( TRUE );
+	}
+
+/* Set up the input from an open file.  If the file is seekable we map it
+   into memory (or failing that read it into memory), otherwise we fall back
+   to buffered reads.  As with stdio, reading starts from the file's current
+   position */
+
+static int inOpen( ASN1_INPUT *input, FILE *inFile )
+	{
+	long startPos, length;
+
+	memset( input, 0, sizeof( ASN1_INPUT ) );
+	input->pushback = EOF;
+
+	/* Find out how much data there is, which also tells us whether the input
+	   is seekable */
+	if( ( startPos = ftell( inFile ) ) >= 0 && \
+		!fseek( inFile, 0, SEEK_END ) && ( length = ftell( inFile ) ) > 0 )
+		{
+#if defined( USE_MMAP )
+		void *mapPtr = mmap( NULL, ( size_t ) length, PROT_READ, MAP_PRIVATE,
+							 fileno( inFile ), 0 );
+
+		if( mapPtr != MAP_FAILED )
+			{
+			input->data = mapPtr;
+			input->isMapped = TRUE;
+			}
+#elif defined( __WIN32__ )
+		input->hMapping = CreateFileMapping( ( HANDLE ) \
+								_get_osfhandle( _fileno( inFile ) ),
+								NULL, PAGE_READONLY, 0, 0, NULL );
+		if( input->hMapping != NULL )
+			{
+			input->data = MapViewOfFile( input->hMapping, FILE_MAP_READ,
+										 0, 0, 0 );
+			if( input->data != NULL )
+				input->isMapped = TRUE;
+			else
+				CloseHandle( input->hMapping );
+			}
+#endif /* OS-specific file mapping */
+
+		/* If we couldn't map it, read it into memory instead */
+		if( !input->isMapped && \
+			( input->buffer = malloc( ( size_t ) length ) ) != NULL )
+			{
+			fseek( inFile, 0, SEEK_SET );
+			length = ( long ) fread( input->buffer, 1, ( size_t ) length,
+									 inFile );
+			input->data = input->buffer;
+			}
+		if( input->data != NULL )
+			{
+			input->dataLen = length;
+			input->pos = startPos;
+			return( TRUE );
+			}
+		}
+
+	/* It's a pipe or something similar (or an empty file), read it via a
+	   buffer */
+	if( startPos >= 0 )
+		fseek( inFile, startPos, SEEK_SET );
+	if( ( input->buffer = malloc( INPUT_LOOKBACK + INPUT_BUFSIZE ) ) == NULL )
+		return( FALSE );
+	input->data = input->buffer;
+	input->stream = inFile;
+
+	return( TRUE );
+	}
+
+static void inClose( ASN1_INPUT *input )
+	{
+#if defined( USE_MMAP )
+	if( input->isMapped )
+		munmap( ( void * ) input->data, ( size_t ) input->dataLen );
+#elif defined( __WIN32__ )
+	if( input->isMapped )
+		{
+		UnmapViewOfFile( input->data );
+		CloseHandle( input->hMapping );
+		}
+#endif /* OS-specific file mapping */
+	if( input->buffer != NULL )
+		free( input->buffer );
+	}
+
+/****************************************************************************
+*																			*
+*							Output/Formatting Routines						*
+*																			*
+****************************************************************************/
+
+/* Not all compilers have snprintf() and vsnprintf() */
+
+#if defined( _MSC_VER ) && _MSC_VER < 1900
+  #define snprintf		_snprintf
+  #define vsnprintf		_vsnprintf
+#endif /* Older versions of VC++ */
+
+/* Write data to the output.  If there's no output stream the data is
+   appended to a memory buffer, which is expanded as required */
+
+static int outExpand( DUMPASN1_CTX *ctx, const long length )
+	{
+	char *newBuffer;
+	long newSize = ( ctx->outSize > 0 ) ? ctx->outSize : 4096;
+
+	while( newSize < ctx->outLength + length + 1 )
+		newSize *= 2;
+	if( ( newBuffer = realloc( ctx->outBuffer, newSize ) ) == NULL )
+		{
+		ctx->status = DUMPASN1_ERROR_MEMORY;
+		strcpy( ctx->errorString, "Out of memory" );
+		return( FALSE );
+		}
+	ctx->outBuffer = newBuffer;
+	ctx->outSize = newSize;
+
+	return( TRUE );
+	}
+
+static void outWrite( DUMPASN1_CTX *ctx, const char *data, const long length )
+	{
+	if( ctx->output != NULL )
+		{
+		fwrite( data, 1, length, ctx->output );
+		return;
+		}
+	if( ctx->outLength + length >= ctx->outSize && \
+		!outExpand( ctx, length ) )
+		return;
+	memcpy( ctx->outBuffer + ctx->outLength, data, length );
+	ctx->outLength += length;
+	ctx->outBuffer[ ctx->outLength ] = '\0';
+	}
+
+static void outPutc( DUMPASN1_CTX *ctx, const int ch )
+	{
+	const char chBuffer = ( char ) ch;
+
+	if( ctx->output != NULL )
+		fputc( ch, ctx->output );
+	else
+		outWrite( ctx, &chBuffer, 1 );
+	}
+
+static void outPuts( DUMPASN1_CTX *ctx, const char *string )
+	{
+	if( ctx->output != NULL )
+		fputs( string, ctx->output );
+	else
+		outWrite( ctx, string, strlen( string ) );
+	}
+
+static void outPrintf( DUMPASN1_CTX *ctx, const char *format, ... )
+	{
+	va_list argPtr;
+	int length = -1;
+
+	va_start( argPtr, format );
+	if( ctx->output != NULL )
+		{
+		vfprintf( ctx->output, format, argPtr );
+		va_end( argPtr );
+		return;
+		}
+
+	/* Try and format the string into the space remaining in the buffer.  If
+	   there isn't enough room, expand the buffer and try again.  Older
+	   vsnprintf()s return -1 rather than the required size if the output
+	   doesn't fit, in which case we keep doubling the buffer */
+	while( TRUE )
+		{
+		const long spaceLeft = ctx->outSize - ctx->outLength;
+
+		if( spaceLeft > 0 )
+			{
+			va_list argPtrCopy;
+
+#ifdef va_copy
+			va_copy( argPtrCopy, argPtr );
+#else
+			memcpy( &argPtrCopy, &argPtr, sizeof( va_list ) );
+#endif /* va_copy */
+			length = vsnprintf( ctx->outBuffer + ctx->outLength, spaceLeft,
+								format, argPtrCopy );
+			va_end( argPtrCopy );
+			if( length >= 0 && length < spaceLeft )
+				{
+				ctx->outLength += length;
+				break;
+				}
+			}
+		if( !outExpand( ctx, ( spaceLeft > 0 && length > 0 ) ? \
+							 length : ctx->outSize + 1 ) )
+			break;
+		}
+	va_end( argPtr );
+	}
+
+#ifdef __OS390__
+
+static int asciiToEbcdic( const int ch )
+	{
+	char convBuffer[ 2 ];
+
+	convBuffer[ 0 ] = ch;
+	convBuffer[ 1 ] = '\0';
+	__atoe( convBuffer ); /* Convert ASCII to EBCDIC for 390 */
+	return( convBuffer[ 0 ] );
+	}
+#endif /* __OS390__ */
+
+/* Indent a string by the appropriate amount */
+
+static void doIndent( DUMPASN1_CTX *ctx, const int level )
+	{
+	int i;
+
+	for( i = 0; i < level; i++ )
+		outPrintf( ctx, ctx->printDots ? ". " : \
+						   ctx->shallowIndent ? " " : "  " );
+	}
+
+/* Complain about an error in the ASN.1 object */
+
+static void complain( DUMPASN1_CTX *ctx, const char *message,
+					  const int level )
+	{
+	if( !ctx->doPure )
+		outPrintf( ctx, INDENT_STRING );
+	doIndent( ctx, level + 1 );
+	outPrintf( ctx, "Error: %s.\n", message );
+	ctx->noErrors++;
+	}
+
+/* Format up to 16 bytes of data as hex digits, each followed by a space,
+   and as printable text.  With SSE2 we convert the whole line at once,
+   otherwise we do it a byte at a time.  textBuffer must have room for 16
+   characters no matter how many bytes are being formatted */
+
+static void formatHexLine( char *hexBuffer, char *textBuffer,
+						   const unsigned char *data, const int length )
+	{
+#ifdef USE_SSE2
+	const __m128i nibbleMask = _mm_set1_epi8( 0x0F );
+	const __m128i digitOffset = _mm_set1_epi8( '0' );
+	const __m128i letterOffset = _mm_set1_epi8( 'A' - '0' - 10 );
+	const __m128i nine = _mm_set1_epi8( 9 );
+	unsigned char lineBuffer[ 16 ], hexPairs[ 32 ];
+	__m128i value, hiDigits, loDigits, printMask;
+	int i;
+
+	/* Load the data, padded out to 16 bytes if necessary.  Full lines are
+	   either 16 bytes, or 8 if we're displaying text alongside the hex */
+	if( length == 16 )
+		value = _mm_loadu_si128( ( const __m128i * ) data );
+	else
+		if( length == 8 )
+			value = _mm_loadl_epi64( ( const __m128i * ) data );
+		else
+			{
+			memset( lineBuffer, 0, 16 );
+			memcpy( lineBuffer, data, length );
+			value = _mm_loadu_si128( ( const __m128i * ) lineBuffer );
+			}
+
+	/* Split each byte into nibbles and convert them to hex digits by adding
+	   '0', and a further offset for the ones that have to be 'A'...'F' */
+	hiDigits = _mm_and_si128( _mm_srli_epi16( value, 4 ), nibbleMask );
+	loDigits = _mm_and_si128( value, nibbleMask );
+	hiDigits = _mm_add_epi8( _mm_add_epi8( hiDigits, digitOffset ),
+							 _mm_and_si128( _mm_cmpgt_epi8( hiDigits, nine ),
+											letterOffset ) );
+	loDigits = _mm_add_epi8( _mm_add_epi8( loDigits, digitOffset ),
+							 _mm_and_si128( _mm_cmpgt_epi8( loDigits, nine ),
+											letterOffset ) );
+	_mm_storeu_si128( ( __m128i * ) hexPairs,
+					  _mm_unpacklo_epi8( hiDigits, loDigits ) );
+	_mm_storeu_si128( ( __m128i * ) ( hexPairs + 16 ),
+					  _mm_unpackhi_epi8( hiDigits, loDigits ) );
+	for( i = 0; i < length; i++ )
+		{
+		hexBuffer[ i * 3 ] = hexPairs[ i * 2 ];
+		hexBuffer[ i * 3 + 1 ] = hexPairs[ i * 2 + 1 ];
+		hexBuffer[ i * 3 + 2 ] = ' ';
+		}
+
+	/* Replace anything outside ' '...'~' with '.'.  Treated as signed
+	   values these are the bytes greater than 0x1F and less than 0x7F */
+	printMask = _mm_and_si128( _mm_cmpgt_epi8( value, _mm_set1_epi8( 0x1F ) ),
+							   _mm_cmplt_epi8( value, _mm_set1_epi8( 0x7F ) ) );
+	value = _mm_or_si128( _mm_and_si128( printMask, value ),
+						  _mm_andnot_si128( printMask, _mm_set1_epi8( '.' ) ) );
+	_mm_storeu_si128( ( __m128i * ) textBuffer, value );
+#else
+	static const char hexDigits[] = "0123456789ABCDEF";
+	int i;
+
+	for( i = 0; i < length; i++ )
+		{
+		const int ch = data[ i ];
+
+		hexBuffer[ i * 3 ] = hexDigits[ ch >> 4 ];
+		hexBuffer[ i * 3 + 1 ] = hexDigits[ ch & 0x0F ];
+		hexBuffer[ i * 3 + 2 ] = ' ';
+		textBuffer[ i ] = ( ch >= ' ' && ch < 127 ) ? ch : '.';
+		}
+#endif /* USE_SSE2 */
+	}
+
+/* Dump data as a string of hex digits up to a maximum of 128 bytes.  Each
+   line is put together in a buffer and written in one go, which is a lot
+   faster than formatting it a byte at a time when there's a lot of data */
+
+static void dumpHex( DUMPASN1_CTX *ctx, long length, int level,
+					 int isInteger )
+	{
+	ASN1_INPUT *input = &ctx->input;
+	const int lineLength = ( ctx->dumpText ) ? 8 : 16;
+	unsigned char data[ 16 ];
+	char printable[ 16 ], prefix[ 64 ], lineBuffer[ 256 ];
+	long noBytes = length, i;
 	int zeroPadded = FALSE, warnPadding = FALSE, warnNegative = isInteger;
-	int singleLine = FALSE;
-	int maxLevel = ( doPure ) ? 15 : 8, i;
+	int singleLine = FALSE, prefixLength = 0, printableLength = 0;
+	int maxLevel = ( ctx->doPure ) ? 15 : 8, j;
 
 	/* Check if LHS status info + indent + "OCTET STRING" string + data will
 	   wrap */
-	if( ( ( doPure ) ? 0 : INDENT_SIZE ) + ( level * 2 ) + 12 + \
+	if( ( ( ctx->doPure ) ? 0 : INDENT_SIZE ) + ( level * 2 ) + 12 + \
 		( length * 3 ) < OUTPUT_WIDTH )
 		singleLine = TRUE;
 
-	if( noBytes > 128 && !printAllData )
+	if( noBytes > 128 && !ctx->printAllData )
 		noBytes = 128;	/* Only output a maximum of 128 bytes */
 	if( level > maxLevel )
 		level = maxLevel;	/* Make sure we don't go off edge of screen */
-	printable[ 8 ] = printable[ 0 ] = '\0';
-	for( i = 0; i < noBytes; i++ )
+
+	/* Set up the text that starts each line, which is either a single space
+	   if it all fits on one line or a newline and the indent, as written by
+	   doIndent() */
+	if( singleLine )
+		prefix[ prefixLength++ ] = ' ';
+	else
 		{
-		int ch;
+		const char *indentString = ctx->printDots ? ". " : \
+								   ctx->shallowIndent ? " " : "  ";
+		const int indentLength = strlen( indentString );
 
-		if( !( i % lineLength ) )
+		prefix[ prefixLength++ ] = '\n';
+		if( !ctx->doPure )
 			{
-			if( singleLine )
-				putchar( ' ' );
-			else
-				{
-				if( dumpText )
-					{
-					/* If we're dumping text alongside the hex data, print
-					   the accumulated text string */
-					fputs( "    ", output );
-					fputs( printable, output );
-					}
-				fputc( '\n', output );
-				if( !doPure )
-					fprintf( output, INDENT_STRING );
-				doIndent( level + 1 );
-				}
+			memcpy( prefix + prefixLength, INDENT_STRING, INDENT_SIZE );
+			prefixLength += INDENT_SIZE;
+			}
+		for( j = 0; j <= level; j++ )
+			{
+			memcpy( prefix + prefixLength, indentString, indentLength );
+			prefixLength += indentLength;
+			}
+		}
+
+	for( i = 0; i < noBytes; i += lineLength )
+		{
+		const int count = ( int ) min( noBytes - i, lineLength );
+		int bytesRead, bufPos = 0;
+
+		/* If we're dumping text alongside the hex data, print the text
+		   accumulated from the previous line before starting a new one */
+		if( ctx->dumpText && !singleLine )
+			{
+			memcpy( lineBuffer, "    ", 4 );
+			memcpy( lineBuffer + 4, printable, printableLength );
+			bufPos = 4 + printableLength;
+			}
+		memcpy( lineBuffer + bufPos, prefix, prefixLength );
+		bufPos += prefixLength;
+
+		/* Format the line's data.  If we run out of data, the rest of the
+		   line is shown as EOF values in the same way as if we'd read it
+		   a byte at a time */
+		bytesRead = ( int ) inRead( data, count, input );
+		formatHexLine( lineBuffer + bufPos, printable, data, bytesRead );
+		bufPos += bytesRead * 3;
+		for( j = bytesRead; j < count; j++ )
+			{
+			bufPos += sprintf( lineBuffer + bufPos, "%02X ", EOF );
+			printable[ j ] = '.';
 			}
-		ch = getc( inFile );
-		fprintf( output, "%s%02X", i % lineLength ? " " : "", ch );
-		printable[ i % 8 ] = ( ch >= ' ' && ch < 127 ) ? ch : '.';
-		fPos++;
+		outWrite( ctx, lineBuffer, bufPos - 1 );	/* Drop trailing space */
+		printableLength = count;
+		ctx->fPos += count;
 
 		/* If we need to check for negative values and zero padding, check
 		   this now */
 		if( !i )
 			{
-			if( !ch )
+			const int ch0 = ( bytesRead > 0 ) ? data[ 0 ] : EOF;
+			const int ch1 = ( bytesRead > 1 ) ? data[ 1 ] : EOF;
+
+			if( !ch0 )
 				zeroPadded = TRUE;
-			if( !( ch & 0x80 ) )
+			if( !( ch0 & 0x80 ) )
 				warnNegative = FALSE;
+			if( count > 1 && zeroPadded && ch1 < 0x80 )
+				warnPadding = TRUE;
 			}
-		if( i == 1 && zeroPadded && ch < 0x80 )
-			warnPadding = TRUE;
 		}
-	if( dumpText )
+	if( ctx->dumpText )
 		{
-		/* Print any remaining text */
-		i %= lineLength;
-		printable[ i ] = '\0';
-		while( i < lineLength )
+		/* Print any remaining text.  If the data ended on a line boundary
+		   then the last line's text has already been consumed and we just
+		   print the padding */
+		const int remainder = ( int ) ( noBytes % lineLength );
+		int bufPos = 0;
+
+		for( j = remainder; j < lineLength; j++ )
 			{
-			fprintf( output, "   " );
-			i++;
+			memcpy( lineBuffer + bufPos, "   ", 3 );
+			bufPos += 3;
 			}
-		fputs( "    ", output );
-		fputs( printable, output );
+		memcpy( lineBuffer + bufPos, "    ", 4 );
+		memcpy( lineBuffer + bufPos + 4, printable, remainder );
+		outWrite( ctx, lineBuffer, bufPos + 4 + remainder );
 		}
-	if( length > 128 && !printAllData )
+	if( length > 128 && !ctx->printAllData )
 		{
 		length -= 128;
-		fputc( '\n', output );
-		if( !doPure )
-			fprintf( output, INDENT_STRING );
-		doIndent( level + 5 );
-		fprintf( output, "[ Another %ld bytes skipped ]", length );
-		fPos += length;
-		if( useStdin )
-			{
-			while( length-- )
-				getc( inFile );
-			}
-		else
-			fseek( inFile, length, SEEK_CUR );
+		outPutc( ctx, '\n' );
+		if( !ctx->doPure )
+			outPrintf( ctx, INDENT_STRING );
+		doIndent( ctx, level + 5 );
+		outPrintf( ctx, "[ Another %ld bytes skipped ]", length );
+		ctx->fPos += length;
+		inSeek( input, length, SEEK_CUR );
 		}
-	fputs( "\n", output );
+	outPuts( ctx, "\n" );
 
 	if( isInteger )
 		{
 		if( warnPadding )
-			complain( "Integer has non-DER encoding", level );
+			complain( ctx, "Integer has non-DER encoding", level );
 		if( warnNegative )
-			complain( "Integer has a negative value", level );
+			complain( ctx, "Integer has a negative value", level );
 		}
 	}
 
 /* Dump a bitstring, reversing the bits into the standard order in the
    process */
 
-static void dumpBitString( FILE *inFile, const int length, const int unused,
-						   const int level )
+static void dumpBitString( DUMPASN1_CTX *ctx, const int length,
+						   const int unused, const int level )
 	{
+	ASN1_INPUT *input = &ctx->input;
 	unsigned int bitString = 0, currentBitMask = 0x80, remainderMask = 0xFF;
 	int bitFlag, value = 0, noBits, bitNo = -1, i;
 	char *errorStr = NULL;
 
 	if( unused < 0 || unused > 7 )
-		complain( "Invalid number of unused bits", level );
+		complain( ctx, "Invalid number of unused bits", level );
 	noBits = ( length * 8 ) - unused;
 
 	/* ASN.1 bitstrings start at bit 0, so we need to reverse the order of
 	   the bits if necessary */
 	if( length )
 		{
-		bitString = fgetc( inFile );
-		fPos++;
+		bitString = inGetc( input );
+		ctx->fPos++;
 		}
 	for( i = noBits - 8; i > 0; i -= 8 )
 		{
-		bitString = ( bitString << 8 ) | fgetc( inFile );
+		bitString = ( bitString << 8 ) | inGetc( input );
 		currentBitMask <<= 8;
 		remainderMask = ( remainderMask << 8 ) | 0xFF;
-		fPos++;
+		ctx->fPos++;
 		}
-	if( reverseBitString )
+	if( ctx->reverseBitString )
 		{
 		for( i = 0, bitFlag = 1; i < noBits; i++ )
 			{
@@ -1105,31 +2156,31 @@ static void dumpBitString( FILE *inFile, const int length, const int unused,
 	   set (which is often the case for bit flags) we also print the bit
 	   number to save users having to count the zeroes to figure out which
 	   flag is set */
-	fputc( '\n', output );
-	if( !doPure )
-		fprintf( output, INDENT_STRING );
-	doIndent( level + 1 );
-	fputc( '\'', output );
-	if( reverseBitString )
+	outPutc( ctx, '\n' );
+	if( !ctx->doPure )
+		outPrintf( ctx, INDENT_STRING );
+	doIndent( ctx, level + 1 );
+	outPutc( ctx, '\'' );
+	if( ctx->reverseBitString )
 		currentBitMask = 1 << ( noBits - 1 );
 	for( i = 0; i < noBits; i++ )
 		{
 		if( value & currentBitMask )
 			{
 			bitNo = ( bitNo == -1 ) ? ( noBits - 1 ) - i : -2;
-			fputc( '1', output );
+			outPutc( ctx, '1' );
 			}
 		else
-			fputc( '0', output );
+			outPutc( ctx, '0' );
 		currentBitMask >>= 1;
 		}
 	if( bitNo >= 0 )
-		fprintf( output, "'B (bit %d)\n", bitNo );
+		outPrintf( ctx, "'B (bit %d)\n", bitNo );
 	else
-		fputs( "'B\n", output );
+		outPuts( ctx, "'B\n" );
 
 	if( errorStr != NULL )
-		complain( errorStr, level );
+		complain( ctx, errorStr, level );
 	}
 
 /* Display data as a text string up to a maximum of 240 characters (8 lines
@@ -1141,19 +2192,20 @@ static void dumpBitString( FILE *inFile, const int length, const int unused,
    same line as the rest of the text (even if it wraps), otherwise we break
    it up into 48-char chunks in a somewhat less nice text-dump format */
 
-static void displayString( FILE *inFile, long length, int level,
+static void displayString( DUMPASN1_CTX *ctx, long length, int level,
 						   STR_OPTION strOption )
 	{
+	ASN1_INPUT *input = &ctx->input;
 	char timeStr[ 64 ];
 #ifdef __OS390__
 	char convBuffer[ 2 ];
 #endif /* __OS390__ */
 	long noBytes = length;
-	int lineLength = 48, maxLevel = ( doPure ) ? 15 : 8, i;
+	int lineLength = 48, maxLevel = ( ctx->doPure ) ? 15 : 8, i;
 	int firstTime = TRUE, doTimeStr = FALSE, warnIA5 = FALSE;
 	int warnPrintable = FALSE, warnTime = FALSE, warnBMP = FALSE;
 
-	if( noBytes > 384 && !printAllData )
+	if( noBytes > 384 && !ctx->printAllData )
 		noBytes = 384;	/* Only output a maximum of 384 bytes */
 	if( strOption == STR_UTCTIME || strOption == STR_GENERALIZED )
 		{
@@ -1161,10 +2213,10 @@ static void displayString( FILE *inFile, long length, int level,
 			( strOption == STR_GENERALIZED && length != 15 ) )
 			warnTime = TRUE;
 		else
-			doTimeStr = rawTimeString ? FALSE : TRUE;
+			doTimeStr = ctx->rawTimeString ? FALSE : TRUE;
 		}
 	if( !doTimeStr && length <= 40 )
-		fprintf( output, " '" );		/* Print string on same line */
+		outPrintf( ctx, " '" );		/* Print string on same line */
 	if( level > maxLevel )
 		level = maxLevel;	/* Make sure we don't go off edge of screen */
 	for( i = 0; i < noBytes; i++ )
@@ -1176,15 +2228,15 @@ static void displayString( FILE *inFile, long length, int level,
 		if( length > 40 && !( i % lineLength ) )
 			{
 			if( !firstTime )
-				fputc( '\'', output );
-			fputc( '\n', output );
-			if( !doPure )
-				fprintf( output, INDENT_STRING );
-			doIndent( level + 1 );
-			fputc( '\'', output );
+				outPutc( ctx, '\'' );
+			outPutc( ctx, '\n' );
+			if( !ctx->doPure )
+				outPrintf( ctx, INDENT_STRING );
+			doIndent( ctx, level + 1 );
+			outPutc( ctx, '\'' );
 			firstTime = FALSE;
 			}
-		ch = getc( inFile );
+		ch = inGetc( input );
 #if defined( __WIN32__ ) || defined( __UNIX__ ) || defined( __OS390__ )
 		if( strOption == STR_BMP )
 			{
@@ -1193,7 +2245,7 @@ static void displayString( FILE *inFile, long length, int level,
 				warnBMP = TRUE;
 			else
 				{
-				const wchar_t wCh = ( ch << 8 ) | getc( inFile );
+				const wchar_t wCh = ( ch << 8 ) | inGetc( input );
 #if defined( __WIN32__ ) || ( defined( __UNIX__ ) && !defined( __MACH__ ) )
 				unsigned char outBuf[ 8 ];
 #else
@@ -1212,25 +2264,24 @@ static void displayString( FILE *inFile, long length, int level,
 				if( outLen < 1 )
 					/* Can't be displayed as Unicode, fall back to
 					   displaying it as normal text */
-					ungetc( wCh & 0xFF, inFile );
+					inUngetc( wCh & 0xFF, input );
 				else
 					{
 					lineLength++;
 					i++;	/* We've read two characters for a wchar_t */
 #if defined( __WIN32__ ) || ( defined( __UNIX__ ) && !defined( __MACH__ ) )
-					/*!AB, wprintf is absent in our HP-UX (?)
-					 I assume, putwchar should do pretty same action.
-					wprintf( L"%c", wCh ); */
-					putwchar ( wCh ); 
+					/* Write the converted character rather than using
+					   putwchar(), which only works for stdout */
+					outWrite( ctx, ( char * ) outBuf, outLen );
 #else
 					/* This could use some improvement */
   #ifndef __MACH__
 					for( p = outBuf; *p != '\0'; p++ )
 						*p = asciiToEbcdic( *p );
   #endif /* OS X */
-					fprintf( output, "%s", outBuf );
+					outPrintf( ctx, "%s", outBuf );
 #endif /* OS-specific charset handling */
-					fPos += 2;
+					ctx->fPos += 2;
 					continue;
 					}
 				}
@@ -1283,9 +2334,9 @@ static void displayString( FILE *inFile, long length, int level,
 				   ASCII chars, skipping the following zero byte.  This is
 				   safe since the code that detects reversed BMPStrings
 				   has already checked that every second byte is zero */
-				getc( inFile );
+				inGetc( input );
 				i++;
-				fPos++;
+				ctx->fPos++;
 				/* Drop through */
 
 			default:
@@ -1298,21 +2349,21 @@ static void displayString( FILE *inFile, long length, int level,
 		if( doTimeStr )
 			timeStr[ i ] = ch;
 		else
-			fputc( ch, output );
-		fPos++;
+			outPutc( ctx, ch );
+		ctx->fPos++;
 		}
-	if( length > 384 && !printAllData )
+	if( length > 384 && !ctx->printAllData )
 		{
 		length -= 384;
-		fprintf( output, "'\n" );
-		if( !doPure )
-			fprintf( output, INDENT_STRING );
-		doIndent( level + 5 );
-		fprintf( output, "[ Another %ld characters skipped ]", length );
-		fPos += length;
+		outPrintf( ctx, "'\n" );
+		if( !ctx->doPure )
+			outPrintf( ctx, INDENT_STRING );
+		doIndent( ctx, level + 5 );
+		outPrintf( ctx, "[ Another %ld characters skipped ]", length );
+		ctx->fPos += length;
 		while( length-- )
 			{
-			int ch = getc( inFile );
+			int ch = inGetc( input );
 
 			if( strOption == STR_PRINTABLE && !isPrintable( ch ) )
 				warnPrintable = TRUE;
@@ -1326,30 +2377,30 @@ static void displayString( FILE *inFile, long length, int level,
 			const char *timeStrPtr = ( strOption == STR_UTCTIME ) ? \
 									 timeStr : timeStr + 2;
 
-			fprintf( output, " %c%c/%c%c/", timeStrPtr[ 4 ], timeStrPtr[ 5 ],
-					 timeStrPtr[ 2 ], timeStrPtr[ 3 ] );
+			outPrintf( ctx, " %c%c/%c%c/", timeStrPtr[ 4 ], timeStrPtr[ 5 ],
+					   timeStrPtr[ 2 ], timeStrPtr[ 3 ] );
 			if( strOption == STR_UTCTIME )
-				fprintf( output, ( timeStr[ 0 ] < '5' ) ? "20" : "19" );
+				outPrintf( ctx, ( timeStr[ 0 ] < '5' ) ? "20" : "19" );
 			else
-				fprintf( output, "%c%c", timeStr[ 0 ], timeStr[ 1 ] );
-			fprintf( output, "%c%c %c%c:%c%c:%c%c GMT", timeStrPtr[ 0 ],
-					 timeStrPtr[ 1 ], timeStrPtr[ 6 ], timeStrPtr[ 7 ],
-					 timeStrPtr[ 8 ], timeStrPtr[ 9 ], timeStrPtr[ 10 ],
-					 timeStrPtr[ 11 ] );
+				outPrintf( ctx, "%c%c", timeStr[ 0 ], timeStr[ 1 ] );
+			outPrintf( ctx, "%c%c %c%c:%c%c:%c%c GMT", timeStrPtr[ 0 ],
+					   timeStrPtr[ 1 ], timeStrPtr[ 6 ], timeStrPtr[ 7 ],
+					   timeStrPtr[ 8 ], timeStrPtr[ 9 ], timeStrPtr[ 10 ],
+					   timeStrPtr[ 11 ] );
 			}
 		else
-			fputc( '\'', output );
-	fputc( '\n', output );
+			outPutc( ctx, '\'' );
+	outPutc( ctx, '\n' );
 
 	/* Display any problems we encountered */
 	if( warnPrintable )
-		complain( "PrintableString contains illegal character(s)", level );
+		complain( ctx, "PrintableString contains illegal character(s)", level );
 	if( warnIA5 )
-		complain( "IA5String contains illegal character(s)", level );
+		complain( ctx, "IA5String contains illegal character(s)", level );
 	if( warnTime )
-		complain( "Time is encoded incorrectly", level );
+		complain( ctx, "Time is encoded incorrectly", level );
 	if( warnBMP )
-		complain( "BMPString has missing final byte/half character", level );
+		complain( ctx, "BMPString has missing final byte/half character", level );
 	}
 
 /****************************************************************************
@@ -1360,30 +2411,32 @@ static void displayString( FILE *inFile, long length, int level,
 
 /* Get an integer value */
 
-static long getValue( FILE *inFile, const long length )
+static long getValue( DUMPASN1_CTX *ctx, const long length )
 	{
+	ASN1_INPUT *input = &ctx->input;
 	long value;
 	char ch;
 	int i;
 
-	ch = getc( inFile );
+	ch = inGetc( input );
 	value = ch;
 	for( i = 0; i < length - 1; i++ )
-		value = ( value << 8 ) | getc( inFile );
-	fPos += length;
+		value = ( value << 8 ) | inGetc( input );
+	ctx->fPos += length;
 
 	return( value );
 	}
 
 /* Get an ASN.1 objects tag and length */
 
-int getItem( FILE *inFile, ASN1_ITEM *item )
+static int getItem( DUMPASN1_CTX *ctx, ASN1_ITEM *item )
 	{
+	ASN1_INPUT *input = &ctx->input;
 	int tag, length, index = 0;
 
 	memset( item, 0, sizeof( ASN1_ITEM ) );
 	item->indefinite = FALSE;
-	tag = item->header[ index++ ] = fgetc( inFile );
+	tag = item->header[ index++ ] = inGetc( input );
 	item->id = tag & ~TAG_MASK;
 	tag &= TAG_MASK;
 	if( tag == TAG_MASK )
@@ -1396,26 +2449,26 @@ int getItem( FILE *inFile, ASN1_ITEM *item )
 		tag = 0;
 		do
 			{
-			value = fgetc( inFile );
+			value = inGetc( input );
 			tag = ( tag << 7 ) | ( value & 0x7F );
 			item->header[ index++ ] = value;
-			fPos++;
+			ctx->fPos++;
 			}
-		while( value & LEN_XTND && index < 5 && !feof( inFile ) );
+		while( value & LEN_XTND && index < 5 && !inEof( input ) );
 		if( index == 5 )
 			{
-			fPos++;		/* Tag */
+			ctx->fPos++;		/* Tag */
 			return( FALSE );
 			}
 		}
 	item->tag = tag;
-	if( feof( inFile ) )
+	if( inEof( input ) )
 		{
-		fPos++;
+		ctx->fPos++;
 		return( FALSE );
 		}
-	fPos += 2;			/* Tag + length */
-	length = item->header[ index++ ] = fgetc( inFile );
+	ctx->fPos += 2;			/* Tag + length */
+	length = item->header[ index++ ] = inGetc( input );
 	item->headerSize = index;
 	if( length & LEN_XTND )
 		{
@@ -1432,12 +2485,12 @@ int getItem( FILE *inFile, ASN1_ITEM *item )
 			item->indefinite = TRUE;
 		for( i = 0; i < length; i++ )
 			{
-			int ch = fgetc( inFile );
+			int ch = inGetc( input );
 
 			item->length = ( item->length << 8 ) | ch;
 			item->header[ i + index ] = ch;
 			}
-		fPos += length;
+		ctx->fPos += length;
 		}
 	else
 		item->length = length;
@@ -1447,21 +2500,23 @@ int getItem( FILE *inFile, ASN1_ITEM *item )
 
 /* Check whether a BIT STRING or OCTET STRING encapsulates another object */
 
-static int checkEncapsulate( FILE *inFile, const int tag, const int length )
+static int checkEncapsulate( DUMPASN1_CTX *ctx, const int tag,
+							 const int length )
 	{
+	ASN1_INPUT *input = &ctx->input;
 	ASN1_ITEM nestedItem;
-	const int currentPos = fPos;
+	const int currentPos = ctx->fPos;
 	int diffPos;
 
 	/* If we're not looking for encapsulated objects, return */
-	if( !checkEncaps )
+	if( !ctx->checkEncaps )
 		return( FALSE );
 
 	/* Read the details of the next item in the input stream */
-	getItem( inFile, &nestedItem );
-	diffPos = fPos - currentPos;
-	fPos = currentPos;
-	fseek( inFile, -diffPos, SEEK_CUR );
+	getItem( ctx, &nestedItem );
+	diffPos = ctx->fPos - currentPos;
+	ctx->fPos = currentPos;
+	inSeek( input, -diffPos, SEEK_CUR );
 
 	/* If it fits exactly within the current item and has a valid-looking
 	   tag, treat it as nested data */
@@ -1476,7 +2531,7 @@ static int checkEncapsulate( FILE *inFile, const int tag, const int length )
 
 /* Check whether a zero-length item is OK */
 
-int zeroLengthOK( const ASN1_ITEM *item )
+static int zeroLengthOK( const DUMPASN1_CTX *ctx, const ASN1_ITEM *item )
 	{
 	/* An implicitly-tagged NULL can have a zero length.  An occurrence of this
 	   type of item is almost always an error, however OCSP uses a weird status
@@ -1484,7 +2539,7 @@ int zeroLengthOK( const ASN1_ITEM *item )
 	   value to indicate that there's nothing there except the tag that encodes
 	   the status, so we allow this as well if zero-length content is explicitly
 	   enabled */
-	if( zeroLengthAllowed && ( item->id & CLASS_MASK ) == CONTEXT )
+	if( ctx->zeroLengthAllowed && ( item->id & CLASS_MASK ) == CONTEXT )
 		return( TRUE );
 
 	/* If we can't recognise the type from the tag, reject it */
@@ -1502,7 +2557,7 @@ int zeroLengthOK( const ASN1_ITEM *item )
 	/* Everything after this point requires input from the user to say that
 	   zero-length data is OK (usually it's not, so we flag it as a
 	   problem) */
-	if( !zeroLengthAllowed )
+	if( !ctx->zeroLengthAllowed )
 		return( FALSE );
 
 	/* String types can have zero length except for the Unrestricted
@@ -1527,8 +2582,9 @@ int zeroLengthOK( const ASN1_ITEM *item )
 
 /* Check whether the next item looks like text */
 
-static int checkForText( FILE *inFile, const int length )
+static int checkForText( DUMPASN1_CTX *ctx, const int length )
 	{
+	ASN1_INPUT *input = &ctx->input;
 	char buffer[ 16 ];
 	int isBMP = FALSE, isUnicode = FALSE;
 	int sampleLength = min( length, 16 ), i;
@@ -1544,8 +2600,8 @@ static int checkForText( FILE *inFile, const int length )
 		/* For samples of 3-4 characters we only allow ASCII text.  These
 		   short strings are used in some places (eg PKCS #12 files) as
 		   IDs */
-		sampleLength = fread( buffer, 1, sampleLength, inFile );
-		fseek( inFile, -sampleLength, SEEK_CUR );
+		sampleLength = ( int ) inRead( buffer, sampleLength, input );
+		inSeek( input, -sampleLength, SEEK_CUR );
 		for( i = 0; i < sampleLength; i++ )
 			if( !( isalpha( buffer[ i ] ) || isdigit( buffer[ i ] ) || \
 				   isspace( buffer[ i ] ) ) )
@@ -1554,8 +2610,8 @@ static int checkForText( FILE *inFile, const int length )
 		}
 
 	/* Check for ASCII-looking text */
-	sampleLength = fread( buffer, 1, sampleLength, inFile );
-	fseek( inFile, -sampleLength, SEEK_CUR );
+	sampleLength = ( int ) inRead( buffer, sampleLength, input );
+	inSeek( input, -sampleLength, SEEK_CUR );
 	if( isdigit( buffer[ 0 ] ) && ( length == 13 || length == 15 ) && \
 		buffer[ length - 1 ] == 'Z' )
 		{
@@ -1629,21 +2685,23 @@ static int checkForText( FILE *inFile, const int length )
 /* Dump the header bytes for an object, useful for vgrepping the original
    object from a hex dump */
 
-static void dumpHeader( FILE *inFile, const ASN1_ITEM *item )
+static void dumpHeader( DUMPASN1_CTX *ctx, const ASN1_ITEM *item )
 	{
+	ASN1_INPUT *input = &ctx->input;
 	int extraLen = 24 - item->headerSize, i;
 
 	/* Dump the tag and length bytes */
-	if( !doPure )
-		fprintf( output, "    " );
-	fprintf( output, "<%02X", *item->header );
+	if( !ctx->doPure )
+		outPrintf( ctx, "    " );
+	outPrintf( ctx, "<%02X", *item->header );
 	for( i = 1; i < item->headerSize; i++ )
-		fprintf( output, " %02X", item->header[ i ] );
+		outPrintf( ctx, " %02X", item->header[ i ] );
 
 	/* If we're asked for more, dump enough extra data to make up 24 bytes.
-	   This is somewhat ugly since it assumes we can seek backwards over the
-	   data, which means it won't always work on streams */
-	if( extraLen > 0 && doDumpHeader > 1 )
+	   This relies on being able to seek backwards over the data, which for
+	   streams is only possible because the input buffer retains at least
+	   INPUT_LOOKBACK bytes */
+	if( extraLen > 0 && ctx->doDumpHeader > 1 )
 		{
 		/* Make sure we don't print too much data.  This doesn't work for
 		   indefinite-length data, we don't try and guess the length with
@@ -1653,56 +2711,85 @@ static void dumpHeader( FILE *inFile, const ASN1_ITEM *item )
 
 		for( i = 0; i < extraLen; i++ )
 			{
-			int ch = fgetc( inFile );
+			int ch = inGetc( input );
 
-			if( feof( inFile ) )
-				extraLen = i;	/* Exit loop and get fseek() correct */
+			if( inEof( input ) )
+				extraLen = i;	/* Exit loop and get inSeek() correct */
 			else
-				fprintf( output, " %02X", ch );
+				outPrintf( ctx, " %02X", ch );
 			}
-		fseek( inFile, -extraLen, SEEK_CUR );
+		inSeek( input, -extraLen, SEEK_CUR );
 		}
 
-	fputs( ">\n", output );
+	outPuts( ctx, ">\n" );
 	}
 
 /* Print a constructed ASN.1 object */
 
-int printAsn1( FILE *inFile, const int level, long length, const int isIndefinite );
+static int printAsn1( DUMPASN1_CTX *ctx, const int level, long length,
+					  const int isIndefinite );
 
-static void printConstructed( FILE *inFile, int level, const ASN1_ITEM *item )
+static void printConstructed( DUMPASN1_CTX *ctx, int level,
+							  const ASN1_ITEM *item )
 	{
 	int result;
 
 	/* Special case for zero-length objects */
 	if( !item->length && !item->indefinite )
 		{
-		fputs( " {}\n", output );
+		outPuts( ctx, " {}\n" );
 		return;
 		}
 
-	fputs( " {\n", output );
-	result = printAsn1( inFile, level + 1, item->length, item->indefinite );
+	outPuts( ctx, " {\n" );
+	result = printAsn1( ctx, level + 1, item->length, item->indefinite );
+	if( ctx->status != DUMPASN1_OK )
+		return;
 	if( result )
 		{
-		fprintf( output, "Error: Inconsistent object length, %d byte%s "
-				 "difference.\n", result, ( result > 1 ) ? "s" : "" );
-		noErrors++;
+		outPrintf( ctx, "Error: Inconsistent object length, %d byte%s "
+				   "difference.\n", result, ( result > 1 ) ? "s" : "" );
+		ctx->noErrors++;
 		}
-	if( !doPure )
-		fprintf( output, INDENT_STRING );
-	fprintf( output, ( printDots ) ? ". " : "  " );
-	doIndent( level );
-	fputs( "}\n", output );
+	if( !ctx->doPure )
+		outPrintf( ctx, INDENT_STRING );
+	outPrintf( ctx, ( ctx->printDots ) ? ". " : "  " );
+	doIndent( ctx, level );
+	outPuts( ctx, "}\n" );
+	}
+
+/* Check that an object's length is sane.  If it isn't, we can't continue
+   since we've run into the weeds */
+
+static int checkLength( DUMPASN1_CTX *ctx, const ASN1_ITEM *item )
+	{
+	char *errorPtr = ctx->errorString;
+	int i;
+
+	if( item->tag == NULLTAG || item->length >= 0 )
+		return( TRUE );
+
+	errorPtr += sprintf( errorPtr, "Object has bad length field, tag = %02X, "
+						 "length = %lX, value =<%02X", item->tag,
+						 item->length, *item->header );
+	for( i = 1; i < item->headerSize; i++ )
+		errorPtr += sprintf( errorPtr, " %02X", item->header[ i ] );
+	*errorPtr++ = '>';
+	*errorPtr = '\0';
+	ctx->status = DUMPASN1_ERROR_BADLENGTH;
+
+	return( FALSE );
 	}
 
 /* Print a single ASN.1 object */
 
-void printASN1object( FILE *inFile, ASN1_ITEM *item, int level )
+static void printASN1object( DUMPASN1_CTX *ctx, ASN1_ITEM *item, int level )
 	{
-	OIDINFO *oidInfo;
+	ASN1_INPUT *input = &ctx->input;
+	const OIDINFO *oidInfo;
+	OIDINFO oidInfoBuffer;
 	STR_OPTION stringType;
-	char buffer[ MAX_OID_SIZE ];
+	char buffer[ MAX_OID_SIZE + 2 ];	/* +2 for getOIDinfo() */
 	long value;
 	int x, y;
 
@@ -1712,150 +2799,130 @@ void printASN1object( FILE *inFile, ASN1_ITEM *item, int level )
 			{ "UNIVERSAL ", "APPLICATION ", "", "PRIVATE " };
 
 		/* Print the object type */
-		fprintf( output, "[%s%d]",
-				 classtext[ ( item->id & CLASS_MASK ) >> 6 ], item->tag );
+		outPrintf( ctx, "[%s%d]",
+				   classtext[ ( item->id & CLASS_MASK ) >> 6 ], item->tag );
 
 		/* Perform a sanity check */
-		if( ( item->tag != NULLTAG ) && ( item->length < 0 ) )
-			{
-			int i;
-
-			fprintf( stderr, "\nError: Object has bad length field, tag = %02X, "
-					 "length = %lX, value =", item->tag, item->length );
-			fprintf( stderr, "<%02X", *item->header );
-			for( i = 1; i < item->headerSize; i++ )
-				fprintf( stderr, " %02X", item->header[ i ] );
-			fputs( ">.\n", stderr );
-			exit( EXIT_FAILURE );
-			}
+		if( !checkLength( ctx, item ) )
+			return;
 
-		if( !item->length && !item->indefinite && !zeroLengthOK( item ) )
+		if( !item->length && !item->indefinite && !zeroLengthOK( ctx, item ) )
 			{
-			fputc( '\n', output );
-			complain( "Object has zero length", level );
+			outPutc( ctx, '\n' );
+			complain( ctx, "Object has zero length", level );
 			return;
 			}
 
 		/* If it's constructed, print the various fields in it */
 		if( ( item->id & FORM_MASK ) == CONSTRUCTED )
 			{
-			printConstructed( inFile, level, item );
+			printConstructed( ctx, level, item );
 			return;
 			}
 
 		/* It's primitive, if it's a seekable stream try and determine
 		   whether it's text so we can display it as such */
-		if( !useStdin && \
-			( stringType = checkForText( inFile, item->length ) ) != STR_NONE )
+		if( !ctx->useStdin && \
+			( stringType = checkForText( ctx, item->length ) ) != STR_NONE )
 			{
 			/* It looks like a text string, dump it as text */
-			displayString( inFile, item->length, level, stringType );
+			displayString( ctx, item->length, level, stringType );
 			return;
 			}
 
 		/* This could be anything, dump it as hex data */
-		dumpHex( inFile, item->length, level, FALSE );
+		dumpHex( ctx, item->length, level, FALSE );
 
 		return;
 		}
 
 	/* Print the object type */
-	fprintf( output, "%s", idstr( item->tag ) );
+	outPrintf( ctx, "%s", idstr( item->tag ) );
 
 	/* Perform a sanity check */
-	if( ( item->tag != NULLTAG ) && ( item->length < 0 ) )
-		{
-		int i;
-
-		fprintf( stderr, "\nError: Object has bad length field, tag = %02X, "
-				 "length = %lX, value =", item->tag, item->length );
-		fprintf( stderr, "<%02X", *item->header );
-		for( i = 1; i < item->headerSize; i++ )
-			fprintf( stderr, " %02X", item->header[ i ] );
-		fputs( ">.\n", stderr );
-		exit( EXIT_FAILURE );
-		}
+	if( !checkLength( ctx, item ) )
+		return;
 
 	/* If it's constructed, print the various fields in it */
 	if( ( item->id & FORM_MASK ) == CONSTRUCTED )
 		{
-		printConstructed( inFile, level, item );
+		printConstructed( ctx, level, item );
 		return;
 		}
 
 	/* It's primitive */
-	if( !item->length && !zeroLengthOK( item ) )
+	if( !item->length && !zeroLengthOK( ctx, item ) )
 		{
-		fputc( '\n', output );
-		complain( "Object has zero length", level );
+		outPutc( ctx, '\n' );
+		complain( ctx, "Object has zero length", level );
 		return;
 		}
 	switch( item->tag )
 		{
 		case BOOLEAN:
-			x = getc( inFile );
-			fprintf( output, " %s\n", x ? "TRUE" : "FALSE" );
+			x = inGetc( input );
+			outPrintf( ctx, " %s\n", x ? "TRUE" : "FALSE" );
 			if( x != 0 && x != 0xFF )
-				complain( "BOOLEAN has non-DER encoding", level );
-			fPos++;
+				complain( ctx, "BOOLEAN has non-DER encoding", level );
+			ctx->fPos++;
 			break;
 
 		case INTEGER:
 		case ENUMERATED:
 			if( item->length > 4 )
-				dumpHex( inFile, item->length, level, TRUE );
+				dumpHex( ctx, item->length, level, TRUE );
 			else
 				{
-				value = getValue( inFile, item->length );
-				fprintf( output, " %ld\n", value );
+				value = getValue( ctx, item->length );
+				outPrintf( ctx, " %ld\n", value );
 				if( value < 0 )
-					complain( "Integer has a negative value", level );
+					complain( ctx, "Integer has a negative value", level );
 				}
 			break;
 
 		case BITSTRING:
-			if( ( x = getc( inFile ) ) != 0 )
-				fprintf( output, " %d unused bits", x );
-			fPos++;
+			if( ( x = inGetc( input ) ) != 0 )
+				outPrintf( ctx, " %d unused bits", x );
+			ctx->fPos++;
 			if( !--item->length && !x )
 				{
-				fputc( '\n', output );
-				complain( "Object has zero length", level );
+				outPutc( ctx, '\n' );
+				complain( ctx, "Object has zero length", level );
 				return;
 				}
 			if( item->length <= sizeof( int ) )
 				{
 				/* It's short enough to be a bit flag, dump it as a sequence
 				   of bits */
-				dumpBitString( inFile, ( int ) item->length, x, level );
+				dumpBitString( ctx, ( int ) item->length, x, level );
 				break;
 				}
 			/* Drop through to dump it as an octet string */
 
 		case OCTETSTRING:
-			if( checkEncapsulate( inFile, item->tag, item->length ) )
+			if( checkEncapsulate( ctx, item->tag, item->length ) )
 				{
 				/* It's something encapsulated inside the string, print it as
 				   a constructed item */
-				fprintf( output, ", encapsulates" );
-				printConstructed( inFile, level, item );
+				outPrintf( ctx, ", encapsulates" );
+				printConstructed( ctx, level, item );
 				break;
 				}
-			if( !useStdin && !dumpText && \
-				( stringType = checkForText( inFile, item->length ) ) != STR_NONE )
+			if( !ctx->useStdin && !ctx->dumpText && \
+				( stringType = checkForText( ctx, item->length ) ) != STR_NONE )
 				{
 				/* If we'd be doing a straight hex dump and it looks like
 				   encapsulated text, display it as such.  If the user has
 				   overridden character set type checking and it's a string
 				   type for which we normally perform type checking, we reset
 				   its type to none */
-				displayString( inFile, item->length, level, \
-					( !checkCharset && ( stringType == STR_IA5 || \
+				displayString( ctx, item->length, level, \
+					( !ctx->checkCharset && ( stringType == STR_IA5 || \
 										 stringType == STR_PRINTABLE ) ) ? \
 					STR_NONE : stringType );
 				return;
 				}
-			dumpHex( inFile, item->length, level, FALSE );
+			dumpHex( ctx, item->length, level, FALSE );
 			break;
 
 		case OID:
@@ -1865,41 +2932,45 @@ void printASN1object( FILE *inFile, ASN1_ITEM *item, int level )
 			   > 39, so we have to add special-case handling for this */
 			if( item->length > MAX_OID_SIZE )
 				{
-				fprintf( stderr, "\nError: Object identifier length %ld too "
-						 "large.\n", item->length );
-				exit( EXIT_FAILURE );
+				sprintf( ctx->errorString, "Object identifier length %ld too "
+						 "large", item->length );
+				ctx->status = DUMPASN1_ERROR_BADOID;
+				return;
 				}
-			fread( buffer, 1, ( size_t ) item->length, inFile );
-			fPos += item->length;
-			if( ( oidInfo = getOIDinfo( buffer, ( int ) item->length ) ) != NULL )
+			memset( buffer, 0, MAX_OID_SIZE );	/* In case data is truncated */
+			inRead( buffer, item->length, input );
+			ctx->fPos += item->length;
+			if( ( oidInfo = getOIDinfo( ctx->config, buffer,
+										( int ) item->length,
+										&oidInfoBuffer ) ) != NULL )
 				{
 				/* Check if LHS status info + indent + "OID " string + oid
 				   name will wrap */
-				if( ( ( doPure ) ? 0 : INDENT_SIZE ) + ( level * 2 ) + 18 + \
+				if( ( ( ctx->doPure ) ? 0 : INDENT_SIZE ) + ( level * 2 ) + 18 + \
 					strlen( oidInfo->description ) >= OUTPUT_WIDTH )
 					{
-					fputc( '\n', output );
-					if( !doPure )
-						fprintf( output, INDENT_STRING );
-					doIndent( level + 1 );
+					outPutc( ctx, '\n' );
+					if( !ctx->doPure )
+						outPrintf( ctx, INDENT_STRING );
+					doIndent( ctx, level + 1 );
 					}
 				else
-					fputc( ' ', output );
-				fprintf( output, "%s\n", oidInfo->description );
+					outPutc( ctx, ' ' );
+				outPrintf( ctx, "%s\n", oidInfo->description );
 
 				/* Display extra comments about the OID if required */
-				if( extraOIDinfo && oidInfo->comment != NULL )
+				if( ctx->extraOIDinfo && oidInfo->comment != NULL )
 					{
-					if( !doPure )
-						fprintf( output, INDENT_STRING );
-					doIndent( level + 1 );
-					fprintf( output, "(%s)\n", oidInfo->comment );
+					if( !ctx->doPure )
+						outPrintf( ctx, INDENT_STRING );
+					doIndent( ctx, level + 1 );
+					outPrintf( ctx, "(%s)\n", oidInfo->comment );
 					}
 
 				/* If there's a warning associated with this OID, remember
 				   that there was a problem */
 				if( oidInfo->warn )
-					noWarnings++;
+					ctx->noWarnings++;
 
 				break;
 				}
@@ -1913,23 +2984,23 @@ void printASN1object( FILE *inFile, ASN1_ITEM *item, int level )
 				y += ( x - 2 ) * 40;
 				x = 2;
 				}
-			fprintf( output, " '%d %d", x, y );
+			outPrintf( ctx, " '%d %d", x, y );
 			value = 0;
 			for( x = 1; x < item->length; x++ )
 				{
 				value = ( value << 7 ) | ( buffer[ x ] & 0x7F );
 				if( !( buffer[ x ] & 0x80 ) )
 					{
-					fprintf( output, " %ld", value );
+					outPrintf( ctx, " %ld", value );
 					value = 0;
 					}
 				}
-			fprintf( output, "'\n" );
+			outPrintf( ctx, "'\n" );
 			break;
 
 		case EOC:
 		case NULLTAG:
-			fputc( '\n', output );
+			outPutc( ctx, '\n' );
 			break;
 
 		case OBJDESCRIPTOR:
@@ -1940,187 +3011,2478 @@ void printASN1object( FILE *inFile, ASN1_ITEM *item, int level )
 		case NUMERICSTRING:
 		case VIDEOTEXSTRING:
 		case UTF8STRING:
-			displayString( inFile, item->length, level, STR_NONE );
+			displayString( ctx, item->length, level, STR_NONE );
 			break;
 		case PRINTABLESTRING:
-			displayString( inFile, item->length, level, STR_PRINTABLE );
+			displayString( ctx, item->length, level, STR_PRINTABLE );
 			break;
 		case BMPSTRING:
-			displayString( inFile, item->length, level, STR_BMP );
+			displayString( ctx, item->length, level, STR_BMP );
 			break;
 		case UTCTIME:
-			displayString( inFile, item->length, level, STR_UTCTIME );
+			displayString( ctx, item->length, level, STR_UTCTIME );
 			break;
 		case GENERALIZEDTIME:
-			displayString( inFile, item->length, level, STR_GENERALIZED );
+			displayString( ctx, item->length, level, STR_GENERALIZED );
 			break;
 		case IA5STRING:
-			displayString( inFile, item->length, level, STR_IA5 );
+			displayString( ctx, item->length, level, STR_IA5 );
 			break;
 		case T61STRING:
-			displayString( inFile, item->length, level, STR_LATIN1 );
+			displayString( ctx, item->length, level, STR_LATIN1 );
 			break;
 
 		default:
-			fputc( '\n', output );
-			if( !doPure )
-				fprintf( output, INDENT_STRING );
-			doIndent( level + 1 );
-			fprintf( output, "Unrecognised primitive, hex value is:");
-			dumpHex( inFile, item->length, level, FALSE );
-			noErrors++;		/* Treat it as an error */
+			outPutc( ctx, '\n' );
+			if( !ctx->doPure )
+				outPrintf( ctx, INDENT_STRING );
+			doIndent( ctx, level + 1 );
+			outPrintf( ctx, "Unrecognised primitive, hex value is:");
+			dumpHex( ctx, item->length, level, FALSE );
+			ctx->noErrors++;		/* Treat it as an error */
 		}
 	}
 
-/* Print a complex ASN.1 object */
+/* Print an item within a constructed object, along with its position and
+   length.  Once we've seen an EOC the remaining items aren't printed */
 
-int printAsn1( FILE *inFile, const int level, long length,
-			   const int isIndefinite )
+static void printItem( DUMPASN1_CTX *ctx, ASN1_ITEM *item, const int level,
+					   const long lastPos, const int isIndefinite,
+					   int *seenEOC )
 	{
-	ASN1_ITEM item;
-	long lastPos = fPos;
-	int seenEOC = FALSE, status;
+	/* Dump the header as hex data if requested */
+	if( ctx->doDumpHeader )
+		dumpHeader( ctx, item );
 
-	/* Special-case for zero-length objects */
-	if( !length && !isIndefinite )
-		return( 0 );
+	/* Print offset into buffer, tag, and length */
+	if( item->header[ 0 ] == EOC )
+		{
+		*seenEOC = TRUE;
+		if( !isIndefinite)
+			complain( ctx, "Spurious EOC in definite-length item", level );
+		}
+	if( !ctx->doPure )
+		{
+#if 0
+		/* Don't print hex tags any more to save display space */
+		if( item->indefinite )
+			outPrintf( ctx, ( ctx->doHexValues ) ? "%04lX %02X NDEF: " :
+					   "%4ld %02X NDEF: ", lastPos, item->id | item->tag );
+		else
+			if( !*seenEOC )
+				outPrintf( ctx, ( ctx->doHexValues ) ? "%04lX %02X %4lX: " :
+						   "%4ld %02X %4ld: ", lastPos, item->id | item->tag,
+						   item->length );
+#else
+		if( item->indefinite )
+			outPrintf( ctx, ( ctx->doHexValues ) ? "%04lX NDEF: " :
+					   "%4ld NDEF: ", lastPos );
+		else
+			if( !*seenEOC )
+				outPrintf( ctx, ( ctx->doHexValues ) ? "%04lX %4lX: " :
+						   "%4ld %4ld: ", lastPos, item->length );
+#endif
+		}
 
-	while( ( status = getItem( inFile, &item ) ) > 0 )
+	/* Print details on the item */
+	if( !*seenEOC )
 		{
-		/* Perform various special checks the first time we're called */
-		if( length == LENGTH_MAGIC )
-			{
-			/* If the length isn't known and the item has a definite length,
-			   set the length to the item's length */
-			if( !item.indefinite )
-				length = item.headerSize + item.length;
+		doIndent( ctx, level );
+		printASN1object( ctx, item, level );
+		}
+	}
 
-			/* If the input isn't seekable, turn off some options that
-			   require the use of fseek().  This check isn't perfect (some
-			   streams are slightly seekable due to buffering) but it's
-			   better than nothing */
-			if( fseek( inFile, -item.headerSize, SEEK_CUR ) )
-				{
-				useStdin = TRUE;
-				checkEncaps = FALSE;
-				puts( "Warning: Input is non-seekable, some functionality "
-					  "has been disabled." );
+/* Large definite-length SEQUENCEs and SETs such as bags of certificates
+   can have their elements decoded on a pool of threads.  The element
+   boundaries are found from the element headers, then each element is
+   decoded into memory using a copy of the context that starts at the
+   element, and the results are written in order.  Decoding an element on
+   its own only gives the same result as decoding it in sequence if it ends
+   exactly where the next one starts, so if it doesn't, or decoding stops
+   with an error, the output from that element onwards is discarded and
+   decoding continues in the usual manner from the start of the element */
+
+#define PARALLEL_MIN_LENGTH	65536L	/* Min.size of object to decode in parallel */
+#define MAX_DECODE_THREADS	64		/* Max.threads for a single object */
+#define DECODE_LOOKAHEAD	4		/* Elements per thread decoded ahead of output */
+
+#ifdef USE_THREADS
+
+/* An element being decoded and the overall decoding state.  Each element
+   is decoded into a slot in a ring of slots, which limits how much
+   decoded output is held in memory */
+
+typedef struct {
+	DUMPASN1_CTX ctx;			/* Decoding context for the element */
+	int isDone;					/* Whether decoding has finished */
+	int isOK;					/* Whether the output can be used */
+	} DECODE_ITEM;
+
+typedef struct {
+	/* The elements to decode and the state of processing them */
+	long *positions;			/* Position of each element */
+	int noItems;				/* Number of elements */
+	long endPos;				/* Position of end of last element */
+	DECODE_ITEM *slots;			/* Slots for elements being decoded */
+	int nextItem;				/* Next element to be decoded */
+	int nextOutput;				/* Next element to be written */
+	int lookahead;				/* How far decoding can get ahead of output */
+
+	/* The context to decode each element with */
+	DUMPASN1_CTX ctxTemplate;
+	int level;
+
+	/* Synchronisation between the decoding threads and the main thread */
+	MUTEX_TYPE mutex;
+	COND_TYPE stateChanged;
+	} DECODE_INFO;
+
+/* Decode a single element */
+
+static void decodeItem( DECODE_INFO *info, const int index )
+	{
+	DECODE_ITEM *item = &info->slots[ index % info->lookahead ];
+	DUMPASN1_CTX *ctx = &item->ctx;
+	ASN1_ITEM asn1Item;
+	const long position = info->positions[ index ];
+	const long endPos = ( index < info->noItems - 1 ) ? \
+						info->positions[ index + 1 ] : info->endPos;
+	int seenEOC = FALSE;
+
+	*ctx = info->ctxTemplate;
+	ctx->input.pos += position - ctx->fPos;
+	ctx->fPos = position;
+	getItem( ctx, &asn1Item );
+	printItem( ctx, &asn1Item, info->level, position, FALSE, &seenEOC );
+	item->isOK = ( ctx->status == DUMPASN1_OK && !inEof( &ctx->input ) && \
+				   ctx->fPos == endPos ) ? TRUE : FALSE;
+	}
+
+/* Decode elements until there are none left */
+
+static THREAD_FUNCTION( decodeThread, arg )
+	{
+	DECODE_INFO *info = ( DECODE_INFO * ) arg;
+
+	while( TRUE )
+		{
+		int index;
+
+		/* Get the next element to decode, waiting if we've got too far
+		   ahead of the output */
+		mutexLock( &info->mutex );
+		while( info->nextItem < info->noItems && \
+			   info->nextItem >= info->nextOutput + info->lookahead )
+			condWait( &info->stateChanged, &info->mutex );
+		if( info->nextItem >= info->noItems )
+			{
+			mutexUnlock( &info->mutex );
+			break;
+			}
+		index = info->nextItem++;
+		mutexUnlock( &info->mutex );
+
+		decodeItem( info, index );
+
+		mutexLock( &info->mutex );
+		info->slots[ index % info->lookahead ].isDone = TRUE;
+		condBroadcast( &info->stateChanged );
+		mutexUnlock( &info->mutex );
+		}
+
+	THREAD_RETURN;
+	}
+
+/* Skip the contents of an indefinite-length item by following the headers
+   of the items inside it until we get to its EOC */
+
+static int skipIndefinite( DUMPASN1_CTX *ctx, const int depth )
+	{
+	ASN1_ITEM item;
+
+	if( depth > 64 )
+		return( FALSE );	/* Too deeply nested to be worth following */
+	while( getItem( ctx, &item ) > 0 )
+		{
+		if( item.header[ 0 ] == EOC )
+			return( TRUE );
+		if( item.indefinite )
+			{
+			if( !skipIndefinite( ctx, depth + 1 ) )
+				return( FALSE );
+			}
+		else
+			{
+			if( item.length < 0 )
+				return( FALSE );
+			inSeek( &ctx->input, item.length, SEEK_CUR );
+			ctx->fPos += item.length;
+			}
+		}
+
+	return( FALSE );
+	}
+
+/* Find the elements of a constructed object, stopping at anything that
+   isn't a complete element that fits inside the object.  Returns the
+   number of elements found */
+
+static int findElements( DUMPASN1_CTX *ctx, DECODE_INFO *info, long length )
+	{
+	ASN1_INPUT *input = &ctx->input;
+	const ASN1_INPUT savedInput = *input;
+	const int savedPos = ctx->fPos;
+	ASN1_ITEM item;
+	int maxItems = 0;
+
+	info->endPos = ctx->fPos;
+	while( length > 0 )
+		{
+		const long position = ctx->fPos;
+		long itemLength;
+
+		if( getItem( ctx, &item ) <= 0 || item.header[ 0 ] == EOC || \
+			item.length < 0 )
+			break;
+		if( item.indefinite )
+			{
+			if( !skipIndefinite( ctx, 0 ) )
+				break;
+			}
+		else
+			{
+			inSeek( input, item.length, SEEK_CUR );
+			ctx->fPos += item.length;
+			}
+		itemLength = ctx->fPos - position;
+		if( itemLength > length )
+			break;
+		if( info->noItems >= maxItems )
+			{
+			const int newSize = ( maxItems > 0 ) ? maxItems * 2 : 1024;
+			long *newPositions;
+
+			if( ( newPositions = realloc( info->positions,
+									newSize * sizeof( long ) ) ) == NULL )
+				break;
+			info->positions = newPositions;
+			maxItems = newSize;
+			}
+		info->positions[ info->noItems++ ] = position;
+		info->endPos = ctx->fPos;
+		length -= itemLength;
+		}
+	*input = savedInput;
+	ctx->fPos = savedPos;
+
+	return( info->noItems );
+	}
+
+/* Decode the elements of a constructed object in parallel, returning the
+   number of bytes of elements whose output has been written.  Whatever's
+   left is decoded in the usual manner by the caller */
+
+static long printParallel( DUMPASN1_CTX *ctx, const int level,
+						   const long length )
+	{
+	DECODE_INFO info;
+	THREAD_HANDLE threads[ MAX_DECODE_THREADS ];
+	ASN1_INPUT *input = &ctx->input;
+	long endPos;
+	int noThreads, noStarted, noWritten, i;
+
+	/* We can only decode the elements in parallel if all of the object is
+	   in memory, and it's only worth it if the object is large and has
+	   enough elements to keep the threads busy.  If it doesn't then any
+	   large objects nested inside it can still be decoded in parallel */
+	if( length < PARALLEL_MIN_LENGTH || input->stream != NULL || \
+		inEof( input ) || input->pushback != EOF || \
+		input->pos + length > input->dataLen )
+		return( 0 );
+	memset( &info, 0, sizeof( DECODE_INFO ) );
+	if( findElements( ctx, &info, length ) < ctx->noThreads * 2 )
+		{
+		if( info.positions != NULL )
+			free( info.positions );
+		return( 0 );
+		}
+	noThreads = min( ctx->noThreads, min( info.noItems, MAX_DECODE_THREADS ) );
+	info.lookahead = noThreads * DECODE_LOOKAHEAD;
+	if( ( info.slots = ( DECODE_ITEM * ) \
+				calloc( info.lookahead, sizeof( DECODE_ITEM ) ) ) == NULL )
+		{
+		free( info.positions );
+		return( 0 );
+		}
+
+	/* Set up the context that each element is decoded with, which writes
+	   its output to memory and doesn't use any further threads */
+	info.ctxTemplate = *ctx;
+	info.ctxTemplate.noThreads = 0;
+	info.ctxTemplate.output = NULL;
+	info.ctxTemplate.outBuffer = NULL;
+	info.ctxTemplate.outLength = info.ctxTemplate.outSize = 0;
+	info.ctxTemplate.noErrors = info.ctxTemplate.noWarnings = 0;
+	info.level = level;
+	mutexInit( &info.mutex );
+	condInit( &info.stateChanged );
+
+	/* Start the decoding threads */
+	for( noStarted = 0; noStarted < noThreads; noStarted++ )
+		if( !threadCreate( &threads[ noStarted ], decodeThread, &info ) )
+			break;
+
+	/* Write the output for each element in order until we get to one that
+	   has to be decoded again in the usual manner.  If we couldn't start
+	   any threads then it's all decoded in the usual manner */
+	for( noWritten = 0; noWritten < info.noItems && noStarted > 0;
+		 noWritten++ )
+		{
+		DECODE_ITEM *item = &info.slots[ noWritten % info.lookahead ];
+
+		mutexLock( &info.mutex );
+		while( !item->isDone )
+			condWait( &info.stateChanged, &info.mutex );
+		mutexUnlock( &info.mutex );
+		if( !item->isOK )
+			break;
+		outWrite( ctx, item->ctx.outBuffer, item->ctx.outLength );
+		ctx->noErrors += item->ctx.noErrors;
+		ctx->noWarnings += item->ctx.noWarnings;
+		dumpasn1FreeContext( &item->ctx );
+
+		/* Let the decoding threads move on to the next element */
+		mutexLock( &info.mutex );
+		item->isDone = FALSE;
+		info.nextOutput = noWritten + 1;
+		condBroadcast( &info.stateChanged );
+		mutexUnlock( &info.mutex );
+		}
+
+	/* Stop the decoding threads and discard anything that they've decoded
+	   that won't be used */
+	mutexLock( &info.mutex );
+	info.nextItem = info.noItems;
+	condBroadcast( &info.stateChanged );
+	mutexUnlock( &info.mutex );
+	for( i = 0; i < noStarted; i++ )
+		threadJoin( threads[ i ] );
+	for( i = 0; i < info.lookahead; i++ )
+		dumpasn1FreeContext( &info.slots[ i ].ctx );
+	condDestroy( &info.stateChanged );
+	mutexDestroy( &info.mutex );
+	endPos = ( noWritten < info.noItems ) ? \
+			 info.positions[ noWritten ] : info.endPos;
+	free( info.slots );
+	free( info.positions );
+
+	/* Move on past the elements that have been written */
+	endPos -= ctx->fPos;
+	inSeek( input, endPos, SEEK_CUR );
+	ctx->fPos += endPos;
+
+	return( endPos );
+	}
+#else
+  #define printParallel( ctx, level, length )	0
+#endif /* USE_THREADS */
+
+/* Print a complex ASN.1 object */
+
+static int printAsn1( DUMPASN1_CTX *ctx, const int level, long length,
+					  const int isIndefinite )
+	{
+	ASN1_INPUT *input = &ctx->input;
+	ASN1_ITEM item;
+	long lastPos = ctx->fPos;
+	int seenEOC = FALSE, status;
+
+	/* Special-case for zero-length objects */
+	if( !length && !isIndefinite )
+		return( 0 );
+
+	/* If there are threads available, try and decode the elements of a
+	   large object in parallel */
+	if( ctx->noThreads > 1 && !isIndefinite && length != LENGTH_MAGIC )
+		{
+		length -= printParallel( ctx, level, length );
+		lastPos = ctx->fPos;
+		if( !length )
+			return( 0 );
+		}
+
+	while( ( status = getItem( ctx, &item ) ) > 0 )
+		{
+		/* Perform various special checks the first time we're called */
+		if( length == LENGTH_MAGIC )
+			{
+			/* If the length isn't known and the item has a definite length,
+			   set the length to the item's length */
+			if( !item.indefinite )
+				length = item.headerSize + item.length;
+
+			/* If the input isn't seekable, turn off some options that
+			   require the ability to seek backwards.  Buffered input from
+			   pipes and the like keeps enough data to seek back over what
+			   we look ahead at, so this only fails if the input can't seek
+			   backwards at all */
+			if( inSeek( input, -item.headerSize, SEEK_CUR ) )
+				{
+				ctx->useStdin = TRUE;
+				ctx->checkEncaps = FALSE;
+				outPuts( ctx, "Warning: Input is non-seekable, some "
+						 "functionality has been disabled.\n" );
+				}
+			else
+				inSeek( input, item.headerSize, SEEK_CUR );
+			}
+
+		printItem( ctx, &item, level, lastPos, isIndefinite, &seenEOC );
+		if( ctx->status != DUMPASN1_OK )
+			return( 0 );
+
+		/* If it was an indefinite-length object (no length was ever set) and
+		   we've come back to the top level, exit */
+		if( length == LENGTH_MAGIC )
+			return( 0 );
+
+		length -= ctx->fPos - lastPos;
+		lastPos = ctx->fPos;
+		if( isIndefinite )
+			{
+			if( seenEOC )
+				return( 0 );
+			}
+		else
+			if( length <= 0 )
+				{
+				if( length < 0 )
+					return( ( int ) -length );
+				return( 0 );
+				}
+			else
+				if( length == 1 )
+					{
+					const int ch = inGetc( input );
+
+					/* No object can be one byte long, try and recover.  This
+					   only works sometimes because it can be caused by
+					   spurious data in an OCTET STRING hole or an incorrect
+					   length encoding.  The following workaround tries to
+					   recover from spurious data by skipping the byte if
+					   it's zero or a non-basic-ASN.1 tag, but keeping it if
+					   it could be valid ASN.1 */
+					if( ch && ch <= 0x31 )
+						inUngetc( ch, input );
+					else
+						{
+						ctx->fPos++;
+						return( 1 );
+						}
+					}
+		}
+	if( status == -1 )
+		{
+		sprintf( ctx->errorString, "Invalid data encountered at position "
+				 "%d", ctx->fPos );
+		ctx->status = DUMPASN1_ERROR_BADDATA;
+		return( 0 );
+		}
+
+	/* If we see an EOF and there's supposed to be more data present,
+	   complain */
+	if( length && length != LENGTH_MAGIC )
+		{
+		outPrintf( ctx, "Error: Inconsistent object length, %ld byte%s "
+				   "difference.\n", length, ( length > 1 ) ? "s" : "" );
+		ctx->noErrors++;
+		}
+	return( 0 );
+	}
+
+/****************************************************************************
+*																			*
+*								JSON Output Routines						*
+*																			*
+****************************************************************************/
+
+/* As an alternative to the text dump we can output a JSON object for each
+   ASN.1 item, either as newline-delimited JSON with one object per line or
+   as a single JSON array.  Items are identified by a path of child indices,
+   so the first item is "0", its first child is "0.0", and so on, with any
+   objects encapsulated in an OCTET STRING or BIT STRING being children of
+   the string.  Problems with the data are reported as separate objects with
+   an "error" field, in the same order that they'd appear in the text dump */
+
+typedef struct {
+	char *path;					/* Path to the current item */
+	int pathLength, pathSize;	/* Length of path, size of path buffer */
+	int noRecords;				/* Number of objects written */
+	int noObjects;				/* Number of top-level objects */
+	} JSON_STATE;
+
+/* The amount of data that we encode at a time.  This has to be a multiple
+   of 3 so that base64 padding is only added at the end of the data */
+
+#define JSON_CHUNKSIZE		3072
+
+/* Move the path down to a child item.  The caller moves it back up again by
+   truncating it to its original length */
+
+static int jsonPushPath( DUMPASN1_CTX *ctx, JSON_STATE *state,
+						 const int index )
+	{
+	char indexBuffer[ 16 ];
+	const int indexLength = sprintf( indexBuffer, ( state->pathLength > 0 ) ? \
+									 ".%d" : "%d", index );
+
+	if( state->pathLength + indexLength >= state->pathSize )
+		{
+		char *newPath;
+
+		if( ( newPath = realloc( state->path, state->pathSize * 2 ) ) == NULL )
+			{
+			ctx->status = DUMPASN1_ERROR_MEMORY;
+			strcpy( ctx->errorString, "Out of memory" );
+			return( FALSE );
+			}
+		state->path = newPath;
+		state->pathSize *= 2;
+		}
+	memcpy( state->path + state->pathLength, indexBuffer, indexLength + 1 );
+	state->pathLength += indexLength;
+
+	return( TRUE );
+	}
+
+/* Begin and end a JSON object */
+
+static void jsonBeginRecord( DUMPASN1_CTX *ctx, JSON_STATE *state )
+	{
+	if( ctx->jsonOutput > 1 && state->noRecords > 0 )
+		outPuts( ctx, ",\n" );
+	state->noRecords++;
+	outPrintf( ctx, "{\"path\":\"%s\"", state->path );
+	}
+
+static void jsonEndRecord( DUMPASN1_CTX *ctx )
+	{
+	outPuts( ctx, ( ctx->jsonOutput > 1 ) ? "}" : "}\n" );
+	}
+
+/* Report a problem with the data */
+
+static void jsonComplain( DUMPASN1_CTX *ctx, JSON_STATE *state,
+						  const long offset, const char *message )
+	{
+	jsonBeginRecord( ctx, state );
+	outPrintf( ctx, ",\"offset\":%ld,\"error\":\"%s\"", offset, message );
+	jsonEndRecord( ctx );
+	ctx->noErrors++;
+	}
+
+/* Write raw data as hex or base64 */
+
+static void jsonWriteData( DUMPASN1_CTX *ctx, const unsigned char *data,
+						   const int length )
+	{
+	static const char hexDigits[] = "0123456789ABCDEF";
+	static const char base64Digits[] = \
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	char buffer[ ( JSON_CHUNKSIZE * 2 ) + 8 ];
+	int bufPos = 0, i;
+
+	if( !ctx->jsonBase64 )
+		{
+		for( i = 0; i < length; i++ )
+			{
+			buffer[ bufPos++ ] = hexDigits[ data[ i ] >> 4 ];
+			buffer[ bufPos++ ] = hexDigits[ data[ i ] & 0x0F ];
+			}
+		outWrite( ctx, buffer, bufPos );
+		return;
+		}
+	for( i = 0; i < length; i += 3 )
+		{
+		const int remainder = length - i;
+		const long value = ( ( long ) data[ i ] << 16 ) | \
+			( ( remainder > 1 ) ? ( data[ i + 1 ] << 8 ) : 0 ) | \
+			( ( remainder > 2 ) ? data[ i + 2 ] : 0 );
+
+		buffer[ bufPos++ ] = base64Digits[ ( value >> 18 ) & 0x3F ];
+		buffer[ bufPos++ ] = base64Digits[ ( value >> 12 ) & 0x3F ];
+		buffer[ bufPos++ ] = ( remainder > 1 ) ? \
+							 base64Digits[ ( value >> 6 ) & 0x3F ] : '=';
+		buffer[ bufPos++ ] = ( remainder > 2 ) ? \
+							 base64Digits[ value & 0x3F ] : '=';
+		}
+	outWrite( ctx, buffer, bufPos );
+	}
+
+/* Write the raw data for an item, either from memory or from the input.  As
+   with the text dump, we only write the first 128 bytes unless we've been
+   asked to write everything */
+
+static void jsonBufferData( DUMPASN1_CTX *ctx, const unsigned char *data,
+							const long length )
+	{
+	const long noBytes = ( length > 128 && !ctx->printAllData ) ? \
+						 128 : length;
+	long i;
+
+	outPrintf( ctx, ",\"%s\":\"", ( ctx->jsonBase64 ) ? "base64" : "hex" );
+	for( i = 0; i < noBytes; i += JSON_CHUNKSIZE )
+		jsonWriteData( ctx, data + i, ( int ) min( noBytes - i,
+												   JSON_CHUNKSIZE ) );
+	outPutc( ctx, '"' );
+	if( noBytes < length )
+		outPuts( ctx, ",\"truncated\":true" );
+	}
+
+static void jsonStreamData( DUMPASN1_CTX *ctx, const long length )
+	{
+	ASN1_INPUT *input = &ctx->input;
+	unsigned char buffer[ JSON_CHUNKSIZE ];
+	const long noBytes = ( length > 128 && !ctx->printAllData ) ? \
+						 128 : length;
+	long i;
+
+	outPrintf( ctx, ",\"%s\":\"", ( ctx->jsonBase64 ) ? "base64" : "hex" );
+	for( i = 0; i < noBytes; i += JSON_CHUNKSIZE )
+		{
+		const long count = inRead( buffer, min( noBytes - i, JSON_CHUNKSIZE ),
+								   input );
+
+		if( count <= 0 )
+			break;
+		jsonWriteData( ctx, buffer, ( int ) count );
+		}
+	outPutc( ctx, '"' );
+	ctx->fPos += length;
+	if( noBytes < length )
+		{
+		outPuts( ctx, ",\"truncated\":true" );
+		inSeek( input, length - noBytes, SEEK_CUR );
+		}
+	}
+
+/* Read an item's contents into memory */
+
+static unsigned char *jsonReadContent( DUMPASN1_CTX *ctx, const long length )
+	{
+	unsigned char *content;
+
+	if( ( content = malloc( length + 1 ) ) == NULL )
+		{
+		ctx->status = DUMPASN1_ERROR_MEMORY;
+		strcpy( ctx->errorString, "Out of memory" );
+		return( NULL );
+		}
+	memset( content, 0, length + 1 );	/* In case data is truncated */
+	inRead( content, length, &ctx->input );
+	ctx->fPos += length;
+
+	return( content );
+	}
+
+/* Write a string as a JSON string value.  The string is converted to
+   Unicode characters based on its type, with anything that isn't printable
+   ASCII written as an escape sequence so that the output is always valid
+   JSON no matter what the string contains */
+
+static long jsonGetChar( const unsigned char *string, const long length,
+						 const int tag, int *charLength )
+	{
+	long ch;
+	int i;
+
+	switch( tag )
+		{
+		case BMPSTRING:
+			*charLength = 2;
+			if( length < 2 )
+				return( 0xFFFD );
+			return( ( string[ 0 ] << 8 ) | string[ 1 ] );
+
+		case UNIVERSALSTRING:
+			*charLength = 4;
+			if( length < 4 )
+				return( 0xFFFD );
+			ch = ( ( long ) string[ 0 ] << 24 ) | ( ( long ) string[ 1 ] << 16 ) | \
+				 ( string[ 2 ] << 8 ) | string[ 3 ];
+			return( ( ch > 0x10FFFFL || ( ch >= 0xD800 && ch <= 0xDFFF ) ) ? \
+					0xFFFD : ch );
+
+		case UTF8STRING:
+			*charLength = 1;
+			if( string[ 0 ] < 0x80 )
+				return( string[ 0 ] );
+			if( string[ 0 ] >= 0xC2 && string[ 0 ] <= 0xDF )
+				{
+				*charLength = 2;
+				ch = string[ 0 ] & 0x1F;
+				}
+			else
+				if( string[ 0 ] >= 0xE0 && string[ 0 ] <= 0xEF )
+					{
+					*charLength = 3;
+					ch = string[ 0 ] & 0x0F;
+					}
+				else
+					if( string[ 0 ] >= 0xF0 && string[ 0 ] <= 0xF4 )
+						{
+						*charLength = 4;
+						ch = string[ 0 ] & 0x07;
+						}
+					else
+						return( 0xFFFD );
+			if( *charLength > length )
+				{
+				*charLength = 1;
+				return( 0xFFFD );
+				}
+			for( i = 1; i < *charLength; i++ )
+				{
+				if( ( string[ i ] & 0xC0 ) != 0x80 )
+					{
+					*charLength = 1;
+					return( 0xFFFD );
+					}
+				ch = ( ch << 6 ) | ( string[ i ] & 0x3F );
+				}
+
+			/* Reject overlong encodings, surrogates, and out-of-range
+			   values */
+			if( ( *charLength == 3 && ch < 0x800 ) || \
+				( *charLength == 4 && ( ch < 0x10000L || ch > 0x10FFFFL ) ) || \
+				( ch >= 0xD800 && ch <= 0xDFFF ) )
+				{
+				*charLength = 1;
+				return( 0xFFFD );
+				}
+			return( ch );
+
+		default:
+			/* Everything else is treated as latin-1 */
+			*charLength = 1;
+			return( string[ 0 ] );
+		}
+	}
+
+static void jsonWriteString( DUMPASN1_CTX *ctx, const unsigned char *string,
+							 const long length, const int tag )
+	{
+	char buffer[ 256 ];
+	long i;
+	int bufPos = 0, charLength;
+
+	outPutc( ctx, '"' );
+	for( i = 0; i < length; i += charLength )
+		{
+		const long ch = jsonGetChar( string + i, length - i, tag,
+									 &charLength );
+
+		if( ch == '"' || ch == '\\' )
+			{
+			buffer[ bufPos++ ] = '\\';
+			buffer[ bufPos++ ] = ( char ) ch;
+			}
+		else
+			if( ch >= 0x20 && ch < 0x7F )
+				buffer[ bufPos++ ] = ( char ) ch;
+			else
+				if( ch >= 0x10000L )
+					{
+					/* Outside the BMP, encode as a surrogate pair */
+					bufPos += sprintf( buffer + bufPos, "\\u%04X\\u%04X",
+								( int ) ( 0xD800 + ( ( ch - 0x10000L ) >> 10 ) ),
+								( int ) ( 0xDC00 + ( ( ch - 0x10000L ) & 0x3FF ) ) );
+					}
+				else
+					bufPos += sprintf( buffer + bufPos, "\\u%04X", ( int ) ch );
+		if( bufPos > 240 )
+			{
+			outWrite( ctx, buffer, bufPos );
+			bufPos = 0;
+			}
+		}
+	outWrite( ctx, buffer, bufPos );
+	outPutc( ctx, '"' );
+	}
+
+/* Convert a UTCTime or GeneralizedTime string to ISO 8601 form.  This only
+   handles times in UTC, which is what DER requires */
+
+static int jsonConvertTime( const unsigned char *string, const long length,
+							const int isUTCTime, char *buffer )
+	{
+	const int yearLength = ( isUTCTime ) ? 2 : 4;
+	int digits = 0, i;
+
+	/* Find out how many digits there are before the fraction and/or 'Z' */
+	while( digits < length && isdigit( string[ digits ] ) )
+		digits++;
+	if( digits != yearLength + 8 && digits != yearLength + 10 )
+		return( FALSE );
+
+	/* Copy across the date and time, converting the year if necessary */
+	if( isUTCTime )
+		{
+		buffer[ 0 ] = ( string[ 0 ] < '5' ) ? '2' : '1';
+		buffer[ 1 ] = ( string[ 0 ] < '5' ) ? '0' : '9';
+		buffer += 2;
+		}
+	sprintf( buffer, "%.*s-%.2s-%.2sT%.2s:%.2s:%.2s", yearLength, string,
+			 string + yearLength, string + yearLength + 2,
+			 string + yearLength + 4, string + yearLength + 6,
+			 ( digits > yearLength + 8 ) ? \
+				( const char * ) string + yearLength + 8 : "00" );
+	buffer += strlen( buffer );
+
+	/* GeneralizedTime can have fractional seconds */
+	i = digits;
+	if( !isUTCTime && digits == yearLength + 10 && i < length && \
+		( string[ i ] == '.' || string[ i ] == ',' ) )
+		{
+		*buffer++ = '.';
+		for( i++; i < length && isdigit( string[ i ] ) && i < digits + 10; i++ )
+			*buffer++ = string[ i ];
+		}
+	if( i != length - 1 || string[ i ] != 'Z' )
+		return( FALSE );
+	strcpy( buffer, "Z" );
+
+	return( TRUE );
+	}
+
+/* Check a string for the same problems as the text dump */
+
+static void jsonCheckString( DUMPASN1_CTX *ctx, JSON_STATE *state,
+							 const long offset, const unsigned char *string,
+							 const long length, const int tag )
+	{
+	int warnPrintable = FALSE, warnIA5 = FALSE, warnTime = FALSE;
+	long i;
+
+	if( ( tag == UTCTIME && length != 13 ) || \
+		( tag == GENERALIZEDTIME && length != 15 ) )
+		warnTime = TRUE;
+	for( i = 0; i < length; i++ )
+		{
+		const int ch = string[ i ];
+
+		if( tag == PRINTABLESTRING && !isPrintable( ch ) )
+			warnPrintable = TRUE;
+		if( tag == IA5STRING && !isIA5( ch ) )
+			warnIA5 = TRUE;
+		if( ( tag == UTCTIME || tag == GENERALIZEDTIME ) && \
+			!isdigit( ch ) && ch != 'Z' )
+			warnTime = TRUE;
+		}
+	if( warnPrintable )
+		jsonComplain( ctx, state, offset,
+					  "PrintableString contains illegal character(s)" );
+	if( warnIA5 )
+		jsonComplain( ctx, state, offset,
+					  "IA5String contains illegal character(s)" );
+	if( warnTime )
+		jsonComplain( ctx, state, offset, "Time is encoded incorrectly" );
+	if( tag == BMPSTRING && ( length & 1 ) )
+		jsonComplain( ctx, state, offset,
+					  "BMPString has missing final byte/half character" );
+	}
+
+/* Write the value of an object identifier */
+
+static void jsonWriteOID( DUMPASN1_CTX *ctx, const unsigned char *oid,
+						  const long length )
+	{
+	unsigned long value = 0;
+	int isFirst = TRUE;
+	long i;
+
+	outPutc( ctx, '"' );
+	for( i = 0; i < length; i++ )
+		{
+		value = ( value << 7 ) | ( oid[ i ] & 0x7F );
+		if( oid[ i ] & 0x80 )
+			continue;
+		if( isFirst )
+			{
+			/* The first two arcs are encoded together as 40 * x + y, with
+			   y possibly > 39 if x = 2 */
+			if( value < 80 )
+				outPrintf( ctx, "%lu.%lu", value / 40, value % 40 );
+			else
+				outPrintf( ctx, "2.%lu", value - 80 );
+			isFirst = FALSE;
+			}
+		else
+			outPrintf( ctx, ".%lu", value );
+		value = 0;
+		}
+	outPutc( ctx, '"' );
+	}
+
+/* Write a single ASN.1 object */
+
+static int jsonAsn1( DUMPASN1_CTX *ctx, JSON_STATE *state, const int level,
+					 long length, const int isIndefinite );
+
+static void jsonConstructed( DUMPASN1_CTX *ctx, JSON_STATE *state,
+							 const int level, const long length,
+							 const int isIndefinite )
+	{
+	const long offset = ctx->fPos;
+	char message[ 64 ];
+	int result;
+
+	result = jsonAsn1( ctx, state, level + 1, length, isIndefinite );
+	if( ctx->status != DUMPASN1_OK || !result )
+		return;
+	sprintf( message, "Inconsistent object length, %d byte%s difference",
+			 result, ( result > 1 ) ? "s" : "" );
+	jsonComplain( ctx, state, offset, message );
+	}
+
+static void jsonObject( DUMPASN1_CTX *ctx, JSON_STATE *state,
+						ASN1_ITEM *item, const int level, const long offset )
+	{
+	static const char *const classNames[] = \
+		{ "UNIVERSAL", "APPLICATION", "CONTEXT", "PRIVATE" };
+	ASN1_INPUT *input = &ctx->input;
+	const int itemClass = item->id & CLASS_MASK;
+	const int isConstructed = ( item->id & FORM_MASK ) == CONSTRUCTED;
+	const OIDINFO *oidInfo;
+	OIDINFO oidInfoBuffer;
+	unsigned char *content;
+	char buffer[ MAX_OID_SIZE + 2 ];	/* +2 for getOIDinfo() */
+	long i;
+	int x;
+
+	/* Perform a sanity check.  Fatal errors are caught before we start
+	   writing the object so that the output is still valid JSON */
+	if( !checkLength( ctx, item ) )
+		return;
+	if( itemClass == UNIVERSAL && !isConstructed && item->tag == OID && \
+		item->length > MAX_OID_SIZE )
+		{
+		sprintf( ctx->errorString, "Object identifier length %ld too large",
+				 item->length );
+		ctx->status = DUMPASN1_ERROR_BADOID;
+		return;
+		}
+
+	/* Write the details common to all items */
+	jsonBeginRecord( ctx, state );
+	outPrintf( ctx, ",\"offset\":%ld,\"depth\":%d,\"headerSize\":%d,"
+			   "\"class\":\"%s\",\"tag\":%d,\"constructed\":%s", offset, level,
+			   item->headerSize, classNames[ itemClass >> 6 ], item->tag,
+			   ( isConstructed ) ? "true" : "false" );
+	if( item->indefinite )
+		outPuts( ctx, ",\"length\":null,\"indefinite\":true" );
+	else
+		outPrintf( ctx, ",\"length\":%ld", item->length );
+	if( itemClass == UNIVERSAL )
+		outPrintf( ctx, ",\"type\":\"%s\"", idstr( item->tag ) );
+
+	/* Check for zero-length items, which are allowed for a universal
+	   constructed item like an empty SEQUENCE */
+	if( !item->length && !item->indefinite && !zeroLengthOK( ctx, item ) && \
+		!( itemClass == UNIVERSAL && isConstructed ) )
+		{
+		jsonEndRecord( ctx );
+		jsonComplain( ctx, state, offset, "Object has zero length" );
+		return;
+		}
+
+	/* If it's constructed, write the various fields in it */
+	if( isConstructed )
+		{
+		jsonEndRecord( ctx );
+		jsonConstructed( ctx, state, level, item->length, item->indefinite );
+		return;
+		}
+
+	/* If it's not a universal type then all we can do is write the data */
+	if( itemClass != UNIVERSAL )
+		{
+		jsonStreamData( ctx, item->length );
+		jsonEndRecord( ctx );
+		return;
+		}
+
+	switch( item->tag )
+		{
+		case BOOLEAN:
+			if( ( content = jsonReadContent( ctx, item->length ) ) == NULL )
+				return;
+			outPrintf( ctx, ",\"value\":%s", ( *content ) ? "true" : "false" );
+			jsonBufferData( ctx, content, item->length );
+			jsonEndRecord( ctx );
+			if( *content != 0 && *content != 0xFF )
+				jsonComplain( ctx, state, offset,
+							  "BOOLEAN has non-DER encoding" );
+			free( content );
+			break;
+
+		case INTEGER:
+		case ENUMERATED:
+			if( ( content = jsonReadContent( ctx, item->length ) ) == NULL )
+				return;
+			if( item->length <= 4 )
+				{
+				unsigned long value = 0;
+
+				/* Write small values as a number, with the sign and the
+				   magnitude handled separately to avoid overflow */
+				for( i = 0; i < item->length; i++ )
+					value = ( value << 8 ) | content[ i ];
+				if( content[ 0 ] & 0x80 )
+					{
+					value = ( ~value + 1 ) & \
+							( 0xFFFFFFFFUL >> ( ( 4 - item->length ) * 8 ) );
+					outPrintf( ctx, ",\"value\":-%lu", value );
+					}
+				else
+					outPrintf( ctx, ",\"value\":%lu", value );
+				}
+			jsonBufferData( ctx, content, item->length );
+			jsonEndRecord( ctx );
+			if( content[ 0 ] & 0x80 )
+				jsonComplain( ctx, state, offset,
+							  "Integer has a negative value" );
+			free( content );
+			break;
+
+		case BITSTRING:
+			x = inGetc( input );
+			ctx->fPos++;
+			outPrintf( ctx, ",\"unusedBits\":%d", x );
+			if( !--item->length && !x )
+				{
+				jsonEndRecord( ctx );
+				jsonComplain( ctx, state, offset, "Object has zero length" );
+				return;
+				}
+			if( item->length > ( long ) sizeof( int ) && \
+				checkEncapsulate( ctx, item->tag, item->length ) )
+				{
+				outPuts( ctx, ",\"encapsulates\":true" );
+				jsonEndRecord( ctx );
+				jsonConstructed( ctx, state, level, item->length, FALSE );
+				break;
+				}
+			jsonStreamData( ctx, item->length );
+			jsonEndRecord( ctx );
+			break;
+
+		case OCTETSTRING:
+			if( checkEncapsulate( ctx, item->tag, item->length ) )
+				{
+				outPuts( ctx, ",\"encapsulates\":true" );
+				jsonEndRecord( ctx );
+				jsonConstructed( ctx, state, level, item->length, FALSE );
+				break;
+				}
+			jsonStreamData( ctx, item->length );
+			jsonEndRecord( ctx );
+			break;
+
+		case OID:
+			memset( buffer, 0, MAX_OID_SIZE );	/* In case data is truncated */
+			inRead( buffer, item->length, input );
+			ctx->fPos += item->length;
+			outPuts( ctx, ",\"value\":" );
+			jsonWriteOID( ctx, ( unsigned char * ) buffer, item->length );
+			if( ( oidInfo = getOIDinfo( ctx->config, buffer,
+										( int ) item->length,
+										&oidInfoBuffer ) ) != NULL )
+				{
+				if( oidInfo->description != NULL )
+					{
+					outPuts( ctx, ",\"name\":" );
+					jsonWriteString( ctx,
+								( unsigned char * ) oidInfo->description,
+								strlen( oidInfo->description ), 0 );
+					}
+				if( oidInfo->comment != NULL )
+					{
+					outPuts( ctx, ",\"comment\":" );
+					jsonWriteString( ctx,
+								( unsigned char * ) oidInfo->comment,
+								strlen( oidInfo->comment ), 0 );
+					}
+				if( oidInfo->warn )
+					{
+					outPuts( ctx, ",\"warning\":true" );
+					ctx->noWarnings++;
+					}
+				}
+			jsonBufferData( ctx, ( unsigned char * ) buffer, item->length );
+			jsonEndRecord( ctx );
+			break;
+
+		case EOC:
+		case NULLTAG:
+			outPuts( ctx, ",\"value\":null" );
+			if( item->length > 0 )
+				jsonStreamData( ctx, item->length );
+			jsonEndRecord( ctx );
+			break;
+
+		case OBJDESCRIPTOR:
+		case GRAPHICSTRING:
+		case VISIBLESTRING:
+		case GENERALSTRING:
+		case UNIVERSALSTRING:
+		case NUMERICSTRING:
+		case VIDEOTEXSTRING:
+		case UTF8STRING:
+		case PRINTABLESTRING:
+		case BMPSTRING:
+		case UTCTIME:
+		case GENERALIZEDTIME:
+		case IA5STRING:
+		case T61STRING:
+			{
+			char timeBuffer[ 64 ];
+
+			if( ( content = jsonReadContent( ctx, item->length ) ) == NULL )
+				return;
+			outPuts( ctx, ",\"value\":" );
+			jsonWriteString( ctx, content, item->length, item->tag );
+			if( ( item->tag == UTCTIME || item->tag == GENERALIZEDTIME ) && \
+				jsonConvertTime( content, item->length,
+								 item->tag == UTCTIME, timeBuffer ) )
+				outPrintf( ctx, ",\"time\":\"%s\"", timeBuffer );
+			jsonBufferData( ctx, content, item->length );
+			jsonEndRecord( ctx );
+			jsonCheckString( ctx, state, offset, content, item->length,
+							 item->tag );
+			free( content );
+			break;
+			}
+
+		default:
+			jsonStreamData( ctx, item->length );
+			jsonEndRecord( ctx );
+			jsonComplain( ctx, state, offset, "Unrecognised primitive" );
+		}
+	}
+
+/* Write a complex ASN.1 object.  This follows the same process as
+   printAsn1() */
+
+static int jsonAsn1( DUMPASN1_CTX *ctx, JSON_STATE *state, const int level,
+					 long length, const int isIndefinite )
+	{
+	ASN1_INPUT *input = &ctx->input;
+	ASN1_ITEM item;
+	const int parentPathLength = state->pathLength;
+	long lastPos = ctx->fPos;
+	int seenEOC = FALSE, index = 0, status;
+
+	/* Special-case for zero-length objects */
+	if( !length && !isIndefinite )
+		return( 0 );
+
+	/* Top-level objects are numbered in the order that they appear in the
+	   input */
+	if( length == LENGTH_MAGIC )
+		index = state->noObjects++;
+
+	while( ( status = getItem( ctx, &item ) ) > 0 )
+		{
+		/* Perform various special checks the first time we're called */
+		if( length == LENGTH_MAGIC )
+			{
+			if( !item.indefinite )
+				length = item.headerSize + item.length;
+			if( inSeek( input, -item.headerSize, SEEK_CUR ) )
+				{
+				ctx->useStdin = TRUE;
+				ctx->checkEncaps = FALSE;
+				jsonBeginRecord( ctx, state );
+				outPuts( ctx, ",\"warning\":\"Input is non-seekable, some "
+						 "functionality has been disabled\"" );
+				jsonEndRecord( ctx );
+				}
+			else
+				inSeek( input, item.headerSize, SEEK_CUR );
+			}
+
+		/* Write details on the item */
+		if( item.header[ 0 ] == EOC )
+			{
+			seenEOC = TRUE;
+			if( !isIndefinite)
+				jsonComplain( ctx, state, lastPos,
+							  "Spurious EOC in definite-length item" );
+			}
+		if( !seenEOC )
+			{
+			if( !jsonPushPath( ctx, state, index++ ) )
+				return( 0 );
+			jsonObject( ctx, state, &item, level, lastPos );
+			state->pathLength = parentPathLength;
+			state->path[ parentPathLength ] = '\0';
+			if( ctx->status != DUMPASN1_OK )
+				return( 0 );
+			}
+
+		/* If it was an indefinite-length object (no length was ever set) and
+		   we've come back to the top level, exit */
+		if( length == LENGTH_MAGIC )
+			return( 0 );
+
+		length -= ctx->fPos - lastPos;
+		lastPos = ctx->fPos;
+		if( isIndefinite )
+			{
+			if( seenEOC )
+				return( 0 );
+			}
+		else
+			if( length <= 0 )
+				{
+				if( length < 0 )
+					return( ( int ) -length );
+				return( 0 );
+				}
+			else
+				if( length == 1 )
+					{
+					const int ch = inGetc( input );
+
+					/* No object can be one byte long, try and recover in the
+					   same way as printAsn1() */
+					if( ch && ch <= 0x31 )
+						inUngetc( ch, input );
+					else
+						{
+						ctx->fPos++;
+						return( 1 );
+						}
+					}
+		}
+	if( status == -1 )
+		{
+		sprintf( ctx->errorString, "Invalid data encountered at position "
+				 "%d", ctx->fPos );
+		ctx->status = DUMPASN1_ERROR_BADDATA;
+		return( 0 );
+		}
+
+	/* If we see an EOF and there's supposed to be more data present,
+	   complain */
+	if( length && length != LENGTH_MAGIC )
+		{
+		char message[ 80 ];
+
+		sprintf( message, "Inconsistent object length, %ld byte%s "
+				 "difference", length, ( length > 1 ) ? "s" : "" );
+		jsonComplain( ctx, state, lastPos, message );
+		}
+	return( 0 );
+	}
+
+/* Write the data as JSON */
+
+static void jsonDump( DUMPASN1_CTX *ctx )
+	{
+	JSON_STATE state;
+
+	memset( &state, 0, sizeof( JSON_STATE ) );
+	if( ( state.path = malloc( 256 ) ) == NULL )
+		{
+		ctx->status = DUMPASN1_ERROR_MEMORY;
+		strcpy( ctx->errorString, "Out of memory" );
+		return;
+		}
+	state.pathSize = 256;
+	*state.path = '\0';
+
+	if( ctx->jsonOutput > 1 )
+		outPuts( ctx, "[\n" );
+	do
+		jsonAsn1( ctx, &state, 0, LENGTH_MAGIC, FALSE );
+	while( ctx->input.stream != NULL && ctx->status == DUMPASN1_OK && \
+		   inMoreData( &ctx->input ) );
+	if( ctx->jsonOutput > 1 )
+		outPuts( ctx, ( state.noRecords > 0 ) ? "\n]\n" : "]\n" );
+	free( state.path );
+	}
+
+/****************************************************************************
+*																			*
+*								TLV Index Routines							*
+*																			*
+****************************************************************************/
+
+/* The TLV index is built by walking the data in the same way as
+   printAsn1(), but only reading the tags and lengths and skipping the
+   contents, so the items and their paths are the same as in the JSON
+   output.  Objects encapsulated in OCTET STRINGs and BIT STRINGs are always
+   indexed, whether or not they're being displayed, so that a saved index is
+   the same no matter what options it was built with.
+
+   A saved index consists of a header followed by the index entries, stored
+   in the native byte order like the compiled OID index.  The size and
+   modification time of the data file are recorded so that we can tell when
+   the index is out of date */
+
+#define TLV_MAGIC		0x44413154L	/* 'DA1T' */
+#define TLV_VERSION		2
+
+typedef struct {
+	unsigned int magic, version;	/* Magic value and format version */
+	FILE_STAMP dataStamp;			/* Size and time of data file */
+	unsigned int baseOffset;		/* Position in file that index starts at */
+	unsigned int noEntries;			/* Number of entries */
+	unsigned int reserved;			/* Keeps the entries long-aligned */
+	} TLV_HEADER;
+
+/* Get the path for the saved index for a data file */
+
+static int buildTLVPath( char *indexPath, const char *fileName )
+	{
+	if( strlen( fileName ) > FILENAME_MAX - 5 )
+		return( FALSE );
+	sprintf( indexPath, "%s.tlv", fileName );
+
+	return( TRUE );
+	}
+
+/* Add an entry for an item to the index, returning its entry number */
+
+static int addTLV( DUMPASN1_CTX *ctx, DUMPASN1_INDEX *index,
+				   const ASN1_ITEM *item, const long offset,
+				   const int depth, const int parent )
+	{
+	DUMPASN1_TLV *entry;
+
+	if( index->noEntries >= index->bufferSize )
+		{
+		const int newSize = ( index->bufferSize > 0 ) ? \
+							index->bufferSize * 2 : 1024;
+		DUMPASN1_TLV *newBuffer;
+
+		if( ( newBuffer = realloc( index->buffer,
+						newSize * sizeof( DUMPASN1_TLV ) ) ) == NULL )
+			{
+			ctx->status = DUMPASN1_ERROR_MEMORY;
+			strcpy( ctx->errorString, "Out of memory" );
+			return( -1 );
+			}
+		index->buffer = newBuffer;
+		index->entries = newBuffer;
+		index->bufferSize = newSize;
+		}
+	entry = &index->buffer[ index->noEntries ];
+	memset( entry, 0, sizeof( DUMPASN1_TLV ) );
+	entry->offset = offset;
+	entry->length = item->length;
+	entry->parent = parent;
+	entry->headerSize = item->headerSize;
+	entry->depth = depth;
+	entry->id = item->id;
+	entry->tag = item->tag;
+	entry->indefinite = item->indefinite;
+
+	return( index->noEntries++ );
+	}
+
+/* Index a single ASN.1 object and anything nested inside it */
+
+static int indexAsn1( DUMPASN1_CTX *ctx, DUMPASN1_INDEX *index,
+					  const int depth, const int parent, long length,
+					  const int isIndefinite );
+
+static void indexObject( DUMPASN1_CTX *ctx, DUMPASN1_INDEX *index,
+						 ASN1_ITEM *item, const int depth, const int parent,
+						 const long offset )
+	{
+	ASN1_INPUT *input = &ctx->input;
+	DUMPASN1_TLV *entry;
+	long length = item->length;
+	int entryNo;
+
+	if( !checkLength( ctx, item ) || \
+		( entryNo = addTLV( ctx, index, item, offset, depth, parent ) ) < 0 )
+		return;
+
+	if( ( item->id & FORM_MASK ) == CONSTRUCTED )
+		indexAsn1( ctx, index, depth + 1, entryNo, length, item->indefinite );
+	else
+		{
+		/* Look for encapsulated objects in the same way as printAsn1() */
+		if( ( item->id & CLASS_MASK ) == UNIVERSAL && \
+			item->tag == BITSTRING && length > 0 )
+			{
+			inGetc( input );	/* Skip unused bits count */
+			ctx->fPos++;
+			length--;
+			}
+		if( ( item->id & CLASS_MASK ) == UNIVERSAL && length > 0 && \
+			( item->tag == OCTETSTRING || \
+			  ( item->tag == BITSTRING && length > ( long ) sizeof( int ) ) ) && \
+			checkEncapsulate( ctx, item->tag, length ) )
+			indexAsn1( ctx, index, depth + 1, entryNo, length, FALSE );
+		else
+			{
+			inSeek( input, length, SEEK_CUR );
+			ctx->fPos += length;
+			}
+		}
+
+	/* Now that we've got to the end of the item, fill in the details that
+	   depend on its contents */
+	entry = &index->buffer[ entryNo ];
+	entry->noDescendants = index->noEntries - entryNo - 1;
+	if( item->indefinite )
+		entry->length = ctx->fPos - offset - item->headerSize;
+	}
+
+/* Index a complex ASN.1 object */
+
+static int indexAsn1( DUMPASN1_CTX *ctx, DUMPASN1_INDEX *index,
+					  const int depth, const int parent, long length,
+					  const int isIndefinite )
+	{
+	ASN1_INPUT *input = &ctx->input;
+	ASN1_ITEM item;
+	long lastPos = ctx->fPos;
+	int seenEOC = FALSE, status;
+
+	/* Special-case for zero-length objects */
+	if( !length && !isIndefinite )
+		return( 0 );
+
+	while( ( status = getItem( ctx, &item ) ) > 0 )
+		{
+		/* If the length isn't known and the item has a definite length,
+		   set the length to the item's length */
+		if( length == LENGTH_MAGIC && !item.indefinite )
+			length = item.headerSize + item.length;
+
+		if( item.header[ 0 ] == EOC )
+			seenEOC = TRUE;
+		if( !seenEOC )
+			{
+			indexObject( ctx, index, &item, depth, parent, lastPos );
+			if( ctx->status != DUMPASN1_OK )
+				return( 0 );
+			}
+
+		/* If it was an indefinite-length object (no length was ever set) and
+		   we've come back to the top level, exit */
+		if( length == LENGTH_MAGIC )
+			return( 0 );
+
+		length -= ctx->fPos - lastPos;
+		lastPos = ctx->fPos;
+		if( isIndefinite )
+			{
+			if( seenEOC )
+				return( 0 );
+			}
+		else
+			if( length <= 0 )
+				{
+				if( length < 0 )
+					return( ( int ) -length );
+				return( 0 );
 				}
 			else
-				fseek( inFile, item.headerSize, SEEK_CUR );
+				if( length == 1 )
+					{
+					const int ch = inGetc( input );
+
+					/* No object can be one byte long, try and recover in the
+					   same way as printAsn1() */
+					if( ch && ch <= 0x31 )
+						inUngetc( ch, input );
+					else
+						{
+						ctx->fPos++;
+						return( 1 );
+						}
+					}
+		}
+	if( status == -1 )
+		{
+		sprintf( ctx->errorString, "Invalid data encountered at position "
+				 "%d", ctx->fPos );
+		ctx->status = DUMPASN1_ERROR_BADDATA;
+		}
+	return( 0 );
+	}
+
+/* Index the input data.  If there's a problem with it we don't return a
+   partial index, since it could give wrong answers for items after the
+   problem */
+
+static int indexInput( DUMPASN1_CTX *ctx, DUMPASN1_INDEX *index )
+	{
+	const int checkEncaps = ctx->checkEncaps;
+
+	ctx->noErrors = ctx->noWarnings = 0;
+	ctx->status = DUMPASN1_OK;
+	ctx->errorString[ 0 ] = '\0';
+	ctx->fPos = 0;
+
+	ctx->checkEncaps = TRUE;
+	do
+		indexAsn1( ctx, index, 0, -1, LENGTH_MAGIC, FALSE );
+	while( ctx->input.stream != NULL && ctx->status == DUMPASN1_OK && \
+		   inMoreData( &ctx->input ) );
+	ctx->checkEncaps = checkEncaps;
+	if( ctx->status != DUMPASN1_OK )
+		dumpasn1FreeIndex( index );
+
+	return( ctx->status );
+	}
+
+/* Check whether an index entry matches an element of a path, either a
+   child number or the item's type as shown in the dump */
+
+static int matchPathElement( const DUMPASN1_TLV *entry, const int childNo,
+							 const char *element, const int elementLength )
+	{
+	static const char *const classtext[] = \
+		{ "UNIVERSAL ", "APPLICATION ", "", "PRIVATE " };
+	const char *namePtr;
+	char name[ 64 ];
+	int i;
+
+	if( isdigit( *element ) )
+		{
+		long value = 0;
+
+		for( i = 0; i < elementLength && isdigit( element[ i ] ); i++ )
+			value = ( value * 10 ) + ( element[ i ] - '0' );
+		return( i == elementLength && value == childNo );
+		}
+	if( ( entry->id & CLASS_MASK ) == UNIVERSAL )
+		namePtr = idstr( entry->tag );
+	else
+		{
+		sprintf( name, "[%s%d]", classtext[ ( entry->id & CLASS_MASK ) >> 6 ],
+				 entry->tag );
+		namePtr = name;
+		}
+	if( ( int ) strlen( namePtr ) != elementLength )
+		return( FALSE );
+	for( i = 0; i < elementLength; i++ )
+		if( toupper( namePtr[ i ] ) != toupper( element[ i ] ) )
+			return( FALSE );
+
+	return( TRUE );
+	}
+
+/****************************************************************************
+*																			*
+*							Library Interface Routines						*
+*																			*
+****************************************************************************/
+
+/* Set up, read, and free the OID information */
+
+void dumpasn1InitConfig( DUMPASN1_CONFIG *config )
+	{
+	memset( config, 0, sizeof( DUMPASN1_CONFIG ) );
+	}
+
+int dumpasn1ReadConfig( DUMPASN1_CONFIG *config, const char *path )
+	{
+	return( readConfig( config, path, FALSE ) );
+	}
+
+int dumpasn1ReadGlobalConfig( DUMPASN1_CONFIG *config,
+							  const char *programPath )
+	{
+	return( readGlobalConfig( config, programPath ) );
+	}
+
+void dumpasn1FreeConfig( DUMPASN1_CONFIG *config )
+	{
+	OIDINFO *oidPtr = config->oidList;
+
+	while( oidPtr != NULL )
+		{
+		OIDINFO *nextPtr = oidPtr->next;
+
+		if( oidPtr->description != NULL )
+			free( oidPtr->description );
+		if( oidPtr->comment != NULL )
+			free( oidPtr->comment );
+		free( oidPtr );
+		oidPtr = nextPtr;
+		}
+	if( config->oidTable != NULL )
+		free( config->oidTable );
+	if( config->index.data != NULL )
+		inClose( &config->index );
+	memset( config, 0, sizeof( DUMPASN1_CONFIG ) );
+	}
+
+int dumpasn1CompileConfig( DUMPASN1_CONFIG *config, const char *path )
+	{
+	return( compileConfig( config, path ) );
+	}
+
+/* Set up and free a decoding context */
+
+void dumpasn1InitContext( DUMPASN1_CTX *ctx, const DUMPASN1_CONFIG *config )
+	{
+	memset( ctx, 0, sizeof( DUMPASN1_CTX ) );
+	ctx->checkEncaps = TRUE;
+	ctx->checkCharset = TRUE;
+#ifndef __OS390__
+	ctx->reverseBitString = TRUE;
+#else
+	ctx->reverseBitString = FALSE;	/* Natural order on OS390 is the same as ASN.1 */
+#endif /* __OS390__ */
+	ctx->config = config;
+	}
+
+void dumpasn1FreeContext( DUMPASN1_CTX *ctx )
+	{
+	if( ctx->outBuffer != NULL )
+		free( ctx->outBuffer );
+	ctx->outBuffer = NULL;
+	ctx->outLength = ctx->outSize = 0;
+	}
+
+/* Dump the data that's been set up as the input */
+
+static int dumpInput( DUMPASN1_CTX *ctx )
+	{
+	ctx->noErrors = ctx->noWarnings = 0;
+	ctx->status = DUMPASN1_OK;
+	ctx->errorString[ 0 ] = '\0';
+	ctx->outLength = 0;
+	if( ctx->outBuffer != NULL )
+		ctx->outBuffer[ 0 ] = '\0';
+	ctx->fPos = 0;
+
+	/* Dump the data.  Buffered input like a pipe may contain a whole series
+	   of objects, so we keep going until we run out of data */
+	if( ctx->jsonOutput )
+		jsonDump( ctx );
+	else
+		{
+		do
+			printAsn1( ctx, 0, LENGTH_MAGIC, 0 );
+		while( ctx->input.stream != NULL && ctx->status == DUMPASN1_OK && \
+			   inMoreData( &ctx->input ) );
+		}
+
+	return( ctx->status );
+	}
+
+/* Dump ASN.1 data from memory or from a stream */
+
+int dumpasn1DumpBuffer( DUMPASN1_CTX *ctx, const void *data,
+						const long length )
+	{
+	memset( &ctx->input, 0, sizeof( ASN1_INPUT ) );
+	ctx->input.data = data;
+	ctx->input.dataLen = length;
+	ctx->input.pushback = EOF;
+
+	return( dumpInput( ctx ) );
+	}
+
+int dumpasn1DumpStream( DUMPASN1_CTX *ctx, FILE *inFile )
+	{
+	int status;
+
+	if( !inOpen( &ctx->input, inFile ) )
+		{
+		strcpy( ctx->errorString, "Out of memory" );
+		return( DUMPASN1_ERROR_MEMORY );
+		}
+	status = dumpInput( ctx );
+	inClose( &ctx->input );
+	memset( &ctx->input, 0, sizeof( ASN1_INPUT ) );
+
+	return( status );
+	}
+
+/* Get the dump text that's been collected in memory */
+
+/* Build, save, load, and search an index of ASN.1 data */
+
+int dumpasn1IndexBuffer( DUMPASN1_CTX *ctx, DUMPASN1_INDEX *index,
+						 const void *data, const long length )
+	{
+	memset( index, 0, sizeof( DUMPASN1_INDEX ) );
+	memset( &ctx->input, 0, sizeof( ASN1_INPUT ) );
+	ctx->input.data = data;
+	ctx->input.dataLen = length;
+	ctx->input.pushback = EOF;
+
+	return( indexInput( ctx, index ) );
+	}
+
+int dumpasn1IndexStream( DUMPASN1_CTX *ctx, DUMPASN1_INDEX *index,
+						 FILE *inFile )
+	{
+	int status;
+
+	memset( index, 0, sizeof( DUMPASN1_INDEX ) );
+	if( ( index->baseOffset = ftell( inFile ) ) < 0 )
+		index->baseOffset = 0;
+	if( !inOpen( &ctx->input, inFile ) )
+		{
+		strcpy( ctx->errorString, "Out of memory" );
+		return( DUMPASN1_ERROR_MEMORY );
+		}
+	status = indexInput( ctx, index );
+	inClose( &ctx->input );
+	memset( &ctx->input, 0, sizeof( ASN1_INPUT ) );
+
+	return( status );
+	}
+
+int dumpasn1SaveIndex( DUMPASN1_CTX *ctx, const DUMPASN1_INDEX *index,
+					   const char *fileName )
+	{
+	TLV_HEADER header;
+	FILE_STAMP dataStamp;
+	char indexPath[ FILENAME_MAX ];
+
+	if( !buildTLVPath( indexPath, fileName ) )
+		{
+		ctx->status = DUMPASN1_ERROR_FILE;
+		strcpy( ctx->errorString, "File path is too long" );
+		return( ctx->status );
+		}
+	if( !getFileStamp( fileName, &dataStamp ) )
+		{
+		ctx->status = DUMPASN1_ERROR_FILE;
+		sprintf( ctx->errorString, "Cannot open file (%.80s)",
+				 strerror( errno ) );
+		return( ctx->status );
+		}
+	memset( &header, 0, sizeof( TLV_HEADER ) );
+	header.magic = TLV_MAGIC;
+	header.version = TLV_VERSION;
+	header.dataStamp = dataStamp;
+	header.baseOffset = ( unsigned int ) index->baseOffset;
+	header.noEntries = index->noEntries;
+
+	if( !writeIndex( indexPath, &header, sizeof( TLV_HEADER ),
+					 index->entries, index->noEntries * sizeof( DUMPASN1_TLV ),
+					 NULL, 0, ctx->errorString ) )
+		{
+		ctx->status = DUMPASN1_ERROR_FILE;
+		return( ctx->status );
+		}
+
+	return( DUMPASN1_OK );
+	}
+
+int dumpasn1LoadIndex( DUMPASN1_INDEX *index, const char *fileName )
+	{
+	const TLV_HEADER *header;
+	FILE_STAMP dataStamp;
+	FILE *file;
+	char indexPath[ FILENAME_MAX ];
+	int status, i;
+
+	memset( index, 0, sizeof( DUMPASN1_INDEX ) );
+	if( !getFileStamp( fileName, &dataStamp ) || \
+		!buildTLVPath( indexPath, fileName ) || \
+		( file = fopen( indexPath, "rb" ) ) == NULL )
+		return( FALSE );
+	status = inOpen( &index->file, file );
+	fclose( file );
+	if( !status )
+		{
+		memset( index, 0, sizeof( DUMPASN1_INDEX ) );
+		return( FALSE );
+		}
+
+	/* Make sure that the index is in memory, is what it claims to be, and
+	   is for the current version of the data file */
+	header = ( const TLV_HEADER * ) index->file.data;
+	if( index->file.stream != NULL || \
+		index->file.dataLen < ( long ) sizeof( TLV_HEADER ) || \
+		header->magic != TLV_MAGIC || header->version != TLV_VERSION || \
+		memcmp( &header->dataStamp, &dataStamp, sizeof( FILE_STAMP ) ) || \
+		header->noEntries > ( unsigned int ) index->file.dataLen / \
+							sizeof( DUMPASN1_TLV ) || \
+		index->file.dataLen != ( long ) sizeof( TLV_HEADER ) + \
+			( long ) ( header->noEntries * sizeof( DUMPASN1_TLV ) ) )
+		{
+		dumpasn1FreeIndex( index );
+		return( FALSE );
+		}
+	index->entries = ( const DUMPASN1_TLV * ) \
+					 ( index->file.data + sizeof( TLV_HEADER ) );
+	index->noEntries = ( int ) header->noEntries;
+	index->baseOffset = header->baseOffset;
+
+	/* Make sure that the structure is consistent, so that searching it
+	   can't go outside the index */
+	for( i = 0; i < index->noEntries; i++ )
+		{
+		const DUMPASN1_TLV *entry = &index->entries[ i ];
+
+		if( entry->parent < -1 || entry->parent >= i || \
+			entry->noDescendants < 0 || \
+			entry->noDescendants >= index->noEntries - i )
+			{
+			dumpasn1FreeIndex( index );
+			return( FALSE );
 			}
+		}
+
+	return( TRUE );
+	}
+
+void dumpasn1FreeIndex( DUMPASN1_INDEX *index )
+	{
+	if( index->buffer != NULL )
+		free( index->buffer );
+	if( index->file.data != NULL )
+		inClose( &index->file );
+	memset( index, 0, sizeof( DUMPASN1_INDEX ) );
+	}
+
+int dumpasn1FindItem( const DUMPASN1_INDEX *index, const char *path )
+	{
+	const char separator = ( strchr( path, '/' ) != NULL ) ? '/' : '.';
+	int parent = -1;
+
+	while( *path )
+		{
+		const char *endPtr = strchr( path, separator );
+		const int elementLength = ( endPtr != NULL ) ? \
+								  ( int ) ( endPtr - path ) : \
+								  ( int ) strlen( path );
+		const int endEntry = ( parent < 0 ) ? index->noEntries : \
+							 parent + 1 + index->entries[ parent ].noDescendants;
+		int entryNo, childNo = 0;
+
+		/* Find the child of the current item that matches this element of
+		   the path, skipping over each child's descendants to get to the
+		   next one */
+		for( entryNo = parent + 1; entryNo < endEntry;
+			 entryNo += 1 + index->entries[ entryNo ].noDescendants )
+			{
+			if( matchPathElement( &index->entries[ entryNo ], childNo,
+								  path, elementLength ) )
+				break;
+			childNo++;
+			}
+		if( entryNo >= endEntry )
+			return( -1 );
+		parent = entryNo;
+		path += elementLength;
+		if( *path )
+			path++;	/* Skip separator */
+		}
+
+	return( parent );
+	}
+
+const char *dumpasn1GetOutput( const DUMPASN1_CTX *ctx, long *length )
+	{
+	if( length != NULL )
+		*length = ctx->outLength;
+	return( ( ctx->outBuffer != NULL ) ? ctx->outBuffer : "" );
+	}
+
+#ifndef DUMPASN1_LIBRARY
+
+/****************************************************************************
+*																			*
+*							Batch Processing Routines						*
+*																			*
+****************************************************************************/
+
+/* When we're given more than one file or a directory, the files are decoded
+   on a pool of threads, each with its own decoding context, while the main
+   thread writes the results in the order in which the files were given */
+
+/* The maximum number of threads that we use, and how many files each thread
+   can decode ahead of the one being written before it has to wait.  The
+   latter limits the amount of decoded output held in memory */
+
+#define MAX_BATCH_THREADS	64
+#define BATCH_LOOKAHEAD		4
+
+/* The list of files to process */
+
+typedef struct {
+	char **names;				/* File names */
+	int noNames, maxNames;		/* Number of names, size of list */
+	} FILE_LIST;
+
+/* A file being processed in batch mode and the overall batch state */
+
+typedef struct {
+	const char *fileName;		/* File to decode */
+	DUMPASN1_CTX ctx;			/* Decoding context for the file */
+	int isDone;					/* Whether decoding has finished */
+	int isError;				/* Whether the file couldn't be decoded */
+	} BATCH_ITEM;
+
+typedef struct {
+	/* The files to decode and the state of processing them */
+	BATCH_ITEM *items;
+	int noItems;				/* Number of files */
+	int nextItem;				/* Next file to be decoded */
+	int nextOutput;				/* Next file to be written */
+	int lookahead;				/* How far decoding can get ahead of output */
+
+	/* Options for the decoding */
+	const DUMPASN1_CTX *ctxTemplate;	/* Options to use for each file */
+	long offset;				/* Position in each file to start at */
+	const char *outputSuffix;	/* Suffix for per-file output, or NULL */
+
+	/* Synchronisation between the decoding threads and the main thread */
+	MUTEX_TYPE mutex;
+	COND_TYPE stateChanged;
+	} BATCH_INFO;
+
+/* Check whether a path is a directory */
+
+static int isDirectory( const char *path )
+	{
+	struct stat fileInfo;
+
+	return( !stat( path, &fileInfo ) && \
+			( fileInfo.st_mode & S_IFMT ) == S_IFDIR );
+	}
+
+/* Add a file to the list of files to process */
+
+static int addFile( FILE_LIST *fileList, const char *dirName,
+					const char *fileName )
+	{
+	const int dirNameLen = ( dirName != NULL ) ? strlen( dirName ) : 0;
+	char *name;
+
+	if( fileList->noNames >= fileList->maxNames )
+		{
+		char **names;
+		const int maxNames = ( fileList->maxNames > 0 ) ? \
+							 fileList->maxNames * 2 : 64;
+
+		if( ( names = ( char ** ) realloc( fileList->names,
+								maxNames * sizeof( char * ) ) ) == NULL )
+			{
+			puts( "Out of memory." );
+			return( FALSE );
+			}
+		fileList->names = names;
+		fileList->maxNames = maxNames;
+		}
+	if( ( name = ( char * ) malloc( dirNameLen + strlen( fileName ) + 2 ) ) == NULL )
+		{
+		puts( "Out of memory." );
+		return( FALSE );
+		}
+	if( dirName != NULL )
+		{
+		/* Prepend the directory name, adding a separator if necessary */
+		strcpy( name, dirName );
+		if( dirNameLen > 0 && name[ dirNameLen - 1 ] != '/' && \
+			name[ dirNameLen - 1 ] != '\\' )
+#ifdef __WIN32__
+			strcat( name, "\\" );
+#else
+			strcat( name, "/" );
+#endif /* __WIN32__ */
+		strcat( name, fileName );
+		}
+	else
+		strcpy( name, fileName );
+	fileList->names[ fileList->noNames++ ] = name;
+
+	return( TRUE );
+	}
+
+/* Add the files in a directory to the list of files to process.  Directory
+   entries come back in no particular order, so we sort them to make the
+   output reproducible */
+
+static int compareNames( const void *name1, const void *name2 )
+	{
+	return( strcmp( *( ( const char ** ) name1 ),
+					*( ( const char ** ) name2 ) ) );
+	}
 
-		/* Dump the header as hex data if requested */
-		if( doDumpHeader )
-			dumpHeader( inFile, &item );
+static int addDirectory( FILE_LIST *fileList, const char *dirName )
+	{
+	const int firstName = fileList->noNames;
+#if defined( __WIN32__ )
+	WIN32_FIND_DATAA findData;
+	HANDLE hFind;
+	char pattern[ FILENAME_MAX ];
 
-		/* Print offset into buffer, tag, and length */
-		if( item.header[ 0 ] == EOC )
+	if( strlen( dirName ) > FILENAME_MAX - 3 )
+		{
+		printf( "Directory name '%s' is too long.\n", dirName );
+		return( FALSE );
+		}
+	sprintf( pattern, "%s\\*", dirName );
+	if( ( hFind = FindFirstFileA( pattern, &findData ) ) == INVALID_HANDLE_VALUE )
+		{
+		printf( "Cannot read directory '%s'.\n", dirName );
+		return( FALSE );
+		}
+	do
+		{
+		if( !( findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY ) && \
+			!addFile( fileList, dirName, findData.cFileName ) )
 			{
-			seenEOC = TRUE;
-			if( !isIndefinite)
-				complain( "Spurious EOC in definite-length item", level );
+			FindClose( hFind );
+			return( FALSE );
 			}
-		if( !doPure )
+		}
+	while( FindNextFileA( hFind, &findData ) );
+	FindClose( hFind );
+#elif defined( __UNIX__ )
+	DIR *dir;
+	struct dirent *entry;
+
+	if( ( dir = opendir( dirName ) ) == NULL )
+		{
+		perror( dirName );
+		return( FALSE );
+		}
+	while( ( entry = readdir( dir ) ) != NULL )
+		{
+		if( !strcmp( entry->d_name, "." ) || !strcmp( entry->d_name, ".." ) )
+			continue;
+		if( !addFile( fileList, dirName, entry->d_name ) )
 			{
-#if 0
-			/* Don't print hex tags any more to save display space */
-			if( item.indefinite )
-				fprintf( output, ( doHexValues ) ? "%04lX %02X NDEF: " :
-						 "%4ld %02X NDEF: ", lastPos, item.id | item.tag );
-			else
-				if( !seenEOC )
-					fprintf( output, ( doHexValues ) ? "%04lX %02X %4lX: " :
-							 "%4ld %02X %4ld: ", lastPos, item.id | item.tag,
-							 item.length );
-#else
-			if( item.indefinite )
-				fprintf( output, ( doHexValues ) ? "%04lX NDEF: " :
-						 "%4ld NDEF: ", lastPos );
-			else
-				if( !seenEOC )
-					fprintf( output, ( doHexValues ) ? "%04lX %4lX: " :
-							 "%4ld %4ld: ", lastPos, item.length );
-#endif
+			closedir( dir );
+			return( FALSE );
 			}
 
-		/* Print details on the item */
-		if( !seenEOC )
+		/* Skip subdirectories */
+		if( isDirectory( fileList->names[ fileList->noNames - 1 ] ) )
+			free( fileList->names[ --fileList->noNames ] );
+		}
+	closedir( dir );
+#else
+	printf( "Cannot read directory '%s' on this system.\n", dirName );
+	return( FALSE );
+#endif /* OS-specific directory reading */
+	qsort( fileList->names + firstName, fileList->noNames - firstName,
+		   sizeof( char * ), compareNames );
+
+	return( TRUE );
+	}
+
+static void freeFileList( FILE_LIST *fileList )
+	{
+	int i;
+
+	for( i = 0; i < fileList->noNames; i++ )
+		free( fileList->names[ i ] );
+	if( fileList->names != NULL )
+		free( fileList->names );
+	memset( fileList, 0, sizeof( FILE_LIST ) );
+	}
+
+/* Decode a single file */
+
+static void processItem( BATCH_INFO *batch, BATCH_ITEM *item )
+	{
+	FILE *inFile, *outFile = NULL;
+
+	item->ctx = *batch->ctxTemplate;
+	item->ctx.output = NULL;
+	if( ( inFile = fopen( item->fileName, "rb" ) ) == NULL )
+		{
+		sprintf( item->ctx.errorString, "Cannot open input file (%.80s)",
+				 strerror( errno ) );
+		item->isError = TRUE;
+		return;
+		}
+	if( batch->outputSuffix != NULL )
+		{
+		char outName[ FILENAME_MAX ];
+		int nameLength;
+
+		/* Older VC++ _snprintf()s return -1 if the name doesn't fit */
+		nameLength = snprintf( outName, FILENAME_MAX, "%s%s", item->fileName,
+							   batch->outputSuffix );
+		if( nameLength >= 0 && nameLength < FILENAME_MAX )
+			outFile = fopen( outName, "w" );
+		if( outFile == NULL )
 			{
-			doIndent( level );
-			printASN1object( inFile, &item, level );
+			strcpy( item->ctx.errorString, "Cannot create output file" );
+			item->isError = TRUE;
+			fclose( inFile );
+			return;
 			}
+		item->ctx.output = outFile;
+		}
+	fseek( inFile, batch->offset, SEEK_SET );
+	if( dumpasn1DumpStream( &item->ctx, inFile ) != DUMPASN1_OK )
+		item->isError = TRUE;
+	fclose( inFile );
+	if( outFile != NULL && fclose( outFile ) && !item->isError )
+		{
+		strcpy( item->ctx.errorString, "Cannot write output file" );
+		item->isError = TRUE;
+		}
+	item->ctx.output = NULL;
+	}
 
-		/* If it was an indefinite-length object (no length was ever set) and
-		   we've come back to the top level, exit */
-		if( length == LENGTH_MAGIC )
-			return( 0 );
+/* Decode files until there are none left */
 
-		length -= fPos - lastPos;
-		lastPos = fPos;
-		if( isIndefinite )
+#ifdef USE_THREADS
+
+static THREAD_FUNCTION( batchThread, arg )
+	{
+	BATCH_INFO *batch = ( BATCH_INFO * ) arg;
+
+	while( TRUE )
+		{
+		int index;
+
+		/* Get the next file to decode, waiting if we've got too far ahead
+		   of the output */
+		mutexLock( &batch->mutex );
+		while( batch->nextItem < batch->noItems && \
+			   batch->nextItem >= batch->nextOutput + batch->lookahead )
+			condWait( &batch->stateChanged, &batch->mutex );
+		if( batch->nextItem >= batch->noItems )
 			{
-			if( seenEOC )
-				return( 0 );
+			mutexUnlock( &batch->mutex );
+			break;
 			}
+		index = batch->nextItem++;
+		mutexUnlock( &batch->mutex );
+
+		processItem( batch, &batch->items[ index ] );
+
+		mutexLock( &batch->mutex );
+		batch->items[ index ].isDone = TRUE;
+		condBroadcast( &batch->stateChanged );
+		mutexUnlock( &batch->mutex );
+		}
+
+	THREAD_RETURN;
+	}
+#endif /* USE_THREADS */
+
+/* Get the number of processors to use for decoding */
+
+static int getNoProcessors( void )
+	{
+#if defined( __WIN32__ )
+	SYSTEM_INFO systemInfo;
+
+	GetSystemInfo( &systemInfo );
+	return( ( int ) systemInfo.dwNumberOfProcessors );
+#elif defined( USE_THREADS ) && defined( _SC_NPROCESSORS_ONLN )
+	const long noProcessors = sysconf( _SC_NPROCESSORS_ONLN );
+
+	return( ( noProcessors > 0 ) ? ( int ) noProcessors : 1 );
+#else
+	return( 1 );
+#endif /* OS-specific processor count */
+	}
+
+/* Identify the file that the following output belongs to when we're
+   writing JSON.  For NDJSON this is an object of its own so that the output
+   is still a valid stream of JSON values, for a JSON array it opens an
+   object that holds the file's array of items as "items", so that all of
+   the files together are a single array */
+
+static void printJsonFileName( const char *fileName, const int isArray )
+	{
+	fputs( "{\"file\":\"", stdout );
+	while( *fileName )
+		{
+		const int ch = *( const unsigned char * ) fileName++;
+
+		if( ch == '"' || ch == '\\' )
+			printf( "\\%c", ch );
 		else
-			if( length <= 0 )
+			if( ch < 0x20 )
+				printf( "\\u%04X", ch );
+			else
+				putchar( ch );
+		}
+	fputs( isArray ? "\",\"items\":" : "\"}\n", stdout );
+	}
+
+/* Decode a list of files, returning the program exit code */
+
+static int processBatch( const DUMPASN1_CTX *ctxTemplate,
+						 const FILE_LIST *fileList, const long offset,
+						 const char *outputSuffix, int noThreads,
+						 const int doCheckOnly )
+	{
+	BATCH_INFO batch;
+#ifdef USE_THREADS
+	THREAD_HANDLE threads[ MAX_BATCH_THREADS ];
+#endif /* USE_THREADS */
+	int noWarnings = 0, noErrors = 0, noFailed = 0, noStarted = 0;
+	int noOutput = 0, i;
+
+	memset( &batch, 0, sizeof( BATCH_INFO ) );
+	if( ( batch.items = ( BATCH_ITEM * ) \
+				calloc( fileList->noNames, sizeof( BATCH_ITEM ) ) ) == NULL )
+		{
+		puts( "Out of memory." );
+		return( EXIT_FAILURE );
+		}
+	for( i = 0; i < fileList->noNames; i++ )
+		batch.items[ i ].fileName = fileList->names[ i ];
+	batch.noItems = fileList->noNames;
+	batch.ctxTemplate = ctxTemplate;
+	batch.offset = offset;
+	batch.outputSuffix = outputSuffix;
+	mutexInit( &batch.mutex );
+	condInit( &batch.stateChanged );
+
+	/* Start the decoding threads.  If we're writing the output to stdout
+	   then we have to hold each file's output in memory until it's written,
+	   so we limit how far ahead of the output the decoding can get.  If
+	   we're writing it to individual files then there's nothing held in
+	   memory and no need to limit anything */
+	if( noThreads <= 0 )
+		noThreads = getNoProcessors();
+	noThreads = min( noThreads, min( batch.noItems, MAX_BATCH_THREADS ) );
+	batch.lookahead = ( outputSuffix != NULL ) ? \
+					  batch.noItems : noThreads * BATCH_LOOKAHEAD;
+#ifdef USE_THREADS
+	for( noStarted = 0; noStarted < noThreads && noThreads > 1; noStarted++ )
+		if( !threadCreate( &threads[ noStarted ], batchThread, &batch ) )
+			break;
+#endif /* USE_THREADS */
+
+	/* Write the results for each file in order.  If we couldn't start any
+	   threads then we decode the files ourselves */
+	if( outputSuffix == NULL && ctxTemplate->jsonOutput > 1 )
+		fputs( "[\n", stdout );
+	for( i = 0; i < batch.noItems; i++ )
+		{
+		BATCH_ITEM *item = &batch.items[ i ];
+
+		if( noStarted <= 0 )
+			processItem( &batch, item );
+		else
+			{
+			mutexLock( &batch.mutex );
+			while( !item->isDone )
+				condWait( &batch.stateChanged, &batch.mutex );
+			mutexUnlock( &batch.mutex );
+			}
+
+		/* Write whatever output there is, which may be incomplete if there
+		   was an error, followed by the error message */
+		if( outputSuffix == NULL && \
+			( !item->isError || item->ctx.outLength > 0 ) )
+			{
+			long length;
+			const char *output = dumpasn1GetOutput( &item->ctx, &length );
+
+			if( ctxTemplate->jsonOutput > 1 )
 				{
-				if( length < 0 )
-					return( ( int ) -length );
-				return( 0 );
+				if( noOutput++ > 0 )
+					fputs( ",\n", stdout );
+				printJsonFileName( item->fileName, TRUE );
 				}
 			else
-				if( length == 1 )
-					{
-					const int ch = fgetc( inFile );
+				if( ctxTemplate->jsonOutput )
+					printJsonFileName( item->fileName, FALSE );
+				else
+					printf( ( noOutput++ > 0 ) ? "\n%s:\n" : "%s:\n",
+							item->fileName );
+			fwrite( output, 1, length, stdout );
+			if( ctxTemplate->jsonOutput > 1 )
+				putchar( '}' );
+			}
+		if( item->isError )
+			{
+			fprintf( stderr, "%s: Error: %s.\n", item->fileName,
+					 item->ctx.errorString );
+			noFailed++;
+			}
+		noWarnings += item->ctx.noWarnings;
+		noErrors += item->ctx.noErrors;
+		dumpasn1FreeContext( &item->ctx );
+
+		/* Let the decoding threads move on to the next file */
+		mutexLock( &batch.mutex );
+		batch.nextOutput = i + 1;
+		condBroadcast( &batch.stateChanged );
+		mutexUnlock( &batch.mutex );
+		}
+	if( outputSuffix == NULL && ctxTemplate->jsonOutput > 1 )
+		fputs( ( noOutput > 0 ) ? "\n]\n" : "]\n", stdout );
+#ifdef USE_THREADS
+	for( i = 0; i < noStarted; i++ )
+		threadJoin( threads[ i ] );
+#endif /* USE_THREADS */
+	condDestroy( &batch.stateChanged );
+	mutexDestroy( &batch.mutex );
+	free( batch.items );
+
+	/* Print a summary of warnings/errors across all of the files */
+	if( !ctxTemplate->doPure )
+		{
+		if( !doCheckOnly )
+			fputc( '\n', stderr );
+		fprintf( stderr, "%d file%s, %d warning%s, %d error%s",
+				 batch.noItems, ( batch.noItems != 1 ) ? "s" : "",
+				 noWarnings, ( noWarnings != 1 ) ? "s" : "", noErrors,
+				 ( noErrors != 1 ) ? "s" : "" );
+		if( noFailed > 0 )
+			fprintf( stderr, ", %d file%s couldn't be processed", noFailed,
+					 ( noFailed != 1 ) ? "s" : "" );
+		fputs( ".\n", stderr );
+		}
 
-					/* No object can be one byte long, try and recover.  This
-					   only works sometimes because it can be caused by
-					   spurious data in an OCTET STRING hole or an incorrect
-					   length encoding.  The following workaround tries to
-					   recover from spurious data by skipping the byte if
-					   it's zero or a non-basic-ASN.1 tag, but keeping it if
-					   it could be valid ASN.1 */
-					if( ch && ch <= 0x31 )
-						ungetc( ch, inFile );
-					else
-						{
-						fPos++;
-						return( 1 );
-						}
-					}
+	if( noErrors )
+		return( noErrors );
+	return( ( noFailed ) ? EXIT_FAILURE : EXIT_SUCCESS );
+	}
+
+/****************************************************************************
+*																			*
+*								Main Program								*
+*																			*
+****************************************************************************/
+
+/* Extract the object at the current position in the input to a file */
+
+static int extractItem( DUMPASN1_CTX *ctx, FILE *inFile, FILE *outFile )
+	{
+	ASN1_INPUT *input = &ctx->input;
+	ASN1_ITEM item;
+	long length;
+	int i, status;
+
+	if( !inOpen( input, inFile ) )
+		{
+		puts( "Out of memory." );
+		return( FALSE );
 		}
+
+	/* Make sure there's something there, and that it has a definite
+	   length */
+	status = getItem( ctx, &item );
 	if( status == -1 )
+		puts( "Non-ASN.1 data encountered." );
+	if( status == 0 )
+		puts( "Nothing to read." );
+	if( status > 0 && item.indefinite )
 		{
-		fprintf( stderr, "\nError: Invalid data encountered at position "
-				 "%d.\n", fPos );
-		exit( EXIT_FAILURE );
+		puts( "Cannot process indefinite-length item." );
+		status = 0;
+		}
+	if( status <= 0 )
+		{
+		inClose( input );
+		return( FALSE );
 		}
 
-	/* If we see an EOF and there's supposed to be more data present,
-	   complain */
-	if( length && length != LENGTH_MAGIC )
+	/* Copy the item across, first the header and then the data */
+	for( i = 0; i < item.headerSize; i++ )
+		putc( item.header[ i ], outFile );
+	for( length = 0; length < item.length && !inEof( input ); length++ )
+		putc( inGetc( input ), outFile );
+	inClose( input );
+
+	return( TRUE );
+	}
+
+/* Write an index of a file to <file>.tlv */
+
+static int writeFileIndex( DUMPASN1_CTX *ctx, const char *fileName,
+						   const long offset )
+	{
+	DUMPASN1_INDEX index;
+	FILE *inFile;
+	int status;
+
+	if( ( inFile = fopen( fileName, "rb" ) ) == NULL )
 		{
-		fprintf( output, "Error: Inconsistent object length, %ld byte%s "
-				 "difference.\n", length, ( length > 1 ) ? "s" : "" );
-		noErrors++;
+		perror( fileName );
+		return( FALSE );
 		}
-	return( 0 );
+	fseek( inFile, offset, SEEK_SET );
+	status = dumpasn1IndexStream( ctx, &index, inFile );
+	fclose( inFile );
+	if( status != DUMPASN1_OK )
+		{
+		fprintf( stderr, "%s: %s.\n", fileName, ctx->errorString );
+		return( FALSE );
+		}
+	status = dumpasn1SaveIndex( ctx, &index, fileName );
+	dumpasn1FreeIndex( &index );
+	if( status != DUMPASN1_OK )
+		{
+		fprintf( stderr, "%s: %s.\n", fileName, ctx->errorString );
+		return( FALSE );
+		}
+
+	return( TRUE );
+	}
+
+/* Find the position of the item at the given path in a file, using the
+   saved index if there's an up-to-date one for the same part of the file
+   and indexing the file now if not */
+
+static int findItemOffset( DUMPASN1_CTX *ctx, FILE *inFile,
+						   const char *fileName, const char *path,
+						   long *offset )
+	{
+	DUMPASN1_INDEX index;
+	int entryNo;
+
+	if( !dumpasn1LoadIndex( &index, fileName ) || \
+		index.baseOffset != *offset )
+		{
+		dumpasn1FreeIndex( &index );
+		fseek( inFile, *offset, SEEK_SET );
+		if( dumpasn1IndexStream( ctx, &index, inFile ) != DUMPASN1_OK )
+			{
+			fprintf( stderr, "\nError: %s.\n", ctx->errorString );
+			return( FALSE );
+			}
+		}
+	if( ( entryNo = dumpasn1FindItem( &index, path ) ) < 0 )
+		{
+		printf( "No item at '%s'.\n", path );
+		dumpasn1FreeIndex( &index );
+		return( FALSE );
+		}
+	*offset = index.baseOffset + index.entries[ entryNo ].offset;
+	dumpasn1FreeIndex( &index );
+
+	return( TRUE );
 	}
 
 /* Show usage and exit */
 
-void usageExit( void )
+static void usageExit( void )
 	{
 	puts( "DumpASN1 - ASN.1 object dump/syntax check program." );
 	puts( "Copyright Peter Gutmann 1997 - 2002.  Last updated " UPDATE_STRING "." );
 	puts( "" );
-	puts( "Usage: dumpasn1 [-acdefhlprstuxz] <file>" );
-	puts( "       - = Take input from stdin (some options may not work properly)" );
+	puts( "Usage: dumpasn1 [-abcdefhijklnopqrstuvwxz] <file(s)/directory>" );
+	puts( "       - = Take input from stdin, which may contain a series of objects" );
 	puts( "       -<number> = Start <number> bytes into the file" );
 	puts( "       -- = End of arg list" );
 	puts( "       -a = Print all data in long data blocks, not just the first 128 bytes" );
+	puts( "       -b[<file>] = Compile config file (default = global config file) into a" );
+	puts( "            binary index for faster startup, and exit" );
 	puts( "       -c<file> = Read Object Identifier info from alternate config file" );
 	puts( "            (values will override equivalents in global config file)" );
 	puts( "       -d = Print dots to show column alignment" );
@@ -2130,16 +5492,30 @@ void usageExit( void )
 	puts( "       -h = Hex dump object header (tag+length) before the decoded output" );
 	puts( "       -hh = Same as -h but display more of the object as hex data" );
 	puts( "       -i = Use shallow indenting, for deeply-nested objects" );
+	puts( "       -j<number> = Decode up to <number> files, or the elements of large" );
+	puts( "            SEQUENCEs/SETs in a single file, in parallel (default = number" );
+	puts( "            of processors)" );
+	puts( "       -k = Write an index of each file to <file>.tlv for use with -q, and" );
+	puts( "            exit" );
 	puts( "       -l = Long format, display extra info about Object Identifiers" );
+	puts( "       -n = Output a JSON object for each item, one per line (NDJSON)" );
+	puts( "       -nn = Same as -n but output a single JSON array" );
 	puts( "       -o = Don't check validity of character strings hidden in octet strings" );
 	puts( "       -p = Pure ASN.1 output without encoding information" );
+	puts( "       -q<path> = Dump only the item at <path>, given as child numbers as in" );
+	puts( "            the JSON output (0.1.3) or as types (SEQUENCE/[2]/OCTET STRING)" );
 	puts( "       -r = Print bits in BIT STRING as encoded in reverse order" );
 	puts( "       -s = Syntax check only, don't dump ASN.1 structures" );
 	puts( "       -t = Display text values next to hex dump of data" );
 	puts( "       -u = Don't format UTCTime/GeneralizedTime string data" );
+	puts( "       -v = Write raw data in JSON output as base64 rather than hex" );
+	puts( "       -w[<ext>] = Write each file's output to <file><ext> (default = .txt)" );
+	puts( "            rather than stdout" );
 	puts( "       -x = Display size and offset in hex not decimal" );
 	puts( "       -z = Allow zero-length items" );
 	puts( "" );
+	puts( "If more than one file or a directory is given, each file is dumped in turn" );
+	puts( "followed by a summary for all of the files." );
 	puts( "Warnings generated by deprecated OIDs require the use of '-l' to be displayed." );
 	puts( "Program return code is the number of errors found or EXIT_SUCCESS." );
 	exit( EXIT_FAILURE );
@@ -2147,14 +5523,19 @@ void usageExit( void )
 
 int main( int argc, char *argv[] )
 	{
+	DUMPASN1_CONFIG config;
+	DUMPASN1_CTX ctx;
+	FILE_LIST fileList;
 	FILE *inFile, *outFile = NULL;
+	const char *outputSuffix = NULL, *itemPath = NULL;
 #ifdef __OS390__
 	char pathPtr[ FILENAME_MAX ];
 #else
 	char *pathPtr = argv[ 0 ];
 #endif /* __OS390__ */
 	long offset = 0;
-	int moreArgs = TRUE, doCheckOnly = FALSE;
+	int moreArgs = TRUE, doCheckOnly = FALSE, useStdin = FALSE;
+	int doIndex = FALSE, noThreads = -1, status, i;
 
 #ifdef __OS390__
 	memset( pathPtr, '\0', sizeof( pathPtr ) );
@@ -2168,7 +5549,9 @@ int main( int argc, char *argv[] )
 	/* Display usage if no args given */
 	if( argc < 1 )
 		usageExit();
-	output = stdout;	/* Needs to be assigned at runtime */
+	dumpasn1InitConfig( &config );
+	dumpasn1InitContext( &ctx, &config );
+	ctx.output = stdout;
 
 	/* Check for arguments */
 	while( argc && *argv[ 0 ] == '-' && moreArgs )
@@ -2191,22 +5574,46 @@ int main( int argc, char *argv[] )
 					break;
 
 				case 'A':
-					printAllData = TRUE;
+					ctx.printAllData = TRUE;
 					break;
 
+				case 'B':
+					{
+					DUMPASN1_CONFIG compiledConfig;
+					const char *configPath = argPtr + 1;
+					char pathBuffer[ FILENAME_MAX ];
+
+					if( !*configPath )
+						{
+						findGlobalConfig( pathBuffer, pathPtr );
+						configPath = pathBuffer;
+						}
+					dumpasn1InitConfig( &compiledConfig );
+					status = dumpasn1CompileConfig( &compiledConfig,
+													configPath );
+					if( !status )
+						printf( "%s.\n", compiledConfig.errorString );
+					dumpasn1FreeConfig( &compiledConfig );
+					exit( status ? EXIT_SUCCESS : EXIT_FAILURE );
+					}
+
 				case 'C':
-					if( !readConfig( argPtr + 1, FALSE ) )
+					if( !dumpasn1ReadConfig( &config, argPtr + 1 ) )
+						{
+						fprintf( ( ctx.jsonOutput ) ? stderr : stdout,
+								 "%s.\n", config.errorString );
 						exit( EXIT_FAILURE );
+						}
 					while( argPtr[ 1 ] )
 						argPtr++;	/* Skip rest of arg */
 					break;
 
 				case 'D':
-					printDots = TRUE;
+					ctx.printDots = TRUE;
 					break;
 
 				case 'E':
-					checkEncaps = FALSE;
+					ctx.checkEncaps = FALSE;
 					break;
 
 				case 'F':
@@ -2220,27 +5627,48 @@ int main( int argc, char *argv[] )
 					break;
 
 				case 'I':
-					shallowIndent = TRUE;
+					ctx.shallowIndent = TRUE;
+					break;
+
+				case 'J':
+					noThreads = atoi( argPtr + 1 );
+					while( argPtr[ 1 ] )
+						argPtr++;	/* Skip rest of arg */
+					break;
+
+				case 'K':
+					doIndex = TRUE;
 					break;
 
 				case 'L':
-					extraOIDinfo = TRUE;
+					ctx.extraOIDinfo = TRUE;
+					break;
+
+				case 'N':
+					if( ctx.jsonOutput < 2 )
+						ctx.jsonOutput++;
 					break;
 
 				case 'H':
-					doDumpHeader++;
+					ctx.doDumpHeader++;
 					break;
 
 				case 'O':
-					checkCharset = TRUE;
+					ctx.checkCharset = TRUE;
 					break;
 
 				case 'P':
-					doPure = TRUE;
+					ctx.doPure = TRUE;
+					break;
+
+				case 'Q':
+					itemPath = argPtr + 1;
+					while( argPtr[ 1 ] )
+						argPtr++;	/* Skip rest of arg */
 					break;
 
 				case 'R':
-					reverseBitString = !reverseBitString;
+					ctx.reverseBitString = !ctx.reverseBitString;
 					break;
 
 				case 'S':
@@ -2263,19 +5691,29 @@ int main( int argc, char *argv[] )
 					break;
 
 				case 'T':
-					dumpText = TRUE;
+					ctx.dumpText = TRUE;
 					break;
 
 				case 'U':
-					rawTimeString = TRUE;
+					ctx.rawTimeString = TRUE;
+					break;
+
+				case 'V':
+					ctx.jsonBase64 = TRUE;
+					break;
+
+				case 'W':
+					outputSuffix = ( argPtr[ 1 ] ) ? argPtr + 1 : ".txt";
+					while( argPtr[ 1 ] )
+						argPtr++;	/* Skip rest of arg */
 					break;
 
 				case 'X':
-					doHexValues = TRUE;
+					ctx.doHexValues = TRUE;
 					break;
 
 				case 'Z':
-					zeroLengthAllowed = TRUE;
+					ctx.zeroLengthAllowed = TRUE;
 					break;
 
 				default:
@@ -2289,23 +5727,98 @@ int main( int argc, char *argv[] )
 		}
 
 	/* We can't use options that perform an fseek() if reading from stdin */
-	if( useStdin && ( doDumpHeader || outFile != NULL ) )
+	if( useStdin && ( outFile != NULL || doIndex || itemPath != NULL ) )
 		{
-		puts( "Can't use -f or -h when taking input from stdin" );
+		puts( "Can't use -f, -k or -q when taking input from stdin" );
 		exit( EXIT_FAILURE );
 		}
 
-	/* Check args and read the config file.  We don't bother weeding out
-	   dups during the read because (a) the linear search would make the
-	   process n^2, (b) during the dump process the search will terminate on
-	   the first match so dups aren't that serious, and (c) there should be
-	   very few dups present */
-	if( argc != 1 && !useStdin )
+	/* If we're indexing files, write the index for each one and exit.  This
+	   doesn't need the config file since only the tags and lengths are
+	   read */
+	if( doIndex )
+		{
+		if( argc < 1 )
+			usageExit();
+		memset( &fileList, 0, sizeof( FILE_LIST ) );
+		for( i = 0; i < argc; i++ )
+			{
+			status = isDirectory( argv[ i ] ) ? \
+					 addDirectory( &fileList, argv[ i ] ) : \
+					 addFile( &fileList, NULL, argv[ i ] );
+			if( !status )
+				exit( EXIT_FAILURE );
+			}
+		status = EXIT_SUCCESS;
+		for( i = 0; i < fileList.noNames; i++ )
+			{
+			if( !writeFileIndex( &ctx, fileList.names[ i ], offset ) )
+				status = EXIT_FAILURE;
+			}
+		freeFileList( &fileList );
+		return( status );
+		}
+
+	/* Check args and read the config file.  Dups are weeded out as the OIDs
+	   are added to the hash table, with any OIDs from a config file given
+	   with -c taking precedence over the ones in the global config file */
+	if( argc < 1 && !useStdin )
 		usageExit();
-	if( !readGlobalConfig( pathPtr ) )
+	if( !dumpasn1ReadGlobalConfig( &config, pathPtr ) )
+		{
+		fprintf( ( ctx.jsonOutput ) ? stderr : stdout, "%s.\n",
+				 config.errorString );
 		exit( EXIT_FAILURE );
+		}
+	if( config.noGlobalConfig )
+		{
+		/* Keep the warning out of the way of anything parsing JSON output */
+		FILE *msgStream = ( ctx.jsonOutput ) ? stderr : stdout;
+
+		fputs( "Cannot open config file 'dumpasn1.cfg', which should be in the same\n"
+			   "directory as the dumpasn1 program, a standard system directory, or\n"
+			   "in a location pointed to by the DUMPASN1_PATH environment variable.\n"
+			   "Operation will continue without the ability to display Object \n"
+			   "Identifier information.\n\n"
+			   "If the config file is located elsewhere, you can set the environment\n"
+			   "variable DUMPASN1_PATH to the path to the file.\n", msgStream );
+		}
+
+	/* If we've been given more than one file or a directory, or we're
+	   writing the output to individual files, dump them all in batch mode */
+	if( !useStdin && \
+		( argc > 1 || outputSuffix != NULL || isDirectory( argv[ 0 ] ) ) )
+		{
+		if( outFile != NULL || itemPath != NULL )
+			{
+			puts( "Can't use -f or -q with more than one input file" );
+			exit( EXIT_FAILURE );
+			}
+		memset( &fileList, 0, sizeof( FILE_LIST ) );
+		for( i = 0; i < argc; i++ )
+			{
+			status = isDirectory( argv[ i ] ) ? \
+					 addDirectory( &fileList, argv[ i ] ) : \
+					 addFile( &fileList, NULL, argv[ i ] );
+			if( !status )
+				exit( EXIT_FAILURE );
+			}
+		if( fileList.noNames <= 0 )
+			{
+			puts( "No files to process." );
+			exit( EXIT_FAILURE );
+			}
+		status = processBatch( &ctx, &fileList, offset, outputSuffix,
+							   noThreads, doCheckOnly );
+		freeFileList( &fileList );
+		dumpasn1FreeConfig( &config );
+		return( status );
+		}
 
-	/* Dump the given file */
+	/* Dump the given file.  If we've been asked to use threads then we use
+	   them to decode the elements of large objects */
+	if( noThreads >= 0 )
+		ctx.noThreads = ( noThreads > 0 ) ? noThreads : getNoProcessors();
 	if( useStdin )
 		inFile = stdin;
 	else
@@ -2314,6 +5827,9 @@ int main( int argc, char *argv[] )
 			perror( argv[ 0 ] );
 			exit( EXIT_FAILURE );
 			}
+	if( itemPath != NULL && \
+		!findItemOffset( &ctx, inFile, argv[ 0 ], itemPath, &offset ) )
+		exit( EXIT_FAILURE );
 	if( useStdin )
 		{
 		while( offset-- )
@@ -2323,50 +5839,31 @@ int main( int argc, char *argv[] )
 		fseek( inFile, offset, SEEK_SET );
 	if( outFile != NULL )
 		{
-		ASN1_ITEM item;
-		long length;
-		int i, status;
-
-		/* Make sure there's something there, and that it has a definite
-		   length */
-		status = getItem( inFile, &item );
-		if( status == -1 )
-			{
-			puts( "Non-ASN.1 data encountered." );
-			exit( EXIT_FAILURE );
-			}
-		if( status == 0 )
-			{
-			puts( "Nothing to read." );
-			exit( EXIT_FAILURE );
-			}
-		if( item.indefinite )
-			{
-			puts( "Cannot process indefinite-length item." );
+		if( !extractItem( &ctx, inFile, outFile ) )
 			exit( EXIT_FAILURE );
-			}
-
-		/* Copy the item across, first the header and then the data */
-		for( i = 0; i < item.headerSize; i++ )
-			putc( item.header[ i ], outFile );
-		for( length = 0; length < item.length && !feof( inFile ); length++ )
-			putc( getc( inFile ), outFile );
 		fclose( outFile );
 
 		fseek( inFile, offset, SEEK_SET );
 		}
-	printAsn1( inFile, 0, LENGTH_MAGIC, 0 );
+	status = dumpasn1DumpStream( &ctx, inFile );
 	fclose( inFile );
+	if( status != DUMPASN1_OK )
+		{
+		fprintf( stderr, "\nError: %s.\n", ctx.errorString );
+		exit( EXIT_FAILURE );
+		}
 
 	/* Print a summary of warnings/errors if it's required or appropriate */
-	if( !doPure )
+	if( !ctx.doPure )
 		{
 		if( !doCheckOnly )
 			fputc( '\n', stderr );
-		fprintf( stderr, "%d warning%s, %d error%s.\n", noWarnings,
-				( noWarnings != 1 ) ? "s" : "", noErrors,
-				( noErrors != 1 ) ? "s" : "" );
+		fprintf( stderr, "%d warning%s, %d error%s.\n", ctx.noWarnings,
+				( ctx.noWarnings != 1 ) ? "s" : "", ctx.noErrors,
+				( ctx.noErrors != 1 ) ? "s" : "" );
 		}
 
-	return( ( noErrors ) ? noErrors : EXIT_SUCCESS );
+	return( ( ctx.noErrors ) ? ctx.noErrors : EXIT_SUCCESS );
 	}
+
+#endif /* !DUMPASN1_LIBRARY */
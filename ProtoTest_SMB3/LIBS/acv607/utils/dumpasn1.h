@@ -0,0 +1,232 @@
+/* ASN.1 object dumping code, library interface.  See dumpasn1.c for the
+   copyright and acknowledgements.
+
+   Building dumpasn1.c with DUMPASN1_LIBRARY defined omits main() and leaves
+   a library that can be used to decode ASN.1 data in-process.  All of the
+   decoding state lives in a DUMPASN1_CTX, so any number of objects can be
+   dumped concurrently on different threads as long as each thread uses its
+   own context.  The OID information read from the config file is read-only
+   once it's been loaded and can be shared by any number of contexts.
+
+   Typical use is:
+
+	DUMPASN1_CONFIG config;
+	DUMPASN1_CTX ctx;
+
+	dumpasn1InitConfig( &config );
+	dumpasn1ReadConfig( &config, "dumpasn1.cfg" );
+	...
+	dumpasn1InitContext( &ctx, &config );
+	status = dumpasn1DumpBuffer( &ctx, data, dataLength );
+	text = dumpasn1GetOutput( &ctx, &textLength );
+	...
+	dumpasn1FreeContext( &ctx );
+	...
+	dumpasn1FreeConfig( &config ); */
+
+#ifndef _DUMPASN1_DEFINED
+
+#define _DUMPASN1_DEFINED
+
+#include <stdio.h>
+
+/* Status codes returned by the dump functions.  Problems with the ASN.1
+   data itself are recorded in the context's error and warning counts, the
+   following are only returned when the data is so broken that decoding
+   can't continue, or when a file can't be read or written */
+
+#define DUMPASN1_OK					0	/* No fatal problems */
+#define DUMPASN1_ERROR_MEMORY		-1	/* Out of memory */
+#define DUMPASN1_ERROR_BADLENGTH	-2	/* Object has bad length field */
+#define DUMPASN1_ERROR_BADOID		-3	/* OID is too large to handle */
+#define DUMPASN1_ERROR_BADDATA		-4	/* Invalid data encountered */
+#define DUMPASN1_ERROR_FILE			-5	/* Couldn't read or write a file */
+
+/* Information on an ASN.1 Object Identifier */
+
+#define MAX_OID_SIZE	32
+
+typedef struct tagOIDINFO {
+	struct tagOIDINFO *next;		/* Next item in list */
+	char oid[ MAX_OID_SIZE ], *comment, *description;
+	int oidLength;					/* Name, rank, serial number */
+	int warn;						/* Whether to warn if OID encountered */
+	} OIDINFO;
+
+/* The input data.  Seekable input is memory-mapped (or read into memory in
+   one go if it can't be mapped) and parsed directly from memory, so
+   lookahead and backtracking are just pointer arithmetic.  Non-seekable
+   input like pipes is read via a fixed-size buffer that always retains a
+   little of the data before the current position, so we can back up over
+   anything we've looked ahead at but can otherwise only move forwards */
+
+typedef struct {
+	const unsigned char *data;	/* Input data or current buffer contents */
+	long dataStart;				/* Stream position of data[ 0 ] */
+	long dataLen;				/* Amount of data present */
+	long pos;					/* Current position in data */
+	int eof;					/* Whether we tried to read past the end */
+	int pushback;				/* Char pushed back at EOF, or EOF if none */
+	FILE *stream;				/* Stream for buffered input, NULL if in memory */
+	unsigned char *buffer;		/* Buffer for buffered/in-memory input */
+	int isMapped;				/* Whether data is a mapped view of the file */
+	void *hMapping;				/* Win32 handle for the file mapping */
+	} ASN1_INPUT;
+
+/* The OID information read from the config file(s).  The list owns the
+   entries in the order that they were read, the hash table is used to look
+   them up.  If a config file has an up-to-date compiled index (see
+   dumpasn1CompileConfig()) then the index is mapped into memory and used
+   instead of the text file */
+
+typedef struct {
+	OIDINFO *oidList;				/* List of OIDs */
+	OIDINFO **oidTable;				/* Hash table of OIDs */
+	int oidTableSize;				/* Size of hash table, a power of two */
+	int noOIDs;						/* Number of OIDs in hash table */
+	ASN1_INPUT index;				/* Compiled OID index, if present */
+	int noGlobalConfig;				/* Global config file wasn't found */
+	char errorString[ 128 ];		/* Why reading the config failed */
+	} DUMPASN1_CONFIG;
+
+/* The decoding context.  The options are set to the defaults by
+   dumpasn1InitContext() and can be changed before calling one of the dump
+   functions.  If output is NULL the dump text is collected in memory and
+   can be read with dumpasn1GetOutput().  If noThreads is more than one,
+   the elements of large definite-length objects in memory are decoded on
+   up to that many threads, with the same output as when they're decoded in
+   sequence (Unix builds then need -lpthread) */
+
+typedef struct {
+	/* Config options */
+	int printDots;				/* Whether to print dots to align columns */
+	int doPure;					/* Print data without LHS info column */
+	int doDumpHeader;			/* Dump tag+len in hex (level = 0, 1, 2) */
+	int extraOIDinfo;			/* Print extra information about OIDs */
+	int doHexValues;			/* Display size, offset in hex not dec.*/
+	int useStdin;				/* Input can't seek back, don't look ahead */
+	int zeroLengthAllowed;		/* Zero-length items allowed */
+	int dumpText;				/* Dump text alongside hex data */
+	int printAllData;			/* Whether to print all data in long blocks */
+	int checkEncaps;			/* Print encaps.data in BIT/OCTET STRINGs */
+	int checkCharset;			/* Check val.of char strs.hidden in OCTET STRs */
+	int reverseBitString;		/* Print BIT STRINGs in natural order */
+	int rawTimeString;			/* Print raw time strings */
+	int shallowIndent;			/* Perform shallow indenting */
+	int jsonOutput;				/* Output JSON (1 = NDJSON, 2 = JSON array) */
+	int jsonBase64;				/* Encode JSON raw data as base64 not hex */
+	int noThreads;				/* Threads for decoding large objects */
+
+	/* The OID information to use */
+	const DUMPASN1_CONFIG *config;
+
+	/* The output stream, or NULL to write to the memory buffer */
+	FILE *output;
+	char *outBuffer;			/* Memory buffer for output */
+	long outLength, outSize;	/* Amount of data in/size of buffer */
+
+	/* Error and warning information */
+	int noErrors;				/* Number of errors found */
+	int noWarnings;				/* Number of warnings */
+	int status;					/* DUMPASN1_OK or a fatal error code */
+	char errorString[ 128 ];	/* Description of fatal error */
+
+	/* The input data and position in it */
+	ASN1_INPUT input;
+	int fPos;					/* Absolute position in data */
+	} DUMPASN1_CTX;
+
+/* Read the OID information from a config file.  dumpasn1ReadGlobalConfig()
+   searches the usual locations for dumpasn1.cfg, using the program path
+   (typically argv[ 0 ]) as the first location to try.  If it isn't found
+   anywhere then this isn't an error, but noGlobalConfig is set in the
+   config so that the caller can warn about the missing OID names.  These
+   return FALSE if the config file can't be read, with errorString in the
+   config saying why.  Nothing is written to stdout or stderr */
+
+void dumpasn1InitConfig( DUMPASN1_CONFIG *config );
+int dumpasn1ReadConfig( DUMPASN1_CONFIG *config, const char *path );
+int dumpasn1ReadGlobalConfig( DUMPASN1_CONFIG *config,
+							  const char *programPath );
+void dumpasn1FreeConfig( DUMPASN1_CONFIG *config );
+
+/* Compile the text config file at the given path into a binary index that
+   dumpasn1ReadConfig() will use in place of the text file for as long as
+   the text file is unchanged.  The index is written alongside the config
+   file with a .idx extension.  The text file is read into the config, which
+   has to be newly initialised and should be freed afterwards, and any error
+   is reported in its errorString in the same way as for reading a config */
+
+int dumpasn1CompileConfig( DUMPASN1_CONFIG *config, const char *path );
+
+/* Set up and clean up a decoding context */
+
+void dumpasn1InitContext( DUMPASN1_CTX *ctx, const DUMPASN1_CONFIG *config );
+void dumpasn1FreeContext( DUMPASN1_CTX *ctx );
+
+/* Dump ASN.1 data from a memory buffer or from an open stream, starting at
+   its current position.  These return DUMPASN1_OK or an error code, with
+   the error and warning counts and errorString in the context giving more
+   detail */
+
+int dumpasn1DumpBuffer( DUMPASN1_CTX *ctx, const void *data,
+						const long length );
+int dumpasn1DumpStream( DUMPASN1_CTX *ctx, FILE *inFile );
+
+/* Get the dump text collected in memory when no output stream is set */
+
+const char *dumpasn1GetOutput( const DUMPASN1_CTX *ctx, long *length );
+
+/* A random-access index of the items in ASN.1 data, built in a single pass
+   over the tags and lengths.  The entries are in the order in which the
+   items appear in the data, so an item's children directly follow it and
+   its next sibling follows its last descendant.  Objects encapsulated in
+   OCTET STRINGs and BIT STRINGs are indexed as children of the string */
+
+typedef struct {
+	long offset;				/* Offset of item from start of data */
+	long length;				/* Content length, incl.EOC if indefinite */
+	int parent;					/* Entry for parent, -1 if top-level item */
+	int noDescendants;			/* Number of items nested inside this one */
+	int headerSize;				/* Size of tag+length */
+	int depth;					/* Nesting depth */
+	int id, tag;				/* Tag class + primitive/constructed, tag */
+	int indefinite;				/* Item has indefinite length */
+	} DUMPASN1_TLV;
+
+typedef struct {
+	const DUMPASN1_TLV *entries;	/* Index entries */
+	int noEntries;					/* Number of entries */
+	long baseOffset;				/* Position in file that index starts at */
+	DUMPASN1_TLV *buffer;			/* Entries if built in memory */
+	int bufferSize;					/* Size of buffer in entries */
+	ASN1_INPUT file;				/* Entries if loaded from saved index */
+	} DUMPASN1_INDEX;
+
+/* Build an index of ASN.1 data from a memory buffer or from an open stream,
+   starting at its current position.  These return DUMPASN1_OK or an error
+   code in the same way as the dump functions.  The index can be saved
+   alongside the file that it was built from as <file>.tlv, with any
+   problem writing it returned as DUMPASN1_ERROR_FILE and described in the
+   context's errorString, and dumpasn1LoadIndex() will load it again for as
+   long as the file is unchanged.  The index should be freed with dumpasn1FreeIndex() once it's
+   no longer needed */
+
+int dumpasn1IndexBuffer( DUMPASN1_CTX *ctx, DUMPASN1_INDEX *index,
+						 const void *data, const long length );
+int dumpasn1IndexStream( DUMPASN1_CTX *ctx, DUMPASN1_INDEX *index,
+						 FILE *inFile );
+int dumpasn1SaveIndex( DUMPASN1_CTX *ctx, const DUMPASN1_INDEX *index,
+					   const char *fileName );
+int dumpasn1LoadIndex( DUMPASN1_INDEX *index, const char *fileName );
+void dumpasn1FreeIndex( DUMPASN1_INDEX *index );
+
+/* Find an item in the index, returning its entry number or -1 if there's no
+   such item.  The path is either a list of child numbers separated by dots
+   as in the JSON output, "0.1.3", or a list of elements separated by
+   slashes, "SEQUENCE/[2]/OCTET STRING", where each element is a child
+   number or the type of the first child with that type */
+
+int dumpasn1FindItem( const DUMPASN1_INDEX *index, const char *path );
+
+#endif /* _DUMPASN1_DEFINED */